@@ -3,3 +3,226 @@
 //
 
 #include "SnapShotImageProvider.h"
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <vector>
+#include "../GPUPipeline/cpu/CpuImageOps.h"
+#include "../utils/TaskScheduler.h"
+#include "../utils/WindowRegistry.h"
+
+// output rows per band of a parallel downscale
+static constexpr int kDownscaleBandRows = 32;
+// refreshes queued at once. enqueue blocks on a full pool and refreshes are queued under m_mutex, which the
+// workers need to finish, so stay well below the pool size.
+static constexpr size_t kMaxQueuedRefreshes = 64;
+
+SnapShotImageProvider::SnapShotImageProvider() : QQuickImageProvider(QQuickImageProvider::Image) {
+    unsigned int workerCount = std::clamp(std::thread::hardware_concurrency(), 2u, 8u);
+    std::vector<std::string> workerNames;
+    for (unsigned int i = 0; i < workerCount; i++) {
+        workerNames.push_back("thumbnail" + std::to_string(i));
+    }
+    m_workers = std::make_unique<TaskScheduler>(workerCount, workerNames, 128);
+
+    // resized windows look different, closed ones are not asked for again
+    m_registrySubscription = WindowRegistry::getInstance().subscribe([this](const WindowListDiff& diff) {
+        for (int windowId : diff.resized) {
+            invalidate(windowId);
+        }
+        for (int windowId : diff.removed) {
+            invalidate(windowId);
+        }
+    });
+}
+
+SnapShotImageProvider::~SnapShotImageProvider() {
+    WindowRegistry::getInstance().unsubscribe(m_registrySubscription);
+    m_workers.reset();
+}
+
+void SnapShotImageProvider::setThumbnailRenderer(ThumbnailRenderer renderer) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_renderer = std::move(renderer);
+}
+
+void SnapShotImageProvider::invalidate(int windowId) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_generations[windowId]++;
+}
+
+void SnapShotImageProvider::invalidateAll() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_baseGeneration++;
+}
+
+uint64_t SnapShotImageProvider::generationOf(int windowId) {
+    auto found = m_generations.find(windowId);
+    return m_baseGeneration + (found != m_generations.end() ? found->second : 0);
+}
+
+QSize SnapShotImageProvider::thumbnailSizeFor(const QSize& windowSize, const QSize& requestedSize) {
+    if (windowSize.isEmpty()) {
+        return {};
+    }
+    double scale;
+    if (requestedSize.width() > 0 && requestedSize.height() > 0) {
+        scale = std::max((double)requestedSize.width() / windowSize.width(),
+                         (double)requestedSize.height() / windowSize.height());
+    } else {
+        scale = (double)kDefaultThumbnailSize / std::max(windowSize.width(), windowSize.height());
+    }
+    scale = std::min(scale, 1.0);
+    return {std::max(1, (int)(windowSize.width() * scale + 0.5)), std::max(1, (int)(windowSize.height() * scale + 0.5))};
+}
+
+QImage SnapShotImageProvider::render(int windowId, const QSize& requestedSize, bool parallel) {
+    ThumbnailRenderer renderer;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        renderer = m_renderer;
+    }
+    if (!renderer) {
+        return {};
+    }
+    // a first request waits for its thumbnail, so spread it over the workers. refreshes already run on one.
+    ThumbnailDownscaler downscale = [this, parallel](const CpuImageView& input, const CpuImageView& output) {
+        if (!parallel || output.height <= kDownscaleBandRows) {
+            downscaleImageArea(input, output);
+            return;
+        }
+        std::vector<std::future<void>> bands;
+        for (int rowBegin = 0; rowBegin < output.height; rowBegin += kDownscaleBandRows) {
+            bands.push_back(m_workers->enqueueTask([input, output, rowBegin](const std::string& threadName) {
+                downscaleImageArea(input, output, rowBegin, rowBegin + kDownscaleBandRows);
+            }));
+        }
+        for (auto& band : bands) {
+            if (band.valid()) {
+                band.get();
+            }
+        }
+    };
+    return renderer(windowId, requestedSize, downscale);
+}
+
+void SnapShotImageProvider::insert(const ThumbnailKey& key, const QImage& image) {
+    auto existing = m_thumbnails.find(key);
+    if (existing != m_thumbnails.end()) {
+        m_cacheBytes -= (size_t)existing->second->image.sizeInBytes();
+        m_lru.erase(existing->second);
+        m_thumbnails.erase(existing);
+    }
+    m_lru.push_front({key, image, std::chrono::steady_clock::now()});
+    m_thumbnails[key] = m_lru.begin();
+    m_cacheBytes += (size_t)image.sizeInBytes();
+
+    ThumbnailKey sizeKey = key;
+    sizeKey.generation = 0;
+    auto& newestGeneration = m_newestGenerations[sizeKey];
+    newestGeneration = std::max(newestGeneration, key.generation);
+
+    // least recently used out, but never the one just added
+    while (m_cacheBytes > kMaxCacheBytes && m_lru.size() > 1) {
+        auto& oldest = m_lru.back();
+        sizeKey = oldest.key;
+        sizeKey.generation = 0;
+        auto newest = m_newestGenerations.find(sizeKey);
+        if (newest != m_newestGenerations.end() && newest->second == oldest.key.generation) {
+            m_newestGenerations.erase(newest);
+        }
+        m_cacheBytes -= (size_t)oldest.image.sizeInBytes();
+        m_thumbnails.erase(oldest.key);
+        m_lru.pop_back();
+    }
+}
+
+void SnapShotImageProvider::scheduleRefresh(const ThumbnailKey& key, const QSize& requestedSize) {
+    if (m_refreshing.size() >= kMaxQueuedRefreshes || !m_refreshing.insert(key).second) {
+        return;
+    }
+    bool queued = m_workers->enqueueDetachedTask([this, key, requestedSize](const std::string& threadName) {
+        auto image = render(key.windowId, requestedSize, false);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_refreshing.erase(key);
+        // a newer generation may have come up while this one rendered, it gets its own refresh
+        if (!image.isNull() && key.generation == generationOf(key.windowId)) {
+            insert(key, image);
+        }
+    });
+    if (!queued) {
+        m_refreshing.erase(key);
+    }
+}
+
+void SnapShotImageProvider::prefetch(int windowId) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_lastRequestedSize) {
+        return;
+    }
+    ThumbnailKey key{windowId, m_lastRequestedSize->width(), m_lastRequestedSize->height(), generationOf(windowId)};
+    if (m_thumbnails.find(key) == m_thumbnails.end()) {
+        scheduleRefresh(key, *m_lastRequestedSize);
+    }
+}
+
+QImage SnapShotImageProvider::requestImage(const QString &id, QSize *size, const QSize &requestedSize) {
+    bool isWindowId = false;
+    int windowId = id.toInt(&isWindowId);
+    if (!isWindowId) {
+        // Return a default placeholder if the ID is not found
+        return {};
+    }
+    QSize keySize = requestedSize.isValid() ? requestedSize : QSize(0, 0);
+    ThumbnailKey key{windowId, keySize.width(), keySize.height(), 0};
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_lastRequestedSize = keySize;
+        key.generation = generationOf(windowId);
+        auto found = m_thumbnails.find(key);
+        if (found != m_thumbnails.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, found->second);
+            QImage image = found->second->image;
+            if (std::chrono::steady_clock::now() - found->second->renderTime > kRefreshInterval) {
+                // still shown now, the next request gets the fresh one
+                m_generations[windowId]++;
+                key.generation = generationOf(windowId);
+                scheduleRefresh(key, keySize);
+            }
+            if (size)
+                *size = image.size();
+            return image;
+        }
+
+        ThumbnailKey sizeKey = key;
+        sizeKey.generation = 0;
+        auto newest = m_newestGenerations.find(sizeKey);
+        if (newest != m_newestGenerations.end()) {
+            sizeKey.generation = newest->second;
+            auto stale = m_thumbnails.find(sizeKey);
+            if (stale != m_thumbnails.end()) {
+                m_lru.splice(m_lru.begin(), m_lru, stale->second);
+                QImage image = stale->second->image;
+                scheduleRefresh(key, keySize);
+                if (size)
+                    *size = image.size();
+                return image;
+            }
+        }
+    }
+
+    // first request for this window and size
+    QImage image = render(windowId, keySize, true);
+    if (image.isNull()) {
+        return {};
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (key.generation == generationOf(windowId)) {
+            insert(key, image);
+        }
+    }
+    if (size)
+        *size = image.size();
+    return image;
+}
@@ -6,35 +6,95 @@
 #define HIDINGIN_SNAPSHOTIMAGEPROVIDER_H
 #include "QQuickImageProvider"
 #include <unordered_map>
+#include <unordered_set>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <optional>
+#include "../GPUPipeline/cpu/CpuImage.h"
 
+class TaskScheduler;
+
+// shrinks a window capture into the thumbnail, the provider hands out a banded parallel one or a serial one
+using ThumbnailDownscaler = std::function<void(const CpuImageView& input, const CpuImageView& output)>;
+// window id + requested size -> thumbnail, the platform capture (createWindowThumbnail on macOS)
+using ThumbnailRenderer = std::function<QImage(int windowId, const QSize& requestedSize, const ThumbnailDownscaler& downscale)>;
+
+// app picker thumbnails: the url id is the window id. a thumbnail is made on its first request at the requested
+// size and kept in a bounded LRU keyed by (window id, size, content generation). a window's generation goes up
+// when it is resized, closed or old enough, the stale thumbnail is still served while the thumbnail workers
+// render the new one.
 class SnapShotImageProvider : public QQuickImageProvider {
 public:
-    SnapShotImageProvider() : QQuickImageProvider(QQuickImageProvider::Image) {}
-
-    // Add an image with a specific ID
-    void addImage(const QString &id, const QImage &image) {
-        m_appSnapShotMaps[id.toStdString()] = image;
-    }
-
-    // Override the requestImage method to return the image associated with the ID
-    QImage requestImage(const QString &id, QSize *size, const QSize &requestedSize) override {
-        if (m_appSnapShotMaps.contains(id.toStdString())) {
-            QImage image = m_appSnapShotMaps[id.toStdString()];
-            if (size)
-                *size = image.size();
-
-            if (requestedSize.width() > 0 && requestedSize.height() > 0)
-                return image.scaled(requestedSize.width(), requestedSize.height(), Qt::KeepAspectRatio);
-
-            return image;
-        } else {
-            // Return a default placeholder if the ID is not found
-            return {};
-        }
-    }
+    static constexpr size_t kMaxCacheBytes = 64 << 20;
+    static constexpr int kDefaultThumbnailSize = 512;  // longest side when qml asks for no size
+    static constexpr std::chrono::seconds kRefreshInterval{10};
+
+    SnapShotImageProvider();
+    ~SnapShotImageProvider() override;
+
+    void setThumbnailRenderer(ThumbnailRenderer renderer);
+
+    // the window's thumbnails are stale from now on
+    void invalidate(int windowId);
+    void invalidateAll();
+
+    // renders the window's thumbnail in the background at the size qml last asked for, nothing before qml asked
+    void prefetch(int windowId);
+
+    QImage requestImage(const QString &id, QSize *size, const QSize &requestedSize) override;
+
+    // covers requestedSize keeping the aspect ratio (the picker crops), never bigger than the window
+    static QSize thumbnailSizeFor(const QSize& windowSize, const QSize& requestedSize);
 
 private:
-    std::unordered_map<std::string, QImage> m_appSnapShotMaps;
+    struct ThumbnailKey {
+        int windowId = 0;
+        int width = 0;
+        int height = 0;
+        uint64_t generation = 0;
+
+        bool operator==(const ThumbnailKey& other) const {
+            return windowId == other.windowId && width == other.width && height == other.height &&
+                   generation == other.generation;
+        }
+    };
+
+    struct ThumbnailKeyHash {
+        size_t operator()(const ThumbnailKey& key) const {
+            size_t hash = std::hash<int>{}(key.windowId);
+            hash = hash * 31 + std::hash<int>{}(key.width);
+            hash = hash * 31 + std::hash<int>{}(key.height);
+            return hash * 31 + std::hash<uint64_t>{}(key.generation);
+        }
+    };
+
+    struct Thumbnail {
+        ThumbnailKey key;
+        QImage image;
+        std::chrono::steady_clock::time_point renderTime;
+    };
+
+    QImage render(int windowId, const QSize& requestedSize, bool parallel);
+    void insert(const ThumbnailKey& key, const QImage& image); // under m_mutex
+    void scheduleRefresh(const ThumbnailKey& key, const QSize& requestedSize); // under m_mutex
+    uint64_t generationOf(int windowId); // under m_mutex
+
+    ThumbnailRenderer m_renderer;
+    std::mutex m_mutex;
+    std::list<Thumbnail> m_lru; // most recently used first
+    std::unordered_map<ThumbnailKey, std::list<Thumbnail>::iterator, ThumbnailKeyHash> m_thumbnails;
+    // newest generation cached per (window id, size), keyed with generation 0: the stale thumbnail to serve
+    std::unordered_map<ThumbnailKey, uint64_t, ThumbnailKeyHash> m_newestGenerations;
+    std::unordered_set<ThumbnailKey, ThumbnailKeyHash> m_refreshing;
+    std::unordered_map<int, uint64_t> m_generations;
+    uint64_t m_baseGeneration = 0; // invalidateAll
+    size_t m_cacheBytes = 0;
+    std::optional<QSize> m_lastRequestedSize; // for prefetch
+    std::unique_ptr<TaskScheduler> m_workers;
+    int m_registrySubscription = 0;
 };
 
 
@@ -0,0 +1,127 @@
+#include "WindowAbstractListModel.h"
+#include <QRegularExpression>
+#include <algorithm>
+#include <limits>
+#include "../utils/TaskScheduler.h"
+
+// case folded words of an app name, split on whitespace like the search always did
+static std::vector<std::string> foldedNameWords(const QString& appName) {
+    static const QRegularExpression wordDelimiter("\\s+");
+    std::vector<std::string> words;
+    for (const QString& word : appName.split(wordDelimiter, Qt::SkipEmptyParts)) {
+        words.push_back(word.toCaseFolded().toStdString());
+    }
+    return words;
+}
+
+WindowAbstractListModel::WindowAbstractListModel(QObject *parent) : QAbstractListModel(parent) {
+    std::vector<std::string> workerNames{"appEnumeration"};
+    m_enumerationWorker = std::make_unique<TaskScheduler>(1, workerNames, 4);
+}
+
+WindowAbstractListModel::~WindowAbstractListModel() {
+    if (m_enumerationCancelled) {
+        m_enumerationCancelled->store(true);
+    }
+    // joins the worker, rows it already posted are dropped with this object
+    m_enumerationWorker.reset();
+}
+
+uint64_t WindowAbstractListModel::startEnumeration() {
+    if (m_enumerationCancelled) {
+        m_enumerationCancelled->store(true);
+    }
+    m_enumerationCancelled = std::make_shared<std::atomic<bool>>(false);
+
+    beginResetModel();
+    m_windowsFull.clear();
+    m_shownWindows.clear();
+    m_nameIndex.clear();
+    m_nameWords.clear();
+    endResetModel();
+    return ++m_enumeration;
+}
+
+void WindowAbstractListModel::appendWindows(uint64_t enumeration, const QList<WindowModel>& windows) {
+    if (enumeration != m_enumeration) {
+        return;
+    }
+    std::vector<int> shown;
+    for (const auto& window : windows) {
+        int windowIndex = (int)m_windowsFull.size();
+        m_windowsFull.push_back(window);
+        m_nameWords.push_back(foldedNameWords(window.appName()));
+        m_nameIndex.add(windowIndex, m_nameWords.back());
+
+        bool matches = m_searchTerm.empty() ? (int)(m_shownWindows.size() + shown.size()) < m_showLimit
+                                            : AppNameIndex::matchesPrefix(m_nameWords.back(), m_searchTerm);
+        if (matches) {
+            shown.push_back(windowIndex);
+        }
+    }
+    if (shown.empty()) {
+        return;
+    }
+    // the newest windows have the highest indices, they go at the end
+    beginInsertRows(QModelIndex(), (int)m_shownWindows.size(), (int)(m_shownWindows.size() + shown.size()) - 1);
+    m_shownWindows.insert(m_shownWindows.end(), shown.begin(), shown.end());
+    endInsertRows();
+}
+
+void WindowAbstractListModel::searchApp(const QString& appName) {
+    m_showLimit = std::numeric_limits<int>::max();
+    m_searchTerm = appName.toCaseFolded().toStdString();
+
+    std::vector<int> windows;
+    if (m_searchTerm.empty()) {
+        // If search string is empty, show all apps
+        windows.resize(m_windowsFull.size());
+        for (int i = 0; i < (int)windows.size(); i++) {
+            windows[i] = i;
+        }
+    } else {
+        windows = m_nameIndex.findPrefix(m_searchTerm);
+    }
+    showWindows(windows);
+}
+
+void WindowAbstractListModel::showWindows(const std::vector<int>& windows) {
+    auto isWanted = [&windows](int windowIndex) {
+        return std::binary_search(windows.begin(), windows.end(), windowIndex);
+    };
+
+    // removes first, back to front so the rows in front keep their numbers. one signal per run of rows.
+    int row = (int)m_shownWindows.size() - 1;
+    while (row >= 0) {
+        if (isWanted(m_shownWindows[row])) {
+            row--;
+            continue;
+        }
+        int last = row;
+        while (row >= 0 && !isWanted(m_shownWindows[row])) {
+            row--;
+        }
+        beginRemoveRows(QModelIndex(), row + 1, last);
+        m_shownWindows.erase(m_shownWindows.begin() + row + 1, m_shownWindows.begin() + last + 1);
+        endRemoveRows();
+    }
+
+    // what is left is a subsequence of windows, insert the runs in between
+    size_t shownRow = 0;
+    size_t i = 0;
+    while (i < windows.size()) {
+        if (shownRow < m_shownWindows.size() && m_shownWindows[shownRow] == windows[i]) {
+            shownRow++;
+            i++;
+            continue;
+        }
+        size_t first = i;
+        while (i < windows.size() && (shownRow >= m_shownWindows.size() || m_shownWindows[shownRow] != windows[i])) {
+            i++;
+        }
+        beginInsertRows(QModelIndex(), (int)shownRow, (int)(shownRow + (i - first)) - 1);
+        m_shownWindows.insert(m_shownWindows.begin() + shownRow, windows.begin() + first, windows.begin() + i);
+        endInsertRows();
+        shownRow += i - first;
+    }
+}
@@ -6,7 +6,14 @@
 #include <QList>
 #include "WindowModel.h"  // Include the WindowModel class
 #include "SnapShotImageProvider.h"
-#include <QRegularExpression>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../utils/AppNameIndex.h"
+
+class TaskScheduler;
+
 class WindowAbstractListModel : public QAbstractListModel {
 Q_OBJECT
 
@@ -17,8 +24,8 @@ public:
         FrameContentRole
     };
 
-    explicit WindowAbstractListModel(QObject *parent = nullptr)
-            : QAbstractListModel(parent) {}
+    explicit WindowAbstractListModel(QObject *parent = nullptr);
+    ~WindowAbstractListModel() override;
 
     void updateWindows(){
         clearItemData(QModelIndex());
@@ -29,15 +36,15 @@ public:
     // Override rowCount
     int rowCount(const QModelIndex &parent = QModelIndex()) const override {
         Q_UNUSED(parent);
-        return m_windowsForShow.count();
+        return (int)m_shownWindows.size();
     }
 
     // Override data
     QVariant data(const QModelIndex &index, int role) const override {
-        if (index.row() < 0 || index.row() >= m_windowsForShow.count())
+        if (index.row() < 0 || index.row() >= (int)m_shownWindows.size())
             return {};
 
-        const WindowModel &window = m_windowsForShow[index.row()];
+        const WindowModel &window = m_windowsFull[m_shownWindows[index.row()]];
 
         switch (role) {
             case WindowHandleRole:
@@ -60,6 +67,8 @@ public:
         return roles;
     }
 
+    // starts a new enumeration in the background and returns right away, its windows stream in as rows.
+    // an enumeration still running is cancelled.
     void enumAllApps();
 
     SnapShotImageProvider& getImgProvider(){
@@ -78,44 +87,32 @@ public:
         throw std::runtime_error("Window with app name '" + appName + "' not found.");
     }
 
-    bool matchesFromInitials(const QString& appName, const QString& searchTerm) {
-        // Use QRegularExpression to split the app name by any whitespace characters
-        QRegularExpression wordDelimiter("\\s+");
-        QStringList words = appName.split(wordDelimiter, Qt::SkipEmptyParts);
+    // windows whose app name has a word starting with appName, through the prefix index: a keystroke only
+    // touches the matches and changes the rows that differ instead of resetting the model
+    Q_INVOKABLE void searchApp(const QString& appName);
 
-        // Check if any word starts with the search term
-        for (const QString& word : words) {
-            if (word.startsWith(searchTerm, Qt::CaseInsensitive)) {
-                return true;  // Return true if any word starts with the search term
-            }
-        }
-        return false;
-    }
+private:
+    // the shown rows before the first search
+    static constexpr int kInitialShowCount = 10;
 
-    // Use QString instead of std::string
-    Q_INVOKABLE void searchApp(const QString& appName) {
-        beginResetModel();  // Notify views that we're about to change the data.
-
-        m_windowsForShow.clear();  // Clear the current list of windows for display.
-
-        if (appName.isEmpty()) {
-            // If search string is empty, show all apps
-            m_windowsForShow = m_windowsFull;
-        } else {
-            // Search for windows where the app name starts with the search term at the beginning of any word
-            for (const auto& window : m_windowsFull) {
-                if (matchesFromInitials(window.appName(), appName)) {
-                    m_windowsForShow.push_back(window);
-                }
-            }
-        }
+    // cancels the running enumeration and clears the rows, returns the new enumeration's id
+    uint64_t startEnumeration();
+    // ui thread, drops the rows of a cancelled enumeration
+    void appendWindows(uint64_t enumeration, const QList<WindowModel>& windows);
+    // turns the shown rows into windows (ascending indices into m_windowsFull) with row inserts / removes
+    void showWindows(const std::vector<int>& windows);
 
-        endResetModel();  // Notify views that the data has been updated.
-    }
-private:
     QList<WindowModel> m_windowsFull;  // List of WindowModel objects
-    QList<WindowModel> m_windowsForShow;  // List of WindowModel objects
+    std::vector<int> m_shownWindows;   // indices into m_windowsFull, ascending
+    AppNameIndex m_nameIndex;          // over m_windowsFull
+    std::vector<std::vector<std::string>> m_nameWords; // folded words of each window's app name
+    std::string m_searchTerm;          // folded
+    int m_showLimit = kInitialShowCount;
     SnapShotImageProvider m_snapShotImageProvider;
+
+    uint64_t m_enumeration = 0;
+    std::shared_ptr<std::atomic<bool>> m_enumerationCancelled;
+    std::unique_ptr<TaskScheduler> m_enumerationWorker;
 };
 
 #endif // WINDOWABSTRACTLISTMODEL_H
\ No newline at end of file
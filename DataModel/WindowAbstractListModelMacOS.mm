@@ -6,36 +6,52 @@
 #import <AppKit/AppKit.h>
 #import <ApplicationServices/ApplicationServices.h>
 #include <DesktopCapture/macos/MacOSAppSnapShot.h>
+#include "utils/TaskScheduler.h"
 void WindowAbstractListModel::enumAllApps() {
-    NSArray *runningApps = [[NSWorkspace sharedWorkspace] runningApplications];
+    uint64_t enumeration = startEnumeration();
+    auto cancelled = m_enumerationCancelled;
 
-    for (NSRunningApplication *app in runningApps) {
+    // thumbnails are captured when the picker first shows them, at the size it shows them
+    m_snapShotImageProvider.setThumbnailRenderer(createWindowThumbnail);
+    m_snapShotImageProvider.invalidateAll();
+
+    // enumerate: the running apps are read here, that is cheap and NSWorkspace wants the main thread
+    std::vector<std::pair<std::string, pid_t>> apps;
+    for (NSRunningApplication *app in [[NSWorkspace sharedWorkspace] runningApplications]) {
         if(!app.localizedName || [app.localizedName length] <= 0){
             continue;
         }
-        auto appName = std::string([app.localizedName UTF8String]);
-        std::vector<int> retWinId;
-        auto snapShots = getAllSnapShotsFromApp(appName, retWinId);
-        if(snapShots.empty()){
-            continue;
-        }
-        // to-do: lazy load images, the high pass result is time-consuming:
-        for(int i = 0 ; i < snapShots.size(); i++){
-            auto finalFindName = QString::fromStdString(appName) + QString::number(i);
-            m_snapShotImageProvider.addImage(finalFindName, snapShots[i]);
-            //snapShots[i].save("/Users/binxiaokang/Desktop/bxk.png");
-            auto constructImgUrl = QString("image://appsnapshotprovider/") + finalFindName;
-            WindowModel model(QString::number(retWinId[i]),
-                          QString::fromUtf8([app.localizedName UTF8String]), constructImgUrl, QString::number((app.processIdentifier)));
-            m_windowsFull.push_back(model);
-        }
+        apps.emplace_back(std::string([app.localizedName UTF8String]), app.processIdentifier);
     }
 
-    // Copy up to the top 10 windows from m_windowsFull to m_windowsForShow
-    m_windowsForShow.clear();  // Clear the list before copying
-    int windowCount = std::min((float)10, (float)m_windowsFull.size());
+    // filter -> thumbnail on the enumeration worker, each app's windows are posted back as soon as they are known
+    m_enumerationWorker->enqueueDetachedTask([this, enumeration, cancelled, apps = std::move(apps)](const std::string& threadName) {
+        std::vector<int> windowIds;
+        for (auto& [appName, pid] : apps) {
+            if (cancelled->load()) {
+                return;
+            }
+            QList<WindowModel> windows;
+            auto qAppName = QString::fromStdString(appName);
+            for (auto windowId : findAllWindowIDsForApp(appName)) {
+                auto constructImgUrl = QString("image://appsnapshotprovider/") + QString::number(windowId);
+                windows.push_back(WindowModel(QString::number(windowId), qAppName, constructImgUrl, QString::number(pid)));
+                windowIds.push_back((int)windowId);
+            }
+            if (windows.isEmpty()) {
+                continue;
+            }
+            QMetaObject::invokeMethod(this, [this, enumeration, windows]() {
+                appendWindows(enumeration, windows);
+            }, Qt::QueuedConnection);
+        }
 
-    for (int i = 0; i < windowCount; ++i) {
-        m_windowsForShow.push_back(m_windowsFull[i]);
-    }
+        // warm the thumbnails of the rows not on screen yet, the thumbnail workers render them in parallel
+        for (int windowId : windowIds) {
+            if (cancelled->load()) {
+                return;
+            }
+            m_snapShotImageProvider.prefetch(windowId);
+        }
+    });
 }
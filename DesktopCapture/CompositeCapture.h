@@ -9,8 +9,15 @@
 #include <memory>
 #include <optional>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <array>
+#include <unordered_map>
 #include "common/CaptureStuff.h"
-#include <map>
+#include "../utils/TripleBuffer.h"
+#include "../GPUPipeline/HidingFrameGraph.h"
+#include "../utils/FrameRateGovernor.h"
 
 // Forward declaration of MacOSCaptureSCKit
 #ifdef __APPLE__
@@ -20,16 +27,57 @@ using DesktopCapture = MacOSCaptureSCKit;
 using TextureProcessor = MetalProcessor;
 #endif
 
+class CaptureSource;
+struct RenderState;
+struct DisplayTopology;
+class FrameGraph;
+class FrameGraphBackend;
+struct MtlRenderPipeline;
+
 struct CaptureFrameDesc{
-    void* texId = nullptr;
+    FrameLease lease;          // see CaptureFrameEvent
+    std::string captureEventName; // the renderer to notify, the same for the sources of every display
+    bool isAppCapture = false; // the app to hide, otherwise the desktop it is hidden in
+    uint32_t displayId = 0;    // display the source captures
+    uint64_t sequence = 0;     // per source, starts at 1
+    std::chrono::steady_clock::time_point captureTime;
+    int originX = 0;           // top left of the frame on its display, the display's pixels
+    int originY = 0;
+    // in the ring: changes since the frame the pacing thread consumed last. handed to compositeFrames: changes
+    // since the last composite that ran.
+    DirtyRegion dirtyRegion;
+};
+
+// per source numbers of the pacing thread
+struct CaptureSourceStats{
     std::string captureEventName;
-    std::function<void*(void* texId)> opsToBePerformBeforeComposition;
+    uint64_t framesPublished = 0;
+    uint64_t framesComposited = 0;   // distinct frames the pacing thread picked up
+    uint64_t framesOverwritten = 0;  // published but replaced by a newer one before the pacing thread came by
+    std::chrono::microseconds staleness{0}; // age of this source's frame in the last composite
+    int frameRateLimit = 0;                 // capture rate the governor set, 0 before the first one
 };
 
-struct CompositeOrder{
-    bool operator()(const int& lhs, const int& rhs) const {
-        return lhs > rhs; // Sort in descending order
-    }
+// one capture source: the capture callback publishes into the ring and never waits, the pacing thread takes the
+// newest frame from it
+struct CaptureSourceSlot{
+    // frames a published frame's dirty region can reach back over, a bigger gap is a full redraw
+    static constexpr size_t kDirtyHistorySize = 8;
+
+    std::string captureEventName;
+    std::string rendererName;  // captureEventName without the display suffix
+    bool isAppCapture = false;
+    uint32_t displayId = 0;
+    std::weak_ptr<CaptureSource> captureSource; // gets the governed frame rate
+    TripleBuffer<CaptureFrameDesc> frameRing;
+    std::atomic<uint64_t> publishedCount{0};
+    std::atomic<uint64_t> consumedSequence{0};  // written by the pacing thread, read by the capture callback
+    std::array<DirtyRegion, kDirtyHistorySize> dirtyHistory; // capture callback only, by sequence % size
+    uint64_t lastConsumedSequence = 0; // pacing thread only
+    DirtyRegion pendingDirty;          // pacing thread only, changes no composite has drawn yet
+    DirtyRect captureRegion;           // pacing thread only, what the source was told to capture, empty for all
+    bool displayInUse = true;          // pacing thread only, our window / the app reaches the source's display
+    CaptureSourceStats stats;          // pacing thread, read under m_sourcesMutex
 };
 
 class CompositeCapture {
@@ -39,9 +87,10 @@ public:
 
     void cleanUp();
 
-    // Add a screen capture by application name
+    // Add a screen capture by application name, one source per display
     bool addCaptureByApplicationName(std::optional<CaptureArgs> args = std::nullopt);
 
+    // one source per display, so a window crossing displays only moves capture regions
     bool addWholeDesktopCapture(std::optional<CaptureArgs> args = std::nullopt);
 
     CaptureStatus queryCaptureStatus();
@@ -55,23 +104,52 @@ public:
     // Get the latest composite frame (returns a Metal texture pointer)
     void* getLatestCompositeFrame();
 
+    std::vector<CaptureSourceStats> getCaptureSourceStats();
+
 private:
+    // paces the composites at display rate with the newest frame of every source
     void compositeThreadFunc();
-    int putFrameAndCompositeIfMeet(int order, const CaptureFrameDesc& captureFrameDesc);
-    void waitForCompositeDone();
+    // starts a source for every display of the topology (one for the main display without one), the main display
+    // keeps args' event name
+    bool addDisplayCaptures(bool isAppCapture, const CaptureArgs& args);
+    void addCaptureSourceSlot(const std::string& captureEventName, const std::string& rendererName, uint32_t displayId,
+                              bool isAppCapture, const std::shared_ptr<CaptureSource>& captureSource);
+    // the display rect every source has to deliver for the composite: the part under our window for the desktop,
+    // the app window for the app, nothing when they are on other displays. pacing thread only.
+    void updateCaptureRegions(const RenderState& renderState, const DisplayTopology& topology);
+    // feeds the governor what this tick saw and hands its rate to the sources, pacing thread only
+    void updateFrameRate(double changeRatio, bool windowChanged, std::chrono::steady_clock::time_point now);
+    std::shared_ptr<CaptureSource> createCaptureSource(bool isAppCapture);
+    bool compositeFrames(const MtlRenderPipeline& renderPipelineRes, const std::vector<CaptureFrameDesc>& frames); // render queue only
 
 private:
-    std::vector<std::shared_ptr<DesktopCapture>> m_captureSources;
+    // the frame graph and textures of composites whose window is on one display. a window going back and forth
+    // between a laptop panel and a 4k screen finds its textures still there instead of reallocating them.
+    struct DisplayCompositePipeline {
+        std::unique_ptr<FrameGraphBackend> frameGraphBackend;
+        std::unique_ptr<FrameGraph> frameGraph;
+        // the scene the present target holds, the next composite of the same scene only redraws what changed
+        HidingCompositeDesc lastCompositeDesc;
+        bool lastCompositeValid = false;
+        DirtyTileMap outputDirtyTiles;
+    };
+
+    std::vector<std::shared_ptr<CaptureSource>> m_captureSources;
     std::shared_ptr<TextureProcessor> m_textureProcessor;
     CompositeCaptureArgs m_compCapArgs;
-    std::map<int, CaptureFrameDesc> m_captureFrameSet;
+    std::vector<std::shared_ptr<CaptureSourceSlot>> m_sourceSlots; // in the order the sources were added
+    // render queue only, keyed by the display the window is on
+    std::unordered_map<uint32_t, DisplayCompositePipeline> m_displayPipelines;
+    uint32_t m_lastCompositeDisplayId = 0;             // whose pipeline drew the present target last
+    std::shared_ptr<const HideEffect> m_hideEffect;    // the one composites run, render queue only
     std::thread m_compositeThread;
     std::atomic_bool m_stopAllWork = false;
-    std::mutex m_framesSetMutex;
-    std::condition_variable m_compositeCondVar;
-    int m_capOrder = 0;
-    int reqCompositeNum = 0;
+    std::mutex m_sourcesMutex;
+    std::atomic_int reqCompositeNum = 0;
     int frameIntervalInMilliSeconds = 16;
+    // capture and composite rate from content motion, input and power state, pacing thread only
+    FrameRateGovernor m_rateGovernor;
+    std::chrono::steady_clock::time_point m_nextPowerPoll;
 };
 
 
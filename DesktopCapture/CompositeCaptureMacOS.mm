@@ -6,16 +6,26 @@
 #include "QFile"
 #ifdef __APPLE__
 #include "macos/MacOSCaptureSCKit.h"
+#include "../GPUPipeline/cpu/CpuImage.h"
 #include "Metal/Metal.h"
 #include <CoreGraphics/CoreGraphics.h>
 #include <ImageIO/ImageIO.h>
 #include <Foundation/Foundation.h>
+#include <AppKit/AppKit.h>
 #include <vector>
 #include <com/NotificationCenter.h>
+#include <DesktopCapture/common/CaptureState.h>
 #include <com/EventListener.h>
+#include <com/EventChannel.h>
+#include "platform/macos/MacUtils.h"
 #include "../GPUPipeline/macos/MetalPipeline.h"
+#include "../GPUPipeline/macos/MetalFrameGraphBackend.h"
+#include "../GPUPipeline/FrameGraph.h"
+#include "../GPUPipeline/HidingFrameGraph.h"
 #include "../utils/WindowLogic.h"
+#include "../utils/Tracer.h"
 #include <chrono>
+#include <cmath>
 #endif
 
 static void saveMTLTextureAsPNG(id<MTLTexture> texture) {
@@ -89,138 +99,93 @@ bool CompositeCapture::addCaptureByApplicationName(std::optional<CaptureArgs> ar
         std::cerr << "null capture args is not allowed..." << std::endl;
         return false;
     }
-    std::shared_ptr<DesktopCapture> captureSource = std::make_shared<DesktopCapture>();
-    if(captureSource){
-        captureSource->startCaptureWithSpecificWinId(args);
-
-        // register capture event handler:
-        int capOrderToSet = m_capOrder++;
-        EventManager::getInstance()->registerListener(args->captureEventName, [this, capOrderToSet, args](EventParam& eventParam){
-            CaptureFrameDesc captureFrameDesc;
-            captureFrameDesc.captureEventName = args->captureEventName;
-            captureFrameDesc.texId = std::get<void*>(eventParam.parameters["textureId"]);
-            // for capture app, need to crop out the capture area:
-            captureFrameDesc.opsToBePerformBeforeComposition = [&](void* texId){
-                auto mtlTexture = (id<MTLTexture>)texId;
-
-                Message windowMsg;
-                auto windowMsgResult = NotificationCenter::getInstance().getPersistentMessage(MessageType::Render, windowMsg);
-                auto windowInfo = (WindowSubMsg*)windowMsg.subMsg.get();
-                auto cropROI = calculateRectForWindowAtPosition(WindowSize(mtlTexture.width, mtlTexture.height),
-                                                                WindowSize(windowInfo->capturedAppWidth,
-                                                                           windowInfo->capturedAppHeight),
-                                                                WindowPoint(windowInfo->capturedAppX,
-                                                                            windowInfo->capturedAppY));
-                auto &renderPipeline = MetalPipeline::getGlobalInstance().getRenderPipeline();
-                void* finalTex = nullptr;
-
-                Message msg;
-                NotificationCenter::getInstance().getPersistentMessage(MessageType::Control, msg);
-                auto controlMsg = (ControlSubMsg*)msg.subMsg.get();
-
-                if(controlMsg->showAppContent){
-                    // crop out the app area;
-                    {
-                        REQUEST_TEXTURE(windowInfo->capturedAppWidth, windowInfo->capturedAppHeight,
-                                        mtlTexture.pixelFormat, renderPipeline.mtlDeviceRef);
-                        MtlProcessMisc::getGlobalInstance().encodeCropProcessIntoPipeline(
-                                std::make_tuple(cropROI.x, cropROI.y, cropROI.width, cropROI.height),
-                                std::make_tuple(cropROI.compensateX, cropROI.compensateY),
-                                texId, retTexture, renderPipeline.mtlCommandQueue);
-                        finalTex = retTexture;
-                    }
-
-                    // scale to match window if necessary:
-                    if(windowInfo->capturedAppWidth  != windowInfo->width || windowInfo->capturedAppHeight != windowInfo->height)
-                    {
-                        REQUEST_TEXTURE(windowInfo->width * windowInfo->scalingFactor,
-                                        windowInfo->height * windowInfo->scalingFactor,
-                                        mtlTexture.pixelFormat, renderPipeline.mtlDeviceRef);
-                        MtlProcessMisc::getGlobalInstance().encodeScaleProcessIntoPipeline(finalTex, retTexture, renderPipeline.mtlCommandQueue);
-                        finalTex = retTexture;
-                    }
-                } else{
-                    REQUEST_TEXTURE(windowInfo->capturedAppWidth, windowInfo->capturedAppHeight,
-                                    mtlTexture.pixelFormat, renderPipeline.mtlDeviceRef);
-                    finalTex = retTexture;
-                }
-
-                return finalTex;
-            };
-            if(putFrameAndCompositeIfMeet(capOrderToSet, captureFrameDesc) == -1){
-                // need to wait:
-                waitForCompositeDone();
-            }
-        });
+    return addDisplayCaptures(true, args.value());
+}
 
+bool CompositeCapture::addDisplayCaptures(bool isAppCapture, const CaptureArgs& args) {
+    auto topology = NotificationCenter::getInstance().displayTopology().load();
+    std::vector<uint32_t> displayIds;
+    for(int i = 0; i < topology.displayCount; i++){
+        displayIds.push_back(topology.displays[i].displayId);
+    }
+    if(displayIds.empty()){
+        displayIds.push_back(0);
+    }
+    for(size_t i = 0; i < displayIds.size(); i++){
+        auto displayArgs = args;
+        displayArgs.displayId = displayIds[i];
+        if(i > 0){
+            displayArgs.captureEventName = args.captureEventName + "@" + std::to_string(displayIds[i]);
+        }
+        auto captureSource = createCaptureSource(isAppCapture);
+        if(!captureSource){
+            return false;
+        }
+        if(isAppCapture){
+            captureSource->startCaptureWithSpecificWinId(displayArgs);
+        }else{
+            captureSource->startCapture(displayArgs);
+        }
+        addCaptureSourceSlot(displayArgs.captureEventName, args.captureEventName, displayIds[i], isAppCapture, captureSource);
         m_captureSources.push_back(captureSource);
-    }else{
-        return false;
+        reqCompositeNum++;
     }
-    reqCompositeNum++;
     return true;
 }
 
+std::shared_ptr<CaptureSource> CompositeCapture::createCaptureSource(bool isAppCapture) {
+    if(m_compCapArgs.captureSourceFactory){
+        return m_compCapArgs.captureSourceFactory(isAppCapture);
+    }
+    return std::make_shared<DesktopCapture>();
+}
+
 void CompositeCapture::stopAllCaptures() {
     m_captureSources.clear();
+    std::lock_guard<std::mutex> sourcesLock(m_sourcesMutex);
+    auto& frameChannel = EventChannel<CaptureFrameEvent>::getInstance();
+    for(auto& sourceSlot : m_sourceSlots){
+        frameChannel.unregisterListeners(frameChannel.handleFor(sourceSlot->captureEventName));
+    }
+    m_sourceSlots.clear();
     reqCompositeNum = 0;
 }
 
+std::vector<CaptureSourceStats> CompositeCapture::getCaptureSourceStats() {
+    std::lock_guard<std::mutex> sourcesLock(m_sourcesMutex);
+    std::vector<CaptureSourceStats> sourceStats;
+    for(auto& sourceSlot : m_sourceSlots){
+        sourceStats.push_back(sourceSlot->stats);
+        sourceStats.back().framesPublished = sourceSlot->publishedCount.load(std::memory_order_relaxed);
+    }
+    return sourceStats;
+}
+
 void *CompositeCapture::getLatestCompositeFrame() {
     return nullptr;
 }
 
 bool CompositeCapture::addWholeDesktopCapture(std::optional<CaptureArgs> args) {
-    std::shared_ptr<DesktopCapture> captureSource = std::make_shared<DesktopCapture>();
-    if(captureSource){
-        captureSource->startCapture(args);
-
-        int capOrderToSet = m_capOrder++;
-        // register capture event handler:
-        EventManager::getInstance()->registerListener(args->captureEventName, [this, capOrderToSet, args](EventParam& eventParam){
-            CaptureFrameDesc captureFrameDesc;
-            captureFrameDesc.captureEventName = args->captureEventName;
-            captureFrameDesc.texId = std::get<void*>(eventParam.parameters["textureId"]);
-            // for capture app, need to crop out the capture area:
-            captureFrameDesc.opsToBePerformBeforeComposition = [&](void* texId){
-                auto mtlTexture = (id<MTLTexture>)texId;
-
-                Message windowMsg;
-                auto windowMsgResult = NotificationCenter::getInstance().getPersistentMessage(MessageType::Render, windowMsg);
-                auto windowInfo = (WindowSubMsg*)windowMsg.subMsg.get();
-
-                auto &renderPipeline = MetalPipeline::getGlobalInstance().getRenderPipeline();
-                REQUEST_TEXTURE(windowInfo->width* windowInfo->scalingFactor,
-                                windowInfo->height* windowInfo->scalingFactor,
-                                mtlTexture.pixelFormat, renderPipeline.mtlDeviceRef);
-
-                auto cropTuple = std::make_tuple(windowInfo->xPos * windowInfo->scalingFactor,
-                                                 windowInfo->yPos * windowInfo->scalingFactor,
-                                                 windowInfo->width * windowInfo->scalingFactor,
-                                                 windowInfo->height * windowInfo->scalingFactor);
-                MtlProcessMisc::getGlobalInstance().encodeCropProcessIntoPipeline(
-                        cropTuple, std::make_tuple(0,0), texId, retTexture, renderPipeline.mtlCommandQueue);
-                return retTexture;
-            };
-            if(putFrameAndCompositeIfMeet(capOrderToSet, captureFrameDesc) == -1){
-                // need to wait:
-                waitForCompositeDone();
-            }
-        });
-        m_captureSources.push_back(captureSource);
-    }else{
-        return false;
-    }
-    reqCompositeNum++;
-    return true;
+    return addDisplayCaptures(false, args.value_or(CaptureArgs{}));
 }
 
 CompositeCapture::CompositeCapture(std::optional<CompositeCaptureArgs> compCapArgs)
-//        : m_compositeThread(&CompositeCapture::compositeThreadFunc, this)
 {
     if(compCapArgs.has_value()){
         m_compCapArgs = compCapArgs.value();
     }
+    // composite at the cadence of the fastest display:
+    if (@available(macOS 12.0, *)) {
+        NSInteger maxFps = 0;
+        for(NSScreen *screen in [NSScreen screens]){
+            maxFps = std::max(maxFps, screen.maximumFramesPerSecond);
+        }
+        if(maxFps > 0){
+            frameIntervalInMilliSeconds = std::max(1, (int)(1000 / maxFps));
+            m_rateGovernor.setMaxRate((int)maxFps);
+        }
+    }
+    m_compositeThread = std::thread(&CompositeCapture::compositeThreadFunc, this);
 }
 
 CaptureStatus CompositeCapture::queryCaptureStatus() {
@@ -232,64 +197,499 @@ CaptureStatus CompositeCapture::queryCaptureStatus() {
     return CaptureStatus::Stop;
 }
 
-void CompositeCapture::compositeThreadFunc() {
-    while(!m_stopAllWork){
-        auto execFuture = MetalPipeline::getGlobalInstance().sendJobToRenderQueue(
-                [&](const std::string& threadName, const MtlRenderPipeline& renderPipelineRes){
-            if(m_captureFrameSet.size() < reqCompositeNum){
-                return;
+void CompositeCapture::addCaptureSourceSlot(const std::string& captureEventName, const std::string& rendererName,
+                                            uint32_t displayId, bool isAppCapture,
+                                            const std::shared_ptr<CaptureSource>& captureSource) {
+    auto sourceSlot = std::make_shared<CaptureSourceSlot>();
+    sourceSlot->captureEventName = captureEventName;
+    sourceSlot->rendererName = rendererName;
+    sourceSlot->isAppCapture = isAppCapture;
+    sourceSlot->displayId = displayId;
+    sourceSlot->captureSource = captureSource;
+    sourceSlot->stats.captureEventName = captureEventName;
+
+    // register capture event handler, it only publishes: a slow source never holds up the other one
+    auto& frameChannel = EventChannel<CaptureFrameEvent>::getInstance();
+    frameChannel.registerListener(frameChannel.handleFor(captureEventName), [sourceSlot](const CaptureFrameEvent& frameEvent){
+        auto& captureFrameDesc = sourceSlot->frameRing.backSlot();
+        // the frame this slot held before goes back to its source's pool here, unless a composite still uses it
+        captureFrameDesc.lease = frameEvent.lease;
+        captureFrameDesc.captureEventName = sourceSlot->rendererName;
+        captureFrameDesc.isAppCapture = sourceSlot->isAppCapture;
+        captureFrameDesc.displayId = sourceSlot->displayId;
+        captureFrameDesc.sequence = sourceSlot->publishedCount.fetch_add(1, std::memory_order_relaxed) + 1;
+        captureFrameDesc.captureTime = std::chrono::steady_clock::now();
+        captureFrameDesc.originX = frameEvent.originX;
+        captureFrameDesc.originY = frameEvent.originY;
+
+        // a frame can replace ones the pacing thread never saw, so it carries their changes too: everything since
+        // the consumed frame. a stale consumedSequence only makes the region bigger.
+        auto sequence = captureFrameDesc.sequence;
+        sourceSlot->dirtyHistory[sequence % CaptureSourceSlot::kDirtyHistorySize] = frameEvent.dirtyRegion;
+        auto consumedSequence = sourceSlot->consumedSequence.load(std::memory_order_acquire);
+        captureFrameDesc.dirtyRegion.clear();
+        if(sequence - consumedSequence > CaptureSourceSlot::kDirtyHistorySize){
+            captureFrameDesc.dirtyRegion.markEverything();
+        }else{
+            for(auto dirtySequence = consumedSequence + 1; dirtySequence <= sequence; dirtySequence++){
+                captureFrameDesc.dirtyRegion.add(sourceSlot->dirtyHistory[dirtySequence % CaptureSourceSlot::kDirtyHistorySize]);
+            }
+        }
+        sourceSlot->frameRing.publish();
+    });
+
+    std::lock_guard<std::mutex> sourcesLock(m_sourcesMutex);
+    m_sourceSlots.push_back(sourceSlot);
+}
+
+// the displays the composite maps the window onto. sources and tests without a published topology get one display
+// from the render state, the way a single screen was handled before.
+static DisplayTopology getEffectiveTopology(const RenderState& renderState) {
+    auto topology = NotificationCenter::getInstance().displayTopology().load();
+    if(topology.displayCount == 0){
+        auto scale = renderState.scalingFactor > 0.0f ? renderState.scalingFactor : 1.0f;
+        topology.addDisplay({renderState.displayId, {0, 0, (int)std::lround(renderState.screenWidthInPixels / scale),
+                                                     (int)std::lround(renderState.screenHeightInPixels / scale)}, scale});
+    }
+    return topology;
+}
+
+// the captured app window in global points, the render state keeps it in pixels at the window's scale
+static DirtyRect getCapturedAppPoints(const RenderState& renderState) {
+    auto scale = renderState.scalingFactor > 0.0f ? renderState.scalingFactor : 1.0f;
+    int left = (int)std::lround(renderState.capturedAppX / scale);
+    int top = (int)std::lround(renderState.capturedAppY / scale);
+    int right = (int)std::lround((renderState.capturedAppX + renderState.capturedAppWidth) / scale);
+    int bottom = (int)std::lround((renderState.capturedAppY + renderState.capturedAppHeight) / scale);
+    return {left, top, right - left, bottom - top};
+}
+
+namespace {
+// a captured frame as a texture the graph can read
+struct CompositeFrameTexture {
+    const CaptureFrameDesc* frame = nullptr;
+    id<MTLTexture> texture = nil;
+};
+}
+
+// the frame of one kind the composite is based on: the one of the window's display, else the first of that kind
+static const CompositeFrameTexture* findBaseFrame(const std::vector<CompositeFrameTexture>& frameTextures,
+                                                  bool isAppCapture, uint32_t displayId) {
+    const CompositeFrameTexture* firstOfKind = nullptr;
+    for(auto& frameTexture : frameTextures){
+        if(frameTexture.frame->isAppCapture != isAppCapture){
+            continue;
+        }
+        if(frameTexture.frame->displayId == displayId){
+            return &frameTexture;
+        }
+        if(!firstOfKind){
+            firstOfKind = &frameTexture;
+        }
+    }
+    return firstOfKind;
+}
+
+// the pieces of rect (global points) on displays other than base's, taken out of those displays' frames and
+// placed in a target whose top left is rect's at targetScale. dirty is set when any of their frames changed.
+static std::vector<HidingFramePart> collectFrameParts(const std::vector<CompositeFrameTexture>& frameTextures,
+                                                      const DisplayTopology& topology, const DirtyRect& rect,
+                                                      bool isAppCapture, uint32_t baseDisplayId, float targetScale,
+                                                      const DirtyRect& targetRect, bool& dirty) {
+    std::vector<HidingFramePart> parts;
+    for(auto& displayPart : topology.splitRect(rect)){
+        if(displayPart.displayId == baseDisplayId){
+            continue;
+        }
+        for(auto& frameTexture : frameTextures){
+            auto frame = frameTexture.frame;
+            if(frame->isAppCapture != isAppCapture || frame->displayId != displayPart.displayId){
+                continue;
             }
+            HidingFramePart part;
+            part.frame = (void*)frameTexture.texture;
+            part.frameDesc = {(int)frameTexture.texture.width, (int)frameTexture.texture.height,
+                              (int)frameTexture.texture.pixelFormat};
+            part.crop = {displayPart.pixels.x - frame->originX, displayPart.pixels.y - frame->originY,
+                         displayPart.pixels.width, displayPart.pixels.height, 0, 0};
+            part.target = pointsToPixels(displayPart.points, rect.x, rect.y, targetScale).intersected(targetRect);
+            parts.push_back(part);
+            dirty = dirty || !frame->dirtyRegion.isEmpty();
+            break;
+        }
+    }
+    return parts;
+}
 
-            Message windowMsg;
-            auto windowMsgResult = NotificationCenter::getInstance().getPersistentMessage(MessageType::Render, windowMsg);
-            auto windowInfo = (WindowSubMsg*)windowMsg.subMsg.get();
-            void* lastTexId = nullptr;
-            m_framesSetMutex.lock();
-            for(auto& it : m_captureFrameSet){
-                // will finally match the result size of the result to the window size:
-                auto texIdMtl = (id<MTLTexture>)it.second.texId;
-                if(it.second.opsToBePerformBeforeComposition){
-                    texIdMtl = (id<MTLTexture>)it.second.opsToBePerformBeforeComposition(texIdMtl);
-                }
-                if(lastTexId){
-                    // apply high pass:
-                    REQUEST_TEXTURE(windowInfo->width * windowInfo->scalingFactor,
-                                    windowInfo->height * windowInfo->scalingFactor, texIdMtl.pixelFormat, renderPipelineRes.mtlDeviceRef);
-                    MtlProcessMisc::getGlobalInstance().encodeGaussianProcessIntoPipeline((void*)texIdMtl,
-                                                                                          retTexture,
-                                                                                          renderPipelineRes.mtlCommandQueue);
-                    REQUEST_TEXTURE_ANOTHER(windowInfo->width * windowInfo->scalingFactor,
-                                            windowInfo->height * windowInfo->scalingFactor,
-                                            texIdMtl.pixelFormat, renderPipelineRes.mtlDeviceRef);
-                    MtlProcessMisc::getGlobalInstance().encodeSubtractProcessIntoPipeline((void*)texIdMtl,
-                                                                                          retTexture,
-                                                                                          retTextureAnother,
-                                                                                          renderPipelineRes.mtlCommandQueue);
-
-                    // apply hiding filter:
-                    std::vector<void*> inputTextures;
-                    inputTextures.push_back(lastTexId);
-                    inputTextures.push_back(retTextureAnother);
-                    // since it renders to the final render target, so we need not to do anything then.
-                    auto renderTarget = MetalPipeline::getGlobalInstance().
-                            throughRenderingPipelineState("hidingShader", inputTextures, it.second.captureEventName);
-                }else{
-                    if (reqCompositeNum == 1){
-                        // if only there's only one frame, we just render the texture to the scene
-                        std::vector<void*> inputTextures;
-                        inputTextures.push_back(texIdMtl);
-                        auto renderTarget = MetalPipeline::getGlobalInstance().
-                                throughRenderingPipelineState("basicRenderShader", inputTextures, it.second.captureEventName);
-                    }else{
-                        lastTexId = (void*)texIdMtl;
+// turns the frame set into one frame graph run: crop the desktop under our window, crop and scale the app, hide
+// the app in the desktop and present. the graph keeps its textures across frames and shares them between stages.
+// the window's display is the base, what of the window lies on other displays is cropped out of their frames and
+// scaled to the window's display when their dpi differs. false when there is nowhere to draw yet.
+bool CompositeCapture::compositeFrames(const MtlRenderPipeline& renderPipelineRes, const std::vector<CaptureFrameDesc>& frames) {
+    if(!renderPipelineRes.renderTarget){
+        return false;
+    }
+    TRACE_SCOPE("compositeFrames");
+    auto windowInfo = NotificationCenter::getInstance().renderState().load();
+    auto controlState = NotificationCenter::getInstance().controlState().load();
+    auto topology = getEffectiveTopology(windowInfo);
+    auto outputScale = windowInfo.scalingFactor;
+    DirtyRect windowPoints{windowInfo.xPos, windowInfo.yPos, windowInfo.width, windowInfo.height};
+    auto outputDisplay = topology.findDisplay(windowInfo.displayId);
+    if(!outputDisplay){
+        outputDisplay = topology.primaryDisplayFor(windowPoints);
+    }
+
+    HidingCompositeDesc compositeDesc;
+    compositeDesc.outputDesc = {(int)(windowInfo.width * outputScale),
+                                (int)(windowInfo.height * outputScale),
+                                (int)MTLPixelFormatBGRA8Unorm};
+    compositeDesc.presentTarget = renderPipelineRes.renderTarget;
+    compositeDesc.showAppContent = controlState.showAppContent;
+    // a retune is baked and its pipelines built in the background, until then the last effect keeps running
+    MetalHidingStageExecutor stageExecutor(renderPipelineRes.mtlCommandQueue);
+    compositeDesc.hideEffect = selectHideEffect(m_hideEffect, controlState.hideEffect, stageExecutor);
+    compositeDesc.fusedHighPassHide = MetalPipeline::getGlobalInstance().hasComputePipelineState("highPassHide");
+
+    // textures the graph gives back this frame are reused once the gpu passed endFrame()
+    MtlTextureManager::getGlobalInstance().beginFrame();
+
+    // the last frame of the set names the renderer to notify, as before:
+    std::string triggerRendererName;
+    std::vector<FrameLease> frameLeases;
+    std::vector<CompositeFrameTexture> frameTextures;
+    for(auto& frame : frames){
+        if(!frame.lease){
+            continue;
+        }
+        auto mtlTexture = (id<MTLTexture>)frame.lease->buffer;
+        if(frame.lease->storage == CaptureFrameStorage::CpuImage){
+            // portable capture sources hand out cpu pixels, upload them into a frame texture
+            auto cpuFrame = frame.lease->cpuView();
+            if(!cpuFrame.valid()){
+                continue;
+            }
+            TRACE_SCOPE("uploadCpuFrame");
+            mtlTexture = (id<MTLTexture>)MtlTextureManager::getGlobalInstance().requestFrameTexture(
+                    cpuFrame.width, cpuFrame.height, MTLPixelFormatBGRA8Unorm, renderPipelineRes.mtlDeviceRef);
+            if(!mtlTexture){
+                continue;
+            }
+            [mtlTexture replaceRegion:MTLRegionMake2D(0, 0, cpuFrame.width, cpuFrame.height)
+                          mipmapLevel:0
+                            withBytes:cpuFrame.data
+                          bytesPerRow:cpuFrame.bytesPerRow];
+        }
+        frameTextures.push_back({&frame, mtlTexture});
+        triggerRendererName = frame.captureEventName;
+        frameLeases.push_back(frame.lease);
+    }
+
+    uint32_t outputDisplayId = outputDisplay ? outputDisplay->displayId : windowInfo.displayId;
+    int displayOriginX = outputDisplay ? outputDisplay->frame.x : 0;
+    int displayOriginY = outputDisplay ? outputDisplay->frame.y : 0;
+    DirtyRegion envDirty;
+    DirtyRegion appDirty;
+    bool partsDirty = false;
+    if(auto appBase = findBaseFrame(frameTextures, true, outputDisplayId)){
+        auto& frame = *appBase->frame;
+        auto mtlTexture = appBase->texture;
+        // for capture app, need to crop out the capture area, on the frame's display:
+        int appOnDisplayX = windowInfo.capturedAppX - (int)std::lround(displayOriginX * outputScale);
+        int appOnDisplayY = windowInfo.capturedAppY - (int)std::lround(displayOriginY * outputScale);
+        auto cropROI = calculateRectForWindowAtPosition(WindowSize(mtlTexture.width, mtlTexture.height),
+                                                        WindowSize(windowInfo.capturedAppWidth,
+                                                                   windowInfo.capturedAppHeight),
+                                                        WindowPoint(appOnDisplayX - frame.originX,
+                                                                    appOnDisplayY - frame.originY));
+        compositeDesc.appFrame = (void*)mtlTexture;
+        compositeDesc.appFrameDesc = {(int)mtlTexture.width, (int)mtlTexture.height, (int)mtlTexture.pixelFormat};
+        compositeDesc.appCrop = {cropROI.x, cropROI.y, cropROI.width, cropROI.height,
+                                 cropROI.compensateX, cropROI.compensateY};
+        compositeDesc.appCropWidth = windowInfo.capturedAppWidth;
+        compositeDesc.appCropHeight = windowInfo.capturedAppHeight;
+        compositeDesc.appParts = collectFrameParts(frameTextures, topology, getCapturedAppPoints(windowInfo), true,
+                                                   frame.displayId, outputScale,
+                                                   {0, 0, compositeDesc.appCropWidth, compositeDesc.appCropHeight},
+                                                   partsDirty);
+        appDirty = frame.dirtyRegion;
+    }
+    if(auto envBase = findBaseFrame(frameTextures, false, outputDisplayId)){
+        auto& frame = *envBase->frame;
+        auto mtlTexture = envBase->texture;
+        auto windowOnDisplay = pointsToPixels(windowPoints, displayOriginX, displayOriginY, outputScale);
+        compositeDesc.envFrame = (void*)mtlTexture;
+        compositeDesc.envFrameDesc = {(int)mtlTexture.width, (int)mtlTexture.height, (int)mtlTexture.pixelFormat};
+        compositeDesc.envCrop = {windowOnDisplay.x - frame.originX, windowOnDisplay.y - frame.originY,
+                                 compositeDesc.outputDesc.width, compositeDesc.outputDesc.height, 0, 0};
+        compositeDesc.envParts = collectFrameParts(frameTextures, topology, windowPoints, false, frame.displayId,
+                                                   outputScale,
+                                                   {0, 0, compositeDesc.outputDesc.width, compositeDesc.outputDesc.height},
+                                                   partsDirty);
+        envDirty = frame.dirtyRegion;
+    }
+    if(compositeDesc.outputDesc.width <= 0 || compositeDesc.outputDesc.height <= 0 ||
+       (compositeDesc.appFrame && (compositeDesc.appCropWidth <= 0 || compositeDesc.appCropHeight <= 0))){
+        m_displayPipelines[outputDisplayId].lastCompositeValid = false;
+        MtlTextureManager::getGlobalInstance().endFrame(renderPipelineRes.mtlCommandQueue, std::move(frameLeases));
+        return true;
+    }
+
+    // every display the window was on keeps its pipeline, the ones of displays that are gone go
+    for(auto pipelineIt = m_displayPipelines.begin(); pipelineIt != m_displayPipelines.end();){
+        if(pipelineIt->first != outputDisplayId && !topology.findDisplay(pipelineIt->first)){
+            pipelineIt = m_displayPipelines.erase(pipelineIt);
+        }else{
+            ++pipelineIt;
+        }
+    }
+    auto& pipeline = m_displayPipelines[outputDisplayId];
+    if(outputDisplayId != m_lastCompositeDisplayId){
+        // the present target holds what another display's pipeline drew
+        pipeline.lastCompositeValid = false;
+        m_lastCompositeDisplayId = outputDisplayId;
+    }
+
+    // the present target still shows the last composite: with the same scene only the tiles the changed pixels
+    // reach need drawing, and nothing at all when no change reaches the window. a changed part redraws in full.
+    if(pipeline.lastCompositeValid && !partsDirty && isSameHidingScene(compositeDesc, pipeline.lastCompositeDesc)){
+        markHidingOutputDirtyTiles(compositeDesc, envDirty, appDirty, pipeline.outputDirtyTiles);
+        if(pipeline.outputDirtyTiles.isEmpty()){
+            TRACE_INSTANT("compositeUnchanged");
+            MtlTextureManager::getGlobalInstance().endFrame(renderPipelineRes.mtlCommandQueue, std::move(frameLeases));
+            return true;
+        }
+        if(MetalPipeline::getGlobalInstance().hasComputePipelineState("highPassHideTiles")){
+            compositeDesc.outputDirtyTiles = &pipeline.outputDirtyTiles;
+        }
+    }
+
+    if(!pipeline.frameGraph){
+        pipeline.frameGraphBackend = std::make_unique<MetalFrameGraphBackend>(renderPipelineRes.mtlDeviceRef);
+        pipeline.frameGraph = std::make_unique<FrameGraph>(*pipeline.frameGraphBackend);
+    }
+    stageExecutor.setTriggerRendererName(triggerRendererName);
+
+    bool graphCompiled = false;
+    {
+        TRACE_SCOPE_ARG("buildFrameGraph", compositeDesc.envParts.size() + compositeDesc.appParts.size());
+        pipeline.frameGraph->reset();
+        buildHidingFrameGraph(*pipeline.frameGraph, compositeDesc, stageExecutor);
+        graphCompiled = pipeline.frameGraph->compile();
+    }
+    if(graphCompiled){
+        TRACE_SCOPE("executeFrameGraph");
+        pipeline.frameGraph->execute();
+    }
+    m_hideEffect = compositeDesc.hideEffect;
+    pipeline.lastCompositeDesc = compositeDesc;
+    pipeline.lastCompositeDesc.outputDirtyTiles = nullptr;
+    pipeline.lastCompositeValid = graphCompiled;
+    // the captured frames stay alive until the gpu is done reading them
+    MtlTextureManager::getGlobalInstance().endFrame(renderPipelineRes.mtlCommandQueue, std::move(frameLeases));
+    return true;
+}
+
+// composite jobs are "latest frame wins": a queued one is dropped as soon as a newer one is queued, or when it
+// could not start within a few frame intervals. on a full queue the producer evicts the oldest composite job, never
+// somebody else's.
+static TaskOptions compositeJobOptions(int frameIntervalInMilliSeconds) {
+    static const uint64_t compositeKey = TaskScheduler::coalesceKeyFor("compositeCapture");
+    TaskOptions options;
+    options.lane = TaskLane::Frame;
+    options.coalesceKey = compositeKey;
+    options.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(frameIntervalInMilliSeconds * 3);
+    options.dropOldestWhenFull = true;
+    return options;
+}
+
+// share of the frame that changed, for the governor
+static double frameChangeRatio(const CaptureFrameDesc& frame) {
+    if(!frame.lease){
+        return 0.0;
+    }
+    return frame.dirtyRegion.coverage(frame.lease->width, frame.lease->height);
+}
+
+// capture rate of a display our window and the app are not on
+static constexpr int kIdleDisplayFrameRate = 2;
+
+void CompositeCapture::updateFrameRate(double changeRatio, bool windowChanged, std::chrono::steady_clock::time_point now) {
+    // input anywhere (typing into the hidden app included) or our window being dragged
+    auto secondsSinceInput = std::min(getSecondsSinceLastInput(), 3600.0);
+    m_rateGovernor.reportInput(now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(secondsSinceInput)));
+    if(windowChanged){
+        m_rateGovernor.reportInput(now);
+    }
+    if(now >= m_nextPowerPoll){
+        auto powerStatus = getPowerStatus();
+        m_rateGovernor.setPowerState({powerStatus.onBattery, powerStatus.lowPowerMode,
+                                      powerStatus.thermalPressure, powerStatus.displayAsleep});
+        m_nextPowerPoll = now + std::chrono::seconds(1);
+    }
+    m_rateGovernor.reportChange(changeRatio);
+    auto frameRate = m_rateGovernor.update(now);
+
+    std::lock_guard<std::mutex> sourcesLock(m_sourcesMutex);
+    for(auto& sourceSlot : m_sourceSlots){
+        // the sources of displays nothing of ours is on only have to stay warm for when the window comes over
+        auto sourceFrameRate = sourceSlot->displayInUse ? frameRate : kIdleDisplayFrameRate;
+        if(sourceSlot->stats.frameRateLimit == sourceFrameRate){
+            continue;
+        }
+        TRACE_SCOPE_ARG("setFrameRateLimit", sourceFrameRate);
+        if(auto captureSource = sourceSlot->captureSource.lock()){
+            captureSource->setFrameRateLimit(sourceFrameRate);
+        }
+        sourceSlot->stats.frameRateLimit = sourceFrameRate;
+    }
+}
+
+// extra pixels around the needed rect, so dragging our window does not reconfigure the stream on every tick
+static constexpr int kCaptureRegionMargin = 128;
+
+void CompositeCapture::updateCaptureRegions(const RenderState& renderState, const DisplayTopology& topology) {
+    DirtyRect windowPoints{renderState.xPos, renderState.yPos, renderState.width, renderState.height};
+    auto appPoints = getCapturedAppPoints(renderState);
+
+    std::lock_guard<std::mutex> sourcesLock(m_sourcesMutex);
+    for(auto& sourceSlot : m_sourceSlots){
+        auto display = topology.findDisplay(sourceSlot->displayId);
+        if(!display){
+            sourceSlot->displayInUse = false;
+            continue;
+        }
+        // the display's share of the window / app, in that display's pixels
+        DirtyRect screenRect{0, 0, display->getPixelWidth(), display->getPixelHeight()};
+        auto neededPoints = (sourceSlot->isAppCapture ? appPoints : windowPoints).intersected(display->frame);
+        auto neededRect = pointsToPixels(neededPoints, display->frame.x, display->frame.y, display->scale)
+                .intersected(screenRect);
+        sourceSlot->displayInUse = !neededRect.empty();
+        if(neededRect.empty()){
+            continue;
+        }
+        // reissue when the needed rect left the region or the region got far bigger than it
+        auto& region = sourceSlot->captureRegion;
+        bool covers = !region.empty() && neededRect.intersected(region) == neededRect;
+        bool tooBig = !(region.intersected(neededRect.inflated(kCaptureRegionMargin * 2).intersected(screenRect)) == region);
+        if(covers && !tooBig){
+            continue;
+        }
+        region = neededRect.inflated(kCaptureRegionMargin).intersected(screenRect);
+        TRACE_SCOPE_ARG("setCaptureRegion", region.width * region.height);
+        if(auto captureSource = sourceSlot->captureSource.lock()){
+            captureSource->setCaptureRegion(region.x, region.y, region.width, region.height);
+        }
+    }
+}
+
+void CompositeCapture::compositeThreadFunc() {
+    Tracer::getInstance().setCurrentThreadName("compositePacing");
+    auto nextTick = std::chrono::steady_clock::now();
+    // versions the last composite showed, and the ones the governor / capture regions already reacted to: a tick
+    // that skips the composite must not count the same change again. a composite that was dropped or had nowhere to
+    // draw leaves the versions it was for, and the fresh frames, pending for the next tick.
+    uint64_t lastRenderStateVersion = 0;
+    uint64_t lastControlStateVersion = 0;
+    uint64_t lastTopologyVersion = 0;
+    uint64_t seenRenderStateVersion = 0;
+    uint64_t seenControlStateVersion = 0;
+    uint64_t seenTopologyVersion = 0;
+    bool compositePending = false;
+    std::vector<CaptureFrameDesc> frames;
+    while(!m_stopAllWork){
+        auto frameInterval = m_rateGovernor.getFrameInterval();
+        nextTick += frameInterval;
+        auto now = std::chrono::steady_clock::now();
+        if(nextTick < now){
+            // fell behind (slow composite, suspended machine), start a fresh cadence instead of bursting
+            nextTick = now + frameInterval;
+        }
+        std::this_thread::sleep_until(nextTick);
+        TRACE_SCOPE("compositeTick");
+
+        // newest frame of every source, a source that has nothing new keeps its previous frame
+        frames.clear();
+        bool anyFreshFrame = false;
+        bool everySourceDelivered = true;
+        double changeRatio = 0.0;
+        {
+            std::lock_guard<std::mutex> sourcesLock(m_sourcesMutex);
+            now = std::chrono::steady_clock::now();
+            for(auto& sourceSlot : m_sourceSlots){
+                if(sourceSlot->frameRing.consume()){
+                    auto sequence = sourceSlot->frameRing.frontSlot().sequence;
+                    sourceSlot->stats.framesOverwritten += sequence - sourceSlot->lastConsumedSequence - 1;
+                    sourceSlot->stats.framesComposited++;
+                    sourceSlot->lastConsumedSequence = sequence;
+                    sourceSlot->consumedSequence.store(sequence, std::memory_order_release);
+                    sourceSlot->pendingDirty.add(sourceSlot->frameRing.frontSlot().dirtyRegion);
+                    // what changes on a display we are not on is nothing to show
+                    if(sourceSlot->displayInUse){
+                        changeRatio = std::max(changeRatio, frameChangeRatio(sourceSlot->frameRing.frontSlot()));
+                        anyFreshFrame = true;
                     }
                 }
+                auto& frame = sourceSlot->frameRing.frontSlot();
+                if(!frame.lease){
+                    everySourceDelivered = false;
+                    continue;
+                }
+                sourceSlot->stats.staleness =
+                        std::chrono::duration_cast<std::chrono::microseconds>(now - frame.captureTime);
+                frames.push_back(frame);
+                frames.back().dirtyRegion = sourceSlot->pendingDirty;
             }
-            m_captureFrameSet.clear();
-            m_framesSetMutex.unlock();
-        });
+        }
+        auto renderStateVersion = NotificationCenter::getInstance().renderState().version();
+        auto controlStateVersion = NotificationCenter::getInstance().controlState().version();
+        auto topologyVersion = NotificationCenter::getInstance().displayTopology().version();
+        if(renderStateVersion != seenRenderStateVersion || topologyVersion != seenTopologyVersion){
+            auto renderState = NotificationCenter::getInstance().renderState().load();
+            updateCaptureRegions(renderState, getEffectiveTopology(renderState));
+        }
+        bool stateChangedSinceTick = renderStateVersion != seenRenderStateVersion ||
+                                     controlStateVersion != seenControlStateVersion || topologyVersion != seenTopologyVersion;
+        seenRenderStateVersion = renderStateVersion;
+        seenControlStateVersion = controlStateVersion;
+        seenTopologyVersion = topologyVersion;
+        updateFrameRate(changeRatio, stateChangedSinceTick, now);
+        bool stateChanged = renderStateVersion != lastRenderStateVersion || controlStateVersion != lastControlStateVersion ||
+                            topologyVersion != lastTopologyVersion;
+        if(frames.empty() || !everySourceDelivered || (int)frames.size() < reqCompositeNum){
+            continue;
+        }
+
+        // nothing new to show unless the window moved / resized or the hide toggle flipped
+        if(!anyFreshFrame && !stateChanged && !compositePending){
+            continue;
+        }
+
+        TRACE_SCOPE_ARG("waitComposite", frames.size());
+        bool composited = false;
+        auto execFuture = MetalPipeline::getGlobalInstance().sendJobToRenderQueue(
+                [this, frames, &composited](const std::string& threadName, const MtlRenderPipeline& renderPipelineRes){
+            composited = compositeFrames(renderPipelineRes, frames);
+        }, compositeJobOptions(frameIntervalInMilliSeconds));
+        // one composite in flight at a time, the frame graph lives on the render queue
         if(execFuture.valid()){
-            execFuture.get();
+            try{
+                execFuture.get();
+            }catch(const TaskDroppedError&){
+                // never ran, composited stays false
+            }
+        }
+        compositePending = !composited;
+        if(!composited){
+            continue;
+        }
+        lastRenderStateVersion = renderStateVersion;
+        lastControlStateVersion = controlStateVersion;
+        lastTopologyVersion = topologyVersion;
+        std::lock_guard<std::mutex> sourcesLock(m_sourcesMutex);
+        for(auto& sourceSlot : m_sourceSlots){
+            sourceSlot->pendingDirty.clear();
         }
     }
 }
@@ -304,71 +704,3 @@ void CompositeCapture::cleanUp() {
         m_compositeThread.join();
     }
 }
-
-int CompositeCapture::putFrameAndCompositeIfMeet(int order, const CaptureFrameDesc& captureFrameDesc) {
-    std::unique_lock<std::mutex> frameSetLock(m_framesSetMutex);
-    m_captureFrameSet.insert({order, captureFrameDesc});
-    if(!m_stopAllWork && m_captureFrameSet.size() == reqCompositeNum){
-        auto execFuture = MetalPipeline::getGlobalInstance().sendJobToRenderQueue(
-                [&](const std::string& threadName, const MtlRenderPipeline& renderPipelineRes){
-                    Message windowMsg;
-                    auto windowMsgResult = NotificationCenter::getInstance().getPersistentMessage(MessageType::Render, windowMsg);
-                    auto windowInfo = (WindowSubMsg*)windowMsg.subMsg.get();
-                    void* lastTexId = nullptr;
-
-                    for(auto& it : m_captureFrameSet){
-                        // will finally match the result size of the result to the window size:
-                        auto texIdMtl = (id<MTLTexture>)it.second.texId;
-                        if(it.second.opsToBePerformBeforeComposition){
-                            texIdMtl = (id<MTLTexture>)it.second.opsToBePerformBeforeComposition(texIdMtl);
-                        }
-                        if(lastTexId){
-                            // apply high pass:
-                            REQUEST_TEXTURE(windowInfo->width * windowInfo->scalingFactor,
-                                            windowInfo->height * windowInfo->scalingFactor, texIdMtl.pixelFormat, renderPipelineRes.mtlDeviceRef);
-                            MtlProcessMisc::getGlobalInstance().encodeGaussianProcessIntoPipeline((void*)texIdMtl,
-                                                                                                  retTexture,
-                                                                                                  renderPipelineRes.mtlCommandQueue);
-                            REQUEST_TEXTURE_ANOTHER(windowInfo->width * windowInfo->scalingFactor,
-                                                    windowInfo->height * windowInfo->scalingFactor,
-                                                    texIdMtl.pixelFormat, renderPipelineRes.mtlDeviceRef);
-                            MtlProcessMisc::getGlobalInstance().encodeSubtractProcessIntoPipeline((void*)texIdMtl,
-                                                                                                  retTexture,
-                                                                                                  retTextureAnother,
-                                                                                                  renderPipelineRes.mtlCommandQueue);
-
-                            // apply hiding filter:
-                            std::vector<void*> inputTextures;
-                            inputTextures.push_back(lastTexId);
-                            inputTextures.push_back(retTextureAnother);
-                            // since it renders to the final render target, so we need not to do anything then.
-                            auto renderTarget = MetalPipeline::getGlobalInstance().
-                                    throughRenderingPipelineState("hidingShader", inputTextures, it.second.captureEventName);
-                        }else{
-                            if (reqCompositeNum == 1){
-                                // if only there's only one frame, we just render the texture to the scene
-                                std::vector<void*> inputTextures;
-                                inputTextures.push_back(texIdMtl);
-                                auto renderTarget = MetalPipeline::getGlobalInstance().
-                                        throughRenderingPipelineState("basicRenderShader", inputTextures, it.second.captureEventName);
-                            }else{
-                                lastTexId = (void*)texIdMtl;
-                            }
-                        }
-                    }
-                });
-        if(execFuture.valid()){
-            execFuture.get();
-        }
-        m_captureFrameSet.clear();
-        m_compositeCondVar.notify_all();
-        return 0;
-    }else{
-        return -1;
-    }
-}
-
-void CompositeCapture::waitForCompositeDone() {
-    std::unique_lock<std::mutex> compositeLock(m_framesSetMutex);
-    m_compositeCondVar.wait(compositeLock);
-}
@@ -0,0 +1,33 @@
+#ifndef HIDINGIN_CAPTURESOURCE_H
+#define HIDINGIN_CAPTURESOURCE_H
+
+#include <optional>
+#include "CaptureStuff.h"
+
+// what CompositeCapture drives: something that, once started, triggers EventChannel<CaptureFrameEvent> with
+// args->captureEventName for every frame. MacOSCaptureSCKit is the real one, SyntheticCaptureSource and
+// ReplayCaptureSource run anywhere (ci, benchmarks, recorded sessions).
+class CaptureSource {
+public:
+    virtual ~CaptureSource() = default;
+
+    // whole desktop
+    virtual bool startCapture(std::optional<CaptureArgs> args = std::nullopt) = 0;
+
+    // the window(s) in args->includingWindowIDs, publishes the captured window rect into the render state
+    virtual bool startCaptureWithSpecificWinId(std::optional<CaptureArgs> args) = 0;
+
+    virtual void stopCapture() = 0;
+
+    virtual CaptureStatus getCaptureStatus() = 0;
+
+    // at most that many frames a second from now on, the frame rate governor lowers it while nothing moves. 0 lifts it.
+    virtual void setFrameRateLimit(int) {}
+
+    // only capture this rect (x, y, width, height) of the display (its pixels, 0, 0 its top left), the frames then
+    // carry its origin. an empty rect captures the whole display again. sources that cannot do it keep sending whole
+    // frames with origin 0, 0.
+    virtual void setCaptureRegion(int, int, int, int) {}
+};
+
+#endif //HIDINGIN_CAPTURESOURCE_H
@@ -0,0 +1,12 @@
+#include "CaptureState.h"
+#include "../../com/NotificationCenter.h"
+
+VersionedState<RenderState>& NotificationCenter::renderState() {
+    static VersionedState<RenderState> s_renderState;
+    return s_renderState;
+}
+
+VersionedState<ControlState>& NotificationCenter::controlState() {
+    static VersionedState<ControlState> s_controlState;
+    return s_controlState;
+}
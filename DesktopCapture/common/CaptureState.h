@@ -0,0 +1,69 @@
+#ifndef HIDINGIN_CAPTURESTATE_H
+#define HIDINGIN_CAPTURESTATE_H
+
+#include <cmath>
+#include <cstdint>
+#include "DisplayTopology.h"
+#include "../../GPUPipeline/HideEffect.h"
+
+// what the composite follows, published through NotificationCenter::controlState() / renderState(). the platform
+// and the ui write them, the capture side reads a snapshot per frame.
+struct ControlState {
+    bool couldControlApp = true;
+    bool showAppContent = true;
+    // the composite switches to a change once it is baked (selectHideEffect) and redraws in full then
+    HideEffectSettings hideEffect;
+};
+
+struct RenderState {
+    // overlay window, in points
+    int xPos = 0;
+    int yPos = 0;
+    int width = 0;
+    int height = 0;
+    int visibleRectX = 0;
+    int visibleRectY = 0;
+    int visibleRectWidth = 0;
+    int visibleRectHeight = 0;
+    // the display most of the overlay window is on (followWindowDisplay), the composite runs at its scale
+    uint32_t displayId = 0;
+    int screenWidthInPixels = 0;
+    int screenHeightInPixels = 0;
+    // captured app window, in pixels: global points times scalingFactor
+    int capturedAppX = 0;
+    int capturedAppY = 0;
+    int capturedAppWidth = 0;
+    int capturedAppHeight = 0;
+    int capturedWinId = 0;
+    int appPid = 0;
+    float scalingFactor = 1.0f;
+};
+
+// moves state over to the display most of the overlay window is on: displayId, the screen size and scalingFactor
+// become that display's, the captured app rect is rescaled along. true when any of them changed.
+inline bool followWindowDisplay(RenderState& state, const DisplayTopology& topology) {
+    auto display = topology.primaryDisplayFor(DirtyRect{state.xPos, state.yPos, state.width, state.height});
+    if (!display) {
+        return false;
+    }
+    int screenWidth = display->getPixelWidth();
+    int screenHeight = display->getPixelHeight();
+    if (display->displayId == state.displayId && display->scale == state.scalingFactor &&
+        screenWidth == state.screenWidthInPixels && screenHeight == state.screenHeightInPixels) {
+        return false;
+    }
+    if (display->scale != state.scalingFactor && state.scalingFactor > 0.0f) {
+        float rescale = display->scale / state.scalingFactor;
+        state.capturedAppX = (int)std::lround(state.capturedAppX * rescale);
+        state.capturedAppY = (int)std::lround(state.capturedAppY * rescale);
+        state.capturedAppWidth = (int)std::lround(state.capturedAppWidth * rescale);
+        state.capturedAppHeight = (int)std::lround(state.capturedAppHeight * rescale);
+    }
+    state.displayId = display->displayId;
+    state.scalingFactor = display->scale;
+    state.screenWidthInPixels = screenWidth;
+    state.screenHeightInPixels = screenHeight;
+    return true;
+}
+
+#endif //HIDINGIN_CAPTURESTATE_H
@@ -4,8 +4,13 @@
 
 #ifndef HIDINGIN_CAPTURESTUFF_H
 #define HIDINGIN_CAPTURESTUFF_H
+#include <cstdint>
 #include <vector>
+#include <memory>
+#include <functional>
 #include "string"
+#include "../../GPUPipeline/DirtyRegion.h"
+#include "../../utils/FrameLease.h"
 enum class CaptureStatus{
     NotStart,
     Start,
@@ -18,7 +23,23 @@ struct CaptureArgs{
     std::vector<int> excludingWindowIDs; // -1 means itself.
     std::vector<std::string> excludingAppNames;
     std::vector<int> includingWindowIDs; // for app capture
+    uint32_t displayId = 0;              // display to capture (DisplayTopology), 0 for the main one
 };
+class CaptureSource;
 struct CompositeCaptureArgs{
+    // makes the source behind every add*Capture() call, the platform capture when not set.
+    // e.g. SyntheticCaptureSource / ReplayCaptureSource to run without screen recording permission
+    std::function<std::shared_ptr<CaptureSource>(bool isAppCapture)> captureSourceFactory;
+};
+
+// payload of the per frame capture events (EventChannel<CaptureFrameEvent>), keyed by CaptureArgs::captureEventName
+struct CaptureFrameEvent{
+    // the captured pixels, whoever holds a copy of the lease may read them
+    FrameLease lease;
+    // pixels that changed since the previous frame of this source, everything when the source cannot tell
+    DirtyRegion dirtyRegion;
+    // top left of the frame on its display in the display's pixels, not 0 when the source only captures a region
+    int originX = 0;
+    int originY = 0;
 };
 #endif //HIDINGIN_CAPTURESTUFF_H
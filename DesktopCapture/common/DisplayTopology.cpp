@@ -0,0 +1,120 @@
+#include "DisplayTopology.h"
+#include "../../com/NotificationCenter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+int DisplayInfo::getPixelWidth() const {
+    return (int)std::lround(frame.width * scale);
+}
+
+int DisplayInfo::getPixelHeight() const {
+    return (int)std::lround(frame.height * scale);
+}
+
+DirtyRect pointsToPixels(const DirtyRect& points, int originX, int originY, float scale) {
+    if (points.empty()) {
+        return {};
+    }
+    int left = (int)std::lround((points.x - originX) * (double)scale);
+    int top = (int)std::lround((points.y - originY) * (double)scale);
+    int right = (int)std::lround((points.x + points.width - originX) * (double)scale);
+    int bottom = (int)std::lround((points.y + points.height - originY) * (double)scale);
+    return {left, top, right - left, bottom - top};
+}
+
+bool DisplayTopology::addDisplay(const DisplayInfo& display) {
+    if (displayCount >= kMaxDisplays || findDisplay(display.displayId)) {
+        return false;
+    }
+    displays[displayCount++] = display;
+    return true;
+}
+
+const DisplayInfo* DisplayTopology::findDisplay(uint32_t displayId) const {
+    for (int i = 0; i < displayCount; i++) {
+        if (displays[i].displayId == displayId) {
+            return &displays[i];
+        }
+    }
+    return nullptr;
+}
+
+const DisplayInfo* DisplayTopology::displayAt(int x, int y) const {
+    for (int i = 0; i < displayCount; i++) {
+        auto& frame = displays[i].frame;
+        if (x >= frame.x && x < frame.x + frame.width && y >= frame.y && y < frame.y + frame.height) {
+            return &displays[i];
+        }
+    }
+    return nullptr;
+}
+
+const DisplayInfo* DisplayTopology::primaryDisplayFor(const DirtyRect& rect) const {
+    const DisplayInfo* primary = nullptr;
+    int64_t primaryArea = 0;
+    for (int i = 0; i < displayCount; i++) {
+        auto overlap = rect.intersected(displays[i].frame);
+        auto area = (int64_t)overlap.width * overlap.height;
+        if (area > primaryArea) {
+            primary = &displays[i];
+            primaryArea = area;
+        }
+    }
+    if (primary) {
+        return primary;
+    }
+
+    // off every display (or empty): squared distance from the center to each frame
+    int64_t centerX = rect.x + rect.width / 2;
+    int64_t centerY = rect.y + rect.height / 2;
+    int64_t primaryDistance = INT64_MAX;
+    for (int i = 0; i < displayCount; i++) {
+        auto& frame = displays[i].frame;
+        int64_t dx = centerX < frame.x ? frame.x - centerX : std::max<int64_t>(0, centerX - (frame.x + frame.width - 1));
+        int64_t dy = centerY < frame.y ? frame.y - centerY : std::max<int64_t>(0, centerY - (frame.y + frame.height - 1));
+        if (dx * dx + dy * dy < primaryDistance) {
+            primary = &displays[i];
+            primaryDistance = dx * dx + dy * dy;
+        }
+    }
+    return primary;
+}
+
+std::vector<DisplayRectPart> DisplayTopology::splitRect(const DirtyRect& rect) const {
+    std::vector<DisplayRectPart> parts;
+    for (int i = 0; i < displayCount; i++) {
+        auto& display = displays[i];
+        auto points = rect.intersected(display.frame);
+        if (points.empty()) {
+            continue;
+        }
+        DisplayRectPart part;
+        part.displayId = display.displayId;
+        part.scale = display.scale;
+        part.points = points;
+        part.pixels = pointsToPixels(points, display.frame.x, display.frame.y, display.scale);
+        parts.push_back(part);
+    }
+    return parts;
+}
+
+bool DisplayTopology::operator==(const DisplayTopology& other) const {
+    if (displayCount != other.displayCount) {
+        return false;
+    }
+    for (int i = 0; i < displayCount; i++) {
+        auto& display = displays[i];
+        auto& otherDisplay = other.displays[i];
+        if (display.displayId != otherDisplay.displayId || !(display.frame == otherDisplay.frame) ||
+            display.scale != otherDisplay.scale) {
+            return false;
+        }
+    }
+    return true;
+}
+
+VersionedState<DisplayTopology>& NotificationCenter::displayTopology() {
+    static VersionedState<DisplayTopology> s_displayTopology;
+    return s_displayTopology;
+}
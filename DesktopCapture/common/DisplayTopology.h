@@ -0,0 +1,55 @@
+#ifndef HIDINGIN_DISPLAYTOPOLOGY_H
+#define HIDINGIN_DISPLAYTOPOLOGY_H
+
+#include <cstdint>
+#include <vector>
+#include "../../GPUPipeline/DirtyRegion.h"
+
+// one display of the desktop. frame is in global points with the top left origin CGDisplayBounds and the window
+// list use: the main display sits at 0, 0 and the others around it, at negative coordinates too.
+struct DisplayInfo {
+    uint32_t displayId = 0; // CGDirectDisplayID on macOS
+    DirtyRect frame;
+    float scale = 1.0f;     // pixels per point, 2 on a retina panel
+
+    int getPixelWidth() const;
+    int getPixelHeight() const;
+};
+
+// the piece of a global rect that lies on one display
+struct DisplayRectPart {
+    uint32_t displayId = 0;
+    float scale = 1.0f;
+    DirtyRect points;  // global points, inside the display's frame
+    DirtyRect pixels;  // the same piece in the display's own pixels, 0, 0 is its top left
+};
+
+constexpr int kMaxDisplays = 8;
+
+// a point rect in pixels of a surface whose top left sits at originX, originY (points) and that has scale pixels
+// per point. both edges are rounded on their own, so rects that touch in points touch in pixels too.
+DirtyRect pointsToPixels(const DirtyRect& points, int originX, int originY, float scale);
+
+// the displays and where they sit. a plain value: it goes through a VersionedState (NotificationCenter::
+// displayTopology) and benchmarks / replays can lay out displays by hand.
+struct DisplayTopology {
+    int displayCount = 0;
+    DisplayInfo displays[kMaxDisplays];
+
+    // false when the id is taken or there are kMaxDisplays already
+    bool addDisplay(const DisplayInfo& display);
+
+    const DisplayInfo* findDisplay(uint32_t displayId) const;
+    // the display showing the point, null between / outside the displays
+    const DisplayInfo* displayAt(int x, int y) const;
+    // the display holding the biggest piece of rect, the first one on a tie. a rect on no display goes to the one
+    // nearest to its center, null only without displays.
+    const DisplayInfo* primaryDisplayFor(const DirtyRect& rect) const;
+
+    // rect cut along the display edges in display order, what lies on no display is dropped
+    std::vector<DisplayRectPart> splitRect(const DirtyRect& rect) const;
+
+    bool operator==(const DisplayTopology& other) const;
+};
+
+#endif //HIDINGIN_DISPLAYTOPOLOGY_H
@@ -0,0 +1,173 @@
+#include "ReplayCaptureSource.h"
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char kDumpMagic[8] = {'H', 'I', 'D', 'D', 'U', 'M', 'P', '1'};
+
+CaptureDumpWriter::~CaptureDumpWriter() {
+    close();
+}
+
+bool CaptureDumpWriter::open(const std::string& path, int width, int height, int fps,
+                             int windowX, int windowY, int windowWidth, int windowHeight) {
+    close();
+    if (width <= 0 || height <= 0 || fps <= 0) {
+        std::cerr << "invalid dump size or fps" << std::endl;
+        return false;
+    }
+    m_file = std::fopen(path.c_str(), "wb");
+    if (!m_file) {
+        std::cerr << "failed to create capture dump: " << path << std::endl;
+        return false;
+    }
+    m_header = {};
+    std::memcpy(m_header.magic, kDumpMagic, sizeof(kDumpMagic));
+    m_header.width = width;
+    m_header.height = height;
+    m_header.bytesPerRow = width * 4;
+    m_header.fps = fps;
+    m_header.windowX = windowX;
+    m_header.windowY = windowY;
+    m_header.windowWidth = windowWidth;
+    m_header.windowHeight = windowHeight;
+    // frameCount is patched in by close()
+    return std::fwrite(&m_header, sizeof(m_header), 1, m_file) == 1;
+}
+
+bool CaptureDumpWriter::appendFrame(const CpuImageView& frame) {
+    if (!m_file) {
+        return false;
+    }
+    if (frame.width != (int)m_header.width || frame.height != (int)m_header.height) {
+        std::cerr << "dump frame size mismatch" << std::endl;
+        return false;
+    }
+    for (int y = 0; y < frame.height; y++) {
+        if (std::fwrite(frame.row(y), m_header.bytesPerRow, 1, m_file) != 1) {
+            std::cerr << "failed to write dump frame" << std::endl;
+            return false;
+        }
+    }
+    m_header.frameCount++;
+    return true;
+}
+
+bool CaptureDumpWriter::close() {
+    if (!m_file) {
+        return true;
+    }
+    bool ok = std::fseek(m_file, 0, SEEK_SET) == 0 &&
+              std::fwrite(&m_header, sizeof(m_header), 1, m_file) == 1;
+    ok = std::fclose(m_file) == 0 && ok;
+    m_file = nullptr;
+    return ok;
+}
+
+ReplayCaptureSource::ReplayCaptureSource(const std::string& path, bool loop, int fpsOverride)
+    : m_loop(loop), m_fpsOverride(fpsOverride) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "failed to open capture dump: " << path << std::endl;
+        return;
+    }
+    struct stat fileStat{};
+    if (fstat(fd, &fileStat) != 0 || (size_t)fileStat.st_size < sizeof(CaptureDumpHeader)) {
+        std::cerr << "capture dump too small: " << path << std::endl;
+        ::close(fd);
+        return;
+    }
+    auto fileSize = (size_t)fileStat.st_size;
+    void* mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "failed to map capture dump: " << path << std::endl;
+        return;
+    }
+    std::shared_ptr<void> mapping(mapped, [fileSize](void* address) {
+        munmap(address, fileSize);
+    });
+
+    std::memcpy(&m_header, mapped, sizeof(m_header));
+    size_t frameBytes = (size_t)m_header.height * m_header.bytesPerRow;
+    if (std::memcmp(m_header.magic, kDumpMagic, sizeof(kDumpMagic)) != 0 || m_header.width == 0 ||
+        m_header.height == 0 || m_header.bytesPerRow < m_header.width * 4) {
+        std::cerr << "not a capture dump: " << path << std::endl;
+        return;
+    }
+    // a recording that was cut short (no close()) still plays what made it to disk
+    auto framesOnDisk = (uint32_t)((fileSize - sizeof(m_header)) / frameBytes);
+    if (m_header.frameCount == 0 || m_header.frameCount > framesOnDisk) {
+        m_header.frameCount = framesOnDisk;
+    }
+    if (m_header.frameCount == 0) {
+        std::cerr << "capture dump has no frames: " << path << std::endl;
+        return;
+    }
+    // played front to back, let the kernel read ahead
+    madvise(mapped, fileSize, MADV_SEQUENTIAL);
+
+    m_frames = (const uint8_t*)mapped + sizeof(m_header);
+    m_mapping = std::move(mapping);
+}
+
+ReplayCaptureSource::~ReplayCaptureSource() {
+    stopCapture();
+}
+
+bool ReplayCaptureSource::startCapture(std::optional<CaptureArgs> args) {
+    if (!isOpen()) {
+        std::cerr << "no capture dump to replay" << std::endl;
+        return false;
+    }
+    return ThreadedCaptureSource::startCapture(std::move(args));
+}
+
+bool ReplayCaptureSource::startCaptureWithSpecificWinId(std::optional<CaptureArgs> args) {
+    if (!isOpen()) {
+        std::cerr << "no capture dump to replay" << std::endl;
+        return false;
+    }
+    return ThreadedCaptureSource::startCaptureWithSpecificWinId(std::move(args));
+}
+
+bool ReplayCaptureSource::produceFrame(uint64_t frameIndex, FrameLeaseSlot& frame) {
+    auto index = frameIndex % m_header.frameCount;
+    frame.backing = m_mapping;
+    CpuImageView view;
+    view.data = const_cast<uint8_t*>(m_frames + index * m_header.height * m_header.bytesPerRow);
+    view.width = (int)m_header.width;
+    view.height = (int)m_header.height;
+    view.bytesPerRow = (int)m_header.bytesPerRow;
+    frame.setCpuView(view);
+    return true;
+}
+
+int ReplayCaptureSource::getFps() const {
+    if (m_fpsOverride > 0) {
+        return m_fpsOverride;
+    }
+    return m_header.fps > 0 ? (int)m_header.fps : 60;
+}
+
+void ReplayCaptureSource::getWindowRect(int& x, int& y, int& width, int& height) const {
+    if (m_header.windowWidth > 0 && m_header.windowHeight > 0) {
+        x = m_header.windowX;
+        y = m_header.windowY;
+        width = m_header.windowWidth;
+        height = m_header.windowHeight;
+        return;
+    }
+    width = (int)m_header.width / 2;
+    height = (int)m_header.height / 2;
+    x = ((int)m_header.width - width) / 2;
+    y = ((int)m_header.height - height) / 2;
+}
+
+bool ReplayCaptureSource::hasMoreFrames(uint64_t frameIndex) const {
+    return m_loop || frameIndex < m_header.frameCount;
+}
@@ -0,0 +1,79 @@
+#ifndef HIDINGIN_REPLAYCAPTURESOURCE_H
+#define HIDINGIN_REPLAYCAPTURESOURCE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "ThreadedCaptureSource.h"
+
+// raw capture dump: this header, then frameCount frames of height * bytesPerRow BGRA8 bytes each, back to back.
+// the 64 byte header keeps every row 16 byte aligned inside the mapping.
+struct CaptureDumpHeader {
+    char magic[8];          // "HIDDUMP1"
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerRow;
+    uint32_t frameCount;
+    uint32_t fps;
+    int32_t windowX;        // captured window rect for window mode, zero size if none was recorded
+    int32_t windowY;
+    int32_t windowWidth;
+    int32_t windowHeight;
+    uint32_t reserved[5];
+};
+static_assert(sizeof(CaptureDumpHeader) == 64, "dump header layout is part of the file format");
+
+// records frames into a dump for ReplayCaptureSource, e.g. from a capture listener
+class CaptureDumpWriter {
+public:
+    ~CaptureDumpWriter();
+
+    bool open(const std::string& path, int width, int height, int fps,
+              int windowX = 0, int windowY = 0, int windowWidth = 0, int windowHeight = 0);
+    bool appendFrame(const CpuImageView& frame);
+    // writes the final frame count, called by the destructor too
+    bool close();
+
+    uint32_t getFrameCount() const {
+        return m_header.frameCount;
+    }
+
+private:
+    FILE* m_file = nullptr;
+    CaptureDumpHeader m_header{};
+};
+
+// plays a dump back at its recorded rate (or fpsOverride). the file is mapped, frames point straight into the
+// mapping so nothing is copied on the way to the compositor.
+class ReplayCaptureSource : public ThreadedCaptureSource {
+public:
+    explicit ReplayCaptureSource(const std::string& path, bool loop = true, int fpsOverride = 0);
+    ~ReplayCaptureSource() override;
+
+    // false when the file was missing or not a dump, starting then fails
+    bool isOpen() const {
+        return m_mapping != nullptr;
+    }
+
+    int getWidth() const { return (int)m_header.width; }
+    int getHeight() const { return (int)m_header.height; }
+    uint32_t getFrameCount() const { return m_header.frameCount; }
+
+    bool startCapture(std::optional<CaptureArgs> args = std::nullopt) override;
+    bool startCaptureWithSpecificWinId(std::optional<CaptureArgs> args) override;
+
+protected:
+    bool produceFrame(uint64_t frameIndex, FrameLeaseSlot& frame) override;
+    int getFps() const override;
+    void getWindowRect(int& x, int& y, int& width, int& height) const override;
+    bool hasMoreFrames(uint64_t frameIndex) const override;
+
+private:
+    CaptureDumpHeader m_header{};
+    std::shared_ptr<void> m_mapping;  // unmapped once the last frame referencing it is gone
+    const uint8_t* m_frames = nullptr;
+    bool m_loop;
+    int m_fpsOverride;
+};
+
+#endif //HIDINGIN_REPLAYCAPTURESOURCE_H
@@ -0,0 +1,147 @@
+#include "SyntheticCaptureSource.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// 5x7 glyphs for the frame counter, one byte per row, bit 4 is the leftmost column
+struct SyntheticGlyph {
+    char character;
+    uint8_t rows[7];
+};
+
+static const SyntheticGlyph kGlyphs[] = {
+    {'0', {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}},
+    {'1', {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}},
+    {'2', {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}},
+    {'3', {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}},
+    {'4', {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}},
+    {'5', {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}},
+    {'6', {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}},
+    {'7', {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}},
+    {'8', {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}},
+    {'9', {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}},
+    {'F', {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10}},
+    {'R', {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11}},
+    {'A', {0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}},
+    {'M', {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11}},
+    {'E', {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}},
+};
+
+static const uint8_t* findGlyph(char character) {
+    for (auto& glyph : kGlyphs) {
+        if (glyph.character == character) {
+            return glyph.rows;
+        }
+    }
+    return nullptr; // space
+}
+
+SyntheticFrameGenerator::SyntheticFrameGenerator(const SyntheticCaptureConfig& config) : m_config(config) {
+    // xorshift32, a fixed seed keeps runs comparable
+    uint32_t state = config.seed ? config.seed : 1;
+    m_noiseTile.resize(kNoiseTileSize * kNoiseTileSize);
+    for (auto& value : m_noiseTile) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        value = (uint8_t)(state >> 24);
+    }
+}
+
+void SyntheticFrameGenerator::generate(uint64_t frameIndex, const CpuImageView& output) const {
+    auto t = (int)(frameIndex & 0xffff);
+    int noiseDx = (int)(frameIndex * 3) & (kNoiseTileSize - 1);
+    int noiseDy = (int)(frameIndex * 2) & (kNoiseTileSize - 1);
+    int width = std::max(output.width, 1);
+    int height = std::max(output.height, 1);
+    for (int y = 0; y < output.height; y++) {
+        uint8_t* row = output.row(y);
+        const uint8_t* noiseRow = m_noiseTile.data() + ((y + noiseDy) & (kNoiseTileSize - 1)) * kNoiseTileSize;
+        int green = y * 255 / height + t / 2;
+        for (int x = 0; x < output.width; x++) {
+            int grain = m_config.noise ? (noiseRow[(x + noiseDx) & (kNoiseTileSize - 1)] - 128) / 4 : 0;
+            int blue = x * 255 / width + t;
+            int red = (x + y) / 4 + t * 3;
+            row[x * 4 + 0] = (uint8_t)std::clamp((blue & 255) + grain, 0, 255);
+            row[x * 4 + 1] = (uint8_t)std::clamp((green & 255) + grain, 0, 255);
+            row[x * 4 + 2] = (uint8_t)std::clamp((red & 255) + grain, 0, 255);
+            row[x * 4 + 3] = 255;
+        }
+    }
+    if (m_config.movingText) {
+        drawText(frameIndex, output);
+    }
+}
+
+void SyntheticFrameGenerator::drawText(uint64_t frameIndex, const CpuImageView& output) const {
+    char text[32];
+    std::snprintf(text, sizeof(text), "FRAME %06llu", (unsigned long long)(frameIndex % 1000000));
+    int textLength = (int)std::strlen(text);
+    int scale = std::max(2, output.height / 135);
+    int textWidth = textLength * 6 * scale;
+    int textHeight = 7 * scale;
+
+    // slides left to right and wraps, bobbing up and down a bit
+    int originX = (int)((frameIndex * 7) % (uint64_t)(output.width + textWidth)) - textWidth;
+    int bob = std::max(1, output.height / 4);
+    int originY = output.height / 2 + (int)((frameIndex * 3) % (uint64_t)bob) - textHeight;
+
+    for (int c = 0; c < textLength; c++) {
+        auto glyphRows = findGlyph(text[c]);
+        if (!glyphRows) {
+            continue;
+        }
+        int glyphX = originX + c * 6 * scale;
+        for (int gy = 0; gy < 7; gy++) {
+            for (int gx = 0; gx < 5; gx++) {
+                if (!(glyphRows[gy] & (0x10 >> gx))) {
+                    continue;
+                }
+                int left = std::max(glyphX + gx * scale, 0);
+                int right = std::min(glyphX + (gx + 1) * scale, output.width);
+                int top = std::max(originY + gy * scale, 0);
+                int bottom = std::min(originY + (gy + 1) * scale, output.height);
+                for (int y = top; y < bottom; y++) {
+                    if (right > left) {
+                        std::memset(output.row(y) + left * 4, 255, (size_t)(right - left) * 4);
+                    }
+                }
+            }
+        }
+    }
+}
+
+SyntheticCaptureSource::SyntheticCaptureSource(const SyntheticCaptureConfig& config)
+    : m_config(config), m_generator(config) {
+}
+
+SyntheticCaptureSource::~SyntheticCaptureSource() {
+    stopCapture();
+}
+
+bool SyntheticCaptureSource::produceFrame(uint64_t frameIndex, FrameLeaseSlot& frame) {
+    if (frame.image.width() != m_config.width || frame.image.height() != m_config.height) {
+        frame.image.resize(m_config.width, m_config.height);
+    }
+    frame.setCpuView(frame.image.view());
+    m_generator.generate(frameIndex, frame.cpuView());
+    return true;
+}
+
+int SyntheticCaptureSource::getFps() const {
+    return m_config.fps;
+}
+
+void SyntheticCaptureSource::getWindowRect(int& x, int& y, int& width, int& height) const {
+    if (m_config.windowWidth > 0 && m_config.windowHeight > 0) {
+        x = m_config.windowX;
+        y = m_config.windowY;
+        width = m_config.windowWidth;
+        height = m_config.windowHeight;
+        return;
+    }
+    width = m_config.width / 2;
+    height = m_config.height / 2;
+    x = (m_config.width - width) / 2;
+    y = (m_config.height - height) / 2;
+}
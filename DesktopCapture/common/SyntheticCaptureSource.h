@@ -0,0 +1,53 @@
+#ifndef HIDINGIN_SYNTHETICCAPTURESOURCE_H
+#define HIDINGIN_SYNTHETICCAPTURESOURCE_H
+
+#include <cstdint>
+#include <vector>
+#include "ThreadedCaptureSource.h"
+
+struct SyntheticCaptureConfig {
+    int width = 1920;
+    int height = 1080;
+    int fps = 60;
+    uint32_t seed = 1;
+    bool noise = true;        // drifting grain over a moving gradient, like a video playing
+    bool movingText = true;   // "FRAME 000123" sliding across, sharp edges for the high pass to find
+    // captured window in window mode, pixels. a zero size means the centered half of the frame
+    int windowX = 0;
+    int windowY = 0;
+    int windowWidth = 0;
+    int windowHeight = 0;
+};
+
+// deterministic frames: the same config and frame index always give the same pixels
+class SyntheticFrameGenerator {
+public:
+    explicit SyntheticFrameGenerator(const SyntheticCaptureConfig& config);
+
+    void generate(uint64_t frameIndex, const CpuImageView& output) const;
+
+private:
+    static constexpr int kNoiseTileSize = 256; // power of two
+
+    void drawText(uint64_t frameIndex, const CpuImageView& output) const;
+
+    SyntheticCaptureConfig m_config;
+    std::vector<uint8_t> m_noiseTile;
+};
+
+class SyntheticCaptureSource : public ThreadedCaptureSource {
+public:
+    explicit SyntheticCaptureSource(const SyntheticCaptureConfig& config = {});
+    ~SyntheticCaptureSource() override;
+
+protected:
+    bool produceFrame(uint64_t frameIndex, FrameLeaseSlot& frame) override;
+    int getFps() const override;
+    void getWindowRect(int& x, int& y, int& width, int& height) const override;
+
+private:
+    SyntheticCaptureConfig m_config;
+    SyntheticFrameGenerator m_generator;
+};
+
+#endif //HIDINGIN_SYNTHETICCAPTURESOURCE_H
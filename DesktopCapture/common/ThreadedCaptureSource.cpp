@@ -0,0 +1,126 @@
+#include "ThreadedCaptureSource.h"
+#include "CaptureState.h"
+#include "../../com/NotificationCenter.h"
+#include "../../utils/Tracer.h"
+#include <chrono>
+#include <iostream>
+
+ThreadedCaptureSource::~ThreadedCaptureSource() {
+    // subclasses have to stop in their own destructor, produceFrame() is gone by now
+    if (m_produceThread.joinable()) {
+        std::cerr << "threaded capture source destroyed while still producing" << std::endl;
+        m_stopProducing = true;
+        m_produceThread.join();
+    }
+}
+
+bool ThreadedCaptureSource::startCapture(std::optional<CaptureArgs> args) {
+    return startProducing(args.value_or(CaptureArgs{}));
+}
+
+bool ThreadedCaptureSource::startCaptureWithSpecificWinId(std::optional<CaptureArgs> args) {
+    if (!args.has_value()) {
+        std::cerr << "cap args cannot be null" << std::endl;
+        return false;
+    }
+    int x, y, width, height;
+    getWindowRect(x, y, width, height);
+    int windowId = args->includingWindowIDs.empty() ? 0 : args->includingWindowIDs[0];
+    NotificationCenter::getInstance().renderState().update([&](RenderState& state) {
+        state.capturedAppX = x;
+        state.capturedAppY = y;
+        state.capturedAppWidth = width;
+        state.capturedAppHeight = height;
+        state.capturedWinId = windowId;
+    });
+    return startProducing(args.value());
+}
+
+bool ThreadedCaptureSource::startProducing(const CaptureArgs& args) {
+    if (m_produceThread.joinable()) {
+        std::cerr << "capture source already started" << std::endl;
+        return false;
+    }
+    if (getFps() <= 0) {
+        std::cerr << "capture source needs a positive fps" << std::endl;
+        return false;
+    }
+    m_captureEventHandle = EventChannel<CaptureFrameEvent>::getInstance().handleFor(args.captureEventName);
+    m_tileChangeDetector.reset();
+    m_stopProducing = false;
+    m_captureStatus = CaptureStatus::Start;
+    m_produceThread = std::thread(&ThreadedCaptureSource::produceLoop, this);
+    return true;
+}
+
+void ThreadedCaptureSource::stopCapture() {
+    m_stopProducing = true;
+    if (m_produceThread.joinable()) {
+        m_produceThread.join();
+    }
+    m_captureStatus = CaptureStatus::Stop;
+}
+
+void ThreadedCaptureSource::setCaptureRegion(int x, int y, int width, int height) {
+    std::lock_guard<std::mutex> regionLock(m_captureRegionMutex);
+    m_captureRegion[0] = x;
+    m_captureRegion[1] = y;
+    m_captureRegion[2] = std::max(width, 0);
+    m_captureRegion[3] = std::max(height, 0);
+}
+
+void ThreadedCaptureSource::produceLoop() {
+    Tracer::getInstance().setCurrentThreadName("captureSource");
+    auto nextFrameTime = std::chrono::steady_clock::now();
+    for (uint64_t frameIndex = 0; !m_stopProducing && hasMoreFrames(frameIndex); frameIndex++) {
+        auto fps = getFps();
+        auto frameRateLimit = m_frameRateLimit.load(std::memory_order_relaxed);
+        if (frameRateLimit > 0) {
+            fps = std::min(fps, frameRateLimit);
+        }
+        auto frameInterval = std::chrono::nanoseconds(1000000000LL / fps);
+        TRACE_SCOPE_ARG("produceFrame", frameIndex);
+        // null when every frame is still held downstream (the consumer is behind, skip the frame)
+        auto lease = m_framePool.acquire();
+        if (lease && produceFrame(frameIndex, lease.slot())) {
+            CaptureFrameEvent frameEvent;
+            auto& frame = lease.slot();
+            frame.timestampNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+            {
+                std::lock_guard<std::mutex> regionLock(m_captureRegionMutex);
+                auto view = frame.cpuView();
+                int left = std::clamp(m_captureRegion[0], 0, view.width);
+                int top = std::clamp(m_captureRegion[1], 0, view.height);
+                int right = std::clamp(m_captureRegion[0] + m_captureRegion[2], left, view.width);
+                int bottom = std::clamp(m_captureRegion[1] + m_captureRegion[3], top, view.height);
+                if (m_captureRegion[2] > 0 && m_captureRegion[3] > 0 && right > left && bottom > top) {
+                    view.data = view.row(top) + left * 4;
+                    view.width = right - left;
+                    view.height = bottom - top;
+                    frame.setCpuView(view);
+                    frameEvent.originX = left;
+                    frameEvent.originY = top;
+                }
+            }
+            {
+                TRACE_SCOPE("hashTiles");
+                m_tileChangeDetector.detect(frame.cpuView(), frameEvent.dirtyRegion);
+            }
+            frameEvent.lease = std::move(lease);
+            EventChannel<CaptureFrameEvent>::getInstance().triggerEvent(m_captureEventHandle, frameEvent);
+            m_producedFrames.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            m_skippedFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // fixed cadence like a display driven stream, a late frame does not make the next ones early
+        nextFrameTime += frameInterval;
+        auto now = std::chrono::steady_clock::now();
+        if (nextFrameTime < now) {
+            nextFrameTime = now;
+        }
+        std::this_thread::sleep_until(nextFrameTime);
+    }
+    m_captureStatus = CaptureStatus::Stop;
+}
@@ -0,0 +1,77 @@
+#ifndef HIDINGIN_THREADEDCAPTURESOURCE_H
+#define HIDINGIN_THREADEDCAPTURESOURCE_H
+
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <string>
+#include "CaptureSource.h"
+#include "../../GPUPipeline/cpu/CpuImage.h"
+#include "../../GPUPipeline/cpu/CpuTileChangeDetector.h"
+#include "../../com/EventChannel.h"
+#include "../../utils/FrameLease.h"
+
+// common part of the portable capture sources: a thread that produces frames at a fixed rate and triggers them
+// on EventChannel<CaptureFrameEvent> the way SCFrameReceiver does, the dirty region comes from tile hashing. in
+// window mode the window rect is published into the render state like the sckit capture does.
+class ThreadedCaptureSource : public CaptureSource {
+public:
+    ~ThreadedCaptureSource() override;
+
+    bool startCapture(std::optional<CaptureArgs> args = std::nullopt) override;
+    bool startCaptureWithSpecificWinId(std::optional<CaptureArgs> args) override;
+    void stopCapture() override;
+
+    CaptureStatus getCaptureStatus() override {
+        return m_captureStatus;
+    }
+
+    uint64_t getProducedFrameCount() const {
+        return m_producedFrames.load(std::memory_order_relaxed);
+    }
+
+    uint64_t getSkippedFrameCount() const {
+        return m_skippedFrames.load(std::memory_order_relaxed);
+    }
+
+    void setFrameRateLimit(int fps) override {
+        m_frameRateLimit = std::max(fps, 0);
+    }
+
+    // frames are produced whole and handed out as a view of the region
+    void setCaptureRegion(int x, int y, int width, int height) override;
+
+protected:
+    // fill frame number frameIndex (from 0) into the slot with setCpuView, the pixels in slot.image or kept
+    // alive by slot.backing. false skips it.
+    virtual bool produceFrame(uint64_t frameIndex, FrameLeaseSlot& frame) = 0;
+    virtual int getFps() const = 0;
+    // captured window rect in pixels, for window mode
+    virtual void getWindowRect(int& x, int& y, int& width, int& height) const = 0;
+    // false: the source ran out of frames, the thread stops after it
+    virtual bool hasMoreFrames(uint64_t) const {
+        return true;
+    }
+
+private:
+    bool startProducing(const CaptureArgs& args);
+    void produceLoop();
+
+    std::thread m_produceThread;
+    std::atomic_bool m_stopProducing = false;
+    std::atomic<CaptureStatus> m_captureStatus{CaptureStatus::NotStart};
+    std::atomic<uint64_t> m_producedFrames{0};
+    std::atomic<uint64_t> m_skippedFrames{0};
+    std::atomic_int m_frameRateLimit{0};
+    std::mutex m_captureRegionMutex;
+    int m_captureRegion[4] = {0, 0, 0, 0}; // x, y, width, height
+    EventHandle m_captureEventHandle;
+    FrameLeasePool m_framePool;
+    // the dirty rects of every frame, these sources do not know what they changed
+    CpuTileChangeDetector m_tileChangeDetector;
+};
+
+#endif //HIDINGIN_THREADEDCAPTURESOURCE_H
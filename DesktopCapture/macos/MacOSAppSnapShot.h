@@ -5,6 +5,13 @@
 #ifndef HIDINGIN_MACOSAPPSNAPSHOT_H
 #define HIDINGIN_MACOSAPPSNAPSHOT_H
 #include "QImage"
+#include <CoreGraphics/CoreGraphics.h>
+#include <string>
+#include <vector>
+#include "DataModel/SnapShotImageProvider.h"
 extern QImage getSnapShotFromApp(std::string, int* retWinId = nullptr);
-extern std::vector<QImage> getAllSnapShotsFromApp(const std::string& appName, std::vector<int>& retWinIds);
+// ids of the app's windows big enough to show in the picker, front to back
+extern std::vector<CGWindowID> findAllWindowIDsForApp(const std::string& appName);
+// ThumbnailRenderer for the app picker
+extern QImage createWindowThumbnail(int windowId, const QSize& requestedSize, const ThumbnailDownscaler& downscale);
 #endif //HIDINGIN_MACOSAPPSNAPSHOT_H
@@ -4,8 +4,12 @@
 #include <QImage>
 #include <ApplicationServices/ApplicationServices.h>
 #include <string>
-#import <CoreImage/CoreImage.h>
+#include <algorithm>
 #import <CoreGraphics/CoreGraphics.h>
+#include "platform/macos/MacUtils.h"
+#include "utils/WindowRegistry.h"
+#include "DataModel/SnapShotImageProvider.h"
+#include "GPUPipeline/cpu/CpuBlur.h"
 
 // Helper function to convert CGImageRef to QImage
 QImage CGImageToQImage(CGImageRef imageRef) {
@@ -48,57 +52,43 @@ QImage CGImageToQImage(CGImageRef imageRef) {
 }
 
 CGWindowID findWindowIDForApp(const std::string& appName) {
-    // Convert std::string to NSString
-    NSString *nsAppName = [NSString stringWithUTF8String:appName.c_str()];
-
-    // Get a list of all windows
-    CFArrayRef windowList = CGWindowListCopyWindowInfo(kCGWindowListOptionOnScreenOnly, kCGNullWindowID);
-
-    for (NSDictionary *windowInfo in (NSArray *)windowList) {
-        NSString *windowOwnerName = windowInfo[(NSString *)kCGWindowOwnerName];
+    // the shared window list, front to back
+    for (auto& window : getWindowRegistry().getWindows()) {
         // Compare the window owner name with the app name
-        if ([windowOwnerName containsString:nsAppName]) {
-            // Get the window's bounds (position and size)
-            NSDictionary *boundsDict = windowInfo[(NSString *)kCGWindowBounds];
-            CGRect windowBounds;
-            CGRectMakeWithDictionaryRepresentation((CFDictionaryRef)boundsDict, &windowBounds);
-
-            // Filter out windows that start at (0, 0) and have width or height less than 50
-            if ((windowBounds.size.width < 50 || windowBounds.size.height < 50)) {
-                continue; // Skip this window
-            }
-
-            // If the window passes the filter, return its ID
-            NSNumber *windowID = windowInfo[(NSString *)kCGWindowNumber];
-            CFRelease(windowList);
-            return [windowID unsignedIntValue];
+        if (window.ownerName.find(appName) == std::string::npos) {
+            continue;
         }
+        // Filter out windows that start at (0, 0) and have width or height less than 50
+        if (window.width < 50 || window.height < 50) {
+            continue; // Skip this window
+        }
+        // If the window passes the filter, return its ID
+        return (CGWindowID)window.windowId;
     }
-
-    // Release the window list and return a null window ID if not found
-    CFRelease(windowList);
     return kCGNullWindowID;
 }
 
 CGImageRef applyHighPassFilter(CGImageRef inputImage, CGFloat blurRadius) {
-    // Step 1: Create CIImage from CGImageRef
-    CIImage *ciInput = [CIImage imageWithCGImage:inputImage];
-
-    // Step 2: Apply Gaussian Blur to Extract Low-Frequency Components
-    CIFilter *gaussianBlur = [CIFilter filterWithName:@"CIGaussianBlur"];
-    [gaussianBlur setValue:ciInput forKey:kCIInputImageKey];
-    [gaussianBlur setValue:@(blurRadius) forKey:kCIInputRadiusKey];
-    CIImage *blurredImage = [gaussianBlur valueForKey:kCIOutputImageKey];
-
-    // Step 3: Subtract Blurred Image from Original Image
-    CIFilter *differenceBlend = [CIFilter filterWithName:@"CISubtractBlendMode"];
-    [differenceBlend setValue:ciInput forKey:kCIInputImageKey];
-    [differenceBlend setValue:blurredImage forKey:kCIInputBackgroundImageKey];
-    CIImage *highPassImage = [differenceBlend valueForKey:kCIOutputImageKey];
-
-    // Step 4: Render the Resulting CIImage Back to CGImageRef
-    CIContext *context = [CIContext contextWithOptions:nil];
-    CGImageRef outputImage = [context createCGImage:highPassImage fromRect:[ciInput extent]];
+    if (!inputImage) {
+        return NULL;
+    }
+    // draw into a BGRA bitmap, high pass it there and hand the bitmap out as the image
+    size_t width = CGImageGetWidth(inputImage);
+    size_t height = CGImageGetHeight(inputImage);
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef bitmapContext = CGBitmapContextCreate(nullptr, width, height, 8, 0, colorSpace,
+                                                       kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Little);
+    CGColorSpaceRelease(colorSpace);
+    if (!bitmapContext) {
+        return NULL;
+    }
+    CGContextDrawImage(bitmapContext, CGRectMake(0, 0, width, height), inputImage);
+    CpuImageView image{(uint8_t*)CGBitmapContextGetData(bitmapContext), (int)width, (int)height,
+                       (int)CGBitmapContextGetBytesPerRow(bitmapContext)};
+    // keeps its scratch images between calls
+    static thread_local CpuBlur highPassBlur;
+    CGImageRef outputImage = highPassBlur.highPass(image, (float)blurRadius) ? CGBitmapContextCreateImage(bitmapContext) : NULL;
+    CGContextRelease(bitmapContext);
 
     return outputImage; // The caller is responsible for releasing this CGImageRef
 }
@@ -131,72 +121,97 @@ extern QImage getSnapShotFromApp(std::string appName, int *retWinId) {
 
 // Helper function to find all window IDs for a given app name
 std::vector<CGWindowID> findAllWindowIDsForApp(const std::string& appName) {
-    // Convert std::string to NSString
-    NSString *nsAppName = [NSString stringWithUTF8String:appName.c_str()];
-
-    // Get a list of all windows
-    CFArrayRef windowList = CGWindowListCopyWindowInfo(kCGWindowListOptionOnScreenOnly, kCGNullWindowID);
     std::vector<CGWindowID> windowIDs;
 
-    for (NSDictionary *windowInfo in (NSArray *)windowList) {
-        NSString *windowOwnerName = windowInfo[(NSString *)kCGWindowOwnerName];
+    // the shared window list, front to back
+    for (auto& window : getWindowRegistry().getWindows()) {
         // Compare the window owner name with the app name
-        if ([windowOwnerName containsString:nsAppName]) {
-            // Get the window's bounds (position and size)
-            NSDictionary *boundsDict = windowInfo[(NSString *)kCGWindowBounds];
-            CGRect windowBounds;
-            CGRectMakeWithDictionaryRepresentation((CFDictionaryRef)boundsDict, &windowBounds);
-
-            // Filter out windows that start at (0, 0) and have width or height less than 50
-            if ((windowBounds.size.width < 50 || windowBounds.size.height < 50)) {
-                continue; // Skip this window
-            }
-
-            // If the window passes the filter, add its ID to the list
-            NSNumber *windowID = windowInfo[(NSString *)kCGWindowNumber];
-            windowIDs.push_back([windowID unsignedIntValue]);
+        if (window.ownerName.find(appName) == std::string::npos) {
+            continue;
         }
+        // Filter out windows that start at (0, 0) and have width or height less than 50
+        if (window.width < 50 || window.height < 50) {
+            continue; // Skip this window
+        }
+        // If the window passes the filter, add its ID to the list
+        windowIDs.push_back((CGWindowID)window.windowId);
     }
-
-    // Release the window list
-    CFRelease(windowList);
     return windowIDs;
 }
 
-// Function to get snapshots of all windows for a given app
-std::vector<QImage> getAllSnapShotsFromApp(const std::string& appName, std::vector<int>& retWinIds) {
-    // Find all window IDs of the target application
-    std::vector<CGWindowID> windowIDs = findAllWindowIDsForApp(appName);
-    std::vector<QImage> snapshots;
-
-    for (CGWindowID windowID : windowIDs) {
-        // Store the window ID in the output parameter
-        retWinIds.push_back(windowID);
-
-        // Capture the window image
-        CGRect windowBounds = CGRectNull; // Capture the full window
-        CGImageRef windowImage = CGWindowListCreateImage(windowBounds, kCGWindowListOptionIncludingWindow, windowID, kCGWindowImageDefault);
+// high pass radius at full window size, scaled with the thumbnail
+static constexpr CGFloat kThumbnailHighPassRadius = 5.0;
+
+// one window capture shrunk to the thumbnail size with downscale, then high passed. the high pass runs on the
+// thumbnail instead of the full window, that is where most of the old eager snapshots' time went.
+QImage createWindowThumbnail(int windowId, const QSize& requestedSize, const ThumbnailDownscaler& downscale) {
+    @autoreleasepool {
+        CGImageRef windowImage = CGWindowListCreateImage(CGRectNull, kCGWindowListOptionIncludingWindow, (CGWindowID)windowId,
+                                                         kCGWindowImageBoundsIgnoreFraming | kCGWindowImageNominalResolution);
+        if (!windowImage) {
+            return {};
+        }
+        int width = (int)CGImageGetWidth(windowImage);
+        int height = (int)CGImageGetHeight(windowImage);
+        QSize thumbnailSize = SnapShotImageProvider::thumbnailSizeFor(QSize(width, height), requestedSize);
+        if (thumbnailSize.isEmpty()) {
+            CGImageRelease(windowImage);
+            return {};
+        }
 
-        if (windowImage) {
-            // Optionally apply a high-pass filter or other transformations
-            auto highPassResult = applyHighPassFilter(windowImage, 5.0);
-            if (highPassResult != NULL) {
-                // Convert CGImageRef to QImage and add it to the snapshots list
-                QImage image = CGImageToQImage(highPassResult);
-                snapshots.push_back(image);
-                CGImageRelease(highPassResult); // Release CGImageRef when done
-            } else {
-                // If filtering fails, add the original image
-                QImage image = CGImageToQImage(windowImage);
-                snapshots.push_back(image);
+        // the window server hands out BGRA, read it in place. anything else is drawn into a BGRA bitmap first.
+        CFDataRef pixelData = nullptr;
+        CGContextRef bitmapContext = nullptr;
+        CpuImageView input;
+        input.width = width;
+        input.height = height;
+        CGBitmapInfo bitmapInfo = CGImageGetBitmapInfo(windowImage);
+        CGImageAlphaInfo alphaInfo = (CGImageAlphaInfo)(bitmapInfo & kCGBitmapAlphaInfoMask);
+        bool isBGRA = CGImageGetBitsPerPixel(windowImage) == 32 && CGImageGetBitsPerComponent(windowImage) == 8 &&
+                      (bitmapInfo & kCGBitmapByteOrderMask) == kCGBitmapByteOrder32Little &&
+                      (alphaInfo == kCGImageAlphaPremultipliedFirst || alphaInfo == kCGImageAlphaNoneSkipFirst);
+        if (isBGRA) {
+            pixelData = CGDataProviderCopyData(CGImageGetDataProvider(windowImage));
+            if (pixelData) {
+                input.data = (uint8_t*)CFDataGetBytePtr(pixelData);
+                input.bytesPerRow = (int)CGImageGetBytesPerRow(windowImage);
             }
-
-            CGImageRelease(windowImage); // Release CGImageRef when done
-        } else {
-            // Add an empty QImage as a placeholder if capture failed
-            snapshots.push_back(QImage());
         }
-    }
+        if (!input.data) {
+            CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+            bitmapContext = CGBitmapContextCreate(nullptr, width, height, 8, 0, colorSpace,
+                                                  kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Little);
+            CGColorSpaceRelease(colorSpace);
+            if (bitmapContext) {
+                CGContextDrawImage(bitmapContext, CGRectMake(0, 0, width, height), windowImage);
+                input.data = (uint8_t*)CGBitmapContextGetData(bitmapContext);
+                input.bytesPerRow = (int)CGBitmapContextGetBytesPerRow(bitmapContext);
+            }
+        }
+        CGImageRelease(windowImage);
+        if (!input.data) {
+            if (pixelData)
+                CFRelease(pixelData);
+            if (bitmapContext)
+                CGContextRelease(bitmapContext);
+            return {};
+        }
 
-    return snapshots;
-}
\ No newline at end of file
+        // Format_ARGB32_Premultiplied is BGRA in memory on little endian, what the downscaler and the blur use
+        QImage thumbnail(thumbnailSize, QImage::Format_ARGB32_Premultiplied);
+        CpuImageView output{thumbnail.bits(), thumbnail.width(), thumbnail.height(), (int)thumbnail.bytesPerLine()};
+        downscale(input, output);
+        if (pixelData)
+            CFRelease(pixelData);
+        if (bitmapContext)
+            CGContextRelease(bitmapContext);
+
+        // high pass in place. runs on a thumbnail worker already, so the blur stays on this thread; one per worker
+        // keeps its scratch images between thumbnails. the edges clamp where CoreImage faded to transparent, the
+        // border no longer comes out as an edge of its own
+        static thread_local CpuBlur highPassBlur;
+        float sigma = std::max(1.0f, (float)kThumbnailHighPassRadius * thumbnail.width() / width);
+        highPassBlur.highPass(output, sigma);
+        return thumbnail;
+    }
+}
@@ -3,20 +3,27 @@
 #ifndef SCREEN_CAPTURE_H
 #define SCREEN_CAPTURE_H
 #include "../common/CaptureStuff.h"
-class MacOSCaptureSCKit {  // Removed the trailing underscore
+#include "../common/CaptureSource.h"
+class MacOSCaptureSCKit : public CaptureSource {  // Removed the trailing underscore
 public:
     MacOSCaptureSCKit();    // Constructor
-    ~MacOSCaptureSCKit();   // Destructor
+    ~MacOSCaptureSCKit() override;   // Destructor
 
     // Start capturing the screen content
-    bool startCapture(std::optional<CaptureArgs> args = std::nullopt);
+    bool startCapture(std::optional<CaptureArgs> args = std::nullopt) override;
 
-    bool startCaptureWithSpecificWinId(std::optional<CaptureArgs> args);
+    bool startCaptureWithSpecificWinId(std::optional<CaptureArgs> args) override;
 
     // Stop capturing the screen content
-    void stopCapture();
+    void stopCapture() override;
 
-    CaptureStatus getCaptureStatus() { return captureStatus; }
+    CaptureStatus getCaptureStatus() override { return captureStatus; }
+
+    // minimumFrameInterval of the running stream
+    void setFrameRateLimit(int fps) override;
+
+    // sourceRect of the running stream, the output size follows it
+    void setCaptureRegion(int x, int y, int width, int height) override;
 
 private:
     class Impl;         // Forward declaration of the implementation class
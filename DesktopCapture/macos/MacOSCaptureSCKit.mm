@@ -4,12 +4,19 @@
 #import <MetalKit/MetalKit.h>
 #include "MacOSCaptureSCKit.h"
 #import <CoreMedia/CoreMedia.h>
+#include <algorithm>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include "com/NotificationCenter.h"
+#include "DesktopCapture/common/CaptureState.h"
 #include "com/EventListener.h"
+#include "com/EventChannel.h"
 #include "platform/macos/MacUtils.h"
 #include "../GPUPipeline/macos/MetalPipeline.h"
 #include "../utils/WindowLogic.h"
+#include "../utils/Tracer.h"
 
 static void savePNG(CVImageBufferRef imageBuffer){
     // Lock the base address of the pixel buffer
@@ -66,34 +73,78 @@ NSArray* vectorToNSArray(const std::vector<int>& vec) {
 }
 
 @interface SCFrameReceiver : NSObject <SCStreamOutput,SCStreamDelegate>
-@property (nonatomic) CVMetalTextureCacheRef textureCache;
-@property (nonatomic, assign) CVMetalTextureRef metalTextureRef;
 @property (atomic) bool stopCapturing;
 @property (atomic) bool alreadyEnd;
 @property std::string captureEventName;
+@property EventHandle captureEventHandle;
 
 - (void)stream:(SCStream *)stream
 didOutputSampleBuffer:(CMSampleBufferRef)sampleBuffer
         ofType:(SCStreamOutputType)type;
 - (void)streamDidBecomeInactive:(SCStream *)stream;
 - (void)stream:(SCStream *)stream didStopWithError:(NSError *)error;
+// the screen rect (pixels) the stream captures since the last configuration update, empty for the whole screen
+- (void)setCaptureRegionX:(int)x y:(int)y width:(int)width height:(int)height;
 @end
 
-@implementation SCFrameReceiver
+// the stream cycles through queueDepth (5) surfaces and needs one free to write the next frame into
+static constexpr size_t kMaxLeasedFrames = 4;
+// textures kept for the surfaces the stream cycles through, a region change brings a new set
+static constexpr size_t kMaxSurfaceTextures = 10;
+
+@implementation SCFrameReceiver {
+    // the region before the last update too: frames of the old configuration still in flight are told apart by
+    // their size
+    std::mutex _regionMutex;
+    int _captureRegion[4];
+    int _previousCaptureRegion[4];
+    std::unique_ptr<FrameLeasePool> _framePool;
+    // one texture per IOSurface, made the first time the stream hands out that surface. sample handler queue only.
+    std::vector<std::pair<IOSurfaceRef, id<MTLTexture>>> _surfaceTextures;
+}
 
 - (instancetype)init {
     self = [super init];
-    auto mtlDevice = (id<MTLDevice>)MetalPipeline::getGlobalInstance().getRenderPipeline().mtlDeviceRef;
-    CVReturn status = CVMetalTextureCacheCreate(kCFAllocatorDefault, NULL, mtlDevice, NULL, &_textureCache);
-    EventRegisterParam eventRegisterParam;
-    eventRegisterParam.type = EventType::General;
-    eventRegisterParam.eventName = _captureEventName;
-    EventManager::getInstance()->registerEvent(eventRegisterParam);
+    _framePool = std::make_unique<FrameLeasePool>(kMaxLeasedFrames);
     _alreadyEnd = false;
 
     return self;
 }
 
+- (void)dealloc {
+    for(auto& surfaceTexture : _surfaceTextures){
+        [surfaceTexture.second release];
+    }
+    [super dealloc];
+}
+
+- (void)setCaptureRegionX:(int)x y:(int)y width:(int)width height:(int)height {
+    std::lock_guard<std::mutex> regionLock(_regionMutex);
+    std::copy(_captureRegion, _captureRegion + 4, _previousCaptureRegion);
+    _captureRegion[0] = x;
+    _captureRegion[1] = y;
+    _captureRegion[2] = width;
+    _captureRegion[3] = height;
+}
+
+// origin of a width x height frame on the screen
+- (void)getFrameOrigin:(int)width height:(int)height originX:(int&)originX originY:(int&)originY {
+    std::lock_guard<std::mutex> regionLock(_regionMutex);
+    const int* region = _captureRegion;
+    if((region[2] != width || region[3] != height) &&
+       _previousCaptureRegion[2] == width && _previousCaptureRegion[3] == height){
+        region = _previousCaptureRegion;
+    }
+    originX = region[2] > 0 ? region[0] : 0;
+    originY = region[3] > 0 ? region[1] : 0;
+}
+
+- (void)setCaptureEventName:(std::string)captureEventName {
+    _captureEventName = captureEventName;
+    // intern once here, the sample handler only uses the handle
+    _captureEventHandle = EventChannel<CaptureFrameEvent>::getInstance().handleFor(captureEventName);
+}
+
 - (void)stream:(SCStream *)stream
 didStopWithError:(NSError *)error{
     Message message;
@@ -104,47 +155,139 @@ didStopWithError:(NSError *)error{
     _alreadyEnd = true;
 }
 
+// SCStreamFrameInfoDirtyRects of the frame, in output pixels. a frame without the attachment stays everything.
+static void readDirtyRegion(CMSampleBufferRef sampleBuffer, DirtyRegion& dirtyRegion){
+    CFArrayRef attachmentsArray = CMSampleBufferGetSampleAttachmentsArray(sampleBuffer, false);
+    if(!attachmentsArray || CFArrayGetCount(attachmentsArray) == 0){
+        return;
+    }
+    auto attachments = (NSDictionary*)CFArrayGetValueAtIndex(attachmentsArray, 0);
+    NSArray* dirtyRects = attachments[SCStreamFrameInfoDirtyRects];
+    if(!dirtyRects){
+        return;
+    }
+    dirtyRegion.clear();
+    for(NSDictionary* rectDictionary in dirtyRects){
+        CGRect rect;
+        if(!CGRectMakeWithDictionaryRepresentation((CFDictionaryRef)rectDictionary, &rect)){
+            dirtyRegion.markEverything();
+            return;
+        }
+        // round outwards, a partly covered pixel changed too
+        int left = (int)floor(CGRectGetMinX(rect));
+        int top = (int)floor(CGRectGetMinY(rect));
+        int right = (int)ceil(CGRectGetMaxX(rect));
+        int bottom = (int)ceil(CGRectGetMaxY(rect));
+        dirtyRegion.add(DirtyRect{left, top, right - left, bottom - top});
+    }
+}
+
 - (void)stream:(SCStream *)stream didOutputSampleBuffer:(CMSampleBufferRef)sampleBuffer ofType:(SCStreamOutputType)type {
     if(self.stopCapturing){
         return;
     }
+    TRACE_SCOPE("scStreamFrame");
 
     CVImageBufferRef imageBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
     if(!CMSampleBufferIsValid(sampleBuffer) || !imageBuffer){
         return;
     }
-    id<MTLTexture> newTexture = [self createTextureFromImage:imageBuffer];
-    if (newTexture) {
-        EventParam eventParam;
-        eventParam.addParameter("textureId", (void*)newTexture);
-        EventManager::getInstance()->triggerEvent(_captureEventName, eventParam);
+    IOSurfaceRef surface = CVPixelBufferGetIOSurface(imageBuffer);
+    if(!surface){
+        return;
+    }
+    auto lease = _framePool->acquire();
+    if(!lease){
+        // every frame is still held downstream, the stream needs its surfaces back more than we need this one
+        return;
     }
-}
-
-- (id<MTLTexture>)createTextureFromImage:(CVImageBufferRef)imageBuffer {
     size_t width = CVPixelBufferGetWidth(imageBuffer);
     size_t height = CVPixelBufferGetHeight(imageBuffer);
-
-    CVMetalTextureCacheFlush(self.textureCache, 0);
-    if (_metalTextureRef) {
-        CFRelease(_metalTextureRef);
-        _metalTextureRef = NULL;
+    id<MTLTexture> texture = [self textureForSurface:surface width:width height:height];
+    if(!texture){
+        return;
     }
 
-    CVReturn status = CVMetalTextureCacheCreateTextureFromImage(kCFAllocatorDefault,
-                                                                self.textureCache, imageBuffer,
-                                                                NULL, MTLPixelFormatBGRA8Unorm,
-                                                                width, height, 0, &_metalTextureRef);
-    if (status != kCVReturnSuccess) {
+    // the lease holds the pixel buffer, so the stream does not write into the surface before the last consumer
+    // (the gpu included) let go of the frame, and the texture, so evicting it from the cache cannot pull it away
+    auto& frame = lease.slot();
+    frame.buffer = (void*)[texture retain];
+    frame.storage = CaptureFrameStorage::MetalTexture;
+    frame.format = FramePixelFormat::BGRA8;
+    frame.width = (int)width;
+    frame.height = (int)height;
+    frame.bytesPerRow = (int)CVPixelBufferGetBytesPerRow(imageBuffer);
+    frame.timestampNs = (uint64_t)(CMTimeGetSeconds(CMSampleBufferGetPresentationTimeStamp(sampleBuffer)) * 1e9);
+    frame.releaseContext = (void*)CVPixelBufferRetain(imageBuffer);
+    frame.releaseHook = [](FrameLeaseSlot& slot){
+        [(id<MTLTexture>)slot.buffer release];
+        CVPixelBufferRelease((CVPixelBufferRef)slot.releaseContext);
+    };
+
+    CaptureFrameEvent frameEvent;
+    readDirtyRegion(sampleBuffer, frameEvent.dirtyRegion);
+    [self getFrameOrigin:(int)width height:(int)height originX:frameEvent.originX originY:frameEvent.originY];
+    frameEvent.lease = std::move(lease);
+    EventChannel<CaptureFrameEvent>::getInstance().triggerEvent(_captureEventHandle, frameEvent);
+}
+
+// the texture over surface, made once: the stream only has a handful of surfaces and hands them out again and again
+- (id<MTLTexture>)textureForSurface:(IOSurfaceRef)surface width:(size_t)width height:(size_t)height {
+    for(auto& [cachedSurface, texture] : _surfaceTextures){
+        if(cachedSurface == surface && texture.width == width && texture.height == height){
+            return texture;
+        }
+    }
+    auto mtlDevice = (id<MTLDevice>)MetalPipeline::getGlobalInstance().getRenderPipeline().mtlDeviceRef;
+    MTLTextureDescriptor* descriptor = [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:MTLPixelFormatBGRA8Unorm
+                                                                                          width:width
+                                                                                         height:height
+                                                                                      mipmapped:NO];
+    descriptor.usage = MTLTextureUsageShaderRead;
+    id<MTLTexture> texture = [mtlDevice newTextureWithDescriptor:descriptor iosurface:surface plane:0];
+    if(!texture){
         NSLog(@"Failed to create Metal texture from image");
         return nil;
     }
-
-    return CVMetalTextureGetTexture(_metalTextureRef);
+    // the texture retains its surface, so a cached surface pointer cannot be reused by another surface
+    for(auto it = _surfaceTextures.begin(); it != _surfaceTextures.end();){
+        if(it->first == surface){
+            [it->second release];
+            it = _surfaceTextures.erase(it);
+        }else{
+            ++it;
+        }
+    }
+    if(_surfaceTextures.size() >= kMaxSurfaceTextures){
+        [_surfaceTextures.front().second release];
+        _surfaceTextures.erase(_surfaceTextures.begin());
+    }
+    _surfaceTextures.emplace_back(surface, texture);
+    return texture;
 }
 
 @end
 
+// the display a source captures, the main one for 0. nil when that display is gone
+static SCDisplay* findCaptureDisplay(SCShareableContent *content, uint32_t displayId) {
+    auto wantedId = displayId != 0 ? displayId : CGMainDisplayID();
+    for (SCDisplay *display in content.displays) {
+        if (display.displayID == wantedId) {
+            return display;
+        }
+    }
+    return displayId != 0 ? nil : content.displays.firstObject;
+}
+
+// pixels per point of a display, the render state's factor until a topology is published
+static float getDisplayScale(uint32_t displayId) {
+    auto topology = NotificationCenter::getInstance().displayTopology().load();
+    if (auto display = topology.findDisplay(displayId)) {
+        return display->scale;
+    }
+    return NotificationCenter::getInstance().renderState().load().scalingFactor;
+}
+
 enum CaptureMode{
     FullDesktopCapture,
     AppCapture
@@ -155,9 +298,91 @@ private:
     SCFrameReceiver* frameReceiver = nullptr;
     SCStream *stream = nullptr;
     CaptureMode capMode = CaptureMode::FullDesktopCapture;
+    // the stream is set up on the shareable content callback, the rate limit comes from the pacing thread
+    std::mutex streamMutex;
+    SCStreamConfiguration *streamConfig = nullptr;
+    int frameRateLimit = 0;
+    int captureRegion[4] = {0, 0, 0, 0};   // display pixels, empty for the whole display
+    int displayWidth = 0;                  // output size of the whole display, pixels
+    int displayHeight = 0;
+    float displayScale = 1.0f;             // of the captured display, set when the stream is created
+    CGRect displaySourceRect = CGRectNull;
+
+    // sourceRect and output size for captureRegion, scaled like the rest of the config
+    void applyCaptureRegion(SCStreamConfiguration *config) {
+        if(captureRegion[2] <= 0 || captureRegion[3] <= 0){
+            config.sourceRect = displaySourceRect;
+            config.width = displayWidth;
+            config.height = displayHeight;
+            return;
+        }
+        config.sourceRect = CGRectMake(captureRegion[0] / displayScale, captureRegion[1] / displayScale,
+                                       captureRegion[2] / displayScale, captureRegion[3] / displayScale);
+        config.width = captureRegion[2];
+        config.height = captureRegion[3];
+    }
+
+    void updateStreamConfiguration() {
+        auto receiver = frameReceiver;
+        int region[4] = {captureRegion[0], captureRegion[1], captureRegion[2], captureRegion[3]};
+        [stream updateConfiguration:streamConfig completionHandler:^(NSError *error){
+            if(error){
+                NSLog(@"Error: Unable to update the stream configuration: %@", error);
+                return;
+            }
+            [receiver setCaptureRegionX:region[0] y:region[1] width:region[2] height:region[3]];
+        }];
+    }
+
+    // minimumFrameInterval for the current limit, the stream's own rate when there is none
+    void applyFrameRateLimit(SCStreamConfiguration *config) {
+        if(frameRateLimit > 0){
+            config.minimumFrameInterval = CMTimeMake(1, frameRateLimit);
+        }
+    }
+
+    void createStream(SCContentFilter *filter, SCStreamConfiguration *config, float scale) {
+        std::lock_guard<std::mutex> streamLock(streamMutex);
+        displayScale = scale;
+        applyFrameRateLimit(config);
+        displayWidth = (int)config.width;
+        displayHeight = (int)config.height;
+        displaySourceRect = config.sourceRect;
+        applyCaptureRegion(config);
+        [frameReceiver setCaptureRegionX:captureRegion[0] y:captureRegion[1] width:captureRegion[2] height:captureRegion[3]];
+        stream = [[SCStream alloc] initWithFilter:filter configuration:config delegate:frameReceiver];
+        streamConfig = config;
+    }
 public:
     Impl() {}
 
+    void setFrameRateLimit(int fps) {
+        std::lock_guard<std::mutex> streamLock(streamMutex);
+        if(fps == frameRateLimit){
+            return;
+        }
+        frameRateLimit = fps;
+        if(!stream || !streamConfig){
+            return;
+        }
+        // back to the display rate when the limit is lifted
+        streamConfig.minimumFrameInterval = fps > 0 ? CMTimeMake(1, fps) : kCMTimeZero;
+        updateStreamConfiguration();
+    }
+
+    void setCaptureRegion(int x, int y, int width, int height) {
+        std::lock_guard<std::mutex> streamLock(streamMutex);
+        captureRegion[0] = x;
+        captureRegion[1] = y;
+        captureRegion[2] = std::max(width, 0);
+        captureRegion[3] = std::max(height, 0);
+        if(!stream || !streamConfig){
+            return;
+        }
+        applyCaptureRegion(streamConfig);
+        updateStreamConfiguration();
+    }
+
     ~Impl() {
         stopCapture();
     }
@@ -178,21 +403,19 @@ public:
                  return;
              }
              capMode = CaptureMode::FullDesktopCapture;
-             // Select the main display for capture
-             SCDisplay *display = content.displays.firstObject;
+             // Select the display for capture
+             SCDisplay *display = findCaptureDisplay(content, args.has_value() ? args->displayId : 0);
              if (!display) {
                  NSLog(@"Error: No display found.");
                  dispatch_semaphore_signal(semaphore);  // Signal the semaphore to unblock
                  return;
              }
 
-             // Create a configuration for the capture stream
+             // Create a configuration for the capture stream, at the display's own scale
              SCStreamConfiguration *config = [[SCStreamConfiguration alloc] init];
-             Message windowMsg;
-             auto windowMsgResult = NotificationCenter::getInstance().getPersistentMessage(MessageType::Render, windowMsg);
-             auto windowInfo = (WindowSubMsg*)windowMsg.subMsg.get();
-             config.width = display.width * windowInfo->scalingFactor;
-             config.height = display.height * windowInfo->scalingFactor;
+             auto scale = getDisplayScale(display.displayID);
+             config.width = display.width * scale;
+             config.height = display.height * scale;
              config.pixelFormat = kCVPixelFormatType_32BGRA;
              //config.minimumFrameInterval = CMTimeMake(1, 25);
              config.queueDepth = 5;
@@ -230,7 +453,7 @@ public:
              frameReceiver = [SCFrameReceiver alloc];
              [frameReceiver setCaptureEventName:args->captureEventName];
              [frameReceiver init];
-             stream = [[SCStream alloc] initWithFilter:filter configuration:config delegate:frameReceiver];
+             createStream(filter, config, scale);
              dispatch_queue_t streamQueue = dispatch_queue_create("com.yourAppName.streamOutputQueue", DISPATCH_QUEUE_SERIAL);
              [stream addStreamOutput:frameReceiver type:SCStreamOutputTypeScreen sampleHandlerQueue:streamQueue error:&error];
              NSError *startError = nil;
@@ -267,8 +490,8 @@ public:
                          return;
                      }
                      capMode = CaptureMode::AppCapture;
-                     // Select the main display for capture
-                     SCDisplay *display = content.displays.firstObject;
+                     // Select the display for capture
+                     SCDisplay *display = findCaptureDisplay(content, args.displayId);
                      if (!display) {
                          NSLog(@"Error: No display found.");
                          dispatch_semaphore_signal(semaphore);  // Signal the semaphore to unblock
@@ -287,19 +510,20 @@ public:
                      }
                      // Create a configuration for the capture stream
                      SCStreamConfiguration *config = [[SCStreamConfiguration alloc] init];
-                     Message windowMsg;
-                     auto windowMsgResult = NotificationCenter::getInstance().getPersistentMessage(MessageType::Render, windowMsg);
-                     auto windowInfo = (WindowSubMsg*)windowMsg.subMsg.get();
+                     auto windowInfo = NotificationCenter::getInstance().renderState().load();
 
-                     config.width = display.width * windowInfo->scalingFactor;
-                     config.height = display.height * windowInfo->scalingFactor;
+                     auto scale = getDisplayScale(display.displayID);
+                     config.width = display.width * scale;
+                     config.height = display.height * scale;
                      auto retRect = std::make_tuple(0,0,0,0);
                      getWindowGeometry(args.includingWindowIDs[0], retRect);
-                     windowInfo->capturedAppX = std::get<0>(retRect) * windowInfo->scalingFactor;
-                     windowInfo->capturedAppY = std::get<1>(retRect) * windowInfo->scalingFactor;
-                     windowInfo->capturedAppWidth = std::get<2>(retRect) * windowInfo->scalingFactor;
-                     windowInfo->capturedAppHeight = std::get<3>(retRect) * windowInfo->scalingFactor;
-                     windowInfo->capturedWinId = args.includingWindowIDs[0];
+                     windowInfo = NotificationCenter::getInstance().renderState().update([&](RenderState& state) {
+                         state.capturedAppX = std::get<0>(retRect) * state.scalingFactor;
+                         state.capturedAppY = std::get<1>(retRect) * state.scalingFactor;
+                         state.capturedAppWidth = std::get<2>(retRect) * state.scalingFactor;
+                         state.capturedAppHeight = std::get<3>(retRect) * state.scalingFactor;
+                         state.capturedWinId = args.includingWindowIDs[0];
+                     });
 
                      config.pixelFormat = kCVPixelFormatType_32BGRA;
                      //config.minimumFrameInterval = CMTimeMake(1, 25);
@@ -312,7 +536,7 @@ public:
                      frameReceiver = [SCFrameReceiver alloc];
                      [frameReceiver setCaptureEventName:args.captureEventName];
                      [frameReceiver init];
-                     stream = [[SCStream alloc] initWithFilter:filter configuration:config delegate:frameReceiver];
+                     createStream(filter, config, scale);
                      dispatch_queue_t streamQueue = dispatch_queue_create("com.yourAppName.streamOutputQueue", DISPATCH_QUEUE_SERIAL);
                      [stream addStreamOutput:frameReceiver type:SCStreamOutputTypeScreen sampleHandlerQueue:streamQueue error:&error];
                      NSError *startError = nil;
@@ -349,8 +573,8 @@ public:
                                                              return;
                                                          }
                                                          capMode = CaptureMode::AppCapture;
-                                                         // Select the main display for capture
-                                                         SCDisplay *display = content.displays.firstObject;
+                                                         // Select the display for capture
+                                                         SCDisplay *display = findCaptureDisplay(content, args.displayId);
                                                          if (!display) {
                                                              NSLog(@"Error: No display found.");
                                                              dispatch_semaphore_signal(semaphore);  // Signal the semaphore to unblock
@@ -370,47 +594,51 @@ public:
                                                          }
                                                          // Create a configuration for the capture stream
                                                          SCStreamConfiguration *config = [[SCStreamConfiguration alloc] init];
-                                                         Message windowMsg;
-                                                         auto windowMsgResult = NotificationCenter::getInstance().getPersistentMessage(MessageType::Render, windowMsg);
-                                                         auto windowInfo = (WindowSubMsg*)windowMsg.subMsg.get();
-                                                         config.width = display.width * windowInfo->scalingFactor;
-                                                         config.height = display.height * windowInfo->scalingFactor;
+                                                         auto windowInfo = NotificationCenter::getInstance().renderState().load();
+                                                         auto scale = getDisplayScale(display.displayID);
+                                                         config.width = display.width * scale;
+                                                         config.height = display.height * scale;
                                                          config.pixelFormat = kCVPixelFormatType_32BGRA;
                                                          config.minimumFrameInterval = CMTimeMake(1, 60);
                                                          config.queueDepth = 5;
                                                          config.showsCursor = false;
 
-                                                         config.width = display.width * windowInfo->scalingFactor;
-                                                         config.height = display.height * windowInfo->scalingFactor;
                                                          auto retRect = std::make_tuple(0,0,0,0);
                                                          getWindowGeometry(args.includingWindowIDs[0], retRect);
                                                          auto winIdVecByAnApp = getWindowIDsForAppByName(args.captureAppName);
-                                                         std::vector<int> finalIdVecToExcept;
+                                                         // the app's other windows inside the captured one are left out, tested as one batch
+                                                         WindowRectBatch appWindowRects;
+                                                         appWindowRects.reserve(winIdVecByAnApp.size());
                                                          for(auto id : winIdVecByAnApp){
                                                              auto rectCmp = std::make_tuple(0,0,0,0);
                                                              getWindowGeometry(id, rectCmp);
-                                                             if(isRectInside(retRect, rectCmp) && id != args.includingWindowIDs[0]){
-                                                                 finalIdVecToExcept.push_back(id);
+                                                             appWindowRects.push(rectCmp);
+                                                         }
+                                                         std::vector<uint8_t> insideCaptured;
+                                                         rectsInsideRect(retRect, appWindowRects, insideCaptured);
+                                                         std::vector<int> finalIdVecToExcept;
+                                                         for(size_t i = 0; i < winIdVecByAnApp.size(); i++){
+                                                             if(insideCaptured[i] && winIdVecByAnApp[i] != args.includingWindowIDs[0]){
+                                                                 finalIdVecToExcept.push_back(winIdVecByAnApp[i]);
                                                              }
                                                          }
+                                                         std::sort(finalIdVecToExcept.begin(), finalIdVecToExcept.end());
 
-                                                         NSMutableArray<SCWindow*> *exceptCapWindows = [[content.windows mutableCopy] autorelease];
-                                                         for (int i = (int)[exceptCapWindows count] - 1; i >= 0; i--) {  // Start from the end and move backward
-                                                             auto app = exceptCapWindows[i];
-                                                             auto findResult = std::find(finalIdVecToExcept.begin(),
-                                                                                         finalIdVecToExcept.end(), app.windowID);
-                                                             if (findResult == finalIdVecToExcept.end()) {
-                                                                 [exceptCapWindows removeObjectAtIndex:i];  // Safely remove the element
+                                                         // one pass over the on screen windows, keeping the excepted ones
+                                                         NSMutableArray<SCWindow*> *exceptCapWindows = [NSMutableArray arrayWithCapacity:finalIdVecToExcept.size()];
+                                                         for (SCWindow* window in content.windows) {
+                                                             if (std::binary_search(finalIdVecToExcept.begin(), finalIdVecToExcept.end(), (int)window.windowID)) {
+                                                                 [exceptCapWindows addObject:window];
                                                              }
                                                          }
 
 
-                                                         windowInfo->capturedAppX = std::get<0>(retRect) * windowInfo->scalingFactor;
-                                                         windowInfo->capturedAppY = std::get<1>(retRect) * windowInfo->scalingFactor;
-                                                         windowInfo->capturedAppWidth = std::get<2>(retRect) * windowInfo->scalingFactor;
-                                                         windowInfo->capturedAppHeight = std::get<3>(retRect) * windowInfo->scalingFactor;
-                                                         windowInfo->capturedWinId = args.includingWindowIDs[0];
-                                                         windowInfo->appPid = targetApplication.processID;
+                                                         windowInfo.capturedAppX = std::get<0>(retRect) * windowInfo.scalingFactor;
+                                                         windowInfo.capturedAppY = std::get<1>(retRect) * windowInfo.scalingFactor;
+                                                         windowInfo.capturedAppWidth = std::get<2>(retRect) * windowInfo.scalingFactor;
+                                                         windowInfo.capturedAppHeight = std::get<3>(retRect) * windowInfo.scalingFactor;
+                                                         windowInfo.capturedWinId = args.includingWindowIDs[0];
+                                                         windowInfo.appPid = targetApplication.processID;
 
                                                          // Set up the content filter for the display
                                                          NSArray<SCRunningApplication *> *applicationsArray = [NSArray arrayWithObjects:targetApplication, nil];
@@ -419,7 +647,7 @@ public:
                                                          frameReceiver = [SCFrameReceiver alloc];
                                                          [frameReceiver setCaptureEventName:args.captureEventName];
                                                          [frameReceiver init];
-                                                         stream = [[SCStream alloc] initWithFilter:filter configuration:config delegate:frameReceiver];
+                                                         createStream(filter, config, scale);
                                                          dispatch_queue_t streamQueue = dispatch_queue_create("com.yourAppName.streamOutputQueue", DISPATCH_QUEUE_SERIAL);
                                                          [stream addStreamOutput:frameReceiver type:SCStreamOutputTypeScreen sampleHandlerQueue:streamQueue error:&error];
                                                          NSError *startError = nil;
@@ -476,6 +704,14 @@ void MacOSCaptureSCKit::stopCapture() {
     impl->stopCapture();
 }
 
+void MacOSCaptureSCKit::setFrameRateLimit(int fps) {
+    impl->setFrameRateLimit(fps);
+}
+
+void MacOSCaptureSCKit::setCaptureRegion(int x, int y, int width, int height) {
+    impl->setCaptureRegion(x, y, width, height);
+}
+
 bool MacOSCaptureSCKit::startCaptureWithSpecificWinId(std::optional<CaptureArgs> args) {
     captureStatus = CaptureStatus::Start;
     if(!args.has_value()){
@@ -0,0 +1,163 @@
+#include "DirtyRegion.h"
+#include <algorithm>
+
+DirtyRect DirtyRect::intersected(const DirtyRect& other) const {
+    int left = std::max(x, other.x);
+    int top = std::max(y, other.y);
+    int right = std::min(x + width, other.x + other.width);
+    int bottom = std::min(y + height, other.y + other.height);
+    if (right <= left || bottom <= top) {
+        return {};
+    }
+    return {left, top, right - left, bottom - top};
+}
+
+DirtyRect DirtyRect::united(const DirtyRect& other) const {
+    if (empty()) {
+        return other;
+    }
+    if (other.empty()) {
+        return *this;
+    }
+    int left = std::min(x, other.x);
+    int top = std::min(y, other.y);
+    int right = std::max(x + width, other.x + other.width);
+    int bottom = std::max(y + height, other.y + other.height);
+    return {left, top, right - left, bottom - top};
+}
+
+DirtyRect DirtyRect::inflated(int margin) const {
+    if (empty()) {
+        return {};
+    }
+    return {x - margin, y - margin, width + margin * 2, height + margin * 2};
+}
+
+void DirtyRegion::add(const DirtyRect& rect) {
+    if (everything || rect.empty()) {
+        return;
+    }
+    for (auto& existing : rects) {
+        if (existing.intersected(rect) == rect) {
+            return;
+        }
+    }
+    if (rects.size() >= kMaxRects) {
+        DirtyRect bounds = rect;
+        for (auto& existing : rects) {
+            bounds = bounds.united(existing);
+        }
+        rects.clear();
+        rects.push_back(bounds);
+        return;
+    }
+    rects.push_back(rect);
+}
+
+void DirtyRegion::add(const DirtyRegion& region) {
+    if (everything) {
+        return;
+    }
+    if (region.everything) {
+        markEverything();
+        return;
+    }
+    for (auto& rect : region.rects) {
+        add(rect);
+    }
+}
+
+double DirtyRegion::coverage(int width, int height) const {
+    if (everything) {
+        return 1.0;
+    }
+    if (width <= 0 || height <= 0) {
+        return 0.0;
+    }
+    double changedPixels = 0;
+    for (auto& rect : rects) {
+        auto clipped = rect.intersected({0, 0, width, height});
+        changedPixels += (double)clipped.width * clipped.height;
+    }
+    return std::min(changedPixels / ((double)width * height), 1.0);
+}
+
+void DirtyTileMap::reset(int width, int height) {
+    m_width = std::max(width, 0);
+    m_height = std::max(height, 0);
+    m_tileColumns = (m_width + kTileSize - 1) / kTileSize;
+    m_tileRows = (m_height + kTileSize - 1) / kTileSize;
+    m_tiles.assign((size_t)m_tileColumns * m_tileRows, 0);
+    m_dirtyTileCount = 0;
+}
+
+void DirtyTileMap::markAll() {
+    std::fill(m_tiles.begin(), m_tiles.end(), 1);
+    m_dirtyTileCount = getTileCount();
+}
+
+void DirtyTileMap::markRect(const DirtyRect& rect) {
+    auto clipped = rect.intersected({0, 0, m_width, m_height});
+    if (clipped.empty()) {
+        return;
+    }
+    int firstColumn = clipped.x / kTileSize;
+    int lastColumn = (clipped.x + clipped.width - 1) / kTileSize;
+    int firstRow = clipped.y / kTileSize;
+    int lastRow = (clipped.y + clipped.height - 1) / kTileSize;
+    for (int row = firstRow; row <= lastRow; row++) {
+        auto tileRow = m_tiles.data() + (size_t)row * m_tileColumns;
+        for (int column = firstColumn; column <= lastColumn; column++) {
+            m_dirtyTileCount += tileRow[column] ? 0 : 1;
+            tileRow[column] = 1;
+        }
+    }
+}
+
+void DirtyTileMap::getDirtyTiles(std::vector<uint16_t>& tileCoordinates) const {
+    tileCoordinates.clear();
+    for (int row = 0; row < m_tileRows; row++) {
+        for (int column = 0; column < m_tileColumns; column++) {
+            if (isTileDirty(column, row)) {
+                tileCoordinates.push_back((uint16_t)column);
+                tileCoordinates.push_back((uint16_t)row);
+            }
+        }
+    }
+}
+
+void DirtyTileMap::getDirtyRects(std::vector<DirtyRect>& rects) const {
+    rects.clear();
+    // runs of the previous tile row that can still grow downwards, indices into rects
+    std::vector<size_t> openRuns;
+    std::vector<size_t> rowRuns;
+    for (int row = 0; row < m_tileRows; row++) {
+        rowRuns.clear();
+        int top = row * kTileSize;
+        int height = std::min(kTileSize, m_height - top);
+        for (int column = 0; column < m_tileColumns;) {
+            if (!isTileDirty(column, row)) {
+                column++;
+                continue;
+            }
+            int firstColumn = column;
+            while (column < m_tileColumns && isTileDirty(column, row)) {
+                column++;
+            }
+            int left = firstColumn * kTileSize;
+            int width = std::min(column * kTileSize, m_width) - left;
+
+            auto grown = std::find_if(openRuns.begin(), openRuns.end(), [&](size_t index) {
+                return rects[index].x == left && rects[index].width == width;
+            });
+            if (grown != openRuns.end()) {
+                rects[*grown].height += height;
+                rowRuns.push_back(*grown);
+            } else {
+                rects.push_back({left, top, width, height});
+                rowRuns.push_back(rects.size() - 1);
+            }
+        }
+        openRuns.swap(rowRuns);
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef HIDINGIN_DIRTYREGION_H
+#define HIDINGIN_DIRTYREGION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct DirtyRect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+
+    bool empty() const {
+        return width <= 0 || height <= 0;
+    }
+
+    bool operator==(const DirtyRect& other) const {
+        return x == other.x && y == other.y && width == other.width && height == other.height;
+    }
+
+    DirtyRect intersected(const DirtyRect& other) const;
+    DirtyRect united(const DirtyRect& other) const;
+    DirtyRect inflated(int margin) const;
+    DirtyRect translated(int dx, int dy) const {
+        return {x + dx, y + dy, width, height};
+    }
+};
+
+// what changed in a frame since the previous frame of the same source, in frame pixels. a source that can not
+// tell leaves everything set, so an unknown region always means a full redraw.
+struct DirtyRegion {
+    // past this many rects the region collapses into their bounding box, accumulating stays cheap
+    static constexpr size_t kMaxRects = 32;
+
+    bool everything = true;
+    std::vector<DirtyRect> rects; // only meaningful without everything
+
+    bool isEmpty() const {
+        return !everything && rects.empty();
+    }
+
+    // nothing changed
+    void clear() {
+        everything = false;
+        rects.clear();
+    }
+
+    void markEverything() {
+        everything = true;
+        rects.clear();
+    }
+
+    void add(const DirtyRect& rect);
+    void add(const DirtyRegion& region);
+
+    // share of a width x height frame that changed, 0..1. overlapping rects count twice, so it is an upper bound.
+    double coverage(int width, int height) const;
+};
+
+// fixed grid of kTileSize tiles over an image, the unit the incremental composite works in
+class DirtyTileMap {
+public:
+    static constexpr int kTileSize = 64;
+
+    // nothing dirty
+    void reset(int width, int height);
+
+    void markAll();
+    void markRect(const DirtyRect& rect);
+
+    int getWidth() const { return m_width; }
+    int getHeight() const { return m_height; }
+    int getTileColumns() const { return m_tileColumns; }
+    int getTileRows() const { return m_tileRows; }
+    int getTileCount() const { return m_tileColumns * m_tileRows; }
+    int getDirtyTileCount() const { return m_dirtyTileCount; }
+    bool isEmpty() const { return m_dirtyTileCount == 0; }
+    bool isAllDirty() const { return m_dirtyTileCount == getTileCount(); }
+
+    bool isTileDirty(int column, int row) const {
+        return m_tiles[(size_t)row * m_tileColumns + column] != 0;
+    }
+
+    // tile coordinates (column, row) of every dirty tile, row by row
+    void getDirtyTiles(std::vector<uint16_t>& tileCoordinates) const;
+
+    // the dirty tiles as few rects in pixels, clipped to the image: runs of a tile row are merged, and runs that
+    // repeat in the rows below are stacked into one rect
+    void getDirtyRects(std::vector<DirtyRect>& rects) const;
+
+private:
+    int m_width = 0;
+    int m_height = 0;
+    int m_tileColumns = 0;
+    int m_tileRows = 0;
+    int m_dirtyTileCount = 0;
+    std::vector<uint8_t> m_tiles;
+};
+
+#endif //HIDINGIN_DIRTYREGION_H
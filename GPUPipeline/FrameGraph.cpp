@@ -0,0 +1,309 @@
+#include "FrameGraph.h"
+#include <algorithm>
+#include <iostream>
+
+FrameGraph::FrameGraph(FrameGraphBackend& backend) : m_backend(backend) {
+}
+
+FrameGraph::~FrameGraph() {
+    for (auto& physicalTexture : m_physicalTextures) {
+        if (physicalTexture.texture) {
+            m_backend.destroyTexture(physicalTexture.texture);
+        }
+    }
+}
+
+void FrameGraph::reset() {
+    m_resources.clear();
+    m_passes.clear();
+    m_executionOrder.clear();
+    m_compiled = false;
+}
+
+FrameGraphResource FrameGraph::importTexture(const std::string& name, void* texture, const FrameGraphTextureDesc& desc) {
+    ResourceNode resource;
+    resource.name = name;
+    resource.desc = desc;
+    resource.imported = true;
+    resource.texture = texture;
+    m_resources.push_back(resource);
+    m_compiled = false;
+    return (FrameGraphResource)m_resources.size() - 1;
+}
+
+FrameGraphResource FrameGraph::createTexture(const std::string& name, const FrameGraphTextureDesc& desc) {
+    ResourceNode resource;
+    resource.name = name;
+    resource.desc = desc;
+    m_resources.push_back(resource);
+    m_compiled = false;
+    return (FrameGraphResource)m_resources.size() - 1;
+}
+
+void FrameGraph::addPass(const std::string& name, std::vector<FrameGraphResource> reads,
+                         std::vector<FrameGraphResource> writes, FrameGraphExecuteFunc execute, bool hasSideEffects) {
+    PassNode pass;
+    pass.name = name;
+    pass.reads = std::move(reads);
+    pass.writes = std::move(writes);
+    pass.execute = std::move(execute);
+    pass.hasSideEffects = hasSideEffects;
+    m_passes.push_back(std::move(pass));
+    m_compiled = false;
+}
+
+bool FrameGraph::compile() {
+    m_executionOrder.clear();
+    for (auto& resource : m_resources) {
+        resource.physicalIndex = -1;
+        resource.firstUse = -1;
+        resource.lastUse = -1;
+    }
+    for (auto& pass : m_passes) {
+        pass.culled = false;
+        for (auto resourceIndex : pass.reads) {
+            if (resourceIndex < 0 || resourceIndex >= (int)m_resources.size()) {
+                std::cerr << "frame graph: pass " << pass.name << " reads an unknown resource" << std::endl;
+                return false;
+            }
+        }
+        for (auto resourceIndex : pass.writes) {
+            if (resourceIndex < 0 || resourceIndex >= (int)m_resources.size()) {
+                std::cerr << "frame graph: pass " << pass.name << " writes an unknown resource" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    cullPasses();
+    if (!sortPasses()) {
+        return false;
+    }
+
+    // a transient that is read must have been written earlier in the frame, its content does not survive frames
+    std::vector<bool> written(m_resources.size(), false);
+    for (auto passIndex : m_executionOrder) {
+        auto& pass = m_passes[passIndex];
+        for (auto resourceIndex : pass.reads) {
+            if (!m_resources[resourceIndex].imported && !written[resourceIndex]) {
+                std::cerr << "frame graph: pass " << pass.name << " reads " << m_resources[resourceIndex].name
+                          << " before anything wrote it" << std::endl;
+                return false;
+            }
+        }
+        for (auto resourceIndex : pass.writes) {
+            written[resourceIndex] = true;
+        }
+    }
+
+    assignPhysicalTextures();
+    m_compiled = true;
+    return true;
+}
+
+void FrameGraph::cullPasses() {
+    // walk back from the passes with side effects, whatever they do not reach is dead work
+    std::vector<bool> needed(m_passes.size(), false);
+    std::vector<int> pending;
+    for (int passIndex = 0; passIndex < (int)m_passes.size(); passIndex++) {
+        if (m_passes[passIndex].hasSideEffects) {
+            needed[passIndex] = true;
+            pending.push_back(passIndex);
+        }
+    }
+    while (!pending.empty()) {
+        int passIndex = pending.back();
+        pending.pop_back();
+        for (auto resourceIndex : m_passes[passIndex].reads) {
+            for (int writerIndex = 0; writerIndex < (int)m_passes.size(); writerIndex++) {
+                if (needed[writerIndex]) {
+                    continue;
+                }
+                auto& writes = m_passes[writerIndex].writes;
+                if (std::find(writes.begin(), writes.end(), resourceIndex) != writes.end()) {
+                    needed[writerIndex] = true;
+                    pending.push_back(writerIndex);
+                }
+            }
+        }
+    }
+    for (int passIndex = 0; passIndex < (int)m_passes.size(); passIndex++) {
+        m_passes[passIndex].culled = !needed[passIndex];
+    }
+}
+
+bool FrameGraph::sortPasses() {
+    // kahn over "writer before reader", ties go to declaration order so a linear graph runs as declared
+    auto passCount = (int)m_passes.size();
+    std::vector<std::vector<int>> successors(passCount);
+    std::vector<int> inDegree(passCount, 0);
+    for (int writerIndex = 0; writerIndex < passCount; writerIndex++) {
+        if (m_passes[writerIndex].culled) {
+            continue;
+        }
+        for (auto resourceIndex : m_passes[writerIndex].writes) {
+            for (int readerIndex = 0; readerIndex < passCount; readerIndex++) {
+                if (readerIndex == writerIndex || m_passes[readerIndex].culled) {
+                    continue;
+                }
+                auto& reads = m_passes[readerIndex].reads;
+                if (std::find(reads.begin(), reads.end(), resourceIndex) != reads.end()) {
+                    successors[writerIndex].push_back(readerIndex);
+                    inDegree[readerIndex]++;
+                }
+            }
+        }
+    }
+
+    std::vector<bool> scheduled(passCount, false);
+    for (;;) {
+        int nextPass = -1;
+        for (int passIndex = 0; passIndex < passCount; passIndex++) {
+            if (!m_passes[passIndex].culled && !scheduled[passIndex] && inDegree[passIndex] == 0) {
+                nextPass = passIndex;
+                break;
+            }
+        }
+        if (nextPass < 0) {
+            break;
+        }
+        scheduled[nextPass] = true;
+        m_executionOrder.push_back(nextPass);
+        for (auto successor : successors[nextPass]) {
+            inDegree[successor]--;
+        }
+    }
+
+    for (int passIndex = 0; passIndex < passCount; passIndex++) {
+        if (!m_passes[passIndex].culled && !scheduled[passIndex]) {
+            std::cerr << "frame graph: dependency cycle through pass " << m_passes[passIndex].name << std::endl;
+            m_executionOrder.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+void FrameGraph::assignPhysicalTextures() {
+    for (int position = 0; position < (int)m_executionOrder.size(); position++) {
+        auto& pass = m_passes[m_executionOrder[position]];
+        auto markUse = [&](FrameGraphResource resourceIndex) {
+            auto& resource = m_resources[resourceIndex];
+            if (resource.firstUse < 0) {
+                resource.firstUse = position;
+            }
+            resource.lastUse = position;
+        };
+        std::for_each(pass.reads.begin(), pass.reads.end(), markUse);
+        std::for_each(pass.writes.begin(), pass.writes.end(), markUse);
+    }
+
+    std::vector<int> transients;
+    for (int resourceIndex = 0; resourceIndex < (int)m_resources.size(); resourceIndex++) {
+        auto& resource = m_resources[resourceIndex];
+        if (!resource.imported && resource.firstUse >= 0) {
+            transients.push_back(resourceIndex);
+        }
+    }
+    std::stable_sort(transients.begin(), transients.end(), [this](int lhs, int rhs) {
+        return m_resources[lhs].firstUse < m_resources[rhs].firstUse;
+    });
+
+    // greedy interval packing: a transient takes over a texture of the same desc whose owner is done with it.
+    // the metal passes go through one command queue and the cpu ones run in order, so reuse needs no barrier.
+    std::vector<bool> usedThisFrame(m_physicalTextures.size(), false);
+    for (auto& physicalTexture : m_physicalTextures) {
+        physicalTexture.busyUntil = -1;
+    }
+    for (auto resourceIndex : transients) {
+        auto& resource = m_resources[resourceIndex];
+        int chosen = -1;
+        for (int physicalIndex = 0; physicalIndex < (int)m_physicalTextures.size(); physicalIndex++) {
+            auto& physicalTexture = m_physicalTextures[physicalIndex];
+            if (physicalTexture.desc == resource.desc && physicalTexture.busyUntil < resource.firstUse) {
+                chosen = physicalIndex;
+                break;
+            }
+        }
+        if (chosen < 0) {
+            PhysicalTexture physicalTexture;
+            physicalTexture.desc = resource.desc;
+            physicalTexture.texture = m_backend.createTexture(resource.desc);
+            m_physicalTextures.push_back(physicalTexture);
+            usedThisFrame.push_back(false);
+            chosen = (int)m_physicalTextures.size() - 1;
+        }
+        m_physicalTextures[chosen].busyUntil = resource.lastUse;
+        usedThisFrame[chosen] = true;
+        resource.physicalIndex = chosen;
+        resource.texture = m_physicalTextures[chosen].texture;
+    }
+
+    // textures nobody took this frame belong to an old window size or a dropped stage, give them back
+    std::vector<PhysicalTexture> keptTextures;
+    std::vector<int> remap(m_physicalTextures.size(), -1);
+    for (int physicalIndex = 0; physicalIndex < (int)m_physicalTextures.size(); physicalIndex++) {
+        if (usedThisFrame[physicalIndex]) {
+            remap[physicalIndex] = (int)keptTextures.size();
+            keptTextures.push_back(m_physicalTextures[physicalIndex]);
+        } else if (m_physicalTextures[physicalIndex].texture) {
+            m_backend.destroyTexture(m_physicalTextures[physicalIndex].texture);
+        }
+    }
+    m_physicalTextures.swap(keptTextures);
+    for (auto resourceIndex : transients) {
+        m_resources[resourceIndex].physicalIndex = remap[m_resources[resourceIndex].physicalIndex];
+    }
+}
+
+void FrameGraph::execute() {
+    if (!m_compiled) {
+        std::cerr << "frame graph: execute() without a successful compile()" << std::endl;
+        return;
+    }
+    for (auto passIndex : m_executionOrder) {
+        auto& pass = m_passes[passIndex];
+        if (pass.execute) {
+            FrameGraphPassContext context(*this, pass.name);
+            pass.execute(context);
+        }
+    }
+}
+
+std::vector<std::string> FrameGraph::getExecutionOrder() const {
+    std::vector<std::string> passNames;
+    for (auto passIndex : m_executionOrder) {
+        passNames.push_back(m_passes[passIndex].name);
+    }
+    return passNames;
+}
+
+int FrameGraph::getPhysicalTextureCount() const {
+    return (int)m_physicalTextures.size();
+}
+
+size_t FrameGraph::getPhysicalTextureBytes() const {
+    size_t bytes = 0;
+    for (auto& physicalTexture : m_physicalTextures) {
+        bytes += physicalTexture.desc.byteSize();
+    }
+    return bytes;
+}
+
+size_t FrameGraph::getTransientTextureBytes() const {
+    size_t bytes = 0;
+    for (auto& resource : m_resources) {
+        if (!resource.imported && resource.firstUse >= 0) {
+            bytes += resource.desc.byteSize();
+        }
+    }
+    return bytes;
+}
+
+void* FrameGraphPassContext::getTexture(FrameGraphResource resource) const {
+    return m_graph.m_resources[resource].texture;
+}
+
+const FrameGraphTextureDesc& FrameGraphPassContext::getDesc(FrameGraphResource resource) const {
+    return m_graph.m_resources[resource].desc;
+}
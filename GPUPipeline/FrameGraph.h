@@ -0,0 +1,132 @@
+#ifndef HIDINGIN_FRAMEGRAPH_H
+#define HIDINGIN_FRAMEGRAPH_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+// MTLPixelFormatBGRA8Unorm, kept as a plain int so the graph core does not need the metal headers
+constexpr int kFrameGraphFormatBGRA8 = 80;
+
+struct FrameGraphTextureDesc {
+    int width = 0;
+    int height = 0;
+    int format = kFrameGraphFormatBGRA8;
+
+    bool operator==(const FrameGraphTextureDesc& other) const {
+        return width == other.width && height == other.height && format == other.format;
+    }
+
+    size_t byteSize() const {
+        return (size_t)width * height * 4;
+    }
+};
+
+// creates the physical textures behind the transient resources: id<MTLTexture> on metal, CpuImage* on the cpu
+class FrameGraphBackend {
+public:
+    virtual ~FrameGraphBackend() = default;
+    virtual void* createTexture(const FrameGraphTextureDesc& desc) = 0;
+    virtual void destroyTexture(void* texture) = 0;
+};
+
+using FrameGraphResource = int;
+constexpr FrameGraphResource kInvalidFrameGraphResource = -1;
+
+class FrameGraphPassContext;
+using FrameGraphExecuteFunc = std::function<void(FrameGraphPassContext& context)>;
+
+// declarative per frame pipeline:
+//   1. declare resources (imported = owned outside, e.g. a captured frame or the render target; transient = the
+//      graph allocates it) and passes with the resources they read and write
+//   2. compile(): passes are ordered by their dependencies, passes whose results nobody uses are culled, and
+//      transients whose lifetimes do not overlap share one physical texture when their descs match
+//   3. execute(): runs the surviving passes in order
+// the physical textures survive reset() and are reused by the next compile(), so a steady graph does not allocate.
+class FrameGraph {
+public:
+    explicit FrameGraph(FrameGraphBackend& backend);
+    ~FrameGraph();
+
+    FrameGraph(const FrameGraph&) = delete;
+    FrameGraph& operator=(const FrameGraph&) = delete;
+
+    // forget passes and resources, keep the physical textures for the next frame
+    void reset();
+
+    FrameGraphResource importTexture(const std::string& name, void* texture, const FrameGraphTextureDesc& desc);
+    FrameGraphResource createTexture(const std::string& name, const FrameGraphTextureDesc& desc);
+
+    // passes with side effects (present) are never culled, the others only live if somebody reads what they write
+    void addPass(const std::string& name, std::vector<FrameGraphResource> reads, std::vector<FrameGraphResource> writes,
+                 FrameGraphExecuteFunc execute, bool hasSideEffects = false);
+
+    bool compile();
+    void execute();
+
+    // introspection, mostly for the bench and the cpu tests
+    std::vector<std::string> getExecutionOrder() const;
+    int getPhysicalTextureCount() const;
+    size_t getPhysicalTextureBytes() const;  // what the graph holds with aliasing
+    size_t getTransientTextureBytes() const; // what one texture per transient would hold
+
+private:
+    friend class FrameGraphPassContext;
+
+    struct ResourceNode {
+        std::string name;
+        FrameGraphTextureDesc desc;
+        bool imported = false;
+        void* texture = nullptr;
+        int physicalIndex = -1;
+        int firstUse = -1; // position in m_executionOrder
+        int lastUse = -1;
+    };
+
+    struct PassNode {
+        std::string name;
+        std::vector<FrameGraphResource> reads;
+        std::vector<FrameGraphResource> writes;
+        FrameGraphExecuteFunc execute;
+        bool hasSideEffects = false;
+        bool culled = false;
+    };
+
+    struct PhysicalTexture {
+        FrameGraphTextureDesc desc;
+        void* texture = nullptr;
+        int busyUntil = -1; // last pass of the current owner, only meaningful during compile()
+    };
+
+    bool sortPasses();
+    void cullPasses();
+    void assignPhysicalTextures();
+
+    FrameGraphBackend& m_backend;
+    std::vector<ResourceNode> m_resources;
+    std::vector<PassNode> m_passes;
+    std::vector<int> m_executionOrder; // indices into m_passes, culled passes excluded
+    std::vector<PhysicalTexture> m_physicalTextures;
+    bool m_compiled = false;
+};
+
+class FrameGraphPassContext {
+public:
+    FrameGraphPassContext(FrameGraph& graph, const std::string& passName) : m_graph(graph), m_passName(passName) {
+    }
+
+    void* getTexture(FrameGraphResource resource) const;
+    const FrameGraphTextureDesc& getDesc(FrameGraphResource resource) const;
+
+    const std::string& getPassName() const {
+        return m_passName;
+    }
+
+private:
+    FrameGraph& m_graph;
+    const std::string& m_passName;
+};
+
+#endif //HIDINGIN_FRAMEGRAPH_H
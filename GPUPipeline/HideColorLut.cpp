@@ -0,0 +1,155 @@
+#include "HideColorLut.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+
+static inline float clampVal(float value, float minVal, float maxVal) {
+    return std::min(std::max(value, minVal), maxVal);
+}
+
+static inline uint32_t toUnorm8(float value) {
+    return (uint32_t)std::lrintf(clampVal(value, 0.0f, 1.0f) * 255.0f);
+}
+
+// lightness range of the shift lightness (percent) is in, the branches of adjust_hsl_to_stand_out_in_environment
+// in order: 0 low light, 1 lower diffuse, 2 upper diffuse, 3 specular
+static int lightnessBranch(const HideEffectParams& params, float lightness) {
+    if (lightness > params.specularThreshold) {
+        return 3;
+    }
+    if (lightness < params.lowLightThreshold) {
+        return 0;
+    }
+    return lightness > params.diffuseThreshold ? 2 : 1;
+}
+
+// rgb_to_hsl's lightness in percent
+static float lightnessOf(float R, float G, float B) {
+    float maxVal = std::max(R, std::max(G, B));
+    float minVal = std::min(R, std::min(G, B));
+    return (maxVal + minVal) / 2.0f * 100.0f;
+}
+
+// adjust_hsl_to_stand_out_in_environment as textureBlendHide.metal had it, with the constants pulled out and the
+// lightness range given instead of picked by the color's lightness
+static void adjustHslInBranch(const HideEffectParams& params, int branch, float R, float G, float B, float& outR,
+                              float& outG, float& outB) {
+    // rgb_to_hsl
+    float maxVal = std::max(R, std::max(G, B));
+    float minVal = std::min(R, std::min(G, B));
+    float delta = maxVal - minVal;
+    float L = (maxVal + minVal) / 2.0f;
+    float S = 0.0f;
+    float H = 0.0f;
+    if (delta != 0.0f) {
+        if (L < 0.5f) {
+            S = delta / (maxVal + minVal);
+        } else {
+            S = delta / (2.0f - maxVal - minVal);
+        }
+        if (maxVal == R) {
+            H = ((G - B) / delta) + (G < B ? 6.0f : 0.0f);
+        } else if (maxVal == G) {
+            H = ((B - R) / delta) + 2.0f;
+        } else {
+            H = ((R - G) / delta) + 4.0f;
+        }
+        H *= 60.0f;
+    }
+    float hue = H;
+    float saturation = S * 100.0f;
+    float lightness = L * 100.0f;
+
+    // stand out adjustment
+    float hueShift;
+    if (branch == 3) {
+        lightness = clampVal(lightness - params.specularLightnessDrop, 0.0f, 100.0f);
+        hueShift = params.specularHueShift;
+    } else if (branch == 0) {
+        lightness = clampVal(lightness + params.lowLightLightnessLift, 0.0f, 100.0f);
+        hueShift = params.lowLightHueShift;
+    } else {
+        if (branch == 2) {
+            lightness = clampVal(params.lowLightThreshold + (lightness - params.specularThreshold) * params.upperDiffuseScale,
+                                 0.0f, 100.0f);
+        } else {
+            lightness = clampVal(params.specularThreshold - (params.lowLightThreshold - lightness) * params.lowerDiffuseScale,
+                                 0.0f, 100.0f);
+        }
+        hueShift = params.diffuseHueShift;
+    }
+    // a negative shift from a slider still has to land in [0, 360). a hue a rounding error below 0 comes back as
+    // exactly 360 in float, which no sector of hsl_to_rgb takes and would come out gray.
+    hue = std::fmod(hue + hueShift, 360.0f);
+    if (hue < 0.0f) {
+        hue += 360.0f;
+    }
+    if (hue >= 360.0f) {
+        hue = 0.0f;
+    }
+
+    // hsl_to_rgb
+    float s = saturation / 100.0f;
+    float l = lightness / 100.0f;
+    float C = (1.0f - std::fabs(2.0f * l - 1.0f)) * s;
+    float hPrime = hue / 60.0f;
+    float X = C * (1.0f - std::fabs(std::fmod(hPrime, 2.0f) - 1.0f));
+    float r = 0.0f, g = 0.0f, b = 0.0f;
+    if (hPrime < 1.0f) {
+        r = C; g = X;
+    } else if (hPrime < 2.0f) {
+        r = X; g = C;
+    } else if (hPrime < 3.0f) {
+        g = C; b = X;
+    } else if (hPrime < 4.0f) {
+        g = X; b = C;
+    } else if (hPrime < 5.0f) {
+        r = X; b = C;
+    } else if (hPrime < 6.0f) {
+        r = C; b = X;
+    }
+    float m = l - C / 2.0f;
+    outR = r + m;
+    outG = g + m;
+    outB = b + m;
+}
+
+void adjustHslToStandOut(const HideEffectParams& params, float R, float G, float B, float& outR, float& outG, float& outB) {
+    adjustHslInBranch(params, lightnessBranch(params, lightnessOf(R, G, B)), R, G, B, outR, outG, outB);
+}
+
+static std::atomic<uint64_t> s_nextLutId{1};
+
+HideColorLut::HideColorLut(const HideEffectParams& params)
+        : m_params(params), m_entries(kHideLutEntries), m_id(s_nextLutId++) {
+    const float step = 1.0f / (kHideLutSize - 1);
+    size_t entry = 0;
+    for (int branch = 0; branch < kHideLutBranches; branch++) {
+        for (int b = 0; b < kHideLutSize; b++) {
+            for (int g = 0; g < kHideLutSize; g++) {
+                for (int r = 0; r < kHideLutSize; r++) {
+                    float outR, outG, outB;
+                    adjustHslInBranch(params, branch, r * step, g * step, b * step, outR, outG, outB);
+                    m_entries[entry++] = 0xFF000000u | (toUnorm8(outR) << 16) | (toUnorm8(outG) << 8) | toUnorm8(outB);
+                }
+            }
+        }
+    }
+    // lightness only depends on max + min. the split of the sum only changes the float rounding, which no threshold
+    // lies close enough to for it to matter.
+    for (int sum = 0; sum <= 510; sum++) {
+        float lightness = lightnessOf((sum + 1) / 2 / 255.0f, sum / 2 / 255.0f, sum / 2 / 255.0f);
+        m_entries[entry++] = (uint32_t)(lightnessBranch(params, lightness) * kHideLutLatticeEntries);
+    }
+}
+
+std::shared_ptr<const HideColorLut> HideColorLut::forParams(const HideEffectParams& params) {
+    static std::mutex mutex;
+    static std::shared_ptr<const HideColorLut> lastLut;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!lastLut || lastLut->getParams() != params) {
+        lastLut = std::make_shared<const HideColorLut>(params);
+    }
+    return lastLut;
+}
@@ -0,0 +1,146 @@
+#ifndef HIDINGIN_HIDECOLORLUT_H
+#define HIDINGIN_HIDECOLORLUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// knobs of the hsl "stand out" shift the hide stage applies to the env under the app's edges. the defaults are the
+// constants adjust_hsl_to_stand_out_in_environment always had. lightness and thresholds are in percent, hue in degrees.
+struct HideEffectParams {
+    float specularThreshold = 75.0f;   // above: darkened
+    float diffuseThreshold = 45.0f;    // splits the mid range
+    float lowLightThreshold = 25.0f;   // below: lifted
+    float specularLightnessDrop = 10.0f;
+    float lowLightLightnessLift = 22.5f;
+    float upperDiffuseScale = 0.7f;
+    float lowerDiffuseScale = 0.5f;
+    float specularHueShift = 18.0f;
+    float lowLightHueShift = 25.0f;
+    float diffuseHueShift = 10.0f;
+
+    bool operator==(const HideEffectParams& other) const {
+        return specularThreshold == other.specularThreshold && diffuseThreshold == other.diffuseThreshold &&
+               lowLightThreshold == other.lowLightThreshold && specularLightnessDrop == other.specularLightnessDrop &&
+               lowLightLightnessLift == other.lowLightLightnessLift && upperDiffuseScale == other.upperDiffuseScale &&
+               lowerDiffuseScale == other.lowerDiffuseScale && specularHueShift == other.specularHueShift &&
+               lowLightHueShift == other.lowLightHueShift && diffuseHueShift == other.diffuseHueShift;
+    }
+
+    bool operator!=(const HideEffectParams& other) const {
+        return !(*this == other);
+    }
+};
+
+// lattice points per channel, HIDE_LUT_SIZE in highPassHideCompute.metal / textureBlendHide.metal
+constexpr int kHideLutSize = 33;
+constexpr int kHideLutLatticeEntries = kHideLutSize * kHideLutSize * kHideLutSize;
+// the lightness ranges the shift treats differently: low light, lower diffuse, upper diffuse, specular
+constexpr int kHideLutBranches = 4;
+// entry of the lattice offset of max + min = 0, max + min = 510 is the last entry
+constexpr int kHideLutBranchTable = kHideLutBranches * kHideLutLatticeEntries;
+constexpr int kHideLutEntries = kHideLutBranchTable + 511;
+
+// the stand out shift baked into kHideLutSize^3 lattices over the 8 bit rgb cube, so the hide stage does a lookup
+// per pixel instead of rgb -> hsl -> rgb. entries are opaque BGRA8 pixels as little endian uint32, entry
+// branch * N^3 + (b * N + g) * N + r holds the shift of rgb (r, g, b) * 255 / (N - 1) as its lightness range
+// shifts it, whatever the lightness of (r, g, b) is.
+//
+// the shift jumps at the lightness thresholds (45% comes out as 85% or 4%), which no lattice can interpolate
+// across. lightness is (max + min) / 2 though, exact from the 8 bit channels: the branch table after the lattices
+// maps max + min to the lattice of its range, and within a range the shift is continuous. what is left of the
+// error is next to black and white, where the saturation of a color one step off gray is already 100%.
+//
+// sampling is tetrahedral in integers (sampleHideColorLut), the cpu kernels and both shaders do the same operations
+// so every backend writes the same bytes.
+class HideColorLut {
+public:
+    explicit HideColorLut(const HideEffectParams& params);
+
+    // the lut for params, shared and only rebuilt when params differ from the last call's
+    static std::shared_ptr<const HideColorLut> forParams(const HideEffectParams& params);
+
+    const HideEffectParams& getParams() const {
+        return m_params;
+    }
+
+    const uint32_t* data() const {
+        return m_entries.data();
+    }
+
+    size_t byteSize() const {
+        return m_entries.size() * sizeof(uint32_t);
+    }
+
+    // different for every lut built in this process, for caches of the uploaded copy
+    uint64_t getId() const {
+        return m_id;
+    }
+
+private:
+    HideEffectParams m_params;
+    std::vector<uint32_t> m_entries;
+    uint64_t m_id = 0;
+};
+
+// exact (unbaked) shift of one color, rgb in [0, 1]
+void adjustHslToStandOut(const HideEffectParams& params, float r, float g, float b, float& outR, float& outG, float& outB);
+
+// value / 255 for value in [0, 65534] without a divide, the simd paths use the same trick
+inline uint32_t divideBy255(uint32_t value) {
+    return (value + 1 + (value >> 8)) >> 8;
+}
+
+// lattice cell of an 8 bit channel and the position inside it in 1/256
+inline void hideLutCell(uint32_t value, uint32_t& index, uint32_t& fraction) {
+    uint32_t position = value * (kHideLutSize - 1);
+    index = divideBy255(position);
+    if (index > kHideLutSize - 2) {
+        index = kHideLutSize - 2;
+    }
+    fraction = divideBy255((position - index * 255) * 256 + 127);
+}
+
+// the lut's shift of a BGRA8 pixel (alpha ignored, comes out opaque). the lattice is the one of the pixel's
+// lightness range, its cell is split into 6 tetrahedra by the order of the channel fractions, the 4 corners of the
+// one the pixel is in get weights that add up to 256.
+inline uint32_t sampleHideColorLut(const uint32_t* lut, uint32_t pixel) {
+    constexpr uint32_t kStrideG = kHideLutSize;
+    constexpr uint32_t kStrideB = kHideLutSize * kHideLutSize;
+    uint32_t red = (pixel >> 16) & 0xFF;
+    uint32_t green = (pixel >> 8) & 0xFF;
+    uint32_t blue = pixel & 0xFF;
+    uint32_t maxValue = red > green ? red : green;
+    maxValue = maxValue > blue ? maxValue : blue;
+    uint32_t minValue = red < green ? red : green;
+    minValue = minValue < blue ? minValue : blue;
+    uint32_t indexR, indexG, indexB, fracR, fracG, fracB;
+    hideLutCell(red, indexR, fracR);
+    hideLutCell(green, indexG, fracG);
+    hideLutCell(blue, indexB, fracB);
+    uint32_t base = lut[kHideLutBranchTable + maxValue + minValue] + indexB * kStrideB + indexG * kStrideG + indexR;
+
+    uint32_t fracMax = fracR > fracG ? fracR : fracG;
+    fracMax = fracMax > fracB ? fracMax : fracB;
+    uint32_t fracMin = fracR < fracG ? fracR : fracG;
+    fracMin = fracMin < fracB ? fracMin : fracB;
+    uint32_t fracMid = fracR + fracG + fracB - fracMax - fracMin;
+    // a tie gives the corner it picks a zero weight, so any of the tied channels will do
+    uint32_t strideMax = (fracR >= fracG && fracR >= fracB) ? 1 : (fracG >= fracB ? kStrideG : kStrideB);
+    uint32_t strideMin = (fracR <= fracG && fracR <= fracB) ? 1 : (fracG <= fracB ? kStrideG : kStrideB);
+    constexpr uint32_t kStrideAll = 1 + kStrideG + kStrideB;
+
+    uint32_t corners[4] = {lut[base], lut[base + strideMax], lut[base + kStrideAll - strideMin], lut[base + kStrideAll]};
+    uint32_t weights[4] = {256 - fracMax, fracMax - fracMid, fracMid - fracMin, fracMin};
+    // r / b and g / a blend as two 16 bit lanes each, 256 * 255 + 128 fits
+    uint32_t redBlue = 0x00800080;
+    uint32_t greenAlpha = 0x00800080;
+    for (int i = 0; i < 4; i++) {
+        redBlue += weights[i] * (corners[i] & 0x00FF00FF);
+        greenAlpha += weights[i] * ((corners[i] >> 8) & 0x00FF00FF);
+    }
+    return ((redBlue >> 8) & 0x00FF00FF) | (greenAlpha & 0xFF00FF00);
+}
+
+#endif //HIDINGIN_HIDECOLORLUT_H
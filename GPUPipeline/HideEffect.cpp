@@ -0,0 +1,117 @@
+#include "HideEffect.h"
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include "PipelineVariantCache.h"
+
+HighPassKernel HighPassKernel::forSigma(float sigma) {
+    HighPassKernel kernel;
+    kernel.radius = 0;
+    kernel.weights[0] = 256;
+    for (int i = 1; i <= kMaxHighPassRadius; i++) {
+        kernel.weights[i] = 0;
+    }
+    if (!(sigma > 0.0f)) {
+        return kernel;
+    }
+    double taps[kMaxHighPassRadius + 1];
+    double sum = 0.0;
+    for (int i = 0; i <= kMaxHighPassRadius; i++) {
+        taps[i] = std::exp(-(double)(i * i) / (2.0 * sigma * sigma));
+        sum += i == 0 ? taps[i] : 2.0 * taps[i];
+    }
+    // a wider sigma is cut at kMaxHighPassRadius, the taps that are left still add up to 256
+    uint32_t outerSum = 0;
+    for (int i = 1; i <= kMaxHighPassRadius; i++) {
+        kernel.weights[i] = (uint32_t)std::lrint(256.0 * taps[i] / sum);
+        outerSum += kernel.weights[i];
+    }
+    kernel.weights[0] = 256 - 2 * outerSum;
+    // near flat taps (sigma past ~6) can round the center below its neighbours, a tap above its inner neighbour
+    // hands the unit inwards, the sum stays the same
+    for (bool moved = true; moved;) {
+        moved = false;
+        for (int i = 1; i <= kMaxHighPassRadius; i++) {
+            if (kernel.weights[i] > kernel.weights[i - 1]) {
+                kernel.weights[i]--;
+                kernel.weights[i - 1] += i == 1 ? 2 : 1;
+                moved = true;
+            }
+        }
+    }
+    for (int i = 1; i <= kMaxHighPassRadius; i++) {
+        if (kernel.weights[i] > 0) {
+            kernel.radius = i;
+        }
+    }
+    return kernel;
+}
+
+uint64_t HideEffectSettings::hash() const {
+    const float values[] = {colorShift.specularThreshold, colorShift.diffuseThreshold, colorShift.lowLightThreshold,
+                            colorShift.specularLightnessDrop, colorShift.lowLightLightnessLift, colorShift.upperDiffuseScale,
+                            colorShift.lowerDiffuseScale, colorShift.specularHueShift, colorShift.lowLightHueShift,
+                            colorShift.diffuseHueShift, highPassGain, highPassSigma};
+    // fnv-1a over the bits
+    uint64_t hash = 14695981039346656037ull;
+    for (float value : values) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        for (int i = 0; i < 4; i++) {
+            hash = (hash ^ ((bits >> (i * 8)) & 0xFF)) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+// smallest 8 bit high pass value the old color2 * 1.2 < 0.001 test did not count as black, 256 when none
+static uint32_t keepEnvBelowForGain(float gain) {
+    for (uint32_t value = 1; value < 256; value++) {
+        if (value / 255.0f * gain >= 0.001f) {
+            return value;
+        }
+    }
+    return 256;
+}
+
+static std::atomic<uint64_t> s_nextEffectId{1};
+
+HideEffect::HideEffect(const HideEffectSettings& settings)
+        : m_settings(settings), m_highPassKernel(HighPassKernel::forSigma(settings.highPassSigma)),
+          m_colorLut(HideColorLut::forParams(settings.colorShift)), m_id(s_nextEffectId++) {
+    m_specialization.highPassRadius = m_highPassKernel.radius;
+    for (int i = 0; i <= kMaxHighPassRadius; i++) {
+        m_uniforms.highPassWeights[i] = m_highPassKernel.weights[i];
+    }
+    m_uniforms.keepEnvBelow = keepEnvBelowForGain(settings.highPassGain);
+}
+
+static PipelineVariantCache& effectCache() {
+    static PipelineVariantCache cache("hideEffectBaker", 8);
+    return cache;
+}
+
+std::shared_ptr<const HideEffect> HideEffect::getDefault() {
+    static auto defaultEffect = [] {
+        auto effect = std::make_shared<const HideEffect>(HideEffectSettings{});
+        effectCache().insert(effect->getSettings().hash(), std::const_pointer_cast<HideEffect>(effect));
+        return effect;
+    }();
+    return defaultEffect;
+}
+
+std::shared_ptr<const HideEffect> HideEffect::request(const HideEffectSettings& settings) {
+    auto defaultEffect = getDefault();
+    if (settings == defaultEffect->getSettings()) {
+        return defaultEffect;
+    }
+    auto variant = effectCache().request(settings.hash(), [settings]() -> PipelineVariantCache::Variant {
+        return std::make_shared<HideEffect>(settings);
+    });
+    auto effect = std::static_pointer_cast<const HideEffect>(variant);
+    // a hash collision keeps the effect there is
+    if (effect && effect->getSettings() != settings) {
+        return nullptr;
+    }
+    return effect;
+}
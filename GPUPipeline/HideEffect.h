@@ -0,0 +1,116 @@
+#ifndef HIDINGIN_HIDEEFFECT_H
+#define HIDINGIN_HIDEEFFECT_H
+
+#include <cstdint>
+#include <memory>
+#include "HideColorLut.h"
+
+// widest high pass gaussian the shaders leave apron for, sigma ~1.3
+constexpr int kMaxHighPassRadius = 3;
+
+// the high pass gaussian in integers: weights[0] is the center tap, weights[i] the two taps i pixels away, the
+// 2 * radius + 1 taps of a row add up to 256 (the cpu kernels and the fused shader blur the same way). sigma 0.5 is
+// radius 1 with 27 / 202 / 27, what MPSImageGaussianBlur(0.5) gave before the blur was tunable.
+struct HighPassKernel {
+    int radius = 1;
+    uint32_t weights[kMaxHighPassRadius + 1] = {202, 27, 0, 0};
+
+    static HighPassKernel forSigma(float sigma);
+};
+
+// everything about the hide effect that can be retuned at runtime, the defaults are what the shaders had hard coded
+struct HideEffectSettings {
+    HideEffectParams colorShift;  // baked into the HideColorLut
+    float highPassGain = 1.2f;    // color2 *= 1.2 of hidingShader: how faint an app edge still shifts the env
+    float highPassSigma = 0.5f;   // of the gaussian the high pass subtracts
+
+    bool operator==(const HideEffectSettings& other) const {
+        return colorShift == other.colorShift && highPassGain == other.highPassGain && highPassSigma == other.highPassSigma;
+    }
+
+    bool operator!=(const HideEffectSettings& other) const {
+        return !(*this == other);
+    }
+
+    uint64_t hash() const;
+};
+
+// the part of the settings that changes the code the hide shaders run: function constants of highPassHideCompute.metal,
+// one pipeline state per value. the rest reaches the shaders as HideEffectUniforms.
+struct HideEffectSpecialization {
+    int highPassRadius = 1;  // kHighPassRadius, the loop bounds of the fused gaussian
+
+    bool operator==(const HideEffectSpecialization& other) const {
+        return highPassRadius == other.highPassRadius;
+    }
+
+    bool operator!=(const HideEffectSpecialization& other) const {
+        return !(*this == other);
+    }
+
+    uint64_t hash() const {
+        return (uint64_t)highPassRadius;
+    }
+};
+
+// head of the buffer the hide shaders get, the HideColorLut follows right after it. layout of HideEffectUniforms in
+// highPassHideCompute.metal / textureBlendHide.metal.
+struct HideEffectUniforms {
+    uint32_t highPassWeights[kMaxHighPassRadius + 1];
+    uint32_t keepEnvBelow;  // an env pixel is left alone when every high pass channel is below this
+    uint32_t padding[11];
+};
+static_assert(sizeof(HideEffectUniforms) == 64, "the shaders expect a 64 byte head");
+
+// a HideEffectSettings made ready to run: the lut baked, the gaussian taps and thresholds worked out. immutable, the
+// passes of a frame share one and a retune makes a new one. baking the lut takes a few ms, so frames do not build
+// these themselves: selectHideEffect (HidingFrameGraph.h) asks for one in the background and keeps the old one
+// until it is there.
+class HideEffect {
+public:
+    explicit HideEffect(const HideEffectSettings& settings);
+
+    // the default settings' effect, built once on first use
+    static std::shared_ptr<const HideEffect> getDefault();
+    // the effect for settings if it is built, otherwise null and it is baked in the background
+    static std::shared_ptr<const HideEffect> request(const HideEffectSettings& settings);
+
+    const HideEffectSettings& getSettings() const {
+        return m_settings;
+    }
+
+    const HideEffectSpecialization& getSpecialization() const {
+        return m_specialization;
+    }
+
+    const HighPassKernel& getHighPassKernel() const {
+        return m_highPassKernel;
+    }
+
+    uint32_t getKeepEnvBelow() const {
+        return m_uniforms.keepEnvBelow;
+    }
+
+    const HideEffectUniforms& getUniforms() const {
+        return m_uniforms;
+    }
+
+    const HideColorLut& getColorLut() const {
+        return *m_colorLut;
+    }
+
+    // different for every effect built in this process, for caches of the uploaded copy
+    uint64_t getId() const {
+        return m_id;
+    }
+
+private:
+    HideEffectSettings m_settings;
+    HideEffectSpecialization m_specialization;
+    HighPassKernel m_highPassKernel;
+    HideEffectUniforms m_uniforms{};
+    std::shared_ptr<const HideColorLut> m_colorLut;
+    uint64_t m_id = 0;
+};
+
+#endif //HIDINGIN_HIDEEFFECT_H
@@ -0,0 +1,302 @@
+#include "HidingFrameGraph.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+// past this many rects or half the tiles, patching costs more encodes than it saves pixels
+static constexpr size_t kMaxIncrementalRects = 16;
+
+static const HideEffect& hideEffectOf(const HidingCompositeDesc& desc) {
+    if (desc.hideEffect) {
+        return *desc.hideEffect;
+    }
+    static auto defaultEffect = HideEffect::getDefault();
+    return *defaultEffect;
+}
+
+bool isSameHidingScene(const HidingCompositeDesc& a, const HidingCompositeDesc& b) {
+    return a.presentTarget == b.presentTarget && a.outputDesc == b.outputDesc &&
+           (a.envFrame != nullptr) == (b.envFrame != nullptr) && a.envFrameDesc == b.envFrameDesc && a.envCrop == b.envCrop &&
+           (a.appFrame != nullptr) == (b.appFrame != nullptr) && a.appFrameDesc == b.appFrameDesc && a.appCrop == b.appCrop &&
+           a.appCropWidth == b.appCropWidth && a.appCropHeight == b.appCropHeight &&
+           a.envParts == b.envParts && a.appParts == b.appParts &&
+           a.showAppContent == b.showAppContent && a.fusedHighPassHide == b.fusedHighPassHide &&
+           hideEffectOf(a).getSettings() == hideEffectOf(b).getSettings();
+}
+
+std::shared_ptr<const HideEffect> selectHideEffect(const std::shared_ptr<const HideEffect>& current,
+                                                   const HideEffectSettings& wanted, HidingStageExecutor& executor) {
+    auto effect = current ? current : HideEffect::getDefault();
+    if (effect->getSettings() == wanted) {
+        return effect;
+    }
+    auto wantedEffect = HideEffect::request(wanted);
+    if (!wantedEffect || !executor.isHideEffectReady(wantedEffect->getSpecialization())) {
+        return effect;
+    }
+    return wantedEffect;
+}
+
+// the part of a crop that lands in rect, same shift
+static FrameGraphCrop cropInsideRect(const FrameGraphCrop& crop, const DirtyRect& rect) {
+    auto writeRect = DirtyRect{crop.writeX, crop.writeY, crop.width, crop.height}.intersected(rect);
+    return {crop.x, crop.y, writeRect.width, writeRect.height, writeRect.x, writeRect.y};
+}
+
+// destination pixels of a srcSize -> dstSize bilinear scale that read the source range [begin, end), one extra
+// pixel each side against rounding. a destination pixel d reads floor(p) and floor(p) + 1, p = (d + 0.5) * r - 0.5.
+static void scaledRange(int begin, int end, int srcSize, int dstSize, int& scaledBegin, int& scaledEnd) {
+    double ratio = (double)srcSize / dstSize;
+    scaledBegin = (int)std::floor((begin - 0.5) / ratio - 0.5) - 1;
+    scaledEnd = (int)std::ceil((end + 0.5) / ratio - 0.5) + 1;
+}
+
+// the other way round: source pixels the destination range [begin, end) reads
+static void sourceRange(int begin, int end, int srcSize, int dstSize, int& sourceBegin, int& sourceEnd) {
+    double ratio = (double)srcSize / dstSize;
+    sourceBegin = (int)std::floor((begin + 0.5) * ratio - 0.5) - 1;
+    sourceEnd = (int)std::floor((end - 0.5) * ratio - 0.5) + 3;
+}
+
+void markHidingOutputDirtyTiles(const HidingCompositeDesc& desc, const DirtyRegion& envDirty, const DirtyRegion& appDirty,
+                                DirtyTileMap& outputDirty) {
+    auto outputDesc = desc.outputDesc;
+    outputDirty.reset(outputDesc.width, outputDesc.height);
+    if (desc.envFrame) {
+        if (envDirty.everything) {
+            outputDirty.markAll();
+            return;
+        }
+        auto envWriteRect = DirtyRect{desc.envCrop.writeX, desc.envCrop.writeY, desc.envCrop.width, desc.envCrop.height};
+        for (auto& rect : envDirty.rects) {
+            outputDirty.markRect(rect.translated(-desc.envCrop.x, -desc.envCrop.y).intersected(envWriteRect));
+        }
+    }
+    if (!desc.appFrame || (desc.envFrame && !desc.showAppContent)) {
+        return;
+    }
+    if (appDirty.everything) {
+        outputDirty.markAll();
+        return;
+    }
+    auto appWriteRect = DirtyRect{desc.appCrop.writeX, desc.appCrop.writeY, desc.appCrop.width, desc.appCrop.height};
+    bool scaled = desc.appCropWidth != outputDesc.width || desc.appCropHeight != outputDesc.height;
+    int highPassRadius = hideEffectOf(desc).getHighPassKernel().radius;
+    for (auto& rect : appDirty.rects) {
+        auto cropped = rect.translated(-desc.appCrop.x, -desc.appCrop.y).intersected(appWriteRect);
+        if (cropped.empty()) {
+            continue;
+        }
+        if (scaled) {
+            int left, right, top, bottom;
+            scaledRange(cropped.x, cropped.x + cropped.width, desc.appCropWidth, outputDesc.width, left, right);
+            scaledRange(cropped.y, cropped.y + cropped.height, desc.appCropHeight, outputDesc.height, top, bottom);
+            cropped = {left, top, right - left, bottom - top};
+        }
+        // the gaussian spreads every change by its radius
+        outputDirty.markRect(cropped.inflated(highPassRadius));
+    }
+}
+
+namespace {
+// what an incremental composite redraws in each intermediate
+struct HidingIncrementalRegion {
+    std::vector<DirtyRect> envRects;       // envCropped, the output tiles
+    std::vector<DirtyRect> appOutputRects; // scaled app, tiles plus the gaussian apron
+    std::vector<DirtyRect> appCropRects;   // appCropped, what the scale reads for appOutputRects
+};
+}
+
+static bool buildIncrementalRegion(const HidingCompositeDesc& desc, HidingIncrementalRegion& region) {
+    auto dirtyTiles = desc.outputDirtyTiles;
+    if (!dirtyTiles || !desc.fusedHighPassHide || !desc.envFrame || !desc.appFrame || !desc.showAppContent ||
+        !desc.envParts.empty() || !desc.appParts.empty() ||
+        dirtyTiles->getWidth() != desc.outputDesc.width || dirtyTiles->getHeight() != desc.outputDesc.height ||
+        dirtyTiles->getDirtyTileCount() * 2 > dirtyTiles->getTileCount()) {
+        return false;
+    }
+    dirtyTiles->getDirtyRects(region.envRects);
+    if (region.envRects.size() > kMaxIncrementalRects) {
+        return false;
+    }
+    auto outputRect = DirtyRect{0, 0, desc.outputDesc.width, desc.outputDesc.height};
+    auto appCropRect = DirtyRect{0, 0, desc.appCropWidth, desc.appCropHeight};
+    bool scaled = desc.appCropWidth != desc.outputDesc.width || desc.appCropHeight != desc.outputDesc.height;
+    int highPassRadius = hideEffectOf(desc).getHighPassKernel().radius;
+    for (auto& rect : region.envRects) {
+        auto appOutputRect = rect.inflated(highPassRadius).intersected(outputRect);
+        region.appOutputRects.push_back(appOutputRect);
+        if (!scaled) {
+            region.appCropRects.push_back(appOutputRect);
+            continue;
+        }
+        int left, right, top, bottom;
+        sourceRange(appOutputRect.x, appOutputRect.x + appOutputRect.width, desc.appCropWidth, desc.outputDesc.width, left, right);
+        sourceRange(appOutputRect.y, appOutputRect.y + appOutputRect.height, desc.appCropHeight, desc.outputDesc.height, top, bottom);
+        region.appCropRects.push_back(DirtyRect{left, top, right - left, bottom - top}.intersected(appCropRect));
+    }
+    return true;
+}
+
+// the parts go over what the crop into target wrote. they are declared after it and the compiler keeps declaration
+// order between passes nothing else orders, so the full crop never overwrites them.
+static void addFramePartPasses(FrameGraph& graph, const std::string& name, const std::vector<HidingFramePart>& parts,
+                               FrameGraphResource target, int format, HidingStageExecutor& executor) {
+    for (size_t partIndex = 0; partIndex < parts.size(); partIndex++) {
+        auto& part = parts[partIndex];
+        if (!part.frame || part.crop.width <= 0 || part.crop.height <= 0 || part.target.empty()) {
+            continue;
+        }
+        auto partName = name + "Part" + std::to_string(partIndex);
+        auto partFrame = graph.importTexture(partName + "Frame", part.frame, part.frameDesc);
+        auto partTarget = part.target;
+        if (part.crop.width == partTarget.width && part.crop.height == partTarget.height) {
+            // same scale, one crop straight into place
+            FrameGraphCrop crop{part.crop.x - partTarget.x, part.crop.y - partTarget.y, partTarget.width, partTarget.height,
+                                partTarget.x, partTarget.y};
+            graph.addPass(partName + "Crop", {partFrame}, {target}, [=, &executor](FrameGraphPassContext& context) {
+                executor.crop(context.getTexture(partFrame), crop, context.getTexture(target));
+            });
+            continue;
+        }
+        auto partCropped = graph.createTexture(partName + "Cropped", {part.crop.width, part.crop.height, format});
+        auto partScaled = graph.createTexture(partName + "Scaled", {partTarget.width, partTarget.height, format});
+        auto crop = part.crop;
+        crop.writeX = 0;
+        crop.writeY = 0;
+        graph.addPass(partName + "Crop", {partFrame}, {partCropped}, [=, &executor](FrameGraphPassContext& context) {
+            executor.crop(context.getTexture(partFrame), crop, context.getTexture(partCropped));
+        });
+        graph.addPass(partName + "Scale", {partCropped}, {partScaled}, [=, &executor](FrameGraphPassContext& context) {
+            executor.scale(context.getTexture(partCropped), context.getTexture(partScaled));
+        });
+        // dst(dx, dy) = src(dx - target.x, dy - target.y) inside target
+        FrameGraphCrop place{-partTarget.x, -partTarget.y, partTarget.width, partTarget.height, partTarget.x, partTarget.y};
+        graph.addPass(partName + "Place", {partScaled}, {target}, [=, &executor](FrameGraphPassContext& context) {
+            executor.crop(context.getTexture(partScaled), place, context.getTexture(target));
+        });
+    }
+}
+
+void buildHidingFrameGraph(FrameGraph& graph, const HidingCompositeDesc& desc, HidingStageExecutor& executor) {
+    auto outputDesc = desc.outputDesc;
+    auto presentTarget = graph.importTexture("presentTarget", desc.presentTarget, outputDesc);
+
+    // the passes hold on to the effect, a retune does not pull it from under them
+    auto hideEffect = desc.hideEffect ? desc.hideEffect : HideEffect::getDefault();
+
+    // incremental: every stage only redraws what the dirty output tiles read, the hide patches the present target
+    HidingIncrementalRegion region;
+    bool incremental = buildIncrementalRegion(desc, region);
+
+    // the app chain is declared first so its scratch textures are dead by the time the env crop needs one.
+    // it is also declared when its result is not presented, the compiler drops it then.
+    auto appOutput = kInvalidFrameGraphResource;
+    auto appHighPass = kInvalidFrameGraphResource;
+    if (desc.appFrame) {
+        auto appFrame = graph.importTexture("appFrame", desc.appFrame, desc.appFrameDesc);
+        FrameGraphTextureDesc appCropDesc{desc.appCropWidth, desc.appCropHeight, outputDesc.format};
+        auto appCropped = graph.createTexture("appCropped", appCropDesc);
+        auto appCrop = desc.appCrop;
+        if (incremental) {
+            auto appCropRects = region.appCropRects;
+            graph.addPass("cropApp", {appFrame}, {appCropped}, [=, &executor](FrameGraphPassContext& context) {
+                for (auto& rect : appCropRects) {
+                    auto rectCrop = cropInsideRect(appCrop, rect);
+                    if (rectCrop.width > 0 && rectCrop.height > 0) {
+                        executor.crop(context.getTexture(appFrame), rectCrop, context.getTexture(appCropped));
+                    }
+                }
+            });
+        } else {
+            graph.addPass("cropApp", {appFrame}, {appCropped}, [=, &executor](FrameGraphPassContext& context) {
+                executor.crop(context.getTexture(appFrame), appCrop, context.getTexture(appCropped));
+            });
+        }
+        addFramePartPasses(graph, "app", desc.appParts, appCropped, outputDesc.format, executor);
+        appOutput = appCropped;
+
+        // scale to match window if necessary:
+        if (!(appCropDesc == outputDesc)) {
+            auto appScaled = graph.createTexture("appScaled", outputDesc);
+            if (incremental) {
+                auto appOutputRects = region.appOutputRects;
+                graph.addPass("scaleApp", {appCropped}, {appScaled}, [=, &executor](FrameGraphPassContext& context) {
+                    executor.scaleRects(context.getTexture(appCropped), context.getTexture(appScaled), appOutputRects);
+                });
+            } else {
+                graph.addPass("scaleApp", {appCropped}, {appScaled}, [=, &executor](FrameGraphPassContext& context) {
+                    executor.scale(context.getTexture(appCropped), context.getTexture(appScaled));
+                });
+            }
+            appOutput = appScaled;
+        }
+
+        if (desc.envFrame && !desc.fusedHighPassHide) {
+            auto blurred = graph.createTexture("appBlurred", outputDesc);
+            appHighPass = graph.createTexture("appHighPass", outputDesc);
+            graph.addPass("gaussian", {appOutput}, {blurred}, [=, &executor](FrameGraphPassContext& context) {
+                executor.gaussian(context.getTexture(appOutput), context.getTexture(blurred), *hideEffect);
+            });
+            graph.addPass("subtract", {appOutput, blurred}, {appHighPass}, [=, &executor](FrameGraphPassContext& context) {
+                executor.subtract(context.getTexture(appOutput), context.getTexture(blurred), context.getTexture(appHighPass));
+            });
+        }
+    }
+
+    auto envOutput = kInvalidFrameGraphResource;
+    if (desc.envFrame) {
+        auto envFrame = graph.importTexture("envFrame", desc.envFrame, desc.envFrameDesc);
+        envOutput = graph.createTexture("envCropped", outputDesc);
+        auto envCrop = desc.envCrop;
+        if (incremental) {
+            auto envRects = region.envRects;
+            graph.addPass("cropEnv", {envFrame}, {envOutput}, [=, &executor](FrameGraphPassContext& context) {
+                for (auto& rect : envRects) {
+                    auto rectCrop = cropInsideRect(envCrop, rect);
+                    if (rectCrop.width > 0 && rectCrop.height > 0) {
+                        executor.crop(context.getTexture(envFrame), rectCrop, context.getTexture(envOutput));
+                    }
+                }
+            });
+        } else {
+            graph.addPass("cropEnv", {envFrame}, {envOutput}, [=, &executor](FrameGraphPassContext& context) {
+                executor.crop(context.getTexture(envFrame), envCrop, context.getTexture(envOutput));
+            });
+        }
+        addFramePartPasses(graph, "env", desc.envParts, envOutput, outputDesc.format, executor);
+    }
+
+    auto presentSource = envOutput != kInvalidFrameGraphResource ? envOutput : appOutput;
+    if (envOutput != kInvalidFrameGraphResource && appOutput != kInvalidFrameGraphResource) {
+        // the hide stage draws straight into the present target, present then only has to notify
+        if (incremental) {
+            auto dirtyTiles = desc.outputDirtyTiles;
+            graph.addPass("highPassHide", {envOutput, appOutput}, {presentTarget}, [=, &executor](FrameGraphPassContext& context) {
+                executor.highPassHideTiles(context.getTexture(envOutput), context.getTexture(appOutput),
+                                           context.getTexture(presentTarget), *dirtyTiles, *hideEffect);
+            });
+        } else if (desc.fusedHighPassHide) {
+            graph.addPass("highPassHide", {envOutput, appOutput}, {presentTarget}, [=, &executor](FrameGraphPassContext& context) {
+                executor.highPassHide(context.getTexture(envOutput), context.getTexture(appOutput), context.getTexture(presentTarget),
+                                      *hideEffect);
+            });
+        } else {
+            graph.addPass("hide", {envOutput, appHighPass}, {presentTarget}, [=, &executor](FrameGraphPassContext& context) {
+                executor.hide(context.getTexture(envOutput), context.getTexture(appHighPass), context.getTexture(presentTarget),
+                              *hideEffect);
+            });
+        }
+        // hiding a blank app gives the env back, so hidden app content skips the whole app chain
+        if (desc.showAppContent) {
+            presentSource = presentTarget;
+        }
+    }
+
+    if (presentSource == kInvalidFrameGraphResource) {
+        return;
+    }
+    graph.addPass("present", {presentSource}, {presentTarget}, [=, &executor](FrameGraphPassContext& context) {
+        executor.present(context.getTexture(presentSource), context.getTexture(presentTarget));
+    }, true);
+}
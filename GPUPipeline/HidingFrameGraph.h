@@ -0,0 +1,117 @@
+#ifndef HIDINGIN_HIDINGFRAMEGRAPH_H
+#define HIDINGIN_HIDINGFRAMEGRAPH_H
+
+#include <vector>
+#include "FrameGraph.h"
+#include "DirtyRegion.h"
+#include <memory>
+#include "HideEffect.h"
+
+// MtlProcessMisc crop semantics: the destination rect (writeX, writeY, width, height) is filled with the source shifted
+// by (x, y), i.e. dst(dx, dy) = src(dx + x, dy + y). source pixels outside the frame read as zero, destination pixels
+// outside the rect are left alone.
+struct FrameGraphCrop {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    int writeX = 0;
+    int writeY = 0;
+
+    bool operator==(const FrameGraphCrop& other) const {
+        return x == other.x && y == other.y && width == other.width && height == other.height &&
+               writeX == other.writeX && writeY == other.writeY;
+    }
+};
+
+// the stages the composite pipeline is made of, one implementation per backend. textures are the backend's
+// (id<MTLTexture> / CpuImage*), every call reads its inputs and fully writes its output, but for the incremental
+// ones at the end. the high pass and hide stages run as hideEffect says.
+class HidingStageExecutor {
+public:
+    virtual ~HidingStageExecutor() = default;
+    virtual void crop(void* input, const FrameGraphCrop& crop, void* output) = 0;
+    virtual void scale(void* input, void* output) = 0;
+    virtual void gaussian(void* input, void* output, const HideEffect& hideEffect) = 0;
+    virtual void subtract(void* input1, void* input2, void* output) = 0;
+    virtual void hide(void* envInput, void* highPassInput, void* output, const HideEffect& hideEffect) = 0;
+    virtual void highPassHide(void* envInput, void* appInput, void* output, const HideEffect& hideEffect) = 0;
+    // show input on target and tell the renderer, input == target when an earlier stage already drew into it
+    virtual void present(void* input, void* target) = 0;
+
+    // incremental composite: only the output pixels inside the rects / dirty tiles are written, the rest of the
+    // output keeps what an earlier frame left there
+    virtual void scaleRects(void* input, void* output, const std::vector<DirtyRect>& rects) = 0;
+    virtual void highPassHideTiles(void* envInput, void* appInput, void* output, const DirtyTileMap& dirtyTiles,
+                                   const HideEffect& hideEffect) = 0;
+
+    // whether the stages can run an effect of this specialization right now. false starts building what they need
+    // (pipeline states on the specialization's function constants) in the background, it must never block.
+    virtual bool isHideEffectReady(const HideEffectSpecialization& specialization) = 0;
+};
+
+// a piece of a crop target that comes from another capture, the desktop / app on another display when our window
+// straddles two of them. crop takes the piece out of frame at that display's scale (writeX / writeY unused), target
+// is where it goes in the crop target; the piece is scaled when the sizes differ, a mixed dpi pair.
+struct HidingFramePart {
+    void* frame = nullptr;
+    FrameGraphTextureDesc frameDesc;
+    FrameGraphCrop crop;
+    DirtyRect target;
+
+    bool operator==(const HidingFramePart& other) const {
+        return frameDesc == other.frameDesc && crop == other.crop && target == other.target;
+    }
+};
+
+// everything CompositeCapture knows about one frame
+struct HidingCompositeDesc {
+    void* envFrame = nullptr;       // captured desktop
+    FrameGraphTextureDesc envFrameDesc;
+    FrameGraphCrop envCrop;         // part of the desktop under our window, output sized
+    std::vector<HidingFramePart> envParts; // the desktop under our window on the other displays, over envCrop
+
+    void* appFrame = nullptr;       // captured app, null when only the desktop is captured
+    FrameGraphTextureDesc appFrameDesc;
+    FrameGraphCrop appCrop;         // the app window inside its capture
+    int appCropWidth = 0;           // size of the app window in pixels
+    int appCropHeight = 0;
+    std::vector<HidingFramePart> appParts; // the app on the other displays, in appCrop's target
+    bool showAppContent = true;
+    std::shared_ptr<const HideEffect> hideEffect; // selectHideEffect's, null runs the default settings
+
+    void* presentTarget = nullptr;  // render target of the graphics item
+    FrameGraphTextureDesc outputDesc;
+
+    bool fusedHighPassHide = true;  // highPassHide compute pass instead of gaussian -> subtract -> hide
+
+    // incremental composite: the present target still holds the composite of the previous frame of the same scene
+    // and only these output tiles changed (markHidingOutputDirtyTiles). null redraws everything, so does every
+    // path but the fused hide, a region too scattered to pay off and a scene with parts.
+    const DirtyTileMap* outputDirtyTiles = nullptr;
+};
+
+// same target, sizes, crops, path and effect: a composite of b can patch a's result in place
+bool isSameHidingScene(const HidingCompositeDesc& a, const HidingCompositeDesc& b);
+
+// the effect a composite runs: wanted once it is baked and executor has the pipelines for it, current (null: the
+// default) until then. asking starts whatever is missing in the background, so retuning never stalls a frame on a
+// lut bake or a shader compile; a composite a few frames later picks the new effect up.
+std::shared_ptr<const HideEffect> selectHideEffect(const std::shared_ptr<const HideEffect>& current,
+                                                   const HideEffectSettings& wanted, HidingStageExecutor& executor);
+
+// output tiles the changes in desc's frames reach. the env crop is a shift; the app goes through its crop, the
+// bilinear scale (a source pixel reaches the output pixels around it) and the gaussian of the high pass.
+// changes of an app that is not shown do not count. the frames of envParts / appParts are the caller's to check.
+void markHidingOutputDirtyTiles(const HidingCompositeDesc& desc, const DirtyRegion& envDirty, const DirtyRegion& appDirty,
+                                DirtyTileMap& outputDirty);
+
+// declares the composite pipeline on graph:
+//   crop app -> scale to output -> gaussian -> subtract --+
+//   crop desktop ------------------------------------------+-> hide -> present
+// (gaussian -> subtract -> hide is one highPassHide pass when fused), the parts of other displays cropped (and
+// scaled) into the crop targets. the compiler culls the app chain when the app is not shown and aliases the
+// intermediates.
+void buildHidingFrameGraph(FrameGraph& graph, const HidingCompositeDesc& desc, HidingStageExecutor& executor);
+
+#endif //HIDINGIN_HIDINGFRAMEGRAPH_H
@@ -23,6 +23,8 @@ struct PipelineConfiguration{
     void* mtlRenderPassDesc = nullptr;
     std::vector<ShaderDesc> renderShaders;
     std::vector<ShaderDesc> computeShaders;
+    // where compiled pipelines are kept across launches (ShaderCache), empty compiles every launch
+    std::string shaderCacheDirectory;
 };
 
 #endif //HIDINGIN_PIPELINECONFIGURATION_H
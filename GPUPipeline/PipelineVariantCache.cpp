@@ -0,0 +1,99 @@
+#include "PipelineVariantCache.h"
+#include <iostream>
+#include <vector>
+#include "../utils/TaskScheduler.h"
+
+// builds queued at once, a slider dragged across many values only needs the last few. past this request just
+// answers null and asks again on a later call.
+static constexpr size_t kMaxPendingBuilds = 4;
+
+PipelineVariantCache::PipelineVariantCache(const std::string& name, size_t maxVariants) : m_maxVariants(maxVariants) {
+    std::vector<std::string> threadNames{name};
+    m_builder = std::make_unique<TaskScheduler>(1, threadNames, (unsigned int)kMaxPendingBuilds);
+}
+
+PipelineVariantCache::~PipelineVariantCache() {
+    m_builder.reset();
+}
+
+PipelineVariantCache::Variant PipelineVariantCache::request(uint64_t key, Builder builder) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_variants.find(key);
+    if (found != m_variants.end()) {
+        m_lru.splice(m_lru.begin(), m_lru, found->second.second);
+        return found->second.first;
+    }
+    if (m_building.count(key) || m_failed.count(key) || m_building.size() >= kMaxPendingBuilds) {
+        return nullptr;
+    }
+    // the slot is taken under m_mutex, so the pool never fills up and enqueue does not block
+    m_building.insert(key);
+    bool queued = m_builder->enqueueDetachedTask([this, key, builder = std::move(builder)](const std::string& threadName) {
+        Variant variant;
+        try {
+            variant = builder();
+        } catch (const std::exception& e) {
+            std::cerr << threadName << ": building variant " << key << " failed: " << e.what() << std::endl;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_building.erase(key);
+        if (variant) {
+            insertLocked(key, std::move(variant));
+        } else {
+            m_failed.insert(key);
+        }
+        m_buildDone.notify_all();
+    });
+    if (!queued) {
+        m_building.erase(key);
+    }
+    return nullptr;
+}
+
+PipelineVariantCache::Variant PipelineVariantCache::get(uint64_t key, const Builder& builder) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto found = m_variants.find(key);
+        if (found != m_variants.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, found->second.second);
+            return found->second.first;
+        }
+    }
+    auto variant = builder();
+    if (variant) {
+        insert(key, variant);
+    }
+    return variant;
+}
+
+void PipelineVariantCache::insert(uint64_t key, Variant variant) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    insertLocked(key, std::move(variant));
+}
+
+void PipelineVariantCache::insertLocked(uint64_t key, Variant variant) {
+    auto found = m_variants.find(key);
+    if (found != m_variants.end()) {
+        found->second.first = std::move(variant);
+        m_lru.splice(m_lru.begin(), m_lru, found->second.second);
+        return;
+    }
+    m_lru.push_front(key);
+    m_variants.emplace(key, std::make_pair(std::move(variant), m_lru.begin()));
+    m_failed.erase(key);
+    // whoever still holds an evicted variant keeps it alive, the cache just forgets it
+    while (m_variants.size() > m_maxVariants) {
+        m_variants.erase(m_lru.back());
+        m_lru.pop_back();
+    }
+}
+
+bool PipelineVariantCache::isBuilding() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_building.empty();
+}
+
+void PipelineVariantCache::waitIdle() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_buildDone.wait(lock, [this] { return m_building.empty(); });
+}
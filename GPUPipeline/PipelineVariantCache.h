@@ -0,0 +1,53 @@
+#ifndef HIDINGIN_PIPELINEVARIANTCACHE_H
+#define HIDINGIN_PIPELINEVARIANTCACHE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+class TaskScheduler;
+
+// variants of something expensive to build (pipeline states specialised on function constants, baked luts) by key,
+// a hash of what they are specialised on. request never builds on the calling thread: a missing variant is built on
+// the cache's own worker and the caller keeps to what it had until a later request finds it. variants are opaque
+// to the cache, shared_ptr<void> with the backend's deleter, and the least recently used ones go past maxVariants.
+class PipelineVariantCache {
+public:
+    using Variant = std::shared_ptr<void>;
+    // null when the build failed, the key is not tried again
+    using Builder = std::function<Variant()>;
+
+    explicit PipelineVariantCache(const std::string& name, size_t maxVariants = 16);
+    ~PipelineVariantCache();
+
+    // the variant of key, or null while it is (being) built in the background
+    Variant request(uint64_t key, Builder builder);
+    // builds on the calling thread when needed, for what has to be there from the first frame on
+    Variant get(uint64_t key, const Builder& builder);
+
+    void insert(uint64_t key, Variant variant);
+    bool isBuilding() const;
+    // blocks until the background builds queued so far are done
+    void waitIdle();
+
+private:
+    void insertLocked(uint64_t key, Variant variant); // under m_mutex
+
+    size_t m_maxVariants;
+    mutable std::mutex m_mutex;
+    std::list<uint64_t> m_lru; // most recently used first
+    std::unordered_map<uint64_t, std::pair<Variant, std::list<uint64_t>::iterator>> m_variants;
+    std::unordered_set<uint64_t> m_building;
+    std::unordered_set<uint64_t> m_failed;
+    std::condition_variable m_buildDone;
+    // last, it joins its worker before the maps above go away
+    std::unique_ptr<TaskScheduler> m_builder;
+};
+
+#endif //HIDINGIN_PIPELINEVARIANTCACHE_H
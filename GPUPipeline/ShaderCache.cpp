@@ -0,0 +1,242 @@
+#include "ShaderCache.h"
+#include <cinttypes>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static const char* kManifestName = "manifest.txt";
+static const char* kManifestHeader = "hidingin-shader-cache";
+static const char* kEntryExtension = ".metallib";
+static const char* kStagingExtension = ".partial";
+
+uint64_t hashShaderCacheString(const std::string& value, uint64_t seed) {
+    uint64_t hash = seed;
+    for (unsigned char c : value) {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static std::string toHex(uint64_t value) {
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016" PRIx64, value);
+    return buffer;
+}
+
+static bool fromHex(const std::string& text, uint64_t& value) {
+    if (text.empty() || text.size() > 16) {
+        return false;
+    }
+    char* end = nullptr;
+    value = strtoull(text.c_str(), &end, 16);
+    return end && *end == '\0';
+}
+
+ShaderCacheKey ShaderCacheKey::make(const std::string& source, const std::string& pipeline, const std::string& device) {
+    ShaderCacheKey key;
+    key.sourceHash = hashShaderCacheString(source);
+    key.pipelineHash = hashShaderCacheString(pipeline);
+    key.deviceHash = hashShaderCacheString(device);
+    return key;
+}
+
+std::string ShaderCacheKey::fileName() const {
+    auto hash = hashShaderCacheString(toHex(pipelineHash) + toHex(deviceHash), sourceHash);
+    return toHex(hash) + kEntryExtension;
+}
+
+static std::string entryName(const std::string& shaderDesc, uint64_t deviceHash) {
+    return shaderDesc + "@" + toHex(deviceHash);
+}
+
+ShaderCache::ShaderCache(const std::string& rootDirectory) {
+    if (rootDirectory.empty()) {
+        return;
+    }
+    std::error_code error;
+    auto directory = fs::path(rootDirectory) / "v";
+    directory += std::to_string(kShaderCacheVersion);
+    fs::create_directories(directory, error);
+    if (error || !fs::is_directory(directory, error)) {
+        std::cerr << "shader cache: cannot use " << directory << ", compiling every launch" << std::endl;
+        return;
+    }
+    m_directory = directory.string();
+
+    // what an older version left, its keys mean something else
+    for (const auto& item : fs::directory_iterator(rootDirectory, error)) {
+        auto name = item.path().filename().string();
+        if (item.is_directory(error) && name.size() > 1 && name[0] == 'v' && item.path() != directory) {
+            fs::remove_all(item.path(), error);
+        }
+    }
+    loadManifest();
+    removeUnknownFiles();
+}
+
+void ShaderCache::loadManifest() {
+    std::ifstream manifest(fs::path(m_directory) / kManifestName);
+    if (!manifest) {
+        return;
+    }
+    std::string line;
+    if (!std::getline(manifest, line) || line != std::string(kManifestHeader) + " " + std::to_string(kShaderCacheVersion)) {
+        return;
+    }
+    // shaderDesc sourceHash pipelineHash deviceHash byteSize, a line that does not parse is skipped
+    while (std::getline(manifest, line)) {
+        std::istringstream fields(line);
+        std::string shaderDesc, source, pipeline, device, extra;
+        uint64_t byteSize = 0;
+        if (!(fields >> shaderDesc >> source >> pipeline >> device >> byteSize) || (fields >> extra)) {
+            continue;
+        }
+        Entry entry;
+        entry.byteSize = byteSize;
+        if (!fromHex(source, entry.key.sourceHash) || !fromHex(pipeline, entry.key.pipelineHash) ||
+            !fromHex(device, entry.key.deviceHash)) {
+            continue;
+        }
+        m_entries[entryName(shaderDesc, entry.key.deviceHash)] = entry;
+    }
+}
+
+bool ShaderCache::saveManifestLocked() {
+    auto manifestPath = fs::path(m_directory) / kManifestName;
+    auto stagingPath = manifestPath;
+    stagingPath += kStagingExtension;
+    {
+        std::ofstream manifest(stagingPath, std::ios::trunc);
+        if (!manifest) {
+            return false;
+        }
+        manifest << kManifestHeader << " " << kShaderCacheVersion << "\n";
+        for (const auto& [name, entry] : m_entries) {
+            manifest << name.substr(0, name.rfind('@')) << " " << toHex(entry.key.sourceHash) << " "
+                     << toHex(entry.key.pipelineHash) << " " << toHex(entry.key.deviceHash) << " " << entry.byteSize << "\n";
+        }
+        if (!manifest.flush()) {
+            return false;
+        }
+    }
+    // a reader sees the old manifest or the new one, never half of one
+    std::error_code error;
+    fs::rename(stagingPath, manifestPath, error);
+    return !error;
+}
+
+void ShaderCache::removeUnknownFiles() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::string> knownFiles{kManifestName};
+    for (const auto& [name, entry] : m_entries) {
+        knownFiles.push_back(entry.key.fileName());
+    }
+    std::error_code error;
+    std::vector<fs::path> unknownFiles;
+    for (const auto& item : fs::directory_iterator(m_directory, error)) {
+        auto name = item.path().filename().string();
+        bool known = false;
+        for (const auto& knownFile : knownFiles) {
+            known = known || name == knownFile;
+        }
+        if (!known) {
+            unknownFiles.push_back(item.path());
+        }
+    }
+    for (const auto& path : unknownFiles) {
+        fs::remove_all(path, error);
+    }
+}
+
+std::string ShaderCache::lookup(const std::string& shaderDesc, const ShaderCacheKey& key) {
+    if (!isEnabled()) {
+        return {};
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_entries.find(entryName(shaderDesc, key.deviceHash));
+    if (found == m_entries.end() || found->second.key != key) {
+        return {};
+    }
+    auto path = fs::path(m_directory) / key.fileName();
+    std::error_code error;
+    auto byteSize = fs::file_size(path, error);
+    if (error || byteSize != found->second.byteSize) {
+        return {};
+    }
+    return path.string();
+}
+
+std::string ShaderCache::stagingPath(const ShaderCacheKey& key) const {
+    if (!isEnabled()) {
+        return {};
+    }
+    auto path = fs::path(m_directory) / key.fileName();
+    path += kStagingExtension;
+    return path.string();
+}
+
+bool ShaderCache::store(const std::string& shaderDesc, const ShaderCacheKey& key) {
+    if (!isEnabled()) {
+        return false;
+    }
+    auto staged = fs::path(stagingPath(key));
+    auto path = fs::path(m_directory) / key.fileName();
+    std::error_code error;
+    auto byteSize = fs::file_size(staged, error);
+    if (error || byteSize == 0) {
+        fs::remove(staged, error);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    fs::rename(staged, path, error);
+    if (error) {
+        fs::remove(staged, error);
+        return false;
+    }
+    auto& entry = m_entries[entryName(shaderDesc, key.deviceHash)];
+    if (entry.key != key && entry.byteSize != 0) {
+        // the old file stays when another shaderDesc still uses it (same source and pipeline under two names)
+        bool shared = false;
+        for (const auto& [name, other] : m_entries) {
+            shared = shared || (&other != &entry && other.key == entry.key);
+        }
+        if (!shared) {
+            fs::remove(fs::path(m_directory) / entry.key.fileName(), error);
+        }
+    }
+    entry.key = key;
+    entry.byteSize = byteSize;
+    if (!saveManifestLocked()) {
+        std::cerr << "shader cache: failed to write the manifest of " << m_directory << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void ShaderCache::invalidate(const std::string& shaderDesc, const ShaderCacheKey& key) {
+    if (!isEnabled()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_entries.find(entryName(shaderDesc, key.deviceHash));
+    if (found == m_entries.end()) {
+        return;
+    }
+    auto staleKey = found->second.key;
+    m_entries.erase(found);
+    bool shared = false;
+    for (const auto& [name, other] : m_entries) {
+        shared = shared || other.key == staleKey;
+    }
+    std::error_code error;
+    if (!shared) {
+        fs::remove(fs::path(m_directory) / staleKey.fileName(), error);
+    }
+    saveManifestLocked();
+}
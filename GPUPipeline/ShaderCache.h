@@ -0,0 +1,80 @@
+#ifndef HIDINGIN_SHADERCACHE_H
+#define HIDINGIN_SHADERCACHE_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// bump when what goes into a key or the layout of an entry changes, the old directory is dropped on open
+constexpr int kShaderCacheVersion = 1;
+
+// fnv-1a, the same value on every run and platform (std::hash is neither)
+uint64_t hashShaderCacheString(const std::string& value, uint64_t seed = 14695981039346656037ull);
+
+// what a cached pipeline binary was built from, a different value of any part is a different entry
+struct ShaderCacheKey {
+    uint64_t sourceHash = 0;    // the shader source
+    uint64_t pipelineHash = 0;  // entry points and the descriptor state the binary depends on (pixel formats, ...)
+    uint64_t deviceHash = 0;    // gpu and os build, a driver update changes the binaries
+
+    static ShaderCacheKey make(const std::string& source, const std::string& pipeline, const std::string& device);
+
+    // name of the entry's file, unique per key
+    std::string fileName() const;
+
+    bool operator==(const ShaderCacheKey& other) const {
+        return sourceHash == other.sourceHash && pipelineHash == other.pipelineHash && deviceHash == other.deviceHash;
+    }
+
+    bool operator!=(const ShaderCacheKey& other) const {
+        return !(*this == other);
+    }
+};
+
+// the pipeline binaries of earlier runs, so a launch loads what it compiled last time instead of compiling again.
+// lives in rootDirectory/v<kShaderCacheVersion>: one file per entry plus manifest.txt, which names the key and byte
+// size each shaderDesc's entry was stored with (per device, a second gpu keeps its own). an entry whose source
+// changed is replaced by the next store and its file deleted, files the manifest does not know (a build that died
+// halfway) go on open.
+//
+// the cache only does files, what is in them is up to the backend (MTLBinaryArchive on metal). thread safe, the
+// shader builders look up and store concurrently.
+class ShaderCache {
+public:
+    // an empty rootDirectory, or one that cannot be made, gives a cache that misses every lookup and stores nothing
+    explicit ShaderCache(const std::string& rootDirectory);
+
+    bool isEnabled() const {
+        return !m_directory.empty();
+    }
+
+    const std::string& getDirectory() const {
+        return m_directory;
+    }
+
+    // path of shaderDesc's binary if the cache holds it for key and the file is intact, empty otherwise
+    std::string lookup(const std::string& shaderDesc, const ShaderCacheKey& key);
+    // where the backend writes a new binary for key, store() moves it in
+    std::string stagingPath(const ShaderCacheKey& key) const;
+    // the staged binary of key becomes shaderDesc's entry, the entry's previous file is deleted
+    bool store(const std::string& shaderDesc, const ShaderCacheKey& key);
+    // drops shaderDesc's entry for key's device, for a binary that did not load
+    void invalidate(const std::string& shaderDesc, const ShaderCacheKey& key);
+
+private:
+    struct Entry {
+        ShaderCacheKey key;
+        uint64_t byteSize = 0;
+    };
+
+    void loadManifest();
+    bool saveManifestLocked(); // under m_mutex
+    void removeUnknownFiles();
+
+    std::string m_directory;
+    std::mutex m_mutex;
+    std::map<std::string, Entry> m_entries; // by shaderDesc@device
+};
+
+#endif //HIDINGIN_SHADERCACHE_H
@@ -0,0 +1,250 @@
+#include "TexturePool.h"
+#include <algorithm>
+#include <iostream>
+
+TexturePool::TexturePool(TexturePoolAllocator& allocator, size_t budgetBytes)
+    : m_allocator(allocator), m_budgetBytes(budgetBytes) {
+}
+
+TexturePool::~TexturePool() {
+    for (auto& slot : m_slots) {
+        if (slot.texture) {
+            m_allocator.destroyTexture(slot.texture);
+        }
+    }
+}
+
+size_t TexturePool::bytesPerPixel(int format) {
+    // MTLPixelFormat values
+    switch (format) {
+        case 10:  // R8Unorm
+            return 1;
+        case 55:  // R32Float
+            return 4;
+        case 115: // RGBA16Float
+            return 8;
+        case 125: // RGBA32Float
+            return 16;
+        default:  // BGRA8Unorm(_sRGB), RGBA8Unorm(_sRGB), RGB10A2 ...
+            return 4;
+    }
+}
+
+uint64_t TexturePool::sizeClassKey(int width, int height, int format) {
+    return ((uint64_t)(uint32_t)width << 40) ^ ((uint64_t)(uint32_t)height << 16) ^ (uint64_t)(uint16_t)format;
+}
+
+size_t TexturePool::slotBytes(const Slot& slot) const {
+    return (size_t)slot.width * slot.height * bytesPerPixel(slot.format);
+}
+
+TexturePoolHandle TexturePool::acquire(int width, int height, int format) {
+    if (width <= 0 || height <= 0) {
+        return {};
+    }
+    std::lock_guard<std::mutex> poolLock(m_poolMutex);
+    collectRetired();
+    auto frame = m_currentFrame.load(std::memory_order_relaxed);
+
+    auto bucket = m_idleBySize.find(sizeClassKey(width, height, format));
+    if (bucket != m_idleBySize.end()) {
+        // the key can collide, so the bucket is checked against the real size
+        auto& idleSlots = bucket->second;
+        for (size_t i = idleSlots.size(); i-- > 0;) {
+            auto index = idleSlots[i];
+            auto& slot = m_slots[index];
+            if (slot.width == width && slot.height == height && slot.format == format) {
+                idleSlots.erase(idleSlots.begin() + (ptrdiff_t)i);
+                lruRemove(index);
+                slot.state = SlotState::InUse;
+                slot.lastUsedFrame = frame;
+                m_stats.hits++;
+                m_stats.inUseBytes += slotBytes(slot);
+                return {index, slot.generation};
+            }
+        }
+    }
+
+    // make room first so the new texture does not push the pool over budget when idle ones can go
+    size_t newBytes = (size_t)width * height * bytesPerPixel(format);
+    if (m_stats.residentBytes + newBytes > m_budgetBytes) {
+        evict(m_budgetBytes > newBytes ? m_budgetBytes - newBytes : 0);
+    }
+
+    auto* texture = m_allocator.createTexture(width, height, format);
+    if (!texture) {
+        std::cerr << "texture pool: failed to create " << width << "x" << height << " texture" << std::endl;
+        return {};
+    }
+
+    uint32_t index;
+    if (!m_freeSlots.empty()) {
+        index = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    } else {
+        index = (uint32_t)m_slots.size();
+        m_slots.emplace_back();
+    }
+    auto& slot = m_slots[index];
+    slot.texture = texture;
+    slot.width = width;
+    slot.height = height;
+    slot.format = format;
+    slot.state = SlotState::InUse;
+    slot.lastUsedFrame = frame;
+    m_stats.misses++;
+    m_stats.residentTextures++;
+    m_stats.residentBytes += newBytes;
+    m_stats.inUseBytes += newBytes;
+    return {index, slot.generation};
+}
+
+void TexturePool::release(TexturePoolHandle handle) {
+    std::lock_guard<std::mutex> poolLock(m_poolMutex);
+    if (!handle.valid() || handle.index >= m_slots.size()) {
+        return;
+    }
+    auto& slot = m_slots[handle.index];
+    if (slot.generation != handle.generation || slot.state != SlotState::InUse) {
+        return;
+    }
+    // stale handles stop resolving from here on
+    slot.generation++;
+    slot.state = SlotState::Retiring;
+    slot.retireFrame = m_currentFrame.load(std::memory_order_relaxed);
+    slot.lastUsedFrame = slot.retireFrame;
+    m_stats.inUseBytes -= slotBytes(slot);
+    m_retiring.push_back(handle.index);
+}
+
+void* TexturePool::resolve(TexturePoolHandle handle) const {
+    std::lock_guard<std::mutex> poolLock(m_poolMutex);
+    if (!handle.valid() || handle.index >= m_slots.size()) {
+        return nullptr;
+    }
+    auto& slot = m_slots[handle.index];
+    if (slot.generation != handle.generation || slot.state != SlotState::InUse) {
+        return nullptr;
+    }
+    return slot.texture;
+}
+
+uint64_t TexturePool::beginFrame() {
+    auto frame = m_currentFrame.fetch_add(1, std::memory_order_acq_rel) + 1;
+    std::lock_guard<std::mutex> poolLock(m_poolMutex);
+    collectRetired();
+    // whatever was not wanted for a couple of seconds belongs to an old window size
+    while (m_lruTail != UINT32_MAX && m_slots[m_lruTail].lastUsedFrame + kMaxIdleFrames < frame) {
+        auto index = m_lruTail;
+        lruRemove(index);
+        removeFromBucket(index);
+        destroySlot(index);
+        m_stats.evictions++;
+    }
+    return frame;
+}
+
+void TexturePool::signalFrameCompleted(uint64_t frame) {
+    // completion handlers may report out of order, the fence only moves forward
+    auto completed = m_completedFrame.load(std::memory_order_relaxed);
+    while (completed < frame &&
+           !m_completedFrame.compare_exchange_weak(completed, frame, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+}
+
+void TexturePool::setBudgetBytes(size_t budgetBytes) {
+    std::lock_guard<std::mutex> poolLock(m_poolMutex);
+    m_budgetBytes = budgetBytes;
+    collectRetired();
+    evict(m_budgetBytes);
+}
+
+void TexturePool::trim() {
+    std::lock_guard<std::mutex> poolLock(m_poolMutex);
+    collectRetired();
+    evict(0);
+}
+
+TexturePoolStats TexturePool::getStats() const {
+    std::lock_guard<std::mutex> poolLock(m_poolMutex);
+    return m_stats;
+}
+
+void TexturePool::collectRetired() {
+    auto completed = m_completedFrame.load(std::memory_order_acquire);
+    size_t kept = 0;
+    for (auto index : m_retiring) {
+        auto& slot = m_slots[index];
+        if (slot.retireFrame <= completed) {
+            slot.state = SlotState::Idle;
+            lruPushFront(index);
+            m_idleBySize[sizeClassKey(slot.width, slot.height, slot.format)].push_back(index);
+        } else {
+            m_retiring[kept++] = index;
+        }
+    }
+    m_retiring.resize(kept);
+}
+
+void TexturePool::evict(size_t targetBytes) {
+    while (m_stats.residentBytes > targetBytes && m_lruTail != UINT32_MAX) {
+        auto index = m_lruTail;
+        lruRemove(index);
+        removeFromBucket(index);
+        destroySlot(index);
+        m_stats.evictions++;
+    }
+}
+
+void TexturePool::destroySlot(uint32_t index) {
+    auto& slot = m_slots[index];
+    m_allocator.destroyTexture(slot.texture);
+    m_stats.residentBytes -= slotBytes(slot);
+    m_stats.residentTextures--;
+    slot.texture = nullptr;
+    slot.state = SlotState::Free;
+    slot.generation++;
+    m_freeSlots.push_back(index);
+}
+
+void TexturePool::lruPushFront(uint32_t index) {
+    auto& slot = m_slots[index];
+    slot.lruPrev = UINT32_MAX;
+    slot.lruNext = m_lruHead;
+    if (m_lruHead != UINT32_MAX) {
+        m_slots[m_lruHead].lruPrev = index;
+    }
+    m_lruHead = index;
+    if (m_lruTail == UINT32_MAX) {
+        m_lruTail = index;
+    }
+}
+
+void TexturePool::lruRemove(uint32_t index) {
+    auto& slot = m_slots[index];
+    if (slot.lruPrev != UINT32_MAX) {
+        m_slots[slot.lruPrev].lruNext = slot.lruNext;
+    } else {
+        m_lruHead = slot.lruNext;
+    }
+    if (slot.lruNext != UINT32_MAX) {
+        m_slots[slot.lruNext].lruPrev = slot.lruPrev;
+    } else {
+        m_lruTail = slot.lruPrev;
+    }
+    slot.lruPrev = UINT32_MAX;
+    slot.lruNext = UINT32_MAX;
+}
+
+void TexturePool::removeFromBucket(uint32_t index) {
+    auto& slot = m_slots[index];
+    auto bucket = m_idleBySize.find(sizeClassKey(slot.width, slot.height, slot.format));
+    if (bucket == m_idleBySize.end()) {
+        return;
+    }
+    auto& idleSlots = bucket->second;
+    idleSlots.erase(std::remove(idleSlots.begin(), idleSlots.end(), index), idleSlots.end());
+    if (idleSlots.empty()) {
+        m_idleBySize.erase(bucket);
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef HIDINGIN_TEXTUREPOOL_H
+#define HIDINGIN_TEXTUREPOOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <unordered_map>
+
+// creates / frees the actual textures, id<MTLTexture> on metal, anything on the cpu
+class TexturePoolAllocator {
+public:
+    virtual ~TexturePoolAllocator() = default;
+    virtual void* createTexture(int width, int height, int format) = 0;
+    virtual void destroyTexture(void* texture) = 0;
+};
+
+// index into the pool plus the generation of that slot when it was handed out. a handle outlives its texture
+// safely: once released the slot's generation moves on and resolving the old handle gives nullptr.
+struct TexturePoolHandle {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool valid() const {
+        return index != UINT32_MAX;
+    }
+};
+
+struct TexturePoolStats {
+    size_t residentBytes = 0;  // every texture the pool holds
+    size_t inUseBytes = 0;     // handed out and not released yet
+    int residentTextures = 0;
+    uint64_t hits = 0;         // acquire served from an idle texture
+    uint64_t misses = 0;       // acquire that had to create one
+    uint64_t evictions = 0;
+};
+
+// textures are recycled by size class (width, height, format):
+//   - acquire() takes an idle texture of the same class, or creates one
+//   - release() does not make the texture reusable right away, the gpu may still read it in the frame that
+//     released it. it waits until signalFrameCompleted() reports that frame (the frame fence).
+//   - idle textures are kept in lru order and evicted from the cold end when the resident bytes go over the
+//     budget, or when they sat unused for kMaxIdleFrames frames (the old sizes after a resize)
+// all calls are thread safe, signalFrameCompleted() is meant for a command buffer completion handler.
+class TexturePool {
+public:
+    static constexpr uint64_t kMaxIdleFrames = 120;
+
+    explicit TexturePool(TexturePoolAllocator& allocator, size_t budgetBytes = 256u << 20);
+    ~TexturePool();
+
+    TexturePool(const TexturePool&) = delete;
+    TexturePool& operator=(const TexturePool&) = delete;
+
+    TexturePoolHandle acquire(int width, int height, int format);
+    void release(TexturePoolHandle handle);
+    void* resolve(TexturePoolHandle handle) const;
+
+    // frame the following releases belong to, returns the new frame number
+    uint64_t beginFrame();
+    uint64_t currentFrame() const {
+        return m_currentFrame.load(std::memory_order_acquire);
+    }
+    // the gpu is done with everything submitted up to and including frame
+    void signalFrameCompleted(uint64_t frame);
+
+    void setBudgetBytes(size_t budgetBytes);
+    // drop every idle texture, e.g. when the device goes away
+    void trim();
+    TexturePoolStats getStats() const;
+
+    static size_t bytesPerPixel(int format);
+
+private:
+    enum class SlotState : uint8_t {
+        Free,      // no texture, slot is on the free slot list
+        InUse,
+        Retiring,  // released, waiting for its frame to complete
+        Idle       // reusable, linked into the lru list and its size class bucket
+    };
+
+    struct Slot {
+        void* texture = nullptr;
+        int width = 0;
+        int height = 0;
+        int format = 0;
+        uint32_t generation = 0;
+        SlotState state = SlotState::Free;
+        uint64_t retireFrame = 0;   // frame that released it
+        uint64_t lastUsedFrame = 0;
+        // lru list, most recently released at the head
+        uint32_t lruPrev = UINT32_MAX;
+        uint32_t lruNext = UINT32_MAX;
+    };
+
+    static uint64_t sizeClassKey(int width, int height, int format);
+    size_t slotBytes(const Slot& slot) const;
+
+    void collectRetired();           // retiring -> idle for completed frames
+    void evict(size_t targetBytes);  // idle lru tail until resident <= targetBytes
+    void destroySlot(uint32_t index);
+    void lruPushFront(uint32_t index);
+    void lruRemove(uint32_t index);
+    void removeFromBucket(uint32_t index);
+
+    TexturePoolAllocator& m_allocator;
+    mutable std::mutex m_poolMutex;
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_freeSlots;
+    std::vector<uint32_t> m_retiring;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> m_idleBySize;
+    uint32_t m_lruHead = UINT32_MAX;
+    uint32_t m_lruTail = UINT32_MAX;
+
+    std::atomic<uint64_t> m_currentFrame{0};
+    std::atomic<uint64_t> m_completedFrame{0};
+
+    size_t m_budgetBytes;
+    TexturePoolStats m_stats;
+};
+
+#endif //HIDINGIN_TEXTUREPOOL_H
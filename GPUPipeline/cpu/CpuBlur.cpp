@@ -0,0 +1,315 @@
+#include "CpuBlur.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include "CpuKernels.h"
+#include "../../utils/TaskScheduler.h"
+
+// rows (horizontal passes) or columns (vertical passes) a band has. all the passes of a direction run on one band
+// before the next, the band and the images in between stay in L2 and the full size images are read and written
+// once per direction
+static constexpr int kBandPixels = 32;
+// fewer bands than this per stripe are not worth a task
+static constexpr int kMinStripeBands = 2;
+// widest box whose sum of 255s fits 16 bits
+static constexpr int kMaxShortSumBoxRadius = 128;
+
+CpuGaussianKernel CpuGaussianKernel::forSigma(float sigma) {
+    CpuGaussianKernel kernel;
+    if (!(sigma > 0.0f)) {
+        return kernel;
+    }
+    kernel.radius = std::max(1, (int)std::ceil(3.0f * sigma));
+    kernel.shift = sigma > kCpuGaussianWideSigma ? 16 : 8;
+    int total = 1 << kernel.shift;
+    std::vector<double> taps(kernel.radius + 1);
+    double sum = 0.0;
+    for (int i = 0; i <= kernel.radius; i++) {
+        taps[i] = std::exp(-(double)(i * i) / (2.0 * sigma * sigma));
+        sum += i == 0 ? taps[i] : 2.0 * taps[i];
+    }
+    // largest remainder rounding, so the weights add up to total (a flat area stays flat) without the error of all
+    // the roundings landing on the center
+    kernel.weights.assign(kernel.radius + 1, 0);
+    std::vector<double> remainders(kernel.radius + 1);
+    int leftover = total;
+    for (int i = 0; i <= kernel.radius; i++) {
+        double ideal = total * taps[i] / sum;
+        kernel.weights[i] = (uint16_t)std::floor(ideal);
+        remainders[i] = ideal - kernel.weights[i];
+        leftover -= i == 0 ? kernel.weights[i] : 2 * kernel.weights[i];
+    }
+    // an outer tap counts twice, an odd leftover is the center's
+    if (leftover % 2) {
+        kernel.weights[0]++;
+        leftover--;
+    }
+    std::vector<int> order(kernel.radius);
+    for (int i = 0; i < kernel.radius; i++) {
+        order[i] = i + 1;
+    }
+    // ties go to the tap nearer the center
+    std::stable_sort(order.begin(), order.end(), [&remainders](int a, int b) {
+        return remainders[a] > remainders[b];
+    });
+    for (int i = 0; leftover > 0 && i < kernel.radius; i++, leftover -= 2) {
+        kernel.weights[order[i]]++;
+    }
+    kernel.weights[0] += leftover;
+    // a tap the rounding put above its inner neighbour hands the unit inwards, the sum stays the same
+    for (bool moved = true; moved;) {
+        moved = false;
+        for (int i = 1; i <= kernel.radius; i++) {
+            if (kernel.weights[i] > kernel.weights[i - 1]) {
+                kernel.weights[i]--;
+                kernel.weights[i - 1] += i == 1 ? 2 : 1;
+                moved = true;
+            }
+        }
+    }
+    return kernel;
+}
+
+CpuBoxBlurPasses CpuBoxBlurPasses::forSigma(float sigma) {
+    CpuBoxBlurPasses passes;
+    if (!(sigma > 0.0f)) {
+        return passes;
+    }
+    // three boxes of width w have variance 3 (w^2 - 1) / 12, the odd widths around the ideal one split it
+    double variance = (double)sigma * sigma;
+    int lowerWidth = (int)std::floor(std::sqrt(4.0 * variance + 1.0));
+    if (lowerWidth % 2 == 0) {
+        lowerWidth--;
+    }
+    int upperWidth = lowerWidth + 2;
+    int lowerCount = (int)std::lround((12.0 * variance - 3.0 * lowerWidth * lowerWidth - 12.0 * lowerWidth - 9.0) /
+                                      (-4.0 * lowerWidth - 4.0));
+    lowerCount = std::clamp(lowerCount, 0, 3);
+    for (int i = 0; i < 3; i++) {
+        passes.radii[i] = ((i < lowerCount ? lowerWidth : upperWidth) - 1) / 2;
+    }
+    return passes;
+}
+
+CpuBlur::CpuBlur(TaskScheduler* workers) : m_workers(workers) {
+}
+
+template<typename BandPass>
+void CpuBlur::forEachBand(int bandCount, const BandPass& bandPass) {
+    int threadCount = m_workers ? (int)m_workers->getThreadCount() + 1 : 1;
+    int stripeCount = std::clamp(bandCount / kMinStripeBands, 1, 2 * threadCount);
+    if (!m_workers || stripeCount == 1) {
+        bandPass(0, bandCount);
+        return;
+    }
+    std::vector<std::future<void>> stripes;
+    auto stripeBegin = [bandCount, stripeCount](int stripe) {
+        return (int)((int64_t)stripe * bandCount / stripeCount);
+    };
+    // the calling thread takes the last stripe instead of just waiting
+    for (int stripe = 0; stripe < stripeCount - 1; stripe++) {
+        int bandBegin = stripeBegin(stripe);
+        int bandEnd = stripeBegin(stripe + 1);
+        auto future = m_workers->enqueueTask([&bandPass, bandBegin, bandEnd](const std::string&) {
+            bandPass(bandBegin, bandEnd);
+        });
+        if (!future.valid()) {
+            bandPass(bandBegin, bandEnd);
+            continue;
+        }
+        stripes.push_back(std::move(future));
+    }
+    bandPass(stripeBegin(stripeCount - 1), bandCount);
+    for (auto& stripe : stripes) {
+        stripe.get();
+    }
+}
+
+// rows [begin, end) of view
+static CpuImageView rowBand(const CpuImageView& view, int begin, int end) {
+    CpuImageView band = view;
+    band.data = view.row(begin);
+    band.height = end - begin;
+    return band;
+}
+
+// pixels [begin, end) of every row of view
+static CpuImageView columnBand(const CpuImageView& view, int begin, int end) {
+    CpuImageView band = view;
+    band.data = view.data + (size_t)begin * 4;
+    band.width = end - begin;
+    return band;
+}
+
+// a width x height image with packed rows in pixels
+static CpuImageView packedView(std::vector<uint8_t>& pixels, int width, int height) {
+    pixels.resize((size_t)width * height * 4);
+    CpuImageView imageView;
+    imageView.data = pixels.data();
+    imageView.width = width;
+    imageView.height = height;
+    imageView.bytesPerRow = width * 4;
+    return imageView;
+}
+
+// output row x is input column x, output is input.height wide and input.width high
+static void transposePixels(const CpuImageView& input, const CpuImageView& output) {
+    for (int x = 0; x < input.width; x++) {
+        uint8_t* dst = output.row(x);
+        for (int y = 0; y < input.height; y++) {
+            std::memcpy(dst + y * 4, input.row(y) + x * 4, 4);
+        }
+    }
+}
+
+// gaussian taps down the columns, the rows past the edges are the edge rows
+static void gaussianColumns(const CpuImageView& input, const CpuImageView& output, const CpuGaussianKernel& kernel,
+                            const CpuKernelTable& kernels) {
+    int radius = kernel.radius;
+    int lastRow = input.height - 1;
+    std::vector<const uint8_t*> rows(2 * radius + 1);
+    for (int y = 0; y < input.height; y++) {
+        for (int t = -radius; t <= radius; t++) {
+            rows[radius + t] = input.row(std::clamp(y + t, 0, lastRow));
+        }
+        kernels.blurColumn(rows.data(), output.row(y), input.width * 4, kernel);
+    }
+}
+
+// 1 / (2 * radius + 1) in 1/65536, 65535 for the one pixel box (rounds the same for sums of one pixel) so it fits
+// 16 bits
+static inline uint16_t boxScale(int radius) {
+    return (uint16_t)std::min(std::lrint(65536.0 / (2 * radius + 1)), 65535l);
+}
+
+// a box wider than the 16 bit sums of boxSlideRow hold, scalar and rare (sigma in the hundreds)
+static void wideBoxColumns(const CpuImageView& input, const CpuImageView& output, int radius, int firstRow) {
+    int lastRow = input.height - 1;
+    int byteCount = input.width * 4;
+    double scale = 1.0 / (2 * radius + 1);
+    std::vector<uint32_t> sum(byteCount, 0);
+    for (int k = -radius; k <= radius; k++) {
+        const uint8_t* src = input.row(std::clamp(firstRow + k, 0, lastRow));
+        for (int i = 0; i < byteCount; i++) {
+            sum[i] += src[i];
+        }
+    }
+    for (int y = firstRow; y < firstRow + output.height; y++) {
+        const uint8_t* entering = input.row(std::clamp(y + radius + 1, 0, lastRow));
+        const uint8_t* leaving = input.row(std::clamp(y - radius, 0, lastRow));
+        uint8_t* dst = output.row(y - firstRow);
+        for (int i = 0; i < byteCount; i++) {
+            dst[i] = (uint8_t)std::lrint(sum[i] * scale);
+            sum[i] += entering[i] - leaving[i];
+        }
+    }
+}
+
+// a running sum per column, a row in and a row out per output row. output row y is the box around input row
+// firstRow + y, input rows past the edges are the edge rows
+static void boxColumns(const CpuImageView& input, const CpuImageView& output, int radius, int firstRow,
+                       const CpuKernelTable& kernels) {
+    if (radius > kMaxShortSumBoxRadius) {
+        wideBoxColumns(input, output, radius, firstRow);
+        return;
+    }
+    int lastRow = input.height - 1;
+    int byteCount = input.width * 4;
+    uint16_t scale = boxScale(radius);
+    std::vector<uint16_t> sum(byteCount, 0);
+    for (int k = -radius; k <= radius; k++) {
+        kernels.accumulateRow(input.row(std::clamp(firstRow + k, 0, lastRow)), sum.data(), byteCount);
+    }
+    for (int y = firstRow; y < firstRow + output.height; y++) {
+        kernels.boxSlideRow(input.row(std::clamp(y + radius + 1, 0, lastRow)), input.row(std::clamp(y - radius, 0, lastRow)),
+                            sum.data(), output.row(y - firstRow), byteCount, scale);
+    }
+}
+
+// every pass of the blur down the columns of input, spare holds the images in between
+// the first two boxes also run over the rows past the edges the next boxes reach: a box of clamped boxes is the
+// blur of the clamped image, the way the gaussian sees it, not a blur of the edge row blurred on its own
+static void blurColumns(const CpuImageView& input, const CpuImageView& output, CpuBlurMethod method,
+                        const CpuGaussianKernel& kernel, const CpuBoxBlurPasses& passes, std::vector<uint8_t> spare[2]) {
+    const auto& kernels = getCpuKernels();
+    if (method == CpuBlurMethod::Gaussian) {
+        gaussianColumns(input, output, kernel, kernels);
+        return;
+    }
+    int lastApron = passes.radii[2];
+    int apron = passes.radii[1] + lastApron;
+    auto first = packedView(spare[0], input.width, input.height + 2 * apron);
+    auto second = packedView(spare[1], input.width, input.height + 2 * lastApron);
+    boxColumns(input, first, passes.radii[0], -apron, kernels);
+    boxColumns(first, second, passes.radii[1], passes.radii[1], kernels);
+    boxColumns(second, output, passes.radii[2], lastApron, kernels);
+}
+
+bool CpuBlur::blur(const CpuImageView& input, const CpuImageView& output, float sigma, CpuBlurMethod method) {
+    if (!input.valid() || !output.valid() || !input.sameSizeAs(output)) {
+        std::cerr << "cpu blur: invalid images" << std::endl;
+        return false;
+    }
+    if (method == CpuBlurMethod::Auto) {
+        method = sigma > kCpuBoxBlurMinSigma ? CpuBlurMethod::ThreeBox : CpuBlurMethod::Gaussian;
+    }
+    CpuGaussianKernel kernel;
+    CpuBoxBlurPasses passes;
+    if (method == CpuBlurMethod::ThreeBox) {
+        passes = CpuBoxBlurPasses::forSigma(sigma);
+    } else {
+        kernel = CpuGaussianKernel::forSigma(sigma);
+    }
+    m_horizontal.resize(input.width, input.height);
+    auto horizontal = m_horizontal.view();
+    int width = input.width;
+    int height = input.height;
+
+    // the horizontal passes go down the columns of a band of rows turned on its side, the loops that vectorize go
+    // along rows
+    forEachBand((height + kBandPixels - 1) / kBandPixels, [&](int bandBegin, int bandEnd) {
+        std::vector<uint8_t> transposedPixels;
+        std::vector<uint8_t> blurredPixels;
+        std::vector<uint8_t> spare[2];
+        for (int band = bandBegin; band < bandEnd; band++) {
+            int rowBegin = band * kBandPixels;
+            int rowEnd = std::min(rowBegin + kBandPixels, height);
+            auto transposed = packedView(transposedPixels, rowEnd - rowBegin, width);
+            auto blurred = packedView(blurredPixels, rowEnd - rowBegin, width);
+            transposePixels(rowBand(input, rowBegin, rowEnd), transposed);
+            blurColumns(transposed, blurred, method, kernel, passes, spare);
+            transposePixels(blurred, rowBand(horizontal, rowBegin, rowEnd));
+        }
+    });
+    // every band of the horizontal passes is done before a column band reads the rows of all of them
+    forEachBand((width + kBandPixels - 1) / kBandPixels, [&](int bandBegin, int bandEnd) {
+        std::vector<uint8_t> spare[2];
+        for (int band = bandBegin; band < bandEnd; band++) {
+            int columnBegin = band * kBandPixels;
+            int columnEnd = std::min(columnBegin + kBandPixels, width);
+            blurColumns(columnBand(horizontal, columnBegin, columnEnd), columnBand(output, columnBegin, columnEnd),
+                        method, kernel, passes, spare);
+        }
+    });
+    return true;
+}
+
+bool CpuBlur::highPass(const CpuImageView& image, float sigma) {
+    m_blurred.resize(image.width, image.height);
+    auto blurred = m_blurred.view();
+    if (!blur(image, blurred, sigma)) {
+        return false;
+    }
+    const auto& kernels = getCpuKernels();
+    for (int y = 0; y < image.height; y++) {
+        uint8_t* blurredRow = blurred.row(y);
+        // nothing comes off the alpha
+        for (int x = 0; x < image.width; x++) {
+            blurredRow[x * 4 + 3] = 0;
+        }
+        kernels.subtractRow(image.row(y), blurredRow, image.row(y), image.width * 4);
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+#ifndef HIDINGIN_CPUBLUR_H
+#define HIDINGIN_CPUBLUR_H
+
+#include <cstdint>
+#include <vector>
+#include "CpuImage.h"
+
+class TaskScheduler;
+
+// gaussian blurs of any sigma for BGRA8 images, the cpu counterpart of MtlProcessMisc's blur (sigma 15.5) and of
+// the CIGaussianBlur the app thumbnails are high passed with. edges clamp (MPSImageEdgeModeClamp, what CoreImage
+// does on a clampedToExtent image). all four channels are blurred the same.
+
+enum class CpuBlurMethod {
+    Auto,      // Gaussian up to kCpuBoxBlurMinSigma, ThreeBox above
+    Gaussian,  // separable taps out to 3 sigma, O(sigma) per pixel, within 2 levels of the exact blur
+    ThreeBox   // three box blurs, O(1) per pixel whatever the sigma, within a few levels of the exact blur
+};
+
+// where three boxes get cheaper than the taps, and the box approximation error stays below what a blur that wide hides
+constexpr float kCpuBoxBlurMinSigma = 3.0f;
+
+// above this sigma the taps are too many and too small for 1/256, they get 1/65536 and 32 bit sums
+constexpr float kCpuGaussianWideSigma = 3.0f;
+
+// the taps of one gaussian pass: weights[k] for the two pixels k away (weights[0] the center), in 1 / 2^shift. the
+// 2 * radius + 1 taps add up to 2^shift and never grow away from the center. shift 8 keeps the sums 16 bit, shift
+// 16 (wide sigmas) has every weight below 32768.
+struct CpuGaussianKernel {
+    int radius = 0;
+    int shift = 8;
+    std::vector<uint16_t> weights{256};
+
+    static CpuGaussianKernel forSigma(float sigma);
+};
+
+// the three box radii whose convolution has the variance of a gaussian of sigma: boxes of two odd widths next to
+// each other, the narrower ones first (Kovesi, "Fast almost-Gaussian filtering")
+struct CpuBoxBlurPasses {
+    int radii[3] = {0, 0, 0};
+
+    static CpuBoxBlurPasses forSigma(float sigma);
+};
+
+// runs the horizontal passes on bands of rows and then the vertical ones on bands of columns, the bands spread over
+// the workers when it has them. keeps the image between the two directions, one CpuBlur per thread that blurs.
+class CpuBlur {
+public:
+    // workers: the bands go there and the calling thread waits for them (so not one of workers' own threads).
+    // null runs everything on the calling thread.
+    explicit CpuBlur(TaskScheduler* workers = nullptr);
+
+    // input and output may be the same image. false for invalid or differently sized images
+    bool blur(const CpuImageView& input, const CpuImageView& output, float sigma,
+              CpuBlurMethod method = CpuBlurMethod::Auto);
+    // image minus its blur in place, per channel and clamped at zero, alpha kept: the CIGaussianBlur +
+    // CISubtractBlendMode high pass, CIGaussianBlur's radius is the sigma
+    bool highPass(const CpuImageView& image, float sigma);
+
+private:
+    // bandPass(bandBegin, bandEnd) over [0, bandCount), back once every band is done
+    template<typename BandPass>
+    void forEachBand(int bandCount, const BandPass& bandPass);
+
+    TaskScheduler* m_workers;
+    CpuImage m_horizontal;
+    CpuImage m_blurred; // highPass's
+};
+
+#endif //HIDINGIN_CPUBLUR_H
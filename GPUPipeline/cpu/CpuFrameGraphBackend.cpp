@@ -0,0 +1,78 @@
+#include "CpuFrameGraphBackend.h"
+#include "CpuImageOps.h"
+#include <cstring>
+
+static CpuImageView toView(void* texture) {
+    return static_cast<CpuImage*>(texture)->view();
+}
+
+void* CpuFrameGraphBackend::createTexture(const FrameGraphTextureDesc& desc) {
+    m_liveTextures++;
+    return new CpuImage(desc.width, desc.height);
+}
+
+void CpuFrameGraphBackend::destroyTexture(void* texture) {
+    m_liveTextures--;
+    delete static_cast<CpuImage*>(texture);
+}
+
+CpuHidingStageExecutor::CpuHidingStageExecutor(CpuKernelIsa isa) : m_hidingFilter(isa) {
+}
+
+CpuHidingStageExecutor::CpuHidingStageExecutor() = default;
+
+void CpuHidingStageExecutor::crop(void* input, const FrameGraphCrop& crop, void* output) {
+    cropImage(toView(input), crop.x, crop.y, crop.width, crop.height, crop.writeX, crop.writeY, toView(output));
+}
+
+void CpuHidingStageExecutor::scale(void* input, void* output) {
+    scaleImageBilinear(toView(input), toView(output));
+}
+
+void CpuHidingStageExecutor::gaussian(void* input, void* output, const HideEffect& hideEffect) {
+    m_hidingFilter.gaussianProcess(toView(input), toView(output), hideEffect.getHighPassKernel());
+}
+
+void CpuHidingStageExecutor::subtract(void* input1, void* input2, void* output) {
+    m_hidingFilter.subtractProcess(toView(input1), toView(input2), toView(output));
+}
+
+void CpuHidingStageExecutor::hide(void* envInput, void* highPassInput, void* output, const HideEffect& hideEffect) {
+    m_hidingFilter.hidingProcess(toView(envInput), toView(highPassInput), toView(output), hideEffect);
+}
+
+void CpuHidingStageExecutor::highPassHide(void* envInput, void* appInput, void* output, const HideEffect& hideEffect) {
+    m_hidingFilter.highPassHideProcess(toView(envInput), toView(appInput), toView(output), hideEffect);
+}
+
+void CpuHidingStageExecutor::present(void* input, void* target) {
+    if (input != target) {
+        auto inputView = toView(input);
+        auto targetView = toView(target);
+        if (inputView.sameSizeAs(targetView)) {
+            std::memcpy(targetView.data, inputView.data, (size_t)targetView.bytesPerRow * targetView.height);
+        } else {
+            scaleImageBilinear(inputView, targetView);
+        }
+    }
+    m_presentCount++;
+}
+
+void CpuHidingStageExecutor::scaleRects(void* input, void* output, const std::vector<DirtyRect>& rects) {
+    for (auto& rect : rects) {
+        scaleImageBilinear(toView(input), toView(output), rect.x, rect.y, rect.width, rect.height);
+    }
+}
+
+void CpuHidingStageExecutor::highPassHideTiles(void* envInput, void* appInput, void* output, const DirtyTileMap& dirtyTiles,
+                                               const HideEffect& hideEffect) {
+    dirtyTiles.getDirtyRects(m_dirtyRects);
+    for (auto& rect : m_dirtyRects) {
+        m_hidingFilter.highPassHideRect(toView(envInput), toView(appInput), toView(output), rect.x, rect.y, rect.width,
+                                        rect.height, hideEffect);
+    }
+}
+
+bool CpuHidingStageExecutor::isHideEffectReady(const HideEffectSpecialization&) {
+    return true;
+}
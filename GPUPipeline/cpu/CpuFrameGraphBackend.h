@@ -0,0 +1,51 @@
+#ifndef HIDINGIN_CPUFRAMEGRAPHBACKEND_H
+#define HIDINGIN_CPUFRAMEGRAPHBACKEND_H
+
+#include "../FrameGraph.h"
+#include "../HidingFrameGraph.h"
+#include "CpuHidingFilter.h"
+
+// textures are CpuImage*, imported ones included
+class CpuFrameGraphBackend : public FrameGraphBackend {
+public:
+    void* createTexture(const FrameGraphTextureDesc& desc) override;
+    void destroyTexture(void* texture) override;
+
+    int getLiveTextureCount() const {
+        return m_liveTextures;
+    }
+
+private:
+    int m_liveTextures = 0;
+};
+
+// runs the composite stages with CpuImageOps and CpuHidingFilter, present copies into the target image
+class CpuHidingStageExecutor : public HidingStageExecutor {
+public:
+    explicit CpuHidingStageExecutor(CpuKernelIsa isa);
+    CpuHidingStageExecutor();
+
+    void crop(void* input, const FrameGraphCrop& crop, void* output) override;
+    void scale(void* input, void* output) override;
+    void gaussian(void* input, void* output, const HideEffect& hideEffect) override;
+    void subtract(void* input1, void* input2, void* output) override;
+    void hide(void* envInput, void* highPassInput, void* output, const HideEffect& hideEffect) override;
+    void highPassHide(void* envInput, void* appInput, void* output, const HideEffect& hideEffect) override;
+    void present(void* input, void* target) override;
+    void scaleRects(void* input, void* output, const std::vector<DirtyRect>& rects) override;
+    void highPassHideTiles(void* envInput, void* appInput, void* output, const DirtyTileMap& dirtyTiles,
+                           const HideEffect& hideEffect) override;
+    // the row kernels take any radius, there is nothing to build
+    bool isHideEffectReady(const HideEffectSpecialization& specialization) override;
+
+    int getPresentCount() const {
+        return m_presentCount;
+    }
+
+private:
+    CpuHidingFilter m_hidingFilter;
+    int m_presentCount = 0;
+    std::vector<DirtyRect> m_dirtyRects;
+};
+
+#endif //HIDINGIN_CPUFRAMEGRAPHBACKEND_H
@@ -0,0 +1,140 @@
+#include "CpuHidingFilter.h"
+#include <algorithm>
+#include <iostream>
+
+CpuHidingFilter::CpuHidingFilter(CpuKernelIsa isa) : m_kernels(getCpuKernels(isa)) {
+}
+
+CpuHidingFilter::CpuHidingFilter() : m_kernels(getCpuKernels()) {
+}
+
+// walks the image keeping a ring of 2 * radius + 1 horizontally blurred rows, rowFunc gets (y, rows) while the rows
+// are still in cache, rows[radius] is row y. rows outside the image are the zero row (MPSImageEdgeModeZero).
+template<typename RowFunc>
+static void forEachGaussianRow(const CpuKernelTable& kernels, const CpuImageView& input, const HighPassKernel& kernel,
+                               std::vector<uint8_t>& scratch, RowFunc&& rowFunc) {
+    int rowBytes = input.width * 4;
+    int radius = kernel.radius;
+    int ringSize = radius * 2 + 1;
+    scratch.assign((size_t)rowBytes * (ringSize + 1), 0);
+    auto ringRow = [&](int y) {
+        return scratch.data() + (size_t)rowBytes * (y % ringSize);
+    };
+    const uint8_t* zeroRow = scratch.data() + (size_t)rowBytes * ringSize;
+
+    for (int y = 0; y < std::min(radius, input.height); y++) {
+        kernels.gaussianRow(input.row(y), ringRow(y), input.width, kernel);
+    }
+    const uint8_t* rows[kMaxHighPassRadius * 2 + 1];
+    for (int y = 0; y < input.height; y++) {
+        // the row radius below takes the slot of the row radius + 1 above, nothing reads that one anymore
+        if (y + radius < input.height) {
+            kernels.gaussianRow(input.row(y + radius), ringRow(y + radius), input.width, kernel);
+        }
+        for (int i = 0; i < ringSize; i++) {
+            int rowY = y - radius + i;
+            rows[i] = rowY >= 0 && rowY < input.height ? ringRow(rowY) : zeroRow;
+        }
+        rowFunc(y, rows);
+    }
+}
+
+bool CpuHidingFilter::gaussianProcess(const CpuImageView& input, const CpuImageView& output, const HighPassKernel& kernel) {
+    if (!input.valid() || !output.valid() || !input.sameSizeAs(output)) {
+        std::cerr << "cpu gaussian: invalid or mismatched images" << std::endl;
+        return false;
+    }
+    forEachGaussianRow(m_kernels, input, kernel, m_gaussianRows, [&](int y, const uint8_t* const* rows) {
+        m_kernels.gaussianColumn(rows, output.row(y), input.width * 4, kernel);
+    });
+    return true;
+}
+
+bool CpuHidingFilter::subtractProcess(const CpuImageView& input1, const CpuImageView& input2, const CpuImageView& output) {
+    if (!input1.valid() || !input2.valid() || !output.valid() ||
+        !input1.sameSizeAs(input2) || !input1.sameSizeAs(output)) {
+        std::cerr << "cpu subtract: invalid or mismatched images" << std::endl;
+        return false;
+    }
+    for (int y = 0; y < output.height; y++) {
+        m_kernels.subtractRow(input1.row(y), input2.row(y), output.row(y), output.width * 4);
+    }
+    return true;
+}
+
+bool CpuHidingFilter::hidingProcess(const CpuImageView& envInput, const CpuImageView& highPassInput, const CpuImageView& output,
+                                    const HideEffect& hideEffect) {
+    // the shader rescales tex2 coordinates by size1 / size2, which is the identity for the same sized textures
+    // CompositeCapture always hands it, so only that case is supported here.
+    if (!envInput.valid() || !highPassInput.valid() || !output.valid() ||
+        !envInput.sameSizeAs(highPassInput) || !envInput.sameSizeAs(output)) {
+        std::cerr << "cpu hiding: invalid or mismatched images" << std::endl;
+        return false;
+    }
+    for (int y = 0; y < output.height; y++) {
+        m_kernels.hideRow(envInput.row(y), highPassInput.row(y), output.row(y), output.width, hideEffect);
+    }
+    return true;
+}
+
+bool CpuHidingFilter::process(const CpuImageView& envInput, const CpuImageView& appInput, const CpuImageView& output,
+                              const HideEffect& hideEffect) {
+    m_gaussianResult.resize(appInput.width, appInput.height);
+    m_subtractResult.resize(appInput.width, appInput.height);
+    return gaussianProcess(appInput, m_gaussianResult.view(), hideEffect.getHighPassKernel()) &&
+           subtractProcess(appInput, m_gaussianResult.view(), m_subtractResult.view()) &&
+           hidingProcess(envInput, m_subtractResult.view(), output, hideEffect);
+}
+
+bool CpuHidingFilter::highPassHideProcess(const CpuImageView& envInput, const CpuImageView& appInput, const CpuImageView& output,
+                                          const HideEffect& hideEffect) {
+    if (!envInput.valid() || !appInput.valid() || !output.valid() ||
+        !envInput.sameSizeAs(appInput) || !envInput.sameSizeAs(output)) {
+        std::cerr << "cpu high pass hide: invalid or mismatched images" << std::endl;
+        return false;
+    }
+    // env and app are read once, output written once, the blur and the high pass only live in the row ring
+    forEachGaussianRow(m_kernels, appInput, hideEffect.getHighPassKernel(), m_gaussianRows, [&](int y, const uint8_t* const* rows) {
+        m_kernels.highPassHideRow(envInput.row(y), appInput.row(y), rows, output.row(y), output.width, hideEffect);
+    });
+    return true;
+}
+
+bool CpuHidingFilter::highPassHideRect(const CpuImageView& envInput, const CpuImageView& appInput, const CpuImageView& output,
+                                       int rectX, int rectY, int rectWidth, int rectHeight, const HideEffect& hideEffect) {
+    if (!envInput.valid() || !appInput.valid() || !output.valid() ||
+        !envInput.sameSizeAs(appInput) || !envInput.sameSizeAs(output)) {
+        std::cerr << "cpu high pass hide: invalid or mismatched images" << std::endl;
+        return false;
+    }
+    int left = std::max(rectX, 0);
+    int top = std::max(rectY, 0);
+    int right = std::min(rectX + rectWidth, output.width);
+    int bottom = std::min(rectY + rectHeight, output.height);
+    if (left >= right || top >= bottom) {
+        return true;
+    }
+    // blur a view of the rect plus its apron (the gaussian's radius). the view's edges count as zero, which only
+    // makes the apron itself wrong, and the apron is not written.
+    const auto& kernel = hideEffect.getHighPassKernel();
+    int apronLeft = std::max(left - kernel.radius, 0);
+    int apronTop = std::max(top - kernel.radius, 0);
+    CpuImageView apronView = appInput;
+    apronView.data = appInput.row(apronTop) + apronLeft * 4;
+    apronView.width = std::min(right + kernel.radius, appInput.width) - apronLeft;
+    apronView.height = std::min(bottom + kernel.radius, appInput.height) - apronTop;
+    int rowOffset = (left - apronLeft) * 4;
+    const uint8_t* rectRows[kMaxHighPassRadius * 2 + 1];
+    forEachGaussianRow(m_kernels, apronView, kernel, m_gaussianRows, [&](int apronY, const uint8_t* const* rows) {
+        int y = apronTop + apronY;
+        if (y < top || y >= bottom) {
+            return;
+        }
+        for (int i = 0; i < kernel.radius * 2 + 1; i++) {
+            rectRows[i] = rows[i] + rowOffset;
+        }
+        m_kernels.highPassHideRow(envInput.row(y) + left * 4, appInput.row(y) + left * 4, rectRows, output.row(y) + left * 4,
+                                  right - left, hideEffect);
+    });
+    return true;
+}
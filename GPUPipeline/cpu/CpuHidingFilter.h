@@ -0,0 +1,60 @@
+#ifndef HIDINGIN_CPUHIDINGFILTER_H
+#define HIDINGIN_CPUHIDINGFILTER_H
+
+#include <vector>
+#include "CpuImage.h"
+#include "CpuKernels.h"
+#include "../HideEffect.h"
+
+// portable version of the per frame hide pipeline that CompositeCapture encodes on metal:
+//   MtlProcessMisc gaussian (the effect's sigma) -> MtlProcessMisc subtract -> "hidingShader" (textureBlendHide.metal)
+// it runs on BGRA8 buffers so the chain can be profiled and regression checked without a gpu, and it can take
+// over frames when the gpu queue is saturated. inputs and outputs must not alias.
+class CpuHidingFilter {
+public:
+    explicit CpuHidingFilter(CpuKernelIsa isa);
+    CpuHidingFilter();
+
+    // MPSImageGaussianBlur with the default zero edge mode, taps in 1/256
+    bool gaussianProcess(const CpuImageView& input, const CpuImageView& output, const HighPassKernel& kernel);
+
+    // MPSImageSubtract: input1 - input2, clamped the way a unorm destination clamps it
+    bool subtractProcess(const CpuImageView& input1, const CpuImageView& input2, const CpuImageView& output);
+
+    // fragmentFunction of the hiding shader, envInput is tex1 (the desktop), highPassInput is tex2
+    bool hidingProcess(const CpuImageView& envInput, const CpuImageView& highPassInput, const CpuImageView& output,
+                       const HideEffect& hideEffect);
+
+    // the whole chain as CompositeCapture runs it for a desktop + app frame pair, intermediates stay inside the filter
+    bool process(const CpuImageView& envInput, const CpuImageView& appInput, const CpuImageView& output,
+                 const HideEffect& hideEffect);
+
+    // fused single pass version of process(): same output, but the gaussian and subtract results never hit memory
+    bool highPassHideProcess(const CpuImageView& envInput, const CpuImageView& appInput, const CpuImageView& output,
+                             const HideEffect& hideEffect);
+
+    // highPassHideProcess for the output pixels inside the rect, the rest of output is left alone. the blur reads
+    // the app its radius around the rect, so the pixels come out the same as from the full pass.
+    bool highPassHideRect(const CpuImageView& envInput, const CpuImageView& appInput, const CpuImageView& output,
+                          int rectX, int rectY, int rectWidth, int rectHeight, const HideEffect& hideEffect);
+
+    CpuKernelIsa getIsa() const {
+        return m_kernels.isa;
+    }
+
+    CpuImageView getGaussianResult() {
+        return m_gaussianResult.view();
+    }
+
+    CpuImageView getSubtractResult() {
+        return m_subtractResult.view();
+    }
+
+private:
+    const CpuKernelTable& m_kernels;
+    CpuImage m_gaussianResult;
+    CpuImage m_subtractResult;
+    std::vector<uint8_t> m_gaussianRows; // 2 * radius + 1 horizontally blurred rows + 1 zero row
+};
+
+#endif //HIDINGIN_CPUHIDINGFILTER_H
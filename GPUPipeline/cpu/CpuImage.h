@@ -0,0 +1,62 @@
+#ifndef HIDINGIN_CPUIMAGE_H
+#define HIDINGIN_CPUIMAGE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// cpu counterpart of a MTLPixelFormatBGRA8Unorm texture: 4 bytes per pixel, byte order B, G, R, A.
+// the view does not own the pixels, so it can point at a CVPixelBuffer, a mapped dump file or a CpuImage.
+struct CpuImageView {
+    uint8_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+    int bytesPerRow = 0;
+
+    uint8_t* row(int y) const {
+        return data + (size_t)y * bytesPerRow;
+    }
+
+    bool valid() const {
+        return data && width > 0 && height > 0 && bytesPerRow >= width * 4;
+    }
+
+    bool sameSizeAs(const CpuImageView& other) const {
+        return width == other.width && height == other.height;
+    }
+};
+
+// owning BGRA8 image, resizing keeps the allocation when it is big enough so per frame scratch images do not churn.
+class CpuImage {
+public:
+    CpuImage() = default;
+    CpuImage(int width, int height) {
+        resize(width, height);
+    }
+
+    void resize(int width, int height) {
+        m_width = width;
+        m_height = height;
+        m_pixels.resize((size_t)width * height * 4);
+    }
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    uint8_t* data() { return m_pixels.data(); }
+
+    CpuImageView view() {
+        CpuImageView imageView;
+        imageView.data = m_pixels.data();
+        imageView.width = m_width;
+        imageView.height = m_height;
+        imageView.bytesPerRow = m_width * 4;
+        return imageView;
+    }
+
+private:
+    std::vector<uint8_t> m_pixels;
+    int m_width = 0;
+    int m_height = 0;
+};
+
+#endif //HIDINGIN_CPUIMAGE_H
@@ -0,0 +1,257 @@
+#include "CpuImageOps.h"
+#include "CpuKernels.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+bool cropImage(const CpuImageView& input, int x, int y, int width, int height, int writeX, int writeY,
+               const CpuImageView& output) {
+    if (!input.valid() || !output.valid()) {
+        std::cerr << "cpu crop: invalid images" << std::endl;
+        return false;
+    }
+    int dstLeft = std::max(writeX, 0);
+    int dstTop = std::max(writeY, 0);
+    int dstRight = std::min(writeX + width, output.width);
+    int dstBottom = std::min(writeY + height, output.height);
+    if (dstLeft >= dstRight || dstTop >= dstBottom) {
+        return true;
+    }
+
+    // the part of each destination row whose source column is inside the input, the rest is zero
+    int copyLeft = std::clamp(-x, dstLeft, dstRight);
+    int copyRight = std::clamp(input.width - x, copyLeft, dstRight);
+    for (int dy = dstTop; dy < dstBottom; dy++) {
+        uint8_t* dstRow = output.row(dy);
+        int sy = dy + y;
+        if (sy < 0 || sy >= input.height) {
+            std::memset(dstRow + dstLeft * 4, 0, (size_t)(dstRight - dstLeft) * 4);
+            continue;
+        }
+        std::memset(dstRow + dstLeft * 4, 0, (size_t)(copyLeft - dstLeft) * 4);
+        std::memcpy(dstRow + copyLeft * 4, input.row(sy) + (copyLeft + x) * 4, (size_t)(copyRight - copyLeft) * 4);
+        std::memset(dstRow + copyRight * 4, 0, (size_t)(dstRight - copyRight) * 4);
+    }
+    return true;
+}
+
+namespace {
+struct BilinearTap {
+    int index0;
+    int index1;
+    int weight1; // 0..256, weight of index1
+};
+}
+
+// source taps for every destination column / row: src = (dst + 0.5) * srcSize / dstSize - 0.5, clamped
+static void computeBilinearTaps(int srcSize, int dstSize, std::vector<BilinearTap>& taps) {
+    taps.resize(dstSize);
+    double ratio = (double)srcSize / dstSize;
+    for (int d = 0; d < dstSize; d++) {
+        double position = std::clamp((d + 0.5) * ratio - 0.5, 0.0, (double)(srcSize - 1));
+        int index0 = (int)position;
+        int index1 = std::min(index0 + 1, srcSize - 1);
+        taps[d] = {index0, index1, (int)((position - index0) * 256.0 + 0.5)};
+    }
+}
+
+bool scaleImageBilinear(const CpuImageView& input, const CpuImageView& output) {
+    return scaleImageBilinear(input, output, 0, 0, output.width, output.height);
+}
+
+bool scaleImageBilinear(const CpuImageView& input, const CpuImageView& output, int rectX, int rectY, int rectWidth,
+                        int rectHeight) {
+    if (!input.valid() || !output.valid()) {
+        std::cerr << "cpu scale: invalid images" << std::endl;
+        return false;
+    }
+    int left = std::max(rectX, 0);
+    int top = std::max(rectY, 0);
+    int right = std::min(rectX + rectWidth, output.width);
+    int bottom = std::min(rectY + rectHeight, output.height);
+    if (left >= right || top >= bottom) {
+        return true;
+    }
+    int width = right - left;
+    if (input.sameSizeAs(output)) {
+        for (int y = top; y < bottom; y++) {
+            std::memcpy(output.row(y) + left * 4, input.row(y) + left * 4, (size_t)width * 4);
+        }
+        return true;
+    }
+
+    // the taps only depend on the sizes, a rect gets the same pixels the full scale writes there
+    std::vector<BilinearTap> columnTaps;
+    std::vector<BilinearTap> rowTaps;
+    computeBilinearTaps(input.width, output.width, columnTaps);
+    computeBilinearTaps(input.height, output.height, rowTaps);
+
+    // horizontal pass into two cached source rows, then blend them, so each source row is filtered once per use
+    std::vector<uint16_t> rowCache[2] = {std::vector<uint16_t>((size_t)width * 4),
+                                         std::vector<uint16_t>((size_t)width * 4)};
+    int cachedRow[2] = {-1, -1};
+    auto filterRow = [&](int sy, std::vector<uint16_t>& filtered) {
+        const uint8_t* srcRow = input.row(sy);
+        for (int x = 0; x < width; x++) {
+            auto& tap = columnTaps[left + x];
+            const uint8_t* p0 = srcRow + tap.index0 * 4;
+            const uint8_t* p1 = srcRow + tap.index1 * 4;
+            for (int c = 0; c < 4; c++) {
+                filtered[x * 4 + c] = (uint16_t)(p0[c] * (256 - tap.weight1) + p1[c] * tap.weight1);
+            }
+        }
+    };
+    auto cachedFilteredRow = [&](int sy) -> const std::vector<uint16_t>& {
+        for (int slot = 0; slot < 2; slot++) {
+            if (cachedRow[slot] == sy) {
+                return rowCache[slot];
+            }
+        }
+        // rows only move down, so the slot holding the smaller row is the one that is done
+        int slot = cachedRow[0] < cachedRow[1] ? 0 : 1;
+        filterRow(sy, rowCache[slot]);
+        cachedRow[slot] = sy;
+        return rowCache[slot];
+    };
+
+    for (int y = top; y < bottom; y++) {
+        auto& tap = rowTaps[y];
+        const auto& row0 = cachedFilteredRow(tap.index0);
+        const auto& row1 = cachedFilteredRow(tap.index1);
+        uint8_t* dstRow = output.row(y) + left * 4;
+        for (int i = 0; i < width * 4; i++) {
+            uint32_t value = (uint32_t)row0[i] * (256 - tap.weight1) + (uint32_t)row1[i] * tap.weight1;
+            dstRow[i] = (uint8_t)((value + (1u << 15)) >> 16);
+        }
+    }
+    return true;
+}
+
+namespace {
+// the cells of a ratio < 2 area resample one output pixel covers, weights in 1/256 summing to 256
+struct AreaTap {
+    int first;
+    int count;
+    int weights[4];
+};
+}
+
+static void computeAreaTaps(int srcSize, int dstSize, std::vector<AreaTap>& taps) {
+    taps.resize(dstSize);
+    double ratio = (double)srcSize / dstSize;
+    for (int d = 0; d < dstSize; d++) {
+        double start = d * ratio;
+        double end = std::min((d + 1) * ratio, (double)srcSize);
+        auto& tap = taps[d];
+        tap.first = std::min((int)start, srcSize - 1);
+        tap.count = 0;
+        int total = 0;
+        int largest = 0;
+        for (int cell = tap.first; cell < end && tap.count < 4; cell++) {
+            double overlap = std::min(end, cell + 1.0) - std::max(start, (double)cell);
+            int weight = (int)(overlap / ratio * 256.0 + 0.5);
+            tap.weights[tap.count] = weight;
+            if (weight > tap.weights[largest]) {
+                largest = tap.count;
+            }
+            total += weight;
+            tap.count++;
+        }
+        // rounding leftovers go to the biggest cell, so a flat area stays flat
+        tap.weights[largest] += 256 - total;
+    }
+}
+
+bool downscaleImageArea(const CpuImageView& input, const CpuImageView& output) {
+    return downscaleImageArea(input, output, 0, output.height);
+}
+
+bool downscaleImageArea(const CpuImageView& input, const CpuImageView& output, int rowBegin, int rowEnd) {
+    if (!input.valid() || !output.valid() || output.width > input.width || output.height > input.height) {
+        std::cerr << "cpu area downscale: invalid images or not shrinking" << std::endl;
+        return false;
+    }
+    rowBegin = std::max(rowBegin, 0);
+    rowEnd = std::min(rowEnd, output.height);
+    if (rowBegin >= rowEnd) {
+        return true;
+    }
+    auto& kernels = getCpuKernels();
+
+    // box stage: the source splits evenly into middle pixels of k or k + 1 source pixels per axis, which leaves
+    // a ratio below 2 for the area taps
+    int middleWidth = input.width / (input.width / output.width);
+    int middleHeight = input.height / (input.height / output.height);
+    auto boxStart = [](int index, int sourceSize, int middleSize) {
+        return (int)((int64_t)index * sourceSize / middleSize);
+    };
+
+    std::vector<AreaTap> columnTaps;
+    std::vector<AreaTap> rowTaps;
+    computeAreaTaps(middleWidth, output.width, columnTaps);
+    computeAreaTaps(middleHeight, output.height, rowTaps);
+
+    // the middle rows this band reads
+    int middleBegin = rowTaps[rowBegin].first;
+    int middleEnd = rowTaps[rowEnd - 1].first + rowTaps[rowEnd - 1].count;
+
+    // every middle row of the band: box average, then the horizontal area taps into 1/256 fixed point
+    std::vector<uint16_t> boxSums((size_t)input.width * 4);
+    std::vector<uint32_t> boxTotals((size_t)input.width * 4);
+    std::vector<uint8_t> middleRow((size_t)middleWidth * 4);
+    std::vector<uint16_t> filteredRows((size_t)(middleEnd - middleBegin) * output.width * 4);
+    for (int middleY = middleBegin; middleY < middleEnd; middleY++) {
+        int sourceTop = boxStart(middleY, input.height, middleHeight);
+        int sourceRows = boxStart(middleY + 1, input.height, middleHeight) - sourceTop;
+        std::fill(boxSums.begin(), boxSums.end(), 0);
+        std::fill(boxTotals.begin(), boxTotals.end(), 0);
+        for (int row = 0; row < sourceRows; row++) {
+            kernels.accumulateRow(input.row(sourceTop + row), boxSums.data(), input.width * 4);
+            // 257 rows of 255 fill 16 bits, move them on before that
+            if ((row + 1) % 256 == 0 || row + 1 == sourceRows) {
+                for (size_t i = 0; i < boxSums.size(); i++) {
+                    boxTotals[i] += boxSums[i];
+                }
+                std::fill(boxSums.begin(), boxSums.end(), 0);
+            }
+        }
+        for (int middleX = 0; middleX < middleWidth; middleX++) {
+            int sourceLeft = boxStart(middleX, input.width, middleWidth);
+            int sourceColumns = boxStart(middleX + 1, input.width, middleWidth) - sourceLeft;
+            uint32_t pixelCount = (uint32_t)(sourceColumns * sourceRows);
+            for (int c = 0; c < 4; c++) {
+                uint32_t sum = 0;
+                for (int column = 0; column < sourceColumns; column++) {
+                    sum += boxTotals[(size_t)(sourceLeft + column) * 4 + c];
+                }
+                middleRow[(size_t)middleX * 4 + c] = (uint8_t)((sum + pixelCount / 2) / pixelCount);
+            }
+        }
+        uint16_t* filtered = filteredRows.data() + (size_t)(middleY - middleBegin) * output.width * 4;
+        for (int x = 0; x < output.width; x++) {
+            auto& tap = columnTaps[x];
+            for (int c = 0; c < 4; c++) {
+                uint32_t sum = 0;
+                for (int i = 0; i < tap.count; i++) {
+                    sum += (uint32_t)middleRow[(size_t)(tap.first + i) * 4 + c] * tap.weights[i];
+                }
+                filtered[x * 4 + c] = (uint16_t)sum;
+            }
+        }
+    }
+
+    // vertical area taps over the filtered rows
+    for (int y = rowBegin; y < rowEnd; y++) {
+        auto& tap = rowTaps[y];
+        uint8_t* dstRow = output.row(y);
+        for (int i = 0; i < output.width * 4; i++) {
+            uint32_t sum = 0;
+            for (int t = 0; t < tap.count; t++) {
+                sum += (uint32_t)filteredRows[(size_t)(tap.first + t - middleBegin) * output.width * 4 + i] * tap.weights[t];
+            }
+            dstRow[i] = (uint8_t)((sum + (1u << 15)) >> 16);
+        }
+    }
+    return true;
+}
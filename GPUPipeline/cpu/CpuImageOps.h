@@ -0,0 +1,25 @@
+#ifndef HIDINGIN_CPUIMAGEOPS_H
+#define HIDINGIN_CPUIMAGEOPS_H
+
+#include "CpuImage.h"
+
+// cpu versions of the MtlProcessMisc crop and scale steps in front of the hiding filter
+
+// MPSImageLanczosScale at scale 1 with translate (-x, -y) and the clip rect (writeX, writeY, width, height):
+// dst(dx, dy) = src(dx + x, dy + y) inside the clip rect, zero where that falls outside the source
+bool cropImage(const CpuImageView& input, int x, int y, int width, int height, int writeX, int writeY,
+               const CpuImageView& output);
+
+// MPSImageBilinearScale stretching input over output: pixel centers map onto each other, edges clamp
+bool scaleImageBilinear(const CpuImageView& input, const CpuImageView& output);
+// same, but only the output pixels inside the rect are written (the incremental composite)
+bool scaleImageBilinear(const CpuImageView& input, const CpuImageView& output, int rectX, int rectY, int rectWidth,
+                        int rectHeight);
+
+// area average of input over output, shrinking only (output no bigger than input on either axis). a whole k x k box
+// pre-reduce on the accumulateRow kernel, then area weights for the rest of the ratio (below 2). the second form
+// only writes output rows [rowBegin, rowEnd), bands of one image can run on different threads.
+bool downscaleImageArea(const CpuImageView& input, const CpuImageView& output);
+bool downscaleImageArea(const CpuImageView& input, const CpuImageView& output, int rowBegin, int rowEnd);
+
+#endif //HIDINGIN_CPUIMAGEOPS_H
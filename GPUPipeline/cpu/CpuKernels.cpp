@@ -0,0 +1,851 @@
+#include "CpuKernels.h"
+#include "CpuBlur.h"
+#include "../HideEffect.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define HIDINGIN_HAS_AVX2_PATH 1
+#include <immintrin.h>
+#define HIDINGIN_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#define HIDINGIN_HAS_NEON_PATH 1
+#include <arm_neon.h>
+#endif
+
+// one output of the high pass gaussian along a row or a column, tap(k) reads the input k pixels away
+template<typename Tap>
+static inline uint8_t gaussianTap(const HighPassKernel& kernel, Tap tap) {
+    uint32_t sum = kernel.weights[0] * tap(0) + 128;
+    for (int t = 1; t <= kernel.radius; t++) {
+        sum += kernel.weights[t] * (tap(-t) + tap(t));
+    }
+    return (uint8_t)(sum >> 8);
+}
+
+// byte i of a row, zero outside [0, byteCount) (MPSImageEdgeModeZero)
+static inline uint8_t gaussianRowTap(const uint8_t* src, int i, int byteCount, const HighPassKernel& kernel) {
+    return gaussianTap(kernel, [=](int t) -> uint32_t {
+        int tapIndex = i + t * 4;
+        return tapIndex >= 0 && tapIndex < byteCount ? src[tapIndex] : 0;
+    });
+}
+
+static inline uint8_t gaussianColumnTap(const uint8_t* const* rows, int i, const HighPassKernel& kernel) {
+    return gaussianTap(kernel, [=](int t) -> uint32_t { return rows[kernel.radius + t][i]; });
+}
+
+// the high pass stays 8 bit, every channel below keepEnvBelow is (channel * gain < 0.001) of the old shader
+static inline uint8_t keepEnvMaxOf(const HideEffect& effect) {
+    uint32_t keepEnvBelow = effect.getKeepEnvBelow();
+    return (uint8_t)(keepEnvBelow > 255 ? 255 : keepEnvBelow - 1);
+}
+
+// ---- scalar ----
+
+static void gaussianRowScalar(const uint8_t* src, uint8_t* dst, int width, const HighPassKernel& kernel) {
+    int byteCount = width * 4;
+    for (int i = 0; i < byteCount; i++) {
+        dst[i] = gaussianRowTap(src, i, byteCount, kernel);
+    }
+}
+
+// bytes [begin, end), the simd versions finish their rows with it
+static void gaussianColumnRangeScalar(const uint8_t* const* rows, uint8_t* dst, int begin, int end, const HighPassKernel& kernel) {
+    for (int i = begin; i < end; i++) {
+        dst[i] = gaussianColumnTap(rows, i, kernel);
+    }
+}
+
+static void gaussianColumnScalar(const uint8_t* const* rows, uint8_t* dst, int byteCount, const HighPassKernel& kernel) {
+    gaussianColumnRangeScalar(rows, dst, 0, byteCount, kernel);
+}
+
+static void subtractRowScalar(const uint8_t* primary, const uint8_t* secondary, uint8_t* dst, int byteCount) {
+    for (int i = 0; i < byteCount; i++) {
+        int diff = (int)primary[i] - (int)secondary[i];
+        dst[i] = (uint8_t)(diff > 0 ? diff : 0);
+    }
+}
+
+static inline void hidePixelScalar(const uint8_t* envPixel, const uint8_t* highPassPixel, uint8_t* dstPixel,
+                                   const uint32_t* hideLut, uint8_t keepEnvMax) {
+    if (highPassPixel[0] <= keepEnvMax && highPassPixel[1] <= keepEnvMax && highPassPixel[2] <= keepEnvMax) {
+        dstPixel[0] = envPixel[0];
+        dstPixel[1] = envPixel[1];
+        dstPixel[2] = envPixel[2];
+        dstPixel[3] = 255;
+    } else {
+        uint32_t pixel;
+        std::memcpy(&pixel, envPixel, 4);
+        pixel = sampleHideColorLut(hideLut, pixel);
+        std::memcpy(dstPixel, &pixel, 4);
+    }
+}
+
+static void hideRowScalar(const uint8_t* env, const uint8_t* highPass, uint8_t* dst, int width, const HideEffect& effect) {
+    const uint32_t* hideLut = effect.getColorLut().data();
+    uint8_t keepEnvMax = keepEnvMaxOf(effect);
+    for (int x = 0; x < width; x++) {
+        hidePixelScalar(env + x * 4, highPass + x * 4, dst + x * 4, hideLut, keepEnvMax);
+    }
+}
+
+// pixels [xBegin, xEnd)
+static void highPassHideRangeScalar(const uint8_t* env, const uint8_t* app, const uint8_t* const* rows, uint8_t* dst,
+                                    int xBegin, int xEnd, const HideEffect& effect) {
+    const auto& kernel = effect.getHighPassKernel();
+    const uint32_t* hideLut = effect.getColorLut().data();
+    uint8_t keepEnvMax = keepEnvMaxOf(effect);
+    for (int x = xBegin; x < xEnd; x++) {
+        uint8_t highPassPixel[4];
+        for (int c = 0; c < 4; c++) {
+            int i = x * 4 + c;
+            int diff = (int)app[i] - (int)gaussianColumnTap(rows, i, kernel);
+            highPassPixel[c] = (uint8_t)(diff > 0 ? diff : 0);
+        }
+        hidePixelScalar(env + x * 4, highPassPixel, dst + x * 4, hideLut, keepEnvMax);
+    }
+}
+
+static void highPassHideRowScalar(const uint8_t* env, const uint8_t* app, const uint8_t* const* rows, uint8_t* dst, int width,
+                                  const HideEffect& effect) {
+    highPassHideRangeScalar(env, app, rows, dst, 0, width, effect);
+}
+
+// tile hash, xxh3 style: every 32 byte block feeds 4 64 bit lanes, a lane adds its input with the 32 bit halves
+// swapped plus the product of the halves of input ^ key. the key moves on per block so blocks do not commute.
+static constexpr uint64_t kTileHashKeys[kTileHashLanes] = {0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full,
+                                                           0x165667B19E3779F9ull, 0xD6E8FEB86659FD93ull};
+static constexpr uint64_t kTileHashBlockStep = 0xA0761D6478BD642Full;
+
+static inline void tileHashBlockScalar(const uint8_t* block, uint64_t blockKey, uint64_t* lanes) {
+    for (int lane = 0; lane < kTileHashLanes; lane++) {
+        uint64_t value;
+        std::memcpy(&value, block + lane * 8, 8);
+        uint64_t mixed = value ^ kTileHashKeys[lane] ^ blockKey;
+        lanes[lane] += ((value << 32) | (value >> 32)) + (mixed & 0xffffffffull) * (mixed >> 32);
+    }
+}
+
+// whole blocks, then the rest zero padded into one more block
+static void tileHashBlocksScalar(const uint8_t* row, int byteCount, uint64_t blockKey, uint64_t* lanes) {
+    int i = 0;
+    for (; i + 32 <= byteCount; i += 32, blockKey += kTileHashBlockStep) {
+        tileHashBlockScalar(row + i, blockKey, lanes);
+    }
+    if (i < byteCount) {
+        uint8_t block[32] = {};
+        std::memcpy(block, row + i, (size_t)(byteCount - i));
+        tileHashBlockScalar(block, blockKey, lanes);
+    }
+}
+
+static void tileHashRowScalar(const uint8_t* row, int byteCount, uint64_t rowKey, uint64_t* lanes) {
+    tileHashBlocksScalar(row, byteCount, rowKey, lanes);
+}
+
+static void accumulateRowScalar(const uint8_t* src, uint16_t* acc, int byteCount) {
+    for (int i = 0; i < byteCount; i++) {
+        acc[i] = (uint16_t)(acc[i] + src[i]);
+    }
+}
+
+// bytes [begin, end), the weights add up to 256 like the high pass ones
+static void blurColumnRangeScalar(const uint8_t* const* rows, uint8_t* dst, int begin, int end, const CpuGaussianKernel& kernel) {
+    int radius = kernel.radius;
+    for (int i = begin; i < end; i++) {
+        uint32_t sum = kernel.weights[0] * rows[radius][i] + (1u << (kernel.shift - 1));
+        for (int t = 1; t <= radius; t++) {
+            sum += kernel.weights[t] * (rows[radius - t][i] + rows[radius + t][i]);
+        }
+        dst[i] = (uint8_t)(sum >> kernel.shift);
+    }
+}
+
+static void blurColumnScalar(const uint8_t* const* rows, uint8_t* dst, int byteCount, const CpuGaussianKernel& kernel) {
+    blurColumnRangeScalar(rows, dst, 0, byteCount, kernel);
+}
+
+static void boxSlideRowScalar(const uint8_t* entering, const uint8_t* leaving, uint16_t* sum, uint8_t* dst, int byteCount,
+                              uint16_t scale) {
+    for (int i = 0; i < byteCount; i++) {
+        uint32_t scaled = (sum[i] * (uint32_t)scale + 32768) >> 16;
+        dst[i] = (uint8_t)(scaled > 255 ? 255 : scaled);
+        sum[i] = (uint16_t)(sum[i] + entering[i] - leaving[i]);
+    }
+}
+
+static const CpuKernelTable s_scalarKernels = {
+        CpuKernelIsa::Scalar,
+        gaussianRowScalar,
+        gaussianColumnScalar,
+        subtractRowScalar,
+        hideRowScalar,
+        highPassHideRowScalar,
+        tileHashRowScalar,
+        accumulateRowScalar,
+        blurColumnScalar,
+        boxSlideRowScalar
+};
+
+// ---- avx2 ----
+
+#ifdef HIDINGIN_HAS_AVX2_PATH
+
+// 16 bytes of the gaussian from the unpacked taps: the center and the sums of the two taps t away. the weights add
+// up to 256, so the sum stays below 256 * 255 + 128 and fits an unsigned 16 bit lane.
+HIDINGIN_AVX2_TARGET
+static inline __m256i gaussianSum16Avx2(__m256i sum, __m256i outerSum, __m256i weight) {
+    return _mm256_add_epi16(sum, _mm256_mullo_epi16(outerSum, weight));
+}
+
+HIDINGIN_AVX2_TARGET
+static inline __m256i loadWiden16Avx2(const uint8_t* src) {
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)src));
+}
+
+// horizontal gaussian of the 16 bytes at src, its taps are whole pixels (4 bytes) apart
+HIDINGIN_AVX2_TARGET
+static inline __m256i gaussianRow16Avx2(const uint8_t* src, int radius, const __m256i* weights) {
+    __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(loadWiden16Avx2(src), weights[0]), _mm256_set1_epi16(128));
+    for (int t = 1; t <= radius; t++) {
+        sum = gaussianSum16Avx2(sum, _mm256_add_epi16(loadWiden16Avx2(src - t * 4), loadWiden16Avx2(src + t * 4)), weights[t]);
+    }
+    return _mm256_srli_epi16(sum, 8);
+}
+
+// vertical gaussian of the 16 bytes at offset, rows[radius] is the center row
+HIDINGIN_AVX2_TARGET
+static inline __m256i gaussianColumn16Avx2(const uint8_t* const* rows, int offset, int radius, const __m256i* weights) {
+    __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(loadWiden16Avx2(rows[radius] + offset), weights[0]), _mm256_set1_epi16(128));
+    for (int t = 1; t <= radius; t++) {
+        sum = gaussianSum16Avx2(sum, _mm256_add_epi16(loadWiden16Avx2(rows[radius - t] + offset), loadWiden16Avx2(rows[radius + t] + offset)),
+                                weights[t]);
+    }
+    return _mm256_srli_epi16(sum, 8);
+}
+
+HIDINGIN_AVX2_TARGET
+static inline void gaussianWeightsAvx2(const HighPassKernel& kernel, __m256i* weights) {
+    for (int t = 0; t <= kernel.radius; t++) {
+        weights[t] = _mm256_set1_epi16((short)kernel.weights[t]);
+    }
+}
+
+HIDINGIN_AVX2_TARGET
+static inline __m256i packGaussian32Avx2(__m256i low, __m256i high) {
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xD8);
+}
+
+HIDINGIN_AVX2_TARGET
+static void gaussianRowAvx2(const uint8_t* src, uint8_t* dst, int width, const HighPassKernel& kernel) {
+    int byteCount = width * 4;
+    int apron = kernel.radius * 4;
+    if (byteCount < apron * 2 + 32) {
+        gaussianRowScalar(src, dst, width, kernel);
+        return;
+    }
+    __m256i weights[kMaxHighPassRadius + 1];
+    gaussianWeightsAvx2(kernel, weights);
+    // the first and last radius pixels touch the zero border
+    for (int i = 0; i < apron; i++) {
+        dst[i] = gaussianRowTap(src, i, byteCount, kernel);
+    }
+    int i = apron;
+    for (; i + 32 <= byteCount - apron; i += 32) {
+        __m256i low = gaussianRow16Avx2(src + i, kernel.radius, weights);
+        __m256i high = gaussianRow16Avx2(src + i + 16, kernel.radius, weights);
+        _mm256_storeu_si256((__m256i*)(dst + i), packGaussian32Avx2(low, high));
+    }
+    for (; i < byteCount; i++) {
+        dst[i] = gaussianRowTap(src, i, byteCount, kernel);
+    }
+}
+
+HIDINGIN_AVX2_TARGET
+static void gaussianColumnAvx2(const uint8_t* const* rows, uint8_t* dst, int byteCount, const HighPassKernel& kernel) {
+    __m256i weights[kMaxHighPassRadius + 1];
+    gaussianWeightsAvx2(kernel, weights);
+    int i = 0;
+    for (; i + 32 <= byteCount; i += 32) {
+        __m256i low = gaussianColumn16Avx2(rows, i, kernel.radius, weights);
+        __m256i high = gaussianColumn16Avx2(rows, i + 16, kernel.radius, weights);
+        _mm256_storeu_si256((__m256i*)(dst + i), packGaussian32Avx2(low, high));
+    }
+    gaussianColumnRangeScalar(rows, dst, i, byteCount, kernel);
+}
+
+HIDINGIN_AVX2_TARGET
+static void subtractRowAvx2(const uint8_t* primary, const uint8_t* secondary, uint8_t* dst, int byteCount) {
+    int i = 0;
+    for (; i + 32 <= byteCount; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(primary + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(secondary + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_subs_epu8(a, b));
+    }
+    subtractRowScalar(primary + i, secondary + i, dst + i, byteCount - i);
+}
+
+HIDINGIN_AVX2_TARGET
+static inline __m256i divideBy255Avx2(__m256i value) {
+    return _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(value, _mm256_set1_epi32(1)), _mm256_srli_epi32(value, 8)), 8);
+}
+
+// hideLutCell for 8 channel values
+HIDINGIN_AVX2_TARGET
+static inline void hideLutCellAvx2(__m256i value, __m256i& index, __m256i& fraction) {
+    __m256i position = _mm256_mullo_epi32(value, _mm256_set1_epi32(kHideLutSize - 1));
+    index = _mm256_min_epu32(divideBy255Avx2(position), _mm256_set1_epi32(kHideLutSize - 2));
+    __m256i remainder = _mm256_sub_epi32(position, _mm256_mullo_epi32(index, _mm256_set1_epi32(255)));
+    fraction = divideBy255Avx2(_mm256_add_epi32(_mm256_slli_epi32(remainder, 8), _mm256_set1_epi32(127)));
+}
+
+// 8 pixels of sampleHideColorLut, the lattice offsets and the corners come in with gathers
+HIDINGIN_AVX2_TARGET
+static inline __m256i sampleHideColorLut8Avx2(const uint32_t* hideLut, __m256i pixels) {
+    const __m256i byteMask = _mm256_set1_epi32(0xFF);
+    const __m256i strideR = _mm256_set1_epi32(1);
+    const __m256i strideG = _mm256_set1_epi32(kHideLutSize);
+    const __m256i strideB = _mm256_set1_epi32(kHideLutSize * kHideLutSize);
+    const __m256i strideAll = _mm256_set1_epi32(1 + kHideLutSize + kHideLutSize * kHideLutSize);
+    const __m256i lowLanes = _mm256_set1_epi32(0x00FF00FF);
+    const __m256i rounding = _mm256_set1_epi32(0x00800080);
+
+    __m256i red = _mm256_and_si256(_mm256_srli_epi32(pixels, 16), byteMask);
+    __m256i green = _mm256_and_si256(_mm256_srli_epi32(pixels, 8), byteMask);
+    __m256i blue = _mm256_and_si256(pixels, byteMask);
+    __m256i maxPlusMin = _mm256_add_epi32(_mm256_max_epi32(red, _mm256_max_epi32(green, blue)),
+                                          _mm256_min_epi32(red, _mm256_min_epi32(green, blue)));
+    __m256i lattice = _mm256_i32gather_epi32((const int*)(hideLut + kHideLutBranchTable), maxPlusMin, 4);
+    __m256i indexR, indexG, indexB, fracR, fracG, fracB;
+    hideLutCellAvx2(red, indexR, fracR);
+    hideLutCellAvx2(green, indexG, fracG);
+    hideLutCellAvx2(blue, indexB, fracB);
+    __m256i base = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(indexB, strideB), _mm256_mullo_epi32(indexG, strideG)),
+                                    _mm256_add_epi32(indexR, lattice));
+
+    __m256i fracMax = _mm256_max_epi32(fracR, _mm256_max_epi32(fracG, fracB));
+    __m256i fracMin = _mm256_min_epi32(fracR, _mm256_min_epi32(fracG, fracB));
+    __m256i fracMid = _mm256_sub_epi32(_mm256_sub_epi32(_mm256_add_epi32(fracR, _mm256_add_epi32(fracG, fracB)), fracMax), fracMin);
+    // same tie breaking as the scalar version: r before g before b. blendv picks its first operand where the
+    // mask is clear, so the "not greater" tests select with swapped operands.
+    __m256i rNotMax = _mm256_or_si256(_mm256_cmpgt_epi32(fracG, fracR), _mm256_cmpgt_epi32(fracB, fracR));
+    __m256i strideMax = _mm256_blendv_epi8(strideG, strideB, _mm256_cmpgt_epi32(fracB, fracG));
+    strideMax = _mm256_blendv_epi8(strideR, strideMax, rNotMax);
+    __m256i rNotMin = _mm256_or_si256(_mm256_cmpgt_epi32(fracR, fracG), _mm256_cmpgt_epi32(fracR, fracB));
+    __m256i strideMin = _mm256_blendv_epi8(strideG, strideB, _mm256_cmpgt_epi32(fracG, fracB));
+    strideMin = _mm256_blendv_epi8(strideR, strideMin, rNotMin);
+
+    __m256i corners[4] = {
+            _mm256_i32gather_epi32((const int*)hideLut, base, 4),
+            _mm256_i32gather_epi32((const int*)hideLut, _mm256_add_epi32(base, strideMax), 4),
+            _mm256_i32gather_epi32((const int*)hideLut, _mm256_sub_epi32(_mm256_add_epi32(base, strideAll), strideMin), 4),
+            _mm256_i32gather_epi32((const int*)hideLut, _mm256_add_epi32(base, strideAll), 4)};
+    __m256i weights[4] = {_mm256_sub_epi32(_mm256_set1_epi32(256), fracMax), _mm256_sub_epi32(fracMax, fracMid),
+                          _mm256_sub_epi32(fracMid, fracMin), fracMin};
+    __m256i redBlue = rounding;
+    __m256i greenAlpha = rounding;
+    for (int i = 0; i < 4; i++) {
+        redBlue = _mm256_add_epi32(redBlue, _mm256_mullo_epi32(weights[i], _mm256_and_si256(corners[i], lowLanes)));
+        greenAlpha = _mm256_add_epi32(greenAlpha,
+                                      _mm256_mullo_epi32(weights[i], _mm256_and_si256(_mm256_srli_epi32(corners[i], 8), lowLanes)));
+    }
+    return _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(redBlue, 8), lowLanes),
+                           _mm256_andnot_si256(lowLanes, greenAlpha));
+}
+
+// 8 pixels of the hiding shader, pixels whose high pass is about black (no channel above keepEnvMax) keep the env color
+HIDINGIN_AVX2_TARGET
+static inline __m256i hide8Avx2(__m256i envPixels, __m256i highPassPixels, const uint32_t* hideLut, __m256i keepEnvMax) {
+    const __m256i rgbMask = _mm256_set1_epi32(0x00FFFFFF);
+    const __m256i opaque = _mm256_set1_epi32((int)0xFF000000);
+    __m256i aboveKeep = _mm256_and_si256(_mm256_subs_epu8(highPassPixels, keepEnvMax), rgbMask);
+    __m256i keepEnv = _mm256_cmpeq_epi32(aboveKeep, _mm256_setzero_si256());
+    __m256i passThrough = _mm256_or_si256(envPixels, opaque);
+    if (_mm256_movemask_epi8(keepEnv) == -1) {
+        return passThrough;
+    }
+    return _mm256_blendv_epi8(sampleHideColorLut8Avx2(hideLut, envPixels), passThrough, keepEnv);
+}
+
+HIDINGIN_AVX2_TARGET
+static void hideRowAvx2(const uint8_t* env, const uint8_t* highPass, uint8_t* dst, int width, const HideEffect& effect) {
+    const uint32_t* hideLut = effect.getColorLut().data();
+    const __m256i keepEnvMax = _mm256_set1_epi8((char)keepEnvMaxOf(effect));
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i envPixels = _mm256_loadu_si256((const __m256i*)(env + x * 4));
+        __m256i highPassPixels = _mm256_loadu_si256((const __m256i*)(highPass + x * 4));
+        _mm256_storeu_si256((__m256i*)(dst + x * 4), hide8Avx2(envPixels, highPassPixels, hideLut, keepEnvMax));
+    }
+    hideRowScalar(env + x * 4, highPass + x * 4, dst + x * 4, width - x, effect);
+}
+
+// vertical gaussian, subtract and hide of 8 pixels without leaving registers
+HIDINGIN_AVX2_TARGET
+static void highPassHideRowAvx2(const uint8_t* env, const uint8_t* app, const uint8_t* const* rows, uint8_t* dst, int width,
+                                const HideEffect& effect) {
+    const auto& kernel = effect.getHighPassKernel();
+    const uint32_t* hideLut = effect.getColorLut().data();
+    const __m256i keepEnvMax = _mm256_set1_epi8((char)keepEnvMaxOf(effect));
+    __m256i weights[kMaxHighPassRadius + 1];
+    gaussianWeightsAvx2(kernel, weights);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        int i = x * 4;
+        __m256i blurred = packGaussian32Avx2(gaussianColumn16Avx2(rows, i, kernel.radius, weights),
+                                             gaussianColumn16Avx2(rows, i + 16, kernel.radius, weights));
+        __m256i highPassPixels = _mm256_subs_epu8(_mm256_loadu_si256((const __m256i*)(app + i)), blurred);
+        __m256i envPixels = _mm256_loadu_si256((const __m256i*)(env + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), hide8Avx2(envPixels, highPassPixels, hideLut, keepEnvMax));
+    }
+    highPassHideRangeScalar(env, app, rows, dst, x, width, effect);
+}
+
+HIDINGIN_AVX2_TARGET
+static void tileHashRowAvx2(const uint8_t* row, int byteCount, uint64_t rowKey, uint64_t* lanes) {
+    const __m256i keys = _mm256_loadu_si256((const __m256i*)kTileHashKeys);
+    __m256i acc = _mm256_loadu_si256((const __m256i*)lanes);
+    uint64_t blockKey = rowKey;
+    int i = 0;
+    for (; i + 32 <= byteCount; i += 32, blockKey += kTileHashBlockStep) {
+        __m256i value = _mm256_loadu_si256((const __m256i*)(row + i));
+        __m256i mixed = _mm256_xor_si256(value, _mm256_xor_si256(keys, _mm256_set1_epi64x((long long)blockKey)));
+        // mul_epu32 multiplies the low halves, so this is low(mixed) * high(mixed) per lane
+        __m256i product = _mm256_mul_epu32(mixed, _mm256_srli_epi64(mixed, 32));
+        __m256i swapped = _mm256_shuffle_epi32(value, _MM_SHUFFLE(2, 3, 0, 1));
+        acc = _mm256_add_epi64(acc, _mm256_add_epi64(swapped, product));
+    }
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    tileHashBlocksScalar(row + i, byteCount - i, blockKey, lanes);
+}
+
+HIDINGIN_AVX2_TARGET
+static void accumulateRowAvx2(const uint8_t* src, uint16_t* acc, int byteCount) {
+    int i = 0;
+    for (; i + 16 <= byteCount; i += 16) {
+        __m256i sum = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(acc + i)),
+                                       _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + i))));
+        _mm256_storeu_si256((__m256i*)(acc + i), sum);
+    }
+    accumulateRowScalar(src + i, acc + i, byteCount - i);
+}
+
+// gaussianColumn16Avx2 with the taps of a CpuGaussianKernel, broadcast as they are needed (no fixed radius bound)
+HIDINGIN_AVX2_TARGET
+static inline __m256i blurColumn16Avx2(const uint8_t* const* rows, int offset, const CpuGaussianKernel& kernel) {
+    int radius = kernel.radius;
+    __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(loadWiden16Avx2(rows[radius] + offset), _mm256_set1_epi16((short)kernel.weights[0])),
+                                   _mm256_set1_epi16(128));
+    for (int t = 1; t <= radius; t++) {
+        sum = gaussianSum16Avx2(sum, _mm256_add_epi16(loadWiden16Avx2(rows[radius - t] + offset), loadWiden16Avx2(rows[radius + t] + offset)),
+                                _mm256_set1_epi16((short)kernel.weights[t]));
+    }
+    return _mm256_srli_epi16(sum, 8);
+}
+
+// the 16 bit weights of a wide kernel: two taps per madd into 32 bit sums, the center paired with the first tap.
+// unpacklo / unpackhi split a lane's 8 bytes in two halves and packus_epi32 puts them back in order.
+HIDINGIN_AVX2_TARGET
+static inline __m256i blurColumn16WideAvx2(const uint8_t* const* rows, int offset, const CpuGaussianKernel& kernel) {
+    int radius = kernel.radius;
+    __m256i rounding = _mm256_set1_epi32(1 << (kernel.shift - 1));
+    __m256i sumLow = rounding;
+    __m256i sumHigh = rounding;
+    for (int t = 0; t <= radius; t += 2) {
+        __m256i first = t == 0 ? loadWiden16Avx2(rows[radius] + offset) :
+                        _mm256_add_epi16(loadWiden16Avx2(rows[radius - t] + offset), loadWiden16Avx2(rows[radius + t] + offset));
+        __m256i second = t + 1 > radius ? _mm256_setzero_si256() :
+                         _mm256_add_epi16(loadWiden16Avx2(rows[radius - t - 1] + offset), loadWiden16Avx2(rows[radius + t + 1] + offset));
+        uint16_t secondWeight = t + 1 > radius ? 0 : kernel.weights[t + 1];
+        __m256i weights = _mm256_set1_epi32((int)(kernel.weights[t] | ((uint32_t)secondWeight << 16)));
+        sumLow = _mm256_add_epi32(sumLow, _mm256_madd_epi16(_mm256_unpacklo_epi16(first, second), weights));
+        sumHigh = _mm256_add_epi32(sumHigh, _mm256_madd_epi16(_mm256_unpackhi_epi16(first, second), weights));
+    }
+    __m128i shift = _mm_cvtsi32_si128(kernel.shift);
+    return _mm256_packus_epi32(_mm256_srl_epi32(sumLow, shift), _mm256_srl_epi32(sumHigh, shift));
+}
+
+HIDINGIN_AVX2_TARGET
+static void blurColumnAvx2(const uint8_t* const* rows, uint8_t* dst, int byteCount, const CpuGaussianKernel& kernel) {
+    int i = 0;
+    if (kernel.shift > 8) {
+        for (; i + 32 <= byteCount; i += 32) {
+            __m256i low = blurColumn16WideAvx2(rows, i, kernel);
+            __m256i high = blurColumn16WideAvx2(rows, i + 16, kernel);
+            _mm256_storeu_si256((__m256i*)(dst + i), packGaussian32Avx2(low, high));
+        }
+        blurColumnRangeScalar(rows, dst, i, byteCount, kernel);
+        return;
+    }
+    for (; i + 32 <= byteCount; i += 32) {
+        __m256i low = blurColumn16Avx2(rows, i, kernel);
+        __m256i high = blurColumn16Avx2(rows, i + 16, kernel);
+        _mm256_storeu_si256((__m256i*)(dst + i), packGaussian32Avx2(low, high));
+    }
+    blurColumnRangeScalar(rows, dst, i, byteCount, kernel);
+}
+
+// (sum * scale + 32768) >> 16 from the two halves of the 32 bit product: the high half plus the rounding bit
+HIDINGIN_AVX2_TARGET
+static inline __m256i boxScale16Avx2(__m256i sum, __m256i scale) {
+    return _mm256_add_epi16(_mm256_mulhi_epu16(sum, scale), _mm256_srli_epi16(_mm256_mullo_epi16(sum, scale), 15));
+}
+
+HIDINGIN_AVX2_TARGET
+static inline __m256i boxSlide16Avx2(__m256i sum, const uint8_t* entering, const uint8_t* leaving) {
+    return _mm256_add_epi16(sum, _mm256_sub_epi16(loadWiden16Avx2(entering), loadWiden16Avx2(leaving)));
+}
+
+HIDINGIN_AVX2_TARGET
+static void boxSlideRowAvx2(const uint8_t* entering, const uint8_t* leaving, uint16_t* sum, uint8_t* dst, int byteCount,
+                            uint16_t scale) {
+    __m256i scales = _mm256_set1_epi16((short)scale);
+    int i = 0;
+    for (; i + 32 <= byteCount; i += 32) {
+        __m256i low = _mm256_loadu_si256((const __m256i*)(sum + i));
+        __m256i high = _mm256_loadu_si256((const __m256i*)(sum + i + 16));
+        _mm256_storeu_si256((__m256i*)(dst + i), packGaussian32Avx2(boxScale16Avx2(low, scales), boxScale16Avx2(high, scales)));
+        _mm256_storeu_si256((__m256i*)(sum + i), boxSlide16Avx2(low, entering + i, leaving + i));
+        _mm256_storeu_si256((__m256i*)(sum + i + 16), boxSlide16Avx2(high, entering + i + 16, leaving + i + 16));
+    }
+    boxSlideRowScalar(entering + i, leaving + i, sum + i, dst + i, byteCount - i, scale);
+}
+
+static const CpuKernelTable s_avx2Kernels = {
+        CpuKernelIsa::AVX2,
+        gaussianRowAvx2,
+        gaussianColumnAvx2,
+        subtractRowAvx2,
+        hideRowAvx2,
+        highPassHideRowAvx2,
+        tileHashRowAvx2,
+        accumulateRowAvx2,
+        blurColumnAvx2,
+        boxSlideRowAvx2
+};
+
+#endif
+
+// ---- neon ----
+
+#ifdef HIDINGIN_HAS_NEON_PATH
+
+// 8 bytes of the gaussian, same 16 bit sums as the avx2 version
+static inline uint8x8_t gaussianRow8Neon(const uint8_t* src, const HighPassKernel& kernel) {
+    uint16x8_t sum = vmlaq_n_u16(vdupq_n_u16(128), vmovl_u8(vld1_u8(src)), (uint16_t)kernel.weights[0]);
+    for (int t = 1; t <= kernel.radius; t++) {
+        sum = vmlaq_n_u16(sum, vaddl_u8(vld1_u8(src - t * 4), vld1_u8(src + t * 4)), (uint16_t)kernel.weights[t]);
+    }
+    return vshrn_n_u16(sum, 8);
+}
+
+static inline uint8x8_t gaussianColumn8Neon(const uint8_t* const* rows, int offset, const HighPassKernel& kernel) {
+    int radius = kernel.radius;
+    uint16x8_t sum = vmlaq_n_u16(vdupq_n_u16(128), vmovl_u8(vld1_u8(rows[radius] + offset)), (uint16_t)kernel.weights[0]);
+    for (int t = 1; t <= radius; t++) {
+        sum = vmlaq_n_u16(sum, vaddl_u8(vld1_u8(rows[radius - t] + offset), vld1_u8(rows[radius + t] + offset)),
+                          (uint16_t)kernel.weights[t]);
+    }
+    return vshrn_n_u16(sum, 8);
+}
+
+static void gaussianRowNeon(const uint8_t* src, uint8_t* dst, int width, const HighPassKernel& kernel) {
+    int byteCount = width * 4;
+    int apron = kernel.radius * 4;
+    if (byteCount < apron * 2 + 8) {
+        gaussianRowScalar(src, dst, width, kernel);
+        return;
+    }
+    for (int i = 0; i < apron; i++) {
+        dst[i] = gaussianRowTap(src, i, byteCount, kernel);
+    }
+    int i = apron;
+    for (; i + 8 <= byteCount - apron; i += 8) {
+        vst1_u8(dst + i, gaussianRow8Neon(src + i, kernel));
+    }
+    for (; i < byteCount; i++) {
+        dst[i] = gaussianRowTap(src, i, byteCount, kernel);
+    }
+}
+
+static void gaussianColumnNeon(const uint8_t* const* rows, uint8_t* dst, int byteCount, const HighPassKernel& kernel) {
+    int i = 0;
+    for (; i + 8 <= byteCount; i += 8) {
+        vst1_u8(dst + i, gaussianColumn8Neon(rows, i, kernel));
+    }
+    gaussianColumnRangeScalar(rows, dst, i, byteCount, kernel);
+}
+
+static void subtractRowNeon(const uint8_t* primary, const uint8_t* secondary, uint8_t* dst, int byteCount) {
+    int i = 0;
+    for (; i + 16 <= byteCount; i += 16) {
+        vst1q_u8(dst + i, vqsubq_u8(vld1q_u8(primary + i), vld1q_u8(secondary + i)));
+    }
+    subtractRowScalar(primary + i, secondary + i, dst + i, byteCount - i);
+}
+
+static inline uint32x4_t divideBy255Neon(uint32x4_t value) {
+    return vshrq_n_u32(vaddq_u32(vaddq_u32(value, vdupq_n_u32(1)), vshrq_n_u32(value, 8)), 8);
+}
+
+// hideLutCell for 4 channel values
+static inline void hideLutCellNeon(uint32x4_t value, uint32x4_t& index, uint32x4_t& fraction) {
+    uint32x4_t position = vmulq_n_u32(value, kHideLutSize - 1);
+    index = vminq_u32(divideBy255Neon(position), vdupq_n_u32(kHideLutSize - 2));
+    uint32x4_t remainder = vmlsq_n_u32(position, index, 255);
+    fraction = divideBy255Neon(vaddq_u32(vshlq_n_u32(remainder, 8), vdupq_n_u32(127)));
+}
+
+// neon has no gather, the corner offsets are worked out in vectors and loaded lane by lane
+static inline uint32x4_t gatherHideLutNeon(const uint32_t* hideLut, uint32x4_t offsets) {
+    uint32x4_t corners = vdupq_n_u32(0);
+    corners = vld1q_lane_u32(hideLut + vgetq_lane_u32(offsets, 0), corners, 0);
+    corners = vld1q_lane_u32(hideLut + vgetq_lane_u32(offsets, 1), corners, 1);
+    corners = vld1q_lane_u32(hideLut + vgetq_lane_u32(offsets, 2), corners, 2);
+    corners = vld1q_lane_u32(hideLut + vgetq_lane_u32(offsets, 3), corners, 3);
+    return corners;
+}
+
+// 4 pixels of sampleHideColorLut, mirrors the avx2 one
+static inline uint32x4_t sampleHideColorLut4Neon(const uint32_t* hideLut, uint32x4_t pixels) {
+    const uint32x4_t byteMask = vdupq_n_u32(0xFF);
+    const uint32x4_t strideR = vdupq_n_u32(1);
+    const uint32x4_t strideG = vdupq_n_u32(kHideLutSize);
+    const uint32x4_t strideB = vdupq_n_u32(kHideLutSize * kHideLutSize);
+    const uint32x4_t strideAll = vdupq_n_u32(1 + kHideLutSize + kHideLutSize * kHideLutSize);
+    const uint32x4_t lowLanes = vdupq_n_u32(0x00FF00FF);
+    const uint32x4_t rounding = vdupq_n_u32(0x00800080);
+
+    uint32x4_t red = vandq_u32(vshrq_n_u32(pixels, 16), byteMask);
+    uint32x4_t green = vandq_u32(vshrq_n_u32(pixels, 8), byteMask);
+    uint32x4_t blue = vandq_u32(pixels, byteMask);
+    uint32x4_t maxPlusMin = vaddq_u32(vmaxq_u32(red, vmaxq_u32(green, blue)), vminq_u32(red, vminq_u32(green, blue)));
+    uint32x4_t lattice = gatherHideLutNeon(hideLut + kHideLutBranchTable, maxPlusMin);
+    uint32x4_t indexR, indexG, indexB, fracR, fracG, fracB;
+    hideLutCellNeon(red, indexR, fracR);
+    hideLutCellNeon(green, indexG, fracG);
+    hideLutCellNeon(blue, indexB, fracB);
+    uint32x4_t base = vaddq_u32(vmlaq_u32(vmulq_u32(indexB, strideB), indexG, strideG), vaddq_u32(indexR, lattice));
+
+    uint32x4_t fracMax = vmaxq_u32(fracR, vmaxq_u32(fracG, fracB));
+    uint32x4_t fracMin = vminq_u32(fracR, vminq_u32(fracG, fracB));
+    uint32x4_t fracMid = vsubq_u32(vsubq_u32(vaddq_u32(fracR, vaddq_u32(fracG, fracB)), fracMax), fracMin);
+    uint32x4_t rIsMax = vandq_u32(vcgeq_u32(fracR, fracG), vcgeq_u32(fracR, fracB));
+    uint32x4_t strideMax = vbslq_u32(rIsMax, strideR, vbslq_u32(vcgeq_u32(fracG, fracB), strideG, strideB));
+    uint32x4_t rIsMin = vandq_u32(vcleq_u32(fracR, fracG), vcleq_u32(fracR, fracB));
+    uint32x4_t strideMin = vbslq_u32(rIsMin, strideR, vbslq_u32(vcleq_u32(fracG, fracB), strideG, strideB));
+
+    uint32x4_t corners[4] = {gatherHideLutNeon(hideLut, base),
+                             gatherHideLutNeon(hideLut, vaddq_u32(base, strideMax)),
+                             gatherHideLutNeon(hideLut, vsubq_u32(vaddq_u32(base, strideAll), strideMin)),
+                             gatherHideLutNeon(hideLut, vaddq_u32(base, strideAll))};
+    uint32x4_t weights[4] = {vsubq_u32(vdupq_n_u32(256), fracMax), vsubq_u32(fracMax, fracMid), vsubq_u32(fracMid, fracMin),
+                             fracMin};
+    uint32x4_t redBlue = rounding;
+    uint32x4_t greenAlpha = rounding;
+    for (int i = 0; i < 4; i++) {
+        redBlue = vmlaq_u32(redBlue, weights[i], vandq_u32(corners[i], lowLanes));
+        greenAlpha = vmlaq_u32(greenAlpha, weights[i], vandq_u32(vshrq_n_u32(corners[i], 8), lowLanes));
+    }
+    return vorrq_u32(vandq_u32(vshrq_n_u32(redBlue, 8), lowLanes), vbicq_u32(greenAlpha, lowLanes));
+}
+
+// 4 pixels of the hiding shader, mirrors hide8Avx2
+static inline uint32x4_t hide4Neon(uint32x4_t envPixels, uint8x16_t highPassPixels, const uint32_t* hideLut, uint8x16_t keepEnvMax) {
+    const uint32x4_t rgbMask = vdupq_n_u32(0x00FFFFFF);
+    const uint32x4_t opaque = vdupq_n_u32(0xFF000000);
+    uint32x4_t aboveKeep = vandq_u32(vreinterpretq_u32_u8(vqsubq_u8(highPassPixels, keepEnvMax)), rgbMask);
+    uint32x4_t keepEnv = vceqq_u32(aboveKeep, vdupq_n_u32(0));
+    uint32x4_t passThrough = vorrq_u32(envPixels, opaque);
+    if (vminvq_u32(keepEnv) == 0xFFFFFFFF) {
+        return passThrough;
+    }
+    return vbslq_u32(keepEnv, passThrough, sampleHideColorLut4Neon(hideLut, envPixels));
+}
+
+static void hideRowNeon(const uint8_t* env, const uint8_t* highPass, uint8_t* dst, int width, const HideEffect& effect) {
+    const uint32_t* hideLut = effect.getColorLut().data();
+    const uint8x16_t keepEnvMax = vdupq_n_u8(keepEnvMaxOf(effect));
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        uint32x4_t envPixels = vld1q_u32((const uint32_t*)(env + x * 4));
+        uint8x16_t highPassPixels = vld1q_u8(highPass + x * 4);
+        vst1q_u32((uint32_t*)(dst + x * 4), hide4Neon(envPixels, highPassPixels, hideLut, keepEnvMax));
+    }
+    hideRowScalar(env + x * 4, highPass + x * 4, dst + x * 4, width - x, effect);
+}
+
+static void highPassHideRowNeon(const uint8_t* env, const uint8_t* app, const uint8_t* const* rows, uint8_t* dst, int width,
+                                const HideEffect& effect) {
+    const auto& kernel = effect.getHighPassKernel();
+    const uint32_t* hideLut = effect.getColorLut().data();
+    const uint8x16_t keepEnvMax = vdupq_n_u8(keepEnvMaxOf(effect));
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        int i = x * 4;
+        uint8x16_t blurred = vcombine_u8(gaussianColumn8Neon(rows, i, kernel), gaussianColumn8Neon(rows, i + 8, kernel));
+        uint8x16_t highPassPixels = vqsubq_u8(vld1q_u8(app + i), blurred);
+        uint32x4_t envPixels = vld1q_u32((const uint32_t*)(env + i));
+        vst1q_u32((uint32_t*)(dst + i), hide4Neon(envPixels, highPassPixels, hideLut, keepEnvMax));
+    }
+    highPassHideRangeScalar(env, app, rows, dst, x, width, effect);
+}
+
+static inline uint64x2_t tileHashLanesNeon(uint64x2_t acc, uint64x2_t value, uint64x2_t key) {
+    uint64x2_t mixed = veorq_u64(value, key);
+    uint64x2_t product = vmull_u32(vmovn_u64(mixed), vshrn_n_u64(mixed, 32));
+    uint64x2_t swapped = vreinterpretq_u64_u32(vrev64q_u32(vreinterpretq_u32_u64(value)));
+    return vaddq_u64(acc, vaddq_u64(swapped, product));
+}
+
+static void tileHashRowNeon(const uint8_t* row, int byteCount, uint64_t rowKey, uint64_t* lanes) {
+    const uint64x2_t keys0 = vld1q_u64(kTileHashKeys);
+    const uint64x2_t keys1 = vld1q_u64(kTileHashKeys + 2);
+    uint64x2_t acc0 = vld1q_u64(lanes);
+    uint64x2_t acc1 = vld1q_u64(lanes + 2);
+    uint64_t blockKey = rowKey;
+    int i = 0;
+    for (; i + 32 <= byteCount; i += 32, blockKey += kTileHashBlockStep) {
+        uint64x2_t blockKeys = vdupq_n_u64(blockKey);
+        acc0 = tileHashLanesNeon(acc0, vreinterpretq_u64_u8(vld1q_u8(row + i)), veorq_u64(keys0, blockKeys));
+        acc1 = tileHashLanesNeon(acc1, vreinterpretq_u64_u8(vld1q_u8(row + i + 16)), veorq_u64(keys1, blockKeys));
+    }
+    vst1q_u64(lanes, acc0);
+    vst1q_u64(lanes + 2, acc1);
+    tileHashBlocksScalar(row + i, byteCount - i, blockKey, lanes);
+}
+
+static void accumulateRowNeon(const uint8_t* src, uint16_t* acc, int byteCount) {
+    int i = 0;
+    for (; i + 16 <= byteCount; i += 16) {
+        uint8x16_t value = vld1q_u8(src + i);
+        vst1q_u16(acc + i, vaddw_u8(vld1q_u16(acc + i), vget_low_u8(value)));
+        vst1q_u16(acc + i + 8, vaddw_u8(vld1q_u16(acc + i + 8), vget_high_u8(value)));
+    }
+    accumulateRowScalar(src + i, acc + i, byteCount - i);
+}
+
+// the 16 bit weights of a wide kernel, 32 bit sums. vrshrn adds the 32768 before the shift
+static inline uint8x8_t blurColumn8WideNeon(const uint8_t* const* rows, int offset, const CpuGaussianKernel& kernel) {
+    int radius = kernel.radius;
+    uint16x8_t center = vmovl_u8(vld1_u8(rows[radius] + offset));
+    uint32x4_t sumLow = vmull_n_u16(vget_low_u16(center), kernel.weights[0]);
+    uint32x4_t sumHigh = vmull_n_u16(vget_high_u16(center), kernel.weights[0]);
+    for (int t = 1; t <= radius; t++) {
+        uint16x8_t outer = vaddl_u8(vld1_u8(rows[radius - t] + offset), vld1_u8(rows[radius + t] + offset));
+        sumLow = vmlal_n_u16(sumLow, vget_low_u16(outer), kernel.weights[t]);
+        sumHigh = vmlal_n_u16(sumHigh, vget_high_u16(outer), kernel.weights[t]);
+    }
+    return vqmovn_u16(vcombine_u16(vrshrn_n_u32(sumLow, 16), vrshrn_n_u32(sumHigh, 16)));
+}
+
+static void blurColumnNeon(const uint8_t* const* rows, uint8_t* dst, int byteCount, const CpuGaussianKernel& kernel) {
+    int radius = kernel.radius;
+    int i = 0;
+    if (kernel.shift > 8) {
+        for (; i + 8 <= byteCount; i += 8) {
+            vst1_u8(dst + i, blurColumn8WideNeon(rows, i, kernel));
+        }
+        blurColumnRangeScalar(rows, dst, i, byteCount, kernel);
+        return;
+    }
+    for (; i + 8 <= byteCount; i += 8) {
+        uint16x8_t sum = vmlaq_n_u16(vdupq_n_u16(128), vmovl_u8(vld1_u8(rows[radius] + i)), kernel.weights[0]);
+        for (int t = 1; t <= radius; t++) {
+            sum = vmlaq_n_u16(sum, vaddl_u8(vld1_u8(rows[radius - t] + i), vld1_u8(rows[radius + t] + i)), kernel.weights[t]);
+        }
+        vst1_u8(dst + i, vshrn_n_u16(sum, 8));
+    }
+    blurColumnRangeScalar(rows, dst, i, byteCount, kernel);
+}
+
+static void boxSlideRowNeon(const uint8_t* entering, const uint8_t* leaving, uint16_t* sum, uint8_t* dst, int byteCount,
+                            uint16_t scale) {
+    int i = 0;
+    for (; i + 8 <= byteCount; i += 8) {
+        uint16x8_t sums = vld1q_u16(sum + i);
+        // vrshrn adds the 32768 before the shift
+        uint16x4_t low = vrshrn_n_u32(vmull_n_u16(vget_low_u16(sums), scale), 16);
+        uint16x4_t high = vrshrn_n_u32(vmull_n_u16(vget_high_u16(sums), scale), 16);
+        vst1_u8(dst + i, vqmovn_u16(vcombine_u16(low, high)));
+        // the widened difference wraps like the scalar one
+        vst1q_u16(sum + i, vaddq_u16(sums, vsubl_u8(vld1_u8(entering + i), vld1_u8(leaving + i))));
+    }
+    boxSlideRowScalar(entering + i, leaving + i, sum + i, dst + i, byteCount - i, scale);
+}
+
+static const CpuKernelTable s_neonKernels = {
+        CpuKernelIsa::NEON,
+        gaussianRowNeon,
+        gaussianColumnNeon,
+        subtractRowNeon,
+        hideRowNeon,
+        highPassHideRowNeon,
+        tileHashRowNeon,
+        accumulateRowNeon,
+        blurColumnNeon,
+        boxSlideRowNeon
+};
+
+#endif
+
+// ---- dispatch ----
+
+bool isCpuKernelIsaSupported(CpuKernelIsa isa) {
+    switch (isa) {
+        case CpuKernelIsa::Scalar:
+            return true;
+        case CpuKernelIsa::AVX2:
+#ifdef HIDINGIN_HAS_AVX2_PATH
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+        case CpuKernelIsa::NEON:
+#ifdef HIDINGIN_HAS_NEON_PATH
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+const CpuKernelTable& getCpuKernels(CpuKernelIsa isa) {
+    if (!isCpuKernelIsaSupported(isa)) {
+        return s_scalarKernels;
+    }
+    switch (isa) {
+#ifdef HIDINGIN_HAS_AVX2_PATH
+        case CpuKernelIsa::AVX2:
+            return s_avx2Kernels;
+#endif
+#ifdef HIDINGIN_HAS_NEON_PATH
+        case CpuKernelIsa::NEON:
+            return s_neonKernels;
+#endif
+        default:
+            return s_scalarKernels;
+    }
+}
+
+const CpuKernelTable& getCpuKernels() {
+    static const CpuKernelTable& bestKernels = isCpuKernelIsaSupported(CpuKernelIsa::AVX2) ? getCpuKernels(CpuKernelIsa::AVX2)
+                                                                                           : getCpuKernels(CpuKernelIsa::NEON);
+    return bestKernels;
+}
+
+const char* cpuKernelIsaName(CpuKernelIsa isa) {
+    switch (isa) {
+        case CpuKernelIsa::Scalar:
+            return "scalar";
+        case CpuKernelIsa::AVX2:
+            return "avx2";
+        case CpuKernelIsa::NEON:
+            return "neon";
+    }
+    return "unknown";
+}
@@ -0,0 +1,59 @@
+#ifndef HIDINGIN_CPUKERNELS_H
+#define HIDINGIN_CPUKERNELS_H
+
+#include <cstdint>
+
+// row kernels behind CpuHidingFilter. every kernel works on BGRA8 rows and has a scalar version plus
+// an AVX2 (x86_64, picked at runtime) or NEON (arm64) version that produces the same bytes.
+enum class CpuKernelIsa {
+    Scalar,
+    AVX2,
+    NEON
+};
+
+struct HighPassKernel;
+struct CpuGaussianKernel;
+class HideEffect;
+
+struct CpuKernelTable {
+    CpuKernelIsa isa;
+    // horizontal high pass gaussian of one row, pixels outside the row count as zero (MPSImageEdgeModeZero)
+    void (*gaussianRow)(const uint8_t* src, uint8_t* dst, int width, const HighPassKernel& kernel);
+    // vertical gaussian over the 2 * radius + 1 rows (center in the middle) that already went through gaussianRow,
+    // pass zeroed rows past the edges
+    void (*gaussianColumn)(const uint8_t* const* rows, uint8_t* dst, int byteCount, const HighPassKernel& kernel);
+    // primary - secondary clamped at zero, the way MPSImageSubtract ends up in a unorm texture
+    void (*subtractRow)(const uint8_t* primary, const uint8_t* secondary, uint8_t* dst, int byteCount);
+    // "hidingShader" fragment function: env pixels under a high pass pixel with a channel at or above the effect's
+    // keepEnvBelow get the hsl stand out shift, sampled from its HideColorLut
+    void (*hideRow)(const uint8_t* env, const uint8_t* highPass, uint8_t* dst, int width, const HideEffect& effect);
+    // the three steps above for one row in a single pass: vertical gaussian of the horizontally blurred app rows,
+    // subtract from the app row and hide against the env row. the high pass never goes to memory.
+    void (*highPassHideRow)(const uint8_t* env, const uint8_t* app, const uint8_t* const* rows, uint8_t* dst, int width,
+                            const HideEffect& effect);
+    // mixes byteCount bytes of a tile row into the 4 lanes of a tile hash (change detection, not crypto). rowKey
+    // tells the rows of a tile apart, every isa ends up with the same lanes.
+    void (*tileHashRow)(const uint8_t* row, int byteCount, uint64_t rowKey, uint64_t* lanes);
+    // acc[i] += src[i], the vertical sum of a box downscale. up to 257 rows fit before acc has to be flushed.
+    void (*accumulateRow)(const uint8_t* src, uint16_t* acc, int byteCount);
+    // CpuBlur's vertical gaussian over the 2 * radius + 1 rows (center in the middle), any radius
+    void (*blurColumn)(const uint8_t* const* rows, uint8_t* dst, int byteCount, const CpuGaussianKernel& kernel);
+    // one row of a vertical box blur: dst[i] = sum[i] * scale in 1/65536 rounded, then the box moves a row down,
+    // sum[i] += entering[i] - leaving[i]. the sums of up to 257 rows fit (they wrap in between)
+    void (*boxSlideRow)(const uint8_t* entering, const uint8_t* leaving, uint16_t* sum, uint8_t* dst, int byteCount,
+                        uint16_t scale);
+};
+
+constexpr int kTileHashLanes = 4;
+
+// best kernels this cpu supports
+const CpuKernelTable& getCpuKernels();
+
+// kernels for a specific isa, falls back to scalar if the cpu (or the build) does not support it
+const CpuKernelTable& getCpuKernels(CpuKernelIsa isa);
+
+bool isCpuKernelIsaSupported(CpuKernelIsa isa);
+
+const char* cpuKernelIsaName(CpuKernelIsa isa);
+
+#endif //HIDINGIN_CPUKERNELS_H
@@ -0,0 +1,71 @@
+#include "CpuTileChangeDetector.h"
+#include <algorithm>
+
+static constexpr uint64_t kTileRowKeyStep = 0x8EBC6AF09C88C6E3ull;
+
+static inline uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// folds the lanes into one value, murmur3 finalizer at the end
+static uint64_t finishTileHash(const uint64_t* lanes) {
+    uint64_t hash = lanes[0] ^ rotateLeft(lanes[1], 17) ^ rotateLeft(lanes[2], 31) ^ rotateLeft(lanes[3], 47);
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+CpuTileChangeDetector::CpuTileChangeDetector(CpuKernelIsa isa) : m_kernels(getCpuKernels(isa)) {
+}
+
+CpuTileChangeDetector::CpuTileChangeDetector() : m_kernels(getCpuKernels()) {
+}
+
+void CpuTileChangeDetector::detect(const CpuImageView& frame, DirtyRegion& dirty) {
+    dirty.markEverything();
+    if (!frame.valid()) {
+        m_tileHashes.clear();
+        return;
+    }
+    constexpr int kTileSize = DirtyTileMap::kTileSize;
+    bool compare = frame.width == m_width && frame.height == m_height && !m_tileHashes.empty();
+    m_width = frame.width;
+    m_height = frame.height;
+    m_changedTiles.reset(frame.width, frame.height);
+    int tileColumns = m_changedTiles.getTileColumns();
+    int tileRows = m_changedTiles.getTileRows();
+    m_tileHashes.resize((size_t)tileColumns * tileRows);
+    m_tileLanes.resize((size_t)tileColumns * kTileHashLanes);
+
+    for (int tileRow = 0; tileRow < tileRows; tileRow++) {
+        std::fill(m_tileLanes.begin(), m_tileLanes.end(), 0);
+        int top = tileRow * kTileSize;
+        int bottom = std::min(top + kTileSize, frame.height);
+        for (int y = top; y < bottom; y++) {
+            const uint8_t* row = frame.row(y);
+            uint64_t rowKey = (uint64_t)(y - top + 1) * kTileRowKeyStep;
+            for (int tileColumn = 0; tileColumn < tileColumns; tileColumn++) {
+                int left = tileColumn * kTileSize;
+                int width = std::min(kTileSize, frame.width - left);
+                m_kernels.tileHashRow(row + left * 4, width * 4, rowKey, &m_tileLanes[(size_t)tileColumn * kTileHashLanes]);
+            }
+        }
+        for (int tileColumn = 0; tileColumn < tileColumns; tileColumn++) {
+            auto hash = finishTileHash(&m_tileLanes[(size_t)tileColumn * kTileHashLanes]);
+            auto& previousHash = m_tileHashes[(size_t)tileRow * tileColumns + tileColumn];
+            if (compare && hash != previousHash) {
+                m_changedTiles.markRect({tileColumn * kTileSize, top, kTileSize, kTileSize});
+            }
+            previousHash = hash;
+        }
+    }
+    if (!compare || m_changedTiles.isAllDirty()) {
+        return;
+    }
+    dirty.clear();
+    m_changedTiles.getDirtyRects(m_changedRects);
+    for (auto& rect : m_changedRects) {
+        dirty.add(rect);
+    }
+}
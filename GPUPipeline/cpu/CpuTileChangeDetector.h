@@ -0,0 +1,36 @@
+#ifndef HIDINGIN_CPUTILECHANGEDETECTOR_H
+#define HIDINGIN_CPUTILECHANGEDETECTOR_H
+
+#include <cstdint>
+#include <vector>
+#include "CpuImage.h"
+#include "CpuKernels.h"
+#include "../DirtyRegion.h"
+
+// dirty rects for capture sources that do not report any: hashes every DirtyTileMap::kTileSize tile of a frame and
+// reports the tiles whose hash differs from the previous frame's. one pass over the frame, row by row, with the
+// tileHashRow kernel.
+class CpuTileChangeDetector {
+public:
+    explicit CpuTileChangeDetector(CpuKernelIsa isa);
+    CpuTileChangeDetector();
+
+    // the first frame and a frame of a new size come back as everything
+    void detect(const CpuImageView& frame, DirtyRegion& dirty);
+
+    // forget the previous frame
+    void reset() {
+        m_tileHashes.clear();
+    }
+
+private:
+    const CpuKernelTable& m_kernels;
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<uint64_t> m_tileHashes;
+    std::vector<uint64_t> m_tileLanes; // one tile row being hashed
+    DirtyTileMap m_changedTiles;
+    std::vector<DirtyRect> m_changedRects;
+};
+
+#endif //HIDINGIN_CPUTILECHANGEDETECTOR_H
@@ -0,0 +1,61 @@
+#ifndef HIDINGIN_METALFRAMEGRAPHBACKEND_H
+#define HIDINGIN_METALFRAMEGRAPHBACKEND_H
+
+#include <string>
+#include <unordered_map>
+#include "../TexturePool.h"
+#include "../FrameGraph.h"
+#include "../HidingFrameGraph.h"
+
+// transient textures come from the MtlTextureManager pool, a texture the graph drops (resize) goes back fenced
+class MetalFrameGraphBackend : public FrameGraphBackend {
+public:
+    explicit MetalFrameGraphBackend(void* mtlDevice) : m_mtlDevice(mtlDevice) {
+    }
+    ~MetalFrameGraphBackend() override;
+
+    void* createTexture(const FrameGraphTextureDesc& desc) override;
+    void destroyTexture(void* texture) override;
+
+private:
+    void* m_mtlDevice;
+    std::unordered_map<void*, TexturePoolHandle> m_poolHandles;
+};
+
+// the composite stages on the render queue: MtlProcessMisc for crop / scale / gaussian / subtract, MetalPipeline
+// pipeline states for hide, highPassHide and present (the hide ones read the effect from MetalPipeline's copy, the
+// fused ones run the state specialised for its radius). every stage commits its own command buffer on the render
+// command queue, so they run on the gpu in the order the graph executes them.
+class MetalHidingStageExecutor : public HidingStageExecutor {
+public:
+    explicit MetalHidingStageExecutor(void* mtlCommandQueue) : m_mtlCommandQueue(mtlCommandQueue) {
+    }
+
+    // renderer notified by present
+    void setTriggerRendererName(const std::string& triggerRendererName) {
+        m_triggerRendererName = triggerRendererName;
+    }
+
+    void crop(void* input, const FrameGraphCrop& crop, void* output) override;
+    void scale(void* input, void* output) override;
+    void gaussian(void* input, void* output, const HideEffect& hideEffect) override;
+    void subtract(void* input1, void* input2, void* output) override;
+    // hidingShader renders into the render target, output has to be it
+    void hide(void* envInput, void* highPassInput, void* output, const HideEffect& hideEffect) override;
+    void highPassHide(void* envInput, void* appInput, void* output, const HideEffect& hideEffect) override;
+    void present(void* input, void* target) override;
+
+    // scale once per rect with the filter's clip rect, highPassHideTiles only dispatches the dirty tiles
+    void scaleRects(void* input, void* output, const std::vector<DirtyRect>& rects) override;
+    void highPassHideTiles(void* envInput, void* appInput, void* output, const DirtyTileMap& dirtyTiles,
+                           const HideEffect& hideEffect) override;
+    // the fused path needs highPassHide / highPassHideTiles specialised for the radius, MPS takes any sigma
+    bool isHideEffectReady(const HideEffectSpecialization& specialization) override;
+
+private:
+    void* m_mtlCommandQueue;
+    std::string m_triggerRendererName;
+    std::vector<uint16_t> m_dirtyTiles;
+};
+
+#endif //HIDINGIN_METALFRAMEGRAPHBACKEND_H
@@ -0,0 +1,124 @@
+#include "MetalFrameGraphBackend.h"
+#include "MetalPipeline.h"
+#include "../../utils/Tracer.h"
+#import <Metal/Metal.h>
+#include <algorithm>
+#include <iostream>
+#include <tuple>
+
+MetalFrameGraphBackend::~MetalFrameGraphBackend() {
+    for(auto& poolHandle : m_poolHandles){
+        MtlTextureManager::getGlobalInstance().releaseTexture(poolHandle.second);
+    }
+}
+
+void* MetalFrameGraphBackend::createTexture(const FrameGraphTextureDesc& desc) {
+    auto handle = MtlTextureManager::getGlobalInstance().acquireTexture(desc.width, desc.height, desc.format, m_mtlDevice);
+    auto texture = MtlTextureManager::getGlobalInstance().getTexture(handle);
+    if(texture){
+        m_poolHandles[texture] = handle;
+    }
+    return texture;
+}
+
+void MetalFrameGraphBackend::destroyTexture(void* texture) {
+    auto findHandle = m_poolHandles.find(texture);
+    if(findHandle == m_poolHandles.end()){
+        return;
+    }
+    MtlTextureManager::getGlobalInstance().releaseTexture(findHandle->second);
+    m_poolHandles.erase(findHandle);
+}
+
+void MetalHidingStageExecutor::crop(void* input, const FrameGraphCrop& crop, void* output) {
+    TRACE_SCOPE("encodeCrop");
+    MtlProcessMisc::getGlobalInstance().encodeCropProcessIntoPipeline(
+            std::make_tuple(crop.x, crop.y, crop.width, crop.height),
+            std::make_tuple(crop.writeX, crop.writeY),
+            input, output, m_mtlCommandQueue);
+}
+
+void MetalHidingStageExecutor::scale(void* input, void* output) {
+    TRACE_SCOPE("encodeScale");
+    MtlProcessMisc::getGlobalInstance().encodeScaleProcessIntoPipeline(input, output, m_mtlCommandQueue);
+}
+
+void MetalHidingStageExecutor::gaussian(void* input, void* output, const HideEffect& hideEffect) {
+    TRACE_SCOPE("encodeGaussian");
+    // MPS wants a positive sigma, one this small is the identity HighPassKernel makes of sigma <= 0
+    MtlProcessMisc::getGlobalInstance().encodeGaussianProcessIntoPipeline(input, output, m_mtlCommandQueue,
+                                                                          std::max(hideEffect.getSettings().highPassSigma, 0.01f));
+}
+
+void MetalHidingStageExecutor::subtract(void* input1, void* input2, void* output) {
+    TRACE_SCOPE("encodeSubtract");
+    MtlProcessMisc::getGlobalInstance().encodeSubtractProcessIntoPipeline(input1, input2, output, m_mtlCommandQueue);
+}
+
+void MetalHidingStageExecutor::hide(void* envInput, void* highPassInput, void* output, const HideEffect& hideEffect) {
+    if (output != MetalPipeline::getGlobalInstance().getRenderPipeline().renderTarget) {
+        std::cerr << "metal hide stage: hidingShader can only render into the render target" << std::endl;
+        return;
+    }
+    std::vector<void*> inputTextures{envInput, highPassInput};
+    std::vector<void*> effectBuffers{MetalPipeline::getGlobalInstance().getHideEffectBuffer(hideEffect)};
+    // present notifies the renderer once the frame is complete
+    MetalPipeline::getGlobalInstance().throughRenderingPipelineState("hidingShader", inputTextures, "", effectBuffers);
+}
+
+void MetalHidingStageExecutor::highPassHide(void* envInput, void* appInput, void* output, const HideEffect& hideEffect) {
+    auto& metalPipeline = MetalPipeline::getGlobalInstance();
+    // selectHideEffect only hands out effects whose specialization isHideEffectReady said is built
+    auto pipelineDesc = metalPipeline.requestSpecializedComputePipeline("highPassHide", hideEffect.getSpecialization());
+    std::vector<void*> inputTextures{envInput, appInput};
+    std::vector<void*> effectBuffers{metalPipeline.getHideEffectBuffer(hideEffect)};
+    if(pipelineDesc.empty() || !metalPipeline.throughComputePipelineState(pipelineDesc, inputTextures, output, effectBuffers)){
+        std::cerr << "metal highPassHide stage: no pipeline state for radius " << hideEffect.getSpecialization().highPassRadius
+                  << std::endl;
+    }
+}
+
+void MetalHidingStageExecutor::scaleRects(void* input, void* output, const std::vector<DirtyRect>& rects) {
+    TRACE_SCOPE_ARG("encodeScaleRects", rects.size());
+    for(auto& rect : rects){
+        MtlProcessMisc::getGlobalInstance().encodeScaleProcessIntoPipeline(
+                input, output, m_mtlCommandQueue, std::make_tuple(rect.x, rect.y, rect.width, rect.height));
+    }
+}
+
+void MetalHidingStageExecutor::highPassHideTiles(void* envInput, void* appInput, void* output, const DirtyTileMap& dirtyTiles,
+                                                 const HideEffect& hideEffect) {
+    auto& metalPipeline = MetalPipeline::getGlobalInstance();
+    auto pipelineDesc = metalPipeline.requestSpecializedComputePipeline("highPassHideTiles", hideEffect.getSpecialization());
+    std::vector<void*> inputTextures{envInput, appInput};
+    std::vector<void*> effectBuffers{metalPipeline.getHideEffectBuffer(hideEffect)};
+    dirtyTiles.getDirtyTiles(m_dirtyTiles);
+    // the inputs only hold valid pixels around the dirty tiles, a full highPassHide is no fallback here
+    if(pipelineDesc.empty() || !metalPipeline.throughComputePipelineStateOnTiles(pipelineDesc, inputTextures, output, m_dirtyTiles,
+                                                                                 DirtyTileMap::kTileSize, effectBuffers)){
+        std::cerr << "metal highPassHideTiles stage: no highPassHideTiles pipeline state" << std::endl;
+    }
+}
+
+bool MetalHidingStageExecutor::isHideEffectReady(const HideEffectSpecialization& specialization) {
+    auto& metalPipeline = MetalPipeline::getGlobalInstance();
+    // ask for both so they build together, the unfused path has nothing to build
+    bool ready = true;
+    for(auto pipelineDesc : {"highPassHide", "highPassHideTiles"}){
+        if(metalPipeline.hasComputePipelineState(pipelineDesc) &&
+           metalPipeline.requestSpecializedComputePipeline(pipelineDesc, specialization).empty()){
+            ready = false;
+        }
+    }
+    return ready;
+}
+
+void MetalHidingStageExecutor::present(void* input, void* target) {
+    if (input == target) {
+        MetalPipeline::getGlobalInstance().triggerRenderUpdate(m_triggerRendererName);
+        return;
+    }
+    // basicRenderShader draws into the render target and notifies on its own
+    std::vector<void*> inputTextures{input};
+    MetalPipeline::getGlobalInstance().throughRenderingPipelineState("basicRenderShader", inputTextures, m_triggerRendererName);
+}
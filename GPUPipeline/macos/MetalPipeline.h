@@ -7,12 +7,17 @@
 
 #include <utility>
 
-#include "utils/TaskQueue.h"
+#include "utils/TaskScheduler.h"
 #include "MetalResources.h"
 #include "../PipelineConfiguration.h"
+#include "../HideEffect.h"
+#include "../PipelineVariantCache.h"
+#include "../ShaderCache.h"
 #include "../com/EventListener.h"
 #include "memory"
 
+constexpr int kComputeThreadgroupSize = 16;
+
 using GpuRenderTask = std::function<void(const std::string& threadName, const MtlRenderPipeline& renderPipelineRes)>;
 using GpuComputeTask = std::function<void(const std::string& threadName, const MtlComputePipeline& computePipelineRes)>;
 using GpuBlitTask = std::function<void(const std::string& threadName, const MtlBlitPipeline& blitPipelineRes)>;
@@ -54,10 +59,16 @@ public:
         return metalPipeline;
     }
 
+    // sets up the queues and starts building the shaders in the background: the pipeline states show up in
+    // mtlPipelineStates once built, loaded from the shader cache when an earlier launch compiled them
     static void initGlobalMetalPipeline(PipelineConfiguration&);
+    // blocks until the shaders initGlobalMetalPipeline started are built (or failed). never on the render queue,
+    // the states are put in by a job on it
+    void waitForShaderBuilds();
 
 public:
-    std::future<void> sendJobToRenderQueue(const GpuRenderTask& renderTask);
+    // frame jobs go with default options, TaskLane::Control jumps ahead of every queued frame job
+    std::future<void> sendJobToRenderQueue(const GpuRenderTask& renderTask, const TaskOptions& options = {});
     std::future<void> sendJobToComputeQueue(const GpuComputeTask& computeTask);
     std::future<void> sendJobToBlitQueue(const GpuBlitTask& blitTask);
 
@@ -67,8 +78,30 @@ public:
 
     void cleanUp();
 
-    void* throughRenderingPipelineState(std::string pipelineDesc, std::vector<void*>& inputTextures, std::string triggerRendererName);
-    void throughComputePipelineState(std::string pipelineDesc, std::vector<void*>& inputTextures, void* resultTexture);
+    // fragmentBuffers (id<MTLBuffer>) are bound at fragment buffer(0..n-1)
+    void* throughRenderingPipelineState(std::string pipelineDesc, std::vector<void*>& inputTextures, std::string triggerRendererName,
+                                        const std::vector<void*>& fragmentBuffers = {});
+    // inputs are bound at texture(0..n-1), the result at texture(n), inputBuffers at buffer(0..m-1). the grid is
+    // whole 16x16 threadgroups.
+    bool throughComputePipelineState(std::string pipelineDesc, std::vector<void*>& inputTextures, void* resultTexture,
+                                     const std::vector<void*>& inputBuffers = {});
+    // same, but only over the tiles in tileCoordinates ((column, row) pairs of tileSize pixel tiles): the grid is
+    // (tileSize / 16, tileSize / 16, tile count) threadgroups and the kernel reads its tile from buffer(0), inputBuffers
+    // follow at buffer(1..m)
+    bool throughComputePipelineStateOnTiles(std::string pipelineDesc, std::vector<void*>& inputTextures, void* resultTexture,
+                                            const std::vector<uint16_t>& tileCoordinates, int tileSize,
+                                            const std::vector<void*>& inputBuffers = {});
+    // id<MTLBuffer> holding the effect's HideEffectUniforms and lut, uploaded again only for a different effect.
+    // render queue only.
+    void* getHideEffectBuffer(const HideEffect& hideEffect);
+    // pipelineDesc's compute pipeline state built with specialization's function constants, as a pipelineDesc for
+    // throughComputePipelineState. empty while it is being built in the background, asking never compiles on the
+    // calling thread. the default specialization is the unspecialised state prepComputePipeline built. render queue only.
+    std::string requestSpecializedComputePipeline(const std::string& pipelineDesc, const HideEffectSpecialization& specialization);
+    bool hasComputePipelineState(const std::string& pipelineDesc){
+        return m_mtlComputePipeline.mtlPipelineStates.count(pipelineDesc) != 0;
+    }
+    void triggerRenderUpdate(const std::string& triggerRendererName);
     void throughBlitPipelineState(void* inputTexture, void* outputTexture); // resource copy method
     bool isRenderingInitDoneBefore(){
         return m_isRenderPipelineInit;
@@ -77,6 +110,11 @@ public:
         return m_renderingPipelineTasks->size();
     }
 
+    // frame jobs that were superseded or missed their deadline before the render queue got to them
+    uint64_t getDroppedRenderTasksCount(){
+        return m_renderingPipelineTasks->getDroppedTaskCount();
+    }
+
     void markRenderTargetDirty(){
         m_mtlRenderPipeline.renderTargetDirty = true;
     }
@@ -94,9 +132,7 @@ public:
         return m_renderingPipelineTasks->empty();
     }
 
-    void setRenderTarget(void* renderTarget){
-        m_mtlRenderPipeline.renderTarget = renderTarget;
-    }
+    void setRenderTarget(void* renderTarget);
 
 public:
     void executeAllRenderTasksInPlace();
@@ -107,11 +143,15 @@ private:
     void prepComputePipeline(PipelineConfiguration& pipelineInitConfiguration);
     void prepBlitPipeline(PipelineConfiguration& pipelineInitConfiguration);
     void prepRenderPipeline(PipelineConfiguration& pipelineInitConfiguration, bool isUpdate = false);
+    void buildShaders(PipelineConfiguration& pipelineInitConfiguration);
 
 private:
-    std::unique_ptr<TaskQueue> m_renderingPipelineTasks;
-    std::unique_ptr<TaskQueue> m_computePipelineTasks;
-    std::unique_ptr<TaskQueue> m_blitPipelineTasks;
+    std::unique_ptr<TaskScheduler> m_renderingPipelineTasks;
+    std::unique_ptr<TaskScheduler> m_computePipelineTasks;
+    std::unique_ptr<TaskScheduler> m_blitPipelineTasks;
+    std::unique_ptr<TaskScheduler> m_shaderBuildTasks;
+    std::vector<std::future<void>> m_shaderBuilds;
+    std::unique_ptr<ShaderCache> m_shaderCache;
 
 private:
     // mtl res:
@@ -124,6 +164,13 @@ private:
     std::map<std::string, std::function<void()>>m_triggerRenderUpdateFuncSet;
     std::unique_ptr<LastRenderingReplayRecord> m_lastRenderingReplayRecord = nullptr;
     void* m_renderTarget;
+    void* m_hideEffectBuffer = nullptr;
+    uint64_t m_hideEffectId = 0;
+    // compute shader source per pipelineDesc (id<MTLLibrary>, function name), for specialised variants
+    std::unordered_map<std::string, std::pair<void*, std::string>> m_computeShaderLibraries;
+    std::unique_ptr<PipelineVariantCache> m_computePipelineVariants;
+    // keeps the specialised states in mtlPipelineStates alive
+    std::unordered_map<std::string, PipelineVariantCache::Variant> m_specializedPipelineStates;
 };
 
 
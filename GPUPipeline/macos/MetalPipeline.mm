@@ -6,15 +6,19 @@
 #import <Metal/Metal.h>
 #import "MetalKit/MetalKit.h"
 #include "../com/NotificationCenter.h"
+#include "../DesktopCapture/common/CaptureState.h"
+#include "../utils/Tracer.h"
 #include <future>
 
 MetalPipeline::MetalPipeline() {
     std::vector<std::string> vecRenderThreadPool = { "renderQueue" };
     std::vector<std::string> vecComputeThreadPool = { "computeQueue1", "computeQueue2"};
     std::vector<std::string> vecBlitThreadPool = { "blitQueue1", "blitQueue2" };
-    m_renderingPipelineTasks = std::make_unique<TaskQueue>(1, vecRenderThreadPool, 10);
-    m_computePipelineTasks = std::make_unique<TaskQueue>(2, vecComputeThreadPool, 20);
-    m_blitPipelineTasks = std::make_unique<TaskQueue>(1, vecBlitThreadPool, 10);
+    std::vector<std::string> vecShaderBuildThreadPool = { "shaderBuilder1", "shaderBuilder2" };
+    m_renderingPipelineTasks = std::make_unique<TaskScheduler>(1, vecRenderThreadPool, 10);
+    m_computePipelineTasks = std::make_unique<TaskScheduler>(2, vecComputeThreadPool, 20);
+    m_blitPipelineTasks = std::make_unique<TaskScheduler>(1, vecBlitThreadPool, 10);
+    m_shaderBuildTasks = std::make_unique<TaskScheduler>(2, vecShaderBuildThreadPool, 10);
 }
 
 void MetalPipeline::initGlobalMetalPipeline(PipelineConfiguration &pipelineInitConfiguration) {
@@ -22,19 +26,38 @@ void MetalPipeline::initGlobalMetalPipeline(PipelineConfiguration &pipelineInitC
     inst.prepRenderPipeline(pipelineInitConfiguration);
     MtlProcessMisc::getGlobalInstance().initAllProcessors(pipelineInitConfiguration.graphicsDevice);
 
-    //getGlobalInstance().prepComputePipeline(pipelineInitConfiguration);
+    inst.prepComputePipeline(pipelineInitConfiguration);
+    // compiling is what made the first frame wait, it goes to the shader builders now
+    inst.buildShaders(pipelineInitConfiguration);
     //getGlobalInstance().prepBlitPipeline(pipelineInitConfiguration);
 }
 
-std::future<void> MetalPipeline::sendJobToRenderQueue(const GpuRenderTask& renderTask) {
+std::future<void> MetalPipeline::sendJobToRenderQueue(const GpuRenderTask& renderTask, const TaskOptions& options) {
     // need to trigger update rendering to qt:
     auto retFuture = m_renderingPipelineTasks->enqueueTask([=, this](const std::string& threadName) {
         renderTask(threadName, m_mtlRenderPipeline);
-    });
+    }, options);
 
     return retFuture;
 }
 
+void MetalPipeline::setRenderTarget(void* renderTarget) {
+    if(!m_renderingPipelineTasks){
+        m_mtlRenderPipeline.renderTarget = renderTarget;
+        return;
+    }
+    // swap it between two frame jobs instead of under a running one, on the control lane so the resize does not
+    // wait behind the queued frames:
+    TaskOptions options;
+    options.lane = TaskLane::Control;
+    auto swapFuture = m_renderingPipelineTasks->enqueueTask([=, this](const std::string& threadName) {
+        m_mtlRenderPipeline.renderTarget = renderTarget;
+    }, options);
+    if(swapFuture.valid()){
+        swapFuture.get();
+    }
+}
+
 std::future<void> MetalPipeline::sendJobToComputeQueue(const GpuComputeTask& computeTask) {
     return m_renderingPipelineTasks->enqueueTask([=, this](const std::string& threadName){
        computeTask(threadName, m_mtlComputePipeline);
@@ -75,91 +98,292 @@ void MetalPipeline::prepRenderPipeline(PipelineConfiguration& pipelineInitConfig
                                                      length:sizeof(quadVertices)
                                                     options:MTLResourceStorageModeShared];
     }
+}
 
-    // prep shaders, pipeline states:
-    {
-        for(auto& shaderDesc : pipelineInitConfiguration.renderShaders){
-            NSString *shaderSource = [NSString stringWithUTF8String:shaderDesc.shaderContent.c_str()];
-            NSString *vertFunc = [NSString stringWithUTF8String:shaderDesc.functionToGoVert.c_str()];
-            NSString *fragFunc = [NSString stringWithUTF8String:shaderDesc.functionToGoFrag.c_str()];
-            if (!shaderSource) {
-                NSLog(@"Failed to read shader source from: qrc:/shader/render.metal");
-                return;
-            }
+void MetalPipeline::prepComputePipeline(PipelineConfiguration& pipelineInitConfiguration) {
+    auto mtlDeviceOC = TO_MTL_DEVICE(pipelineInitConfiguration.graphicsDevice);
+    m_mtlComputePipeline.mtlDeviceRef = (void*)mtlDeviceOC;
 
-            NSError *error = nil;
-            id<MTLLibrary> library = [(id<MTLDevice>)mtlDeviceOC newLibraryWithSource:shaderSource options:nil error:&error];
-            if (!library) {
-                NSLog(@"Failed to compile shader library: %@", error);
-                return;
-            }
+    // compute work reads frames the render queue produced and writes the render target, share the queue so
+    // command buffers stay in submission order without extra fences:
+    m_mtlComputePipeline.mtlCommandQueue = m_mtlRenderPipeline.mtlCommandQueue;
+
+    if (!m_computePipelineVariants) {
+        m_computePipelineVariants = std::make_unique<PipelineVariantCache>("pipelineVariantBuilder");
+    }
+    // command buffers and encoders are created per dispatch in throughComputePipelineState
+    m_mtlComputePipeline.mtlCommandBuffer = nullptr;
+    m_mtlComputePipeline.mtlComputeCommandEncoder = nullptr;
+}
+
+void MetalPipeline::prepBlitPipeline(PipelineConfiguration& pipelineInitConfiguration) {
+    auto mtlDeviceOC = TO_MTL_DEVICE(pipelineInitConfiguration.graphicsDevice);
+    m_blitPipeline.mtlDeviceRef = (void*)mtlDeviceOC;
+    auto commandQueue = [mtlDeviceOC newCommandQueue];
+    // qquick got its own render command queue and buffer, we should get from it:
+    m_blitPipeline.mtlCommandQueue = (void*)commandQueue;
+    m_blitPipeline.mtlCommandBuffer = (void*)[commandQueue commandBuffer];
+    m_blitPipeline.mtlBlitCommandEncoder = (void*)[TO_MTL_COMMAND_BUFFER(m_blitPipeline.mtlCommandBuffer) blitCommandEncoder];
+}
 
-            id<MTLFunction> vertexFunction = [library newFunctionWithName:vertFunc];
-            id<MTLFunction> fragmentFunction = [library newFunctionWithName:fragFunc];
+// the pipelines of one shader file, its source is compiled once for all of them
+struct ShaderBuildGroup {
+    std::string source;
+    bool isCompute = false;
+    std::vector<ShaderDesc> shaderDescs;
+};
+
+// what goes into a ShaderCacheKey besides the source: the entry points and the descriptor state prepRenderPipeline
+// always used
+static std::string pipelineCacheDesc(const ShaderDesc& shaderDesc, bool isCompute) {
+    if(isCompute){
+        return "compute:" + shaderDesc.functionToGoCompute;
+    }
+    return "render:" + shaderDesc.functionToGoVert + "/" + shaderDesc.functionToGoFrag + ":bgra8Unorm";
+}
 
-            // Create a render pipeline descriptor and set up the shaders
-            MTLRenderPipelineDescriptor *pipelineDescriptor = [[MTLRenderPipelineDescriptor alloc] init];
-            pipelineDescriptor.vertexFunction = vertexFunction;
-            pipelineDescriptor.fragmentFunction = fragmentFunction;
-            pipelineDescriptor.colorAttachments[0].pixelFormat = MTLPixelFormatBGRA8Unorm;
-            pipelineDescriptor.colorAttachments[0].blendingEnabled = false;
-            pipelineDescriptor.depthAttachmentPixelFormat = MTLPixelFormatInvalid;
-            pipelineDescriptor.stencilAttachmentPixelFormat = MTLPixelFormatInvalid;
+// the archives hold gpu binaries, they are only good for the gpu and driver (os build) that made them
+static std::string deviceCacheDesc(id<MTLDevice> mtlDevice) {
+    auto osVersion = [[NSProcessInfo processInfo] operatingSystemVersionString];
+    return std::string(mtlDevice.name.UTF8String) + "/" + osVersion.UTF8String;
+}
 
-            auto pipelineState = [mtlDeviceOC newRenderPipelineStateWithDescriptor:pipelineDescriptor error: &error];
-            m_mtlRenderPipeline.mtlPipelineStates.insert({shaderDesc.shaderDesc, (void*)pipelineState});
+// path empty: a new empty archive to add to
+static id<MTLBinaryArchive> newBinaryArchive(id<MTLDevice> mtlDevice, const std::string& path) API_AVAILABLE(macos(11.0)) {
+    auto archiveDescriptor = [[MTLBinaryArchiveDescriptor alloc] init];
+    if(!path.empty()){
+        archiveDescriptor.url = [NSURL fileURLWithPath:[NSString stringWithUTF8String:path.c_str()]];
+    }
+    NSError *error = nil;
+    id<MTLBinaryArchive> archive = [mtlDevice newBinaryArchiveWithDescriptor:archiveDescriptor error:&error];
+    [archiveDescriptor release];
+    if(!archive){
+        NSLog(@"Failed to open binary archive %s: %@", path.c_str(), error);
+    }
+    return archive;
+}
+
+// one pipeline of a group on its way through buildShaderGroup
+struct PendingPipelineState {
+    std::string shaderDesc;
+    ShaderCacheKey cacheKey;
+    id descriptor = nil;        // MTLRenderPipelineDescriptor or MTLComputePipelineDescriptor
+    id pipelineState = nil;
+    bool fromCache = false;
+};
+
+static id newPipelineState(id<MTLDevice> mtlDevice, PendingPipelineState& pending, bool isCompute, NSArray* archives) {
+    NSError *error = nil;
+    MTLPipelineOption options = MTLPipelineOptionNone;
+    if (@available(macOS 11.0, *)) {
+        if(archives){
+            // a miss fails instead of compiling, a stale archive is then replaced
+            options = MTLPipelineOptionFailOnBinaryArchiveMiss;
         }
+        [pending.descriptor setBinaryArchives:archives];
+    }
+    id pipelineState = nil;
+    if(isCompute){
+        pipelineState = [mtlDevice newComputePipelineStateWithDescriptor:(MTLComputePipelineDescriptor*)pending.descriptor
+                                                                 options:options reflection:nil error:&error];
+    }else{
+        pipelineState = [mtlDevice newRenderPipelineStateWithDescriptor:(MTLRenderPipelineDescriptor*)pending.descriptor
+                                                                options:options reflection:nil error:&error];
     }
+    if(!pipelineState && !archives){
+        NSLog(@"Failed to create pipeline state %s: %@", pending.shaderDesc.c_str(), error);
+    }
+    return pipelineState;
 }
 
-void MetalPipeline::prepComputePipeline(PipelineConfiguration& pipelineInitConfiguration) {
-    auto mtlDeviceOC = MTLCreateSystemDefaultDevice();
-    m_mtlComputePipeline.mtlDeviceRef = (void*)mtlDeviceOC;
+// a new archive with the pipeline's binaries goes into the cache for the next launch
+static void storeBinaryArchive(id<MTLDevice> mtlDevice, ShaderCache& shaderCache, const PendingPipelineState& pending,
+                               bool isCompute) {
+    if (@available(macOS 11.0, *)) {
+        TRACE_SCOPE("storeBinaryArchive");
+        auto archive = newBinaryArchive(mtlDevice, "");
+        if(!archive){
+            return;
+        }
+        NSError *error = nil;
+        bool added = isCompute ?
+                [archive addComputePipelineFunctionsWithDescriptor:(MTLComputePipelineDescriptor*)pending.descriptor error:&error] :
+                [archive addRenderPipelineFunctionsWithDescriptor:(MTLRenderPipelineDescriptor*)pending.descriptor error:&error];
+        auto stagingPath = shaderCache.stagingPath(pending.cacheKey);
+        if(added && [archive serializeToURL:[NSURL fileURLWithPath:[NSString stringWithUTF8String:stagingPath.c_str()]]
+                                      error:&error]){
+            shaderCache.store(pending.shaderDesc, pending.cacheKey);
+        }else{
+            NSLog(@"Failed to store %s in the shader cache: %@", pending.shaderDesc.c_str(), error);
+        }
+        [archive release];
+    }
+}
 
-    // qquick got its own render command queue and buffer, we should get from it:
-    auto commandQueue = [mtlDeviceOC newCommandQueue];
-    m_mtlComputePipeline.mtlCommandQueue =
-            (void*)commandQueue;
+// compiles group's source and makes the pipeline state of each of its shaderDescs, from the cached archive when
+// there is one for the state's key. publish gets the states (and the library) as soon as they are there, the
+// archives of the states that had to be compiled are written after so they do not hold up the first frame.
+static void buildShaderGroup(id<MTLDevice> mtlDevice, ShaderCache& shaderCache, const ShaderBuildGroup& group,
+                             const std::function<void(std::vector<std::pair<std::string, void*>>&, id<MTLLibrary>)>& publish) {
+    TRACE_SCOPE_ARG("buildShaderGroup", group.shaderDescs.size());
+    NSError *error = nil;
+    NSString *shaderSource = [NSString stringWithUTF8String:group.source.c_str()];
+    id<MTLLibrary> library = shaderSource ? [mtlDevice newLibraryWithSource:shaderSource options:nil error:&error] : nil;
+    if (!library) {
+        NSLog(@"Failed to compile shader library of %s: %@", group.shaderDescs.front().shaderDesc.c_str(), error);
+        return;
+    }
+    auto deviceDesc = deviceCacheDesc(mtlDevice);
+
+    std::vector<PendingPipelineState> pendingStates;
+    for(auto& shaderDesc : group.shaderDescs){
+        PendingPipelineState pending;
+        pending.shaderDesc = shaderDesc.shaderDesc;
+        pending.cacheKey = ShaderCacheKey::make(group.source, pipelineCacheDesc(shaderDesc, group.isCompute), deviceDesc);
+        if(group.isCompute){
+            id<MTLFunction> computeFunction = [library newFunctionWithName:[NSString stringWithUTF8String:shaderDesc.functionToGoCompute.c_str()]];
+            auto descriptor = [[MTLComputePipelineDescriptor alloc] init];
+            descriptor.computeFunction = computeFunction;
+            [computeFunction release];
+            pending.descriptor = descriptor;
+        }else{
+            id<MTLFunction> vertexFunction = [library newFunctionWithName:[NSString stringWithUTF8String:shaderDesc.functionToGoVert.c_str()]];
+            id<MTLFunction> fragmentFunction = [library newFunctionWithName:[NSString stringWithUTF8String:shaderDesc.functionToGoFrag.c_str()]];
+            auto descriptor = [[MTLRenderPipelineDescriptor alloc] init];
+            descriptor.vertexFunction = vertexFunction;
+            descriptor.fragmentFunction = fragmentFunction;
+            descriptor.colorAttachments[0].pixelFormat = MTLPixelFormatBGRA8Unorm;
+            descriptor.colorAttachments[0].blendingEnabled = false;
+            descriptor.depthAttachmentPixelFormat = MTLPixelFormatInvalid;
+            descriptor.stencilAttachmentPixelFormat = MTLPixelFormatInvalid;
+            [vertexFunction release];
+            [fragmentFunction release];
+            pending.descriptor = descriptor;
+        }
 
-    // prep shaders, pipeline states:
-    {
-        for(auto& shaderDesc : pipelineInitConfiguration.computeShaders){
-            NSString *shaderSource = [NSString stringWithUTF8String:shaderDesc.shaderContent.c_str()];
-            NSString *computeFunc = [NSString stringWithUTF8String:shaderDesc.functionToGoCompute.c_str()];
-            if (!shaderSource) {
-                NSLog(@"Failed to read shader source from: qrc:/shader/render.metal");
-                return;
+        if (@available(macOS 11.0, *)) {
+            auto cachedPath = shaderCache.lookup(pending.shaderDesc, pending.cacheKey);
+            if(!cachedPath.empty()){
+                auto archive = newBinaryArchive(mtlDevice, cachedPath);
+                if(archive){
+                    pending.pipelineState = newPipelineState(mtlDevice, pending, group.isCompute, @[archive]);
+                    [archive release];
+                }
+                pending.fromCache = pending.pipelineState != nil;
+                if(!pending.fromCache){
+                    shaderCache.invalidate(pending.shaderDesc, pending.cacheKey);
+                }
             }
+        }
+        if(!pending.pipelineState){
+            pending.pipelineState = newPipelineState(mtlDevice, pending, group.isCompute, nil);
+        }
+        pendingStates.push_back(pending);
+    }
+
+    std::vector<std::pair<std::string, void*>> pipelineStates;
+    for(auto& pending : pendingStates){
+        if(pending.pipelineState){
+            // publish takes over the reference
+            pipelineStates.emplace_back(pending.shaderDesc, (void*)pending.pipelineState);
+        }
+    }
+    publish(pipelineStates, library);
+    [library release];
 
-            NSError *error = nil;
-            id<MTLLibrary> library = [(id<MTLDevice>)mtlDeviceOC newLibraryWithSource:shaderSource options:nil error:&error];
-            if (!library) {
-                NSLog(@"Failed to compile shader library: %@", error);
+    for(auto& pending : pendingStates){
+        if(pending.pipelineState && !pending.fromCache && shaderCache.isEnabled()){
+            storeBinaryArchive(mtlDevice, shaderCache, pending, group.isCompute);
+        }
+        [pending.descriptor release];
+    }
+}
+
+void MetalPipeline::buildShaders(PipelineConfiguration& pipelineInitConfiguration) {
+    auto mtlDevice = TO_MTL_DEVICE(pipelineInitConfiguration.graphicsDevice);
+    if(!m_shaderBuildTasks){
+        return;
+    }
+    if(!m_shaderCache){
+        m_shaderCache = std::make_unique<ShaderCache>(pipelineInitConfiguration.shaderCacheDirectory);
+    }
+
+    // compute first, the fused highPassHide is what the first hidden frame needs
+    std::vector<ShaderBuildGroup> groups;
+    auto addToGroup = [&groups](const ShaderDesc& shaderDesc, bool isCompute){
+        for(auto& group : groups){
+            if(group.isCompute == isCompute && group.source == shaderDesc.shaderContent){
+                group.shaderDescs.push_back(shaderDesc);
                 return;
             }
+        }
+        groups.push_back({shaderDesc.shaderContent, isCompute, {shaderDesc}});
+    };
+    for(auto& shaderDesc : pipelineInitConfiguration.computeShaders){
+        addToGroup(shaderDesc, true);
+    }
+    for(auto& shaderDesc : pipelineInitConfiguration.renderShaders){
+        addToGroup(shaderDesc, false);
+    }
 
-            id<MTLFunction> computeShaderProcFunc = [library newFunctionWithName:computeFunc];
-
-            auto pipelineState = [mtlDeviceOC newComputePipelineStateWithFunction:computeShaderProcFunc error: &error];
-            m_mtlComputePipeline.mtlPipelineStates.insert({shaderDesc.shaderDesc, (void*)pipelineState});
+    for(auto& group : groups){
+        auto shaderCache = m_shaderCache.get();
+        auto build = m_shaderBuildTasks->enqueueTask([this, mtlDevice, shaderCache, group](const std::string& threadName){
+            @autoreleasepool {
+                buildShaderGroup(mtlDevice, *shaderCache, group, [&](std::vector<std::pair<std::string, void*>>& pipelineStates,
+                                                                     id<MTLLibrary> library){
+                    // the maps are only touched on the render queue, the frames reading them run there
+                    std::vector<std::pair<std::string, std::string>> computeFunctions;
+                    for(auto& shaderDesc : group.shaderDescs){
+                        computeFunctions.emplace_back(shaderDesc.shaderDesc, shaderDesc.functionToGoCompute);
+                    }
+                    TaskOptions options;
+                    options.lane = TaskLane::Control;
+                    auto isCompute = group.isCompute;
+                    auto published = m_renderingPipelineTasks->enqueueTask([&](const std::string& threadName){
+                        auto& mtlPipelineStates = isCompute ? m_mtlComputePipeline.mtlPipelineStates :
+                                                  m_mtlRenderPipeline.mtlPipelineStates;
+                        for(auto& [shaderDesc, pipelineState] : pipelineStates){
+                            auto& slot = mtlPipelineStates[shaderDesc];
+                            if(slot){
+                                [(id)slot release];
+                            }
+                            slot = pipelineState;
+                        }
+                        if(!isCompute){
+                            return;
+                        }
+                        // kept for the specialised variants of the functions
+                        for(auto& [shaderDesc, functionName] : computeFunctions){
+                            auto& slot = m_computeShaderLibraries[shaderDesc];
+                            if(slot.first){
+                                [(id<MTLLibrary>)slot.first release];
+                            }
+                            slot = {(void*)[library retain], functionName};
+                        }
+                    }, options);
+                    if(published.valid()){
+                        published.wait();
+                    }else{
+                        for(auto& pipelineState : pipelineStates){
+                            [(id)pipelineState.second release];
+                        }
+                    }
+                });
+            }
+        });
+        if(build.valid()){
+            m_shaderBuilds.push_back(std::move(build));
         }
     }
-    m_mtlComputePipeline.mtlCommandBuffer =
-            (void*)
-                    [commandQueue commandBuffer];
-    m_mtlComputePipeline.mtlComputeCommandEncoder =
-            (void*)
-                    [TO_MTL_COMMAND_BUFFER(m_mtlComputePipeline.mtlCommandBuffer) computeCommandEncoder];
 }
 
-void MetalPipeline::prepBlitPipeline(PipelineConfiguration& pipelineInitConfiguration) {
-    auto mtlDeviceOC = TO_MTL_DEVICE(pipelineInitConfiguration.graphicsDevice);
-    m_blitPipeline.mtlDeviceRef = (void*)mtlDeviceOC;
-    auto commandQueue = [mtlDeviceOC newCommandQueue];
-    // qquick got its own render command queue and buffer, we should get from it:
-    m_blitPipeline.mtlCommandQueue = (void*)commandQueue;
-    m_blitPipeline.mtlCommandBuffer = (void*)[commandQueue commandBuffer];
-    m_blitPipeline.mtlBlitCommandEncoder = (void*)[TO_MTL_COMMAND_BUFFER(m_blitPipeline.mtlCommandBuffer) blitCommandEncoder];
+void MetalPipeline::waitForShaderBuilds() {
+    for(auto& build : m_shaderBuilds){
+        if(build.valid()){
+            build.wait();
+        }
+    }
 }
 
 void MetalPipeline::executeAllRenderTasksInPlace() {
@@ -187,7 +411,9 @@ MtlRenderPipeline &MetalPipeline::getRenderPipeline() {
 }
 
 
-void* MetalPipeline::throughRenderingPipelineState(std::string pipelineDesc, std::vector<void*>& inputTextures, std::string triggerRendererName) {
+void* MetalPipeline::throughRenderingPipelineState(std::string pipelineDesc, std::vector<void*>& inputTextures, std::string triggerRendererName,
+                                                   const std::vector<void*>& fragmentBuffers) {
+    TRACE_SCOPE("throughRenderingPipelineState");
     auto findPipelineState = m_mtlRenderPipeline.mtlPipelineStates.find(pipelineDesc);
     if(findPipelineState == m_mtlRenderPipeline.mtlPipelineStates.end()){
         return {};
@@ -205,14 +431,12 @@ void* MetalPipeline::throughRenderingPipelineState(std::string pipelineDesc, std
     auto encoder = [commandBuffer
                     renderCommandEncoderWithDescriptor: (MTLRenderPassDescriptor*)renderPassDesc];
 
-    Message msg;
-    NotificationCenter::getInstance().getPersistentMessage(MessageType::Render, msg);
-    auto windowInfo = (WindowSubMsg*)msg.subMsg.get();
+    auto windowInfo = NotificationCenter::getInstance().renderState().load();
     MTLViewport vp;
     vp.originX = 0;
     vp.originY = 0;
-    vp.width = windowInfo->width * windowInfo->scalingFactor;
-    vp.height = windowInfo->height  * windowInfo->scalingFactor;
+    vp.width = windowInfo.width * windowInfo.scalingFactor;
+    vp.height = windowInfo.height  * windowInfo.scalingFactor;
     vp.znear = 0;
     vp.zfar = 1;
 
@@ -222,6 +446,9 @@ void* MetalPipeline::throughRenderingPipelineState(std::string pipelineDesc, std
     for(auto i = 0; i < inputTextures.size(); i++){
         [encoder setFragmentTexture:(id<MTLTexture>)inputTextures[i] atIndex: i];
     }
+    for(auto i = 0; i < fragmentBuffers.size(); i++){
+        [encoder setFragmentBuffer:(id<MTLBuffer>)fragmentBuffers[i] offset:0 atIndex:i];
+    }
     [encoder setRenderPipelineState:pipelineState];
     [encoder drawPrimitives: MTLPrimitiveTypeTriangleStrip vertexStart: 0 vertexCount: 4];
 
@@ -237,9 +464,17 @@ void* MetalPipeline::throughRenderingPipelineState(std::string pipelineDesc, std
     return (void*)renderPassDesc.colorAttachments[0].texture;
 }
 
-void MetalPipeline::throughComputePipelineState(std::string pipelineDesc, std::vector<void*>& inputTextures, void* resultTexture) {
-    auto pipelineState = (id<MTLComputePipelineState>) m_mtlComputePipeline.mtlPipelineStates[pipelineDesc];
-    auto encoder = (id<MTLComputeCommandEncoder>)m_mtlComputePipeline.mtlCommandBuffer;
+bool MetalPipeline::throughComputePipelineState(std::string pipelineDesc, std::vector<void*>& inputTextures, void* resultTexture,
+                                                const std::vector<void*>& inputBuffers) {
+    TRACE_SCOPE("throughComputePipelineState");
+    auto findPipelineState = m_mtlComputePipeline.mtlPipelineStates.find(pipelineDesc);
+    if(findPipelineState == m_mtlComputePipeline.mtlPipelineStates.end() || !resultTexture){
+        return false;
+    }
+    auto pipelineState = (id<MTLComputePipelineState>)findPipelineState->second;
+    auto commandQueue = (id<MTLCommandQueue>)m_mtlComputePipeline.mtlCommandQueue;
+    auto commandBuffer = [commandQueue commandBuffer];
+    auto encoder = [commandBuffer computeCommandEncoder];
     [encoder setComputePipelineState:pipelineState];
     for(auto i = 0; i< inputTextures.size(); i++){
         [encoder setTexture:(id<MTLTexture>)inputTextures[i] atIndex:i];
@@ -247,29 +482,161 @@ void MetalPipeline::throughComputePipelineState(std::string pipelineDesc, std::v
 
     // Bind the output texture
     [encoder setTexture:(id<MTLTexture>)resultTexture atIndex:(int)inputTextures.size()];
+    for(auto i = 0; i < inputBuffers.size(); i++){
+        [encoder setBuffer:(id<MTLBuffer>)inputBuffers[i] offset:0 atIndex:i];
+    }
 
-    // Configure thread groups and grid size based on the first texture (assuming they are the same size)
-    // The texture size (assuming all input textures are the same size)
     NSUInteger width = ((id<MTLTexture>)resultTexture).width;
     NSUInteger height = ((id<MTLTexture>)resultTexture).height;
 
-    // Get the maximum allowed threads per threadgroup for this compute pipeline
-    NSUInteger maxThreadsPerThreadgroup = pipelineState.maxTotalThreadsPerThreadgroup;
+    // the tiled kernels (highPassHide) size their threadgroup memory for 16x16 groups and need every thread of
+    // a group to reach the barriers, so dispatch whole groups and let the kernel skip the pixels past the edge.
+    MTLSize threadGroupSize = MTLSizeMake(kComputeThreadgroupSize, kComputeThreadgroupSize, 1);
+    MTLSize threadGroupCount = MTLSizeMake((width + kComputeThreadgroupSize - 1) / kComputeThreadgroupSize,
+                                           (height + kComputeThreadgroupSize - 1) / kComputeThreadgroupSize, 1);
+    [encoder dispatchThreadgroups:threadGroupCount threadsPerThreadgroup:threadGroupSize];
 
-    // Get the thread execution width (the number of threads per threadgroup that can execute in parallel)
-    NSUInteger threadExecutionWidth = pipelineState.threadExecutionWidth;
+    [encoder endEncoding];
+    [commandBuffer commit];
+    return true;
+}
 
-    // Calculate an optimal threadgroup size based on the texture size and hardware limits
-    MTLSize threadGroupSize = MTLSizeMake(threadExecutionWidth, maxThreadsPerThreadgroup / threadExecutionWidth, 1);
+bool MetalPipeline::throughComputePipelineStateOnTiles(std::string pipelineDesc, std::vector<void*>& inputTextures, void* resultTexture,
+                                                      const std::vector<uint16_t>& tileCoordinates, int tileSize,
+                                                      const std::vector<void*>& inputBuffers) {
+    TRACE_SCOPE_ARG("throughComputePipelineStateOnTiles", tileCoordinates.size() / 2);
+    auto findPipelineState = m_mtlComputePipeline.mtlPipelineStates.find(pipelineDesc);
+    if(findPipelineState == m_mtlComputePipeline.mtlPipelineStates.end() || !resultTexture ||
+       tileSize % kComputeThreadgroupSize != 0){
+        return false;
+    }
+    if(tileCoordinates.empty()){
+        return true;
+    }
+    auto pipelineState = (id<MTLComputePipelineState>)findPipelineState->second;
+    auto commandQueue = (id<MTLCommandQueue>)m_mtlComputePipeline.mtlCommandQueue;
+    auto commandBuffer = [commandQueue commandBuffer];
+    auto encoder = [commandBuffer computeCommandEncoder];
+    [encoder setComputePipelineState:pipelineState];
+    for(auto i = 0; i< inputTextures.size(); i++){
+        [encoder setTexture:(id<MTLTexture>)inputTextures[i] atIndex:i];
+    }
+    [encoder setTexture:(id<MTLTexture>)resultTexture atIndex:(int)inputTextures.size()];
 
-    // Ensure that the grid size covers the entire texture by calculating the number of threadgroups needed
-    MTLSize gridSize = MTLSizeMake(width,
-                                   height, 1);
+    // setBytes takes up to 4KB, a bigger tile list goes into its own buffer
+    auto tileBytes = tileCoordinates.size() * sizeof(uint16_t);
+    if(tileBytes <= 4096){
+        [encoder setBytes:tileCoordinates.data() length:tileBytes atIndex:0];
+    }else{
+        auto mtlDevice = (id<MTLDevice>)m_mtlComputePipeline.mtlDeviceRef;
+        auto tileBuffer = [mtlDevice newBufferWithBytes:tileCoordinates.data() length:tileBytes
+                                                options:MTLResourceStorageModeShared];
+        [encoder setBuffer:tileBuffer offset:0 atIndex:0];
+        [tileBuffer release];
+    }
+    for(auto i = 0; i < inputBuffers.size(); i++){
+        [encoder setBuffer:(id<MTLBuffer>)inputBuffers[i] offset:0 atIndex:i + 1];
+    }
 
-    // Dispatch the compute shader
-    [encoder dispatchThreads:gridSize threadsPerThreadgroup:threadGroupSize];
+    auto groupsPerTile = (NSUInteger)(tileSize / kComputeThreadgroupSize);
+    MTLSize threadGroupSize = MTLSizeMake(kComputeThreadgroupSize, kComputeThreadgroupSize, 1);
+    MTLSize threadGroupCount = MTLSizeMake(groupsPerTile, groupsPerTile, tileCoordinates.size() / 2);
+    [encoder dispatchThreadgroups:threadGroupCount threadsPerThreadgroup:threadGroupSize];
 
     [encoder endEncoding];
+    [commandBuffer commit];
+    return true;
+}
+
+void* MetalPipeline::getHideEffectBuffer(const HideEffect& hideEffect) {
+    if(m_hideEffectBuffer && m_hideEffectId == hideEffect.getId()){
+        return m_hideEffectBuffer;
+    }
+    // a new buffer instead of rewriting the old one: command buffers still in flight keep theirs alive
+    auto mtlDevice = (id<MTLDevice>)m_mtlComputePipeline.mtlDeviceRef;
+    const auto& colorLut = hideEffect.getColorLut();
+    auto effectBuffer = [mtlDevice newBufferWithLength:sizeof(HideEffectUniforms) + colorLut.byteSize()
+                                               options:MTLResourceStorageModeShared];
+    if(!effectBuffer){
+        NSLog(@"Failed to allocate the hide effect buffer");
+        return m_hideEffectBuffer;
+    }
+    auto contents = (uint8_t*)[effectBuffer contents];
+    memcpy(contents, &hideEffect.getUniforms(), sizeof(HideEffectUniforms));
+    memcpy(contents + sizeof(HideEffectUniforms), colorLut.data(), colorLut.byteSize());
+    if(m_hideEffectBuffer){
+        [(id<MTLBuffer>)m_hideEffectBuffer release];
+    }
+    m_hideEffectBuffer = (void*)effectBuffer;
+    m_hideEffectId = hideEffect.getId();
+    return m_hideEffectBuffer;
+}
+
+// function constant 0 of highPassHideCompute.metal, the rest of the library ignores it
+static id<MTLComputePipelineState> newSpecializedComputePipelineState(id<MTLDevice> mtlDevice, id<MTLLibrary> library,
+                                                                      const std::string& functionName,
+                                                                      const HideEffectSpecialization& specialization) {
+    auto constantValues = [[MTLFunctionConstantValues alloc] init];
+    int highPassRadius = specialization.highPassRadius;
+    [constantValues setConstantValue:&highPassRadius type:MTLDataTypeInt atIndex:0];
+
+    NSError *error = nil;
+    id<MTLFunction> function = [library newFunctionWithName:[NSString stringWithUTF8String:functionName.c_str()]
+                                             constantValues:constantValues error:&error];
+    [constantValues release];
+    if(!function){
+        NSLog(@"Failed to specialize %s: %@", functionName.c_str(), error);
+        return nil;
+    }
+    auto pipelineState = [mtlDevice newComputePipelineStateWithFunction:function error:&error];
+    [function release];
+    if(!pipelineState){
+        NSLog(@"Failed to create specialized compute pipeline state: %@", error);
+    }
+    return pipelineState;
+}
+
+std::string MetalPipeline::requestSpecializedComputePipeline(const std::string& pipelineDesc,
+                                                             const HideEffectSpecialization& specialization) {
+    if(specialization == HideEffectSpecialization{}){
+        return hasComputePipelineState(pipelineDesc) ? pipelineDesc : std::string();
+    }
+    auto specializedDesc = pipelineDesc + "#" + std::to_string(specialization.hash());
+    if(m_mtlComputePipeline.mtlPipelineStates.count(specializedDesc)){
+        return specializedDesc;
+    }
+    auto findLibrary = m_computeShaderLibraries.find(pipelineDesc);
+    if(findLibrary == m_computeShaderLibraries.end() || !m_computePipelineVariants){
+        return {};
+    }
+    auto mtlDevice = (id<MTLDevice>)m_mtlComputePipeline.mtlDeviceRef;
+    auto library = (id<MTLLibrary>)findLibrary->second.first;
+    auto functionName = findLibrary->second.second;
+    auto variantKey = std::hash<std::string>{}(pipelineDesc) * 31 + specialization.hash();
+    auto variant = m_computePipelineVariants->request(variantKey, [=]() -> PipelineVariantCache::Variant {
+        @autoreleasepool {
+            auto pipelineState = newSpecializedComputePipelineState(mtlDevice, library, functionName, specialization);
+            if(!pipelineState){
+                return nullptr;
+            }
+            return PipelineVariantCache::Variant((void*)pipelineState, [](void* state){
+                [(id<MTLComputePipelineState>)state release];
+            });
+        }
+    });
+    if(!variant){
+        return {};
+    }
+    m_specializedPipelineStates[specializedDesc] = variant;
+    m_mtlComputePipeline.mtlPipelineStates[specializedDesc] = variant.get();
+    return specializedDesc;
+}
+
+void MetalPipeline::triggerRenderUpdate(const std::string& triggerRendererName) {
+    TRACE_INSTANT("triggerRenderUpdate");
+    if(m_triggerRenderUpdateFuncSet[triggerRendererName]){
+        m_triggerRenderUpdateFuncSet[triggerRendererName]();
+    }
 }
 
 void MetalPipeline::throughBlitPipelineState(void *inputTexture, void *outputTexture) {
@@ -308,7 +675,24 @@ void MetalPipeline::registerInitDoneHandler(std::function<void()> initDoneFunc)
 }
 
 void MetalPipeline::cleanUp() {
+    // the builders hand their states to the render queue, they go first
+    m_shaderBuildTasks.reset();
+    m_shaderBuilds.clear();
     m_renderingPipelineTasks.reset();
     m_computePipelineTasks.reset();
     m_blitPipelineTasks.reset();
+    if(m_hideEffectBuffer){
+        [(id<MTLBuffer>)m_hideEffectBuffer release];
+        m_hideEffectBuffer = nullptr;
+    }
+    // joins the builder before the libraries it compiles from go away
+    m_computePipelineVariants.reset();
+    for(auto& specializedState : m_specializedPipelineStates){
+        m_mtlComputePipeline.mtlPipelineStates.erase(specializedState.first);
+    }
+    m_specializedPipelineStates.clear();
+    for(auto& library : m_computeShaderLibraries){
+        [(id<MTLLibrary>)library.second.first release];
+    }
+    m_computeShaderLibraries.clear();
 }
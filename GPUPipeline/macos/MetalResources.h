@@ -10,6 +10,8 @@
 #include <mutex>
 #include <string>
 #include <queue>
+#include "../TexturePool.h"
+#include "../../utils/FrameLease.h"
 
 #define TO_MTL_DEVICE(DEVICE_OPAQUE) (id<MTLDevice>)DEVICE_OPAQUE
 #define TO_MTL_COMMAND_QUEUE(QUEUE_OPAQUE) (id<MTLCommandQueue>)QUEUE_OPAQUE
@@ -47,50 +49,35 @@ struct MtlBlitPipeline{
     void* mtlBlitCommandEncoder;
 };
 
-struct TextureResource{
-    void* texturePtr = nullptr;
+// device textures for the texture pool, storage as before so the debug readbacks keep working
+class MtlTextureAllocator : public TexturePoolAllocator {
+public:
+    void setDevice(void* mtlDevice){
+        m_mtlDevice = mtlDevice;
+    }
+    void* createTexture(int width, int height, int format) override;
+    void destroyTexture(void* texture) override;
+
+private:
+    void* m_mtlDevice = nullptr;
 };
 
-// texture request helper, it will create a 'retTexture' in place.
+// texture request helper, it will create a 'retTexture' in place. the texture belongs to the current frame and
+// goes back to the pool at MtlTextureManager::endFrame().
 #define REQUEST_TEXTURE(width, height, format, mtlDevice) \
-    void* retTexture = nullptr;                                       \
-    do {                                                   \
-        std::string fileName = __FILE__;                   \
-        std::string funName = __func__;                    \
-        std::string lineName = std::to_string(__LINE__);        \
-        auto finalFindId = fileName + "-" + funName + "-" + lineName; \
-        retTexture = MtlTextureManager::getGlobalInstance()           \
-        .requestTexture(finalFindId, width, height, format, mtlDevice).texturePtr; \
-    } while (0)
+    void* retTexture = MtlTextureManager::getGlobalInstance().requestFrameTexture(width, height, format, mtlDevice)
 
 // texture request helper, it will create a 'retTextureAnother' in place.
 #define REQUEST_TEXTURE_ANOTHER(width, height, format, mtlDevice) \
-    void* retTextureAnother = nullptr;                                       \
-    do {                                                   \
-        std::string fileName = __FILE__;                   \
-        std::string funName = __func__;                    \
-        std::string lineName = std::to_string(__LINE__);        \
-        auto finalFindId = fileName + "-" + funName + "-" + lineName; \
-        retTextureAnother = MtlTextureManager::getGlobalInstance()           \
-        .requestTexture(finalFindId, width, height, format, mtlDevice).texturePtr; \
-    } while (0)
-
-// texture request helper, it will create a 'retTextureQueue' in place.
-#define REQUEST_TEXTURE_QUEUE(width, height, format, mtlDevice) \
-    void* retTextureQueue = nullptr;                                       \
-    do {                                                   \
-        std::string fileName = __FILE__;                   \
-        std::string funName = __func__;                    \
-        std::string lineName = std::to_string(__LINE__);        \
-        auto finalFindId = fileName + "-" + funName + "-" + lineName; \
-        retTexture = MtlTextureManager::getGlobalInstance()           \
-        .requestTextureQueue(finalFindId, width, height, format, mtlDevice, 15); \
-    } while (0)
+    void* retTextureAnother = MtlTextureManager::getGlobalInstance().requestFrameTexture(width, height, format, mtlDevice)
 
+// metal side of the TexturePool: textures are pooled by size class instead of by call site, and whatever is
+// released during a frame only becomes reusable once the gpu finished that frame.
 class MtlTextureManager{
 private:
-    std::unordered_map<std::string, TextureResource> m_textureMaps;
-    std::unordered_map<std::string, std::queue<TextureResource>> m_textureQueueMaps;
+    MtlTextureAllocator m_allocator;
+    TexturePool m_texturePool{m_allocator};
+    std::vector<TexturePoolHandle> m_frameTextures;
     std::mutex m_textureOpMutex;
 
 public:
@@ -99,8 +86,21 @@ public:
         return textureManager;
     }
 
-    TextureResource& requestTexture(std::string findId, int width, int height, int format, void* mtlDevice);
-    std::queue<TextureResource> requestTextureQueue(std::string findId, int width, int height, int format, void* mtlDevice, int initialSize);
+    TexturePoolHandle acquireTexture(int width, int height, int format, void* mtlDevice);
+    void* getTexture(TexturePoolHandle handle);
+    void releaseTexture(TexturePoolHandle handle);
+
+    // a texture that lives until endFrame()
+    void* requestFrameTexture(int width, int height, int format, void* mtlDevice);
+
+    // bracket the gpu work of one frame, endFrame() fences the frame behind what is queued on commandQueue.
+    // frameLeases (the captured frames the gpu reads) are let go once the gpu is done with the frame.
+    void beginFrame();
+    void endFrame(void* commandQueue, std::vector<FrameLease> frameLeases = {});
+
+    TexturePool& getTexturePool(){
+        return m_texturePool;
+    }
 private:
     MtlTextureManager() = default;
 
@@ -117,11 +117,15 @@ public:
         static MtlProcessMisc processMisc;
         return processMisc;
     }
+    // only remembers the device, each kernel is made by the first encode that needs it
     void initAllProcessors(void* mtlDevice);
     void encodeCropProcessIntoPipeline(std::tuple<int, int, int, int> cropROI, std::tuple<int, int>writeStart, void* input,
                                        void* output, void* commandBuffer);
     void encodeScaleProcessIntoPipeline(void* input, void* output, void* commandBuffer);
-    void encodeGaussianProcessIntoPipeline(void* input, void* output, void* commandBuffer);
+    // only writes the destination pixels inside clipRect (x, y, width, height)
+    void encodeScaleProcessIntoPipeline(void* input, void* output, void* commandBuffer, std::tuple<int, int, int, int> clipRect);
+    // the filter is made again when sigma changes, an MPS kernel is cheap to make and needs no compile
+    void encodeGaussianProcessIntoPipeline(void* input, void* output, void* commandBuffer, float sigma = 0.5f);
     void encodeBlurProcessIntoPipeline(void* input, void* output, void* commandBuffer);
     void encodeSubtractProcessIntoPipeline(void* input1, void* input2, void* output, void* commandBuffer);
 
@@ -140,6 +144,7 @@ private:
     void* m_imageCropFilter = nullptr;
     void* m_imageScaleFilter = nullptr;
     void* m_imageGaussianFilter = nullptr;
+    float m_gaussianSigma = 0.5f;
     void* m_imageBlurFilter = nullptr;
     void* m_imageSubtractFilter = nullptr;
 
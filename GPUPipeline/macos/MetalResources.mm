@@ -9,22 +9,17 @@
 #include <unordered_map>
 
 void MtlProcessMisc::initAllProcessors(void* mtlDevice) {
-    bool isInit = m_mtlDevice != nullptr;
+    // the kernels are made on first use, under the lock of their encode call: the fused path never needs most of them
     m_mtlDevice = mtlDevice;
-    if(!isInit){
-        auto convertMtlDevice = TO_MTL_DEVICE(mtlDevice);
-        m_imageCropFilter = (void*)[[MPSImageLanczosScale alloc]initWithDevice:convertMtlDevice];
-        m_imageGaussianFilter = (void*)[[MPSImageGaussianBlur alloc] initWithDevice:convertMtlDevice sigma: 0.5f];
-        m_imageBlurFilter = (void*)[[MPSImageGaussianBlur alloc] initWithDevice:convertMtlDevice sigma: 15.5f];
-        m_imageScaleFilter = (void*)[[MPSImageBilinearScale alloc] initWithDevice: convertMtlDevice];
-        m_imageSubtractFilter = (void*)[[MPSImageSubtract alloc] initWithDevice: convertMtlDevice];
-    }
 }
 
 // Encode Crop Process
 void MtlProcessMisc::encodeCropProcessIntoPipeline(std::tuple<int, int, int, int> cropROI, std::tuple<int, int>writeStart, void* input,
                                                    void* output, void* commandQueue) {
     std::lock_guard<std::mutex> cropLock(m_cropMutex);
+    if(!m_imageCropFilter){
+        m_imageCropFilter = (void*)[[MPSImageLanczosScale alloc] initWithDevice:TO_MTL_DEVICE(m_mtlDevice)];
+    }
     auto convertInput = (id<MTLTexture>)input;
     auto convertOutput = (id<MTLTexture>)output;
     auto convertCommandQueue = (id<MTLCommandQueue>)commandQueue;
@@ -54,7 +49,17 @@ void MtlProcessMisc::encodeCropProcessIntoPipeline(std::tuple<int, int, int, int
 // Encode Scale Process
 void MtlProcessMisc::encodeScaleProcessIntoPipeline(void* input, void* output,
                                                     void* commandQueue) {
+    auto convertOutput = (id<MTLTexture>)output;
+    encodeScaleProcessIntoPipeline(input, output, commandQueue,
+                                   std::make_tuple(0, 0, (int)convertOutput.width, (int)convertOutput.height));
+}
+
+void MtlProcessMisc::encodeScaleProcessIntoPipeline(void* input, void* output, void* commandQueue,
+                                                    std::tuple<int, int, int, int> clipRect) {
     std::lock_guard<std::mutex> scaleLock(m_scaleMutex);
+    if(!m_imageScaleFilter){
+        m_imageScaleFilter = (void*)[[MPSImageBilinearScale alloc] initWithDevice:TO_MTL_DEVICE(m_mtlDevice)];
+    }
     auto convertInput = (id<MTLTexture>)input;
     auto convertOutput = (id<MTLTexture>)output;
     auto convertCommandQueue = (id<MTLCommandQueue>)commandQueue;
@@ -67,8 +72,15 @@ void MtlProcessMisc::encodeScaleProcessIntoPipeline(void* input, void* output,
     scaleTransform.translateX = 0.0; // No horizontal translation
     scaleTransform.translateY = 0.0; // No vertical translation
     [imageScale setScaleTransform:&scaleTransform];
-    
-    
+
+    // the clip rect only limits the pixels written, the transform still maps the whole textures
+    int x, y, width, height;
+    std::tie(x, y, width, height) = clipRect;
+    MTLRegion clipRegion;
+    clipRegion.origin = MTLOriginMake(x, y, 0);
+    clipRegion.size = MTLSizeMake(width, height, 1);
+    [imageScale setClipRect:clipRegion];
+
     // Encode the scale process
     [imageScale encodeToCommandBuffer:commandBuffer
                         sourceTexture:convertInput
@@ -77,8 +89,14 @@ void MtlProcessMisc::encodeScaleProcessIntoPipeline(void* input, void* output,
 }
 
 // Encode Gaussian Blur Process
-void MtlProcessMisc::encodeGaussianProcessIntoPipeline(void* input, void* output, void* commandQueue) {
+void MtlProcessMisc::encodeGaussianProcessIntoPipeline(void* input, void* output, void* commandQueue, float sigma) {
     std::lock_guard<std::mutex> gaussianLock(m_GaussianMutex);
+    if(!m_imageGaussianFilter || sigma != m_gaussianSigma){
+        // encoding does not need the kernel afterwards, the old one can go right away
+        [TO_MPS_IMAGE_GAUSSIAN(m_imageGaussianFilter) release];
+        m_imageGaussianFilter = (void*)[[MPSImageGaussianBlur alloc] initWithDevice:TO_MTL_DEVICE(m_mtlDevice) sigma: sigma];
+        m_gaussianSigma = sigma;
+    }
 
     auto convertInput = (id<MTLTexture>)input;
     auto convertOutput = (id<MTLTexture>)output;
@@ -94,6 +112,9 @@ void MtlProcessMisc::encodeGaussianProcessIntoPipeline(void* input, void* output
 
 void MtlProcessMisc::encodeBlurProcessIntoPipeline(void *input, void *output, void *commandQueue) {
     std::lock_guard<std::mutex> gaussianLock(m_GaussianMutex);
+    if(!m_imageBlurFilter){
+        m_imageBlurFilter = (void*)[[MPSImageGaussianBlur alloc] initWithDevice:TO_MTL_DEVICE(m_mtlDevice) sigma: 15.5f];
+    }
 
     auto convertInput = (id<MTLTexture>)input;
     auto convertOutput = (id<MTLTexture>)output;
@@ -110,6 +131,9 @@ void MtlProcessMisc::encodeBlurProcessIntoPipeline(void *input, void *output, vo
 // Encode Subtract Process
 void MtlProcessMisc::encodeSubtractProcessIntoPipeline(void* input1, void* input2, void* output, void* commandQueue) {
     std::lock_guard<std::mutex> subtractLock(m_SubtractMutex);
+    if(!m_imageSubtractFilter){
+        m_imageSubtractFilter = (void*)[[MPSImageSubtract alloc] initWithDevice:TO_MTL_DEVICE(m_mtlDevice)];
+    }
 
     auto convertInput1 = (id<MTLTexture>)input1;
     auto convertInput2 = (id<MTLTexture>)input2;
@@ -125,75 +149,77 @@ void MtlProcessMisc::encodeSubtractProcessIntoPipeline(void* input1, void* input
     [commandBuffer commit];
 }
 
-TextureResource &MtlTextureManager::requestTexture(std::string findId, int width, int height, int format, void* mtlDevice) {
-    auto mtlDeviceOC = TO_MTL_DEVICE(mtlDevice);
-    std::lock_guard<std::mutex> textureOpLock(m_textureOpMutex);
+void* MtlTextureAllocator::createTexture(int width, int height, int format) {
+    auto mtlDeviceOC = TO_MTL_DEVICE(m_mtlDevice);
+    if(!mtlDeviceOC){
+        return nullptr;
+    }
+    MTLTextureDescriptor *textureDescriptor = [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:(MTLPixelFormat)format
+                                                                                                 width:width
+                                                                                                height:height
+                                                                                             mipmapped:NO];
+    textureDescriptor.usage = MTLTextureUsageShaderWrite | MTLTextureUsageShaderRead;
+    return (void*)[mtlDeviceOC newTextureWithDescriptor:textureDescriptor];
+}
 
-    auto createOneFunc = [=](){
-        MTLTextureDescriptor *textureDescriptor = [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:(MTLPixelFormat)format
-                                                                                                     width:width
-                                                                                                    height:height
-                                                                                                 mipmapped:NO];
-        textureDescriptor.usage = MTLTextureUsageShaderWrite | MTLTextureUsageShaderRead;
-        return [mtlDeviceOC newTextureWithDescriptor:textureDescriptor];
-    };
-
-    auto findResult = m_textureMaps.find(findId);
-    if(findResult != m_textureMaps.end()){
-        auto mtlTex = (id<MTLTexture>)findResult->second.texturePtr;
-        if(mtlTex.width != width || mtlTex.height != height || mtlTex.pixelFormat != format){
-            // recreate one:
-            [mtlTex release];
-            findResult->second.texturePtr = createOneFunc();
-        }
-        return findResult->second;
+void MtlTextureAllocator::destroyTexture(void* texture) {
+    [(id<MTLTexture>)texture release];
+}
+
+TexturePoolHandle MtlTextureManager::acquireTexture(int width, int height, int format, void* mtlDevice) {
+    {
+        std::lock_guard<std::mutex> textureOpLock(m_textureOpMutex);
+        m_allocator.setDevice(mtlDevice);
     }
+    return m_texturePool.acquire(width, height, format);
+}
+
+void* MtlTextureManager::getTexture(TexturePoolHandle handle) {
+    return m_texturePool.resolve(handle);
+}
+
+void MtlTextureManager::releaseTexture(TexturePoolHandle handle) {
+    m_texturePool.release(handle);
+}
 
-    // not found suitable, create one:
-    TextureResource res;
-    res.texturePtr = (void*)createOneFunc();
-    auto insertItem = m_textureMaps.insert({findId, res});
+void* MtlTextureManager::requestFrameTexture(int width, int height, int format, void* mtlDevice) {
+    auto handle = acquireTexture(width, height, format, mtlDevice);
+    if(!handle.valid()){
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> textureOpLock(m_textureOpMutex);
+    m_frameTextures.push_back(handle);
+    return m_texturePool.resolve(handle);
+}
 
-    return insertItem.first->second;
+void MtlTextureManager::beginFrame() {
+    m_texturePool.beginFrame();
 }
 
-std::queue<TextureResource>
-MtlTextureManager::requestTextureQueue(std::string findId, int width, int height, int format, void *mtlDevice,
-                                       int initialSize) {
-    auto mtlDeviceOC = TO_MTL_DEVICE(mtlDevice);
-    std::lock_guard<std::mutex> textureOpLock(m_textureOpMutex); // Lock for thread safety
-
-    // Lambda function to create a single texture
-    auto createOneFunc = [=]() {
-        MTLTextureDescriptor *textureDescriptor = [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:(MTLPixelFormat)format
-                                                                                                     width:width
-                                                                                                    height:height
-                                                                                                 mipmapped:NO];
-        textureDescriptor.usage = MTLTextureUsageShaderWrite | MTLTextureUsageShaderRead;
-        return [mtlDeviceOC newTextureWithDescriptor:textureDescriptor];
-    };
-
-    // Check if there is already a texture queue with the given ID in the map
-    auto findResult = m_textureQueueMaps.find(findId);
-    if (findResult != m_textureQueueMaps.end()) {
-        // take one on the front, and check its props:
-        auto mtlTex = (id<MTLTexture>)findResult->second.front().texturePtr;
-        if (mtlTex.width != width || mtlTex.height != height || mtlTex.pixelFormat != format) {
-            // clear previous if not match. clear previous:
-            std::queue<TextureResource> empty;
-            std::swap(findResult->second, empty);
-        }
-        return findResult->second;
-    } else {
-        std::queue<TextureResource> textureQueue;
-        // Fill the queue with additional textures up to the specified initial size
-        while (textureQueue.size() < initialSize) {
-            TextureResource res;
-            res.texturePtr = (void*)createOneFunc();
-            textureQueue.push(res);
-        }
-        auto insertItem = m_textureQueueMaps.insert({findId, textureQueue});
-
-        return insertItem.first->second;
+void MtlTextureManager::endFrame(void* commandQueue, std::vector<FrameLease> frameLeases) {
+    std::vector<TexturePoolHandle> frameTextures;
+    {
+        std::lock_guard<std::mutex> textureOpLock(m_textureOpMutex);
+        frameTextures.swap(m_frameTextures);
+    }
+    for(auto handle : frameTextures){
+        m_texturePool.release(handle);
     }
+
+    // the queue runs command buffers in order, so when this empty one completes the whole frame is done
+    auto frame = m_texturePool.currentFrame();
+    auto texturePool = &m_texturePool;
+    auto commandBuffer = [(id<MTLCommandQueue>)commandQueue commandBuffer];
+    if(!commandBuffer){
+        texturePool->signalFrameCompleted(frame);
+        return;
+    }
+    // the block keeps its own copy of the leases until it ran, a heap vector so it is one move in and no copy
+    // of each lease
+    auto heldLeases = new std::vector<FrameLease>(std::move(frameLeases));
+    [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> completedBuffer) {
+        texturePool->signalFrameCompleted(frame);
+        delete heldLeases;
+    }];
+    [commandBuffer commit];
 }
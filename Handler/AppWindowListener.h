@@ -21,7 +21,8 @@ public:
     // Start listening for window position and size changes via AX API
     void startAXMonitoring();
 
-    // Start polling window position and size changes via CGWindow API
+    // Start following window position and size changes via the shared window list (WindowRegistry), polled at
+    // pollIntervalSeconds or faster. the callbacks only run when the window moved or resized.
     void startCGWindowMonitoring(double pollIntervalSeconds = 1.0);
 
     // Stop monitoring (for both AX and CGWindow monitoring)
@@ -55,7 +56,7 @@ private:
     /*AXUIElementRef*/void* axAppElement_;
     /*AXUIElementRef*/void* axWindowElement_;
 
-    dispatch_source_t pollingTimer_;
+    int registrySubscription_ = 0;
 
     // Polling control
     bool pollingActive_;
@@ -1,6 +1,8 @@
 #import "AppWindowListener.h"
 #import <Cocoa/Cocoa.h>
 #import <ApplicationServices/ApplicationServices.h>
+#include "platform/macos/MacUtils.h"
+#include "utils/WindowRegistry.h"
 
 // Helper function to convert AXValueRef to CGPoint
 static CGPoint getAXPosition(AXUIElementRef element) {
@@ -99,52 +101,37 @@ void AppWindowListener::startAXMonitoring() {
 #pragma mark - CGWindow API Monitoring
 
 void AppWindowListener::startPolling(double interval) {
+    if (pollingActive_) {
+        return;
+    }
     pollingActive_ = true;
 
-    // Create a global queue for the polling timer
-    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
-
-    // Create the timer source
-    pollingTimer_ = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
-
-    // Set the timer to fire at the specified interval (in seconds)
-    uint64_t intervalInNanoseconds = (uint64_t)(interval * NSEC_PER_SEC);
-
-    // Configure the timer to start immediately and repeat at the interval
-    dispatch_source_set_timer(pollingTimer_, dispatch_time(DISPATCH_TIME_NOW, 0), intervalInNanoseconds, 0);
-
-    // Set the event handler for the timer (this gets called every time the timer fires)
-    dispatch_source_set_event_handler(pollingTimer_, ^{
-        // Get window information
-        CFArrayRef windowList = CGWindowListCopyWindowInfo(kCGWindowListOptionOnScreenOnly, kCGNullWindowID);
-        for (NSDictionary *windowInfo in (__bridge NSArray *)windowList) {
-            pid_t windowPID = [windowInfo[(id)kCGWindowOwnerPID] intValue];
-            CGWindowID windowID = [windowInfo[(id)kCGWindowNumber] unsignedIntValue];
-
-            if (windowPID == appPID_ && windowID == windowID_) {
-                CGRect windowBounds;
-                CGRectMakeWithDictionaryRepresentation((CFDictionaryRef)windowInfo[(id)kCGWindowBounds], &windowBounds);
-
-                // Trigger the callbacks if they are set
-                if (onWindowMovedCallback_) {
-                    onWindowMovedCallback_(windowBounds.origin.x, windowBounds.origin.y);
-                }
-                if (onWindowResizedCallback_) {
-                    onWindowResizedCallback_(windowBounds.size.width, windowBounds.size.height);
-                }
-            }
+    // the registry's poller enumerates the windows once per tick for everyone, this only hears about ticks that
+    // moved or resized our window (on the poller's queue)
+    registrySubscription_ = WindowRegistry::getInstance().subscribe([this](const WindowListDiff& diff) {
+        if (!diff.touches((int)windowID_)) {
+            return;
+        }
+        auto window = WindowRegistry::getInstance().findWindow((int)windowID_);
+        if (!window || window->ownerPid != appPID_) {
+            return;
         }
-        CFRelease(windowList);
-    });
 
-    // Start the timer
-    dispatch_resume(pollingTimer_);
+        // Trigger the callbacks if they are set
+        if (onWindowMovedCallback_) {
+            onWindowMovedCallback_(window->x, window->y);
+        }
+        if (onWindowResizedCallback_) {
+            onWindowResizedCallback_(window->width, window->height);
+        }
+    });
+    startWindowRegistryPolling(interval);
 }
 
 void AppWindowListener::stopPolling() {
-    if (pollingActive_ && pollingTimer_) {
-        dispatch_source_cancel(pollingTimer_);
-        pollingTimer_ = nullptr;
+    if (pollingActive_) {
+        WindowRegistry::getInstance().unsubscribe(registrySubscription_);
+        registrySubscription_ = 0;
         pollingActive_ = false;
     }
 }
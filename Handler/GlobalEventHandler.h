@@ -30,6 +30,11 @@ public:
         ctrlDoubleQuotePressedCB = std::move(cb);
     }
 
+    // cmd + backslash, dumps the frame trace
+    void setCtrlBackslashPressedCB(KeysPressedCB cb){
+        ctrlBackslashPressedCB = std::move(cb);
+    }
+
 private:
 
     // macOS-specific implementation
@@ -37,6 +42,7 @@ private:
     void* runLoopSource;  // Placeholder for run loop source
     KeysPressedCB ctrlColonPressedCB;
     KeysPressedCB ctrlDoubleQuotePressedCB;
+    KeysPressedCB ctrlBackslashPressedCB;
 };
 
 #endif // GLOBALEVENTHANDLER_H
\ No newline at end of file
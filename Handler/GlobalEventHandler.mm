@@ -73,6 +73,11 @@ bool GlobalEventHandler::handleKeyPress(int keycode, bool isCommandPressed) {
             ctrlDoubleQuotePressedCB(keycode);
         }
         return true; // for ctrl+h, the current focused app will respond and hide itself, need to forbid that.
+    }else if(isCommandPressed && keycode == 42){
+        if(ctrlBackslashPressedCB){
+            ctrlBackslashPressedCB(keycode);
+        }
+        return true;
     }
 
     return false;
@@ -4,10 +4,13 @@
 #import <MetalKit/MetalKit.h>
 #import <Metal/Metal.h>
 #import <QFile>
+#include <QStandardPaths>
 #include <iostream>
 #include <chrono>
 #include <rhi/qrhi.h>
 #include "../com/NotificationCenter.h"
+#include "../DesktopCapture/common/CaptureState.h"
+#include "../utils/Tracer.h"
 
 // Constructor
 QMetalGraphicsItem::QMetalGraphicsItem() {
@@ -28,8 +31,10 @@ void QMetalGraphicsItem::onBeforeRendering() {
     // We are not prepared for anything other than running with the RHI and its Metal backend.
     Q_ASSERT(rif->graphicsApi() == QSGRendererInterface::Metal);
     auto& mtlPipeline = MetalPipeline::getGlobalInstance();
+    TRACE_SCOPE("qtBeforeRendering");
     if(!isInit){
         isInit = true;
+        Tracer::getInstance().setCurrentThreadName("qtRenderThread");
         // Read the shader from the Qt resource file
         std::vector<ShaderDesc> renderShaders;
         ShaderDesc shaderDesc;
@@ -59,6 +64,24 @@ void QMetalGraphicsItem::onBeforeRendering() {
         renderShaders.push_back(shaderDesc);
         blendHideRenderShaderFile.close();
 
+        // fused high pass + hide, writes straight into the render target
+        std::vector<ShaderDesc> computeShaders;
+        QFile highPassHideShaderFile(":/shader/highPassHideCompute.metal");
+        if (!highPassHideShaderFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            NSLog(@"Failed to open shader file at path: qrc:/shader/highPassHideCompute.metal");
+            return;
+        }
+        ShaderDesc computeShaderDesc;
+        computeShaderDesc.shaderContent = highPassHideShaderFile.readAll().toStdString();
+        computeShaderDesc.shaderDesc = "highPassHide";
+        computeShaderDesc.functionToGoCompute = "highPassHide";
+        computeShaders.push_back(computeShaderDesc);
+        // same file, the incremental composite only dispatches the dirty tiles
+        computeShaderDesc.shaderDesc = "highPassHideTiles";
+        computeShaderDesc.functionToGoCompute = "highPassHideTiles";
+        computeShaders.push_back(computeShaderDesc);
+        highPassHideShaderFile.close();
+
         PipelineConfiguration pipelineConfiguration;
         pipelineConfiguration.graphicsDevice = rif->getResource(window(), QSGRendererInterface::DeviceResource);
         pipelineConfiguration.mtlRenderCommandQueue = rif->getResource(window(), QSGRendererInterface::CommandQueueResource);
@@ -66,6 +89,10 @@ void QMetalGraphicsItem::onBeforeRendering() {
         pipelineConfiguration.mtlRenderPassDesc = rif->getResource(window(), QSGRendererInterface::RenderPassResource);
         pipelineConfiguration.mtlRenderCommandBuffer = rif->getResource(window(), QSGRendererInterface::CommandListResource);
         pipelineConfiguration.renderShaders = renderShaders;
+        pipelineConfiguration.computeShaders = computeShaders;
+        // compiled pipelines of the last launch, so a relaunch does not compile again
+        pipelineConfiguration.shaderCacheDirectory =
+                (QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/shaderCache").toStdString();
 
         initMetalRenderingPipeline(pipelineConfiguration);
     }else{
@@ -106,6 +133,7 @@ void QMetalGraphicsItem::initMetalRenderingPipeline(PipelineConfiguration &pipel
 }
 
 void QMetalGraphicsItem::afterRenderingDone() {
+    TRACE_INSTANT("qtFrameRendered");
     if(!MetalPipeline::getGlobalInstance().isRenderingInitDoneBefore()){
         MetalPipeline::getGlobalInstance().setRenderingInitDone();
         EventManager::getInstance()->triggerEvent("gpuRenderPipelineInit", EventParam());
@@ -113,6 +141,7 @@ void QMetalGraphicsItem::afterRenderingDone() {
 }
 
 QSGNode *QMetalGraphicsItem::updatePaintNode(QSGNode *oldNode, QQuickItem::UpdatePaintNodeData *) {
+    TRACE_SCOPE("qtUpdatePaintNode");
     // Create a new node if necessary
     QCustomRenderNode* node = static_cast<QCustomRenderNode*>(oldNode);
     if (!node) {
@@ -128,18 +157,17 @@ QSGNode *QMetalGraphicsItem::updatePaintNode(QSGNode *oldNode, QQuickItem::Updat
     if(!metalPipeline.renderTarget || MetalPipeline::getGlobalInstance().isRenderTargetDirty()){
         QSGRendererInterface *rif = window()->rendererInterface();
         auto device = (id<MTLDevice>) rif->getResource(window(), QSGRendererInterface::DeviceResource);
-        Message msg;
-        NotificationCenter::getInstance().getPersistentMessage(MessageType::Render, msg);
-        auto windowInfo = (WindowSubMsg*)msg.subMsg.get();
+        auto windowInfo = NotificationCenter::getInstance().renderState().load();
         MTLTextureDescriptor *desc = [[MTLTextureDescriptor alloc] init];
         desc.textureType = MTLTextureType2D;
         desc.pixelFormat = MTLPixelFormatBGRA8Unorm;
-        desc.width = windowInfo->width * windowInfo->scalingFactor;
-        desc.height = windowInfo->height  * windowInfo->scalingFactor;
+        desc.width = windowInfo.width * windowInfo.scalingFactor;
+        desc.height = windowInfo.height  * windowInfo.scalingFactor;
         desc.mipmapLevelCount = 1;
         desc.resourceOptions = MTLResourceStorageModePrivate;
         desc.storageMode = MTLStorageModePrivate;
-        desc.usage = MTLTextureUsageShaderRead | MTLTextureUsageRenderTarget;
+        // shader write: the highPassHide compute kernel outputs directly into it
+        desc.usage = MTLTextureUsageShaderRead | MTLTextureUsageShaderWrite | MTLTextureUsageRenderTarget;
         auto texture = [device newTextureWithDescriptor: desc];
         [desc release];
 
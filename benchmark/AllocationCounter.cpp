@@ -0,0 +1,92 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> g_allocations{0};
+static std::atomic<uint64_t> g_allocatedBytes{0};
+
+AllocationCount getAllocationCount() {
+    AllocationCount count;
+    count.allocations = g_allocations.load(std::memory_order_relaxed);
+    count.bytes = g_allocatedBytes.load(std::memory_order_relaxed);
+    return count;
+}
+
+static void* countedAllocate(std::size_t size, std::size_t alignment) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (size == 0) {
+        size = 1;
+    }
+    void* memory = nullptr;
+    if (alignment <= alignof(std::max_align_t)) {
+        memory = std::malloc(size);
+    } else if (posix_memalign(&memory, alignment, size) != 0) {
+        memory = nullptr;
+    }
+    return memory;
+}
+
+void* operator new(std::size_t size) {
+    if (auto memory = countedAllocate(size, alignof(std::max_align_t))) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, alignof(std::max_align_t));
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, alignof(std::max_align_t));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (auto memory = countedAllocate(size, (std::size_t)alignment)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept {
+    std::free(memory);
+}
@@ -0,0 +1,15 @@
+#ifndef HIDINGIN_ALLOCATIONCOUNTER_H
+#define HIDINGIN_ALLOCATIONCOUNTER_H
+
+#include <cstdint>
+
+// the benchmark replaces the global operator new / delete to count heap allocations, so "allocations per frame"
+// covers everything c++ allocates on the frame path. objective-c objects (command buffers, encoders) are not seen.
+struct AllocationCount {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+};
+
+AllocationCount getAllocationCount();
+
+#endif //HIDINGIN_ALLOCATIONCOUNTER_H
@@ -0,0 +1,469 @@
+#include "BenchHarness.h"
+#include "AllocationCounter.h"
+#include "../DesktopCapture/common/SyntheticCaptureSource.h"
+#include "../GPUPipeline/cpu/CpuTileChangeDetector.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+    m_buckets[bucketIndex(nanoseconds)]++;
+    m_count++;
+    m_sum += nanoseconds;
+    m_max = std::max(m_max, nanoseconds);
+}
+
+void LatencyHistogram::clear() {
+    m_buckets.fill(0);
+    m_count = 0;
+    m_sum = 0;
+    m_max = 0;
+}
+
+double LatencyHistogram::meanMicroseconds() const {
+    return m_count ? (double)m_sum / (double)m_count / 1000.0 : 0.0;
+}
+
+double LatencyHistogram::maxMicroseconds() const {
+    return (double)m_max / 1000.0;
+}
+
+double LatencyHistogram::percentileMicroseconds(double percentile) const {
+    if (!m_count) {
+        return 0.0;
+    }
+    // rank of the sample we want, 1 based: p99 of 1000 samples is the 990th
+    auto rank = (uint64_t)std::max(1.0, std::ceil(percentile * (double)m_count));
+    uint64_t seen = 0;
+    for (int index = 0; index < kBucketCount; index++) {
+        seen += m_buckets[index];
+        if (seen >= rank) {
+            // middle of the bucket, but never past the largest sample
+            auto lower = bucketLowerBound(index);
+            auto upper = index + 1 < kBucketCount ? bucketLowerBound(index + 1) : lower;
+            auto value = std::min(lower + (upper - lower) / 2, m_max);
+            return (double)value / 1000.0;
+        }
+    }
+    return maxMicroseconds();
+}
+
+int LatencyHistogram::bucketIndex(uint64_t nanoseconds) {
+    if (nanoseconds < (1u << kSubBucketBits)) {
+        return (int)nanoseconds;
+    }
+    int exponent = 63 - __builtin_clzll(nanoseconds);
+    int subBucket = (int)(nanoseconds >> (exponent - kSubBucketBits)) & ((1 << kSubBucketBits) - 1);
+    return ((exponent - kSubBucketBits + 1) << kSubBucketBits) + subBucket;
+}
+
+uint64_t LatencyHistogram::bucketLowerBound(int index) {
+    if (index < (1 << kSubBucketBits)) {
+        return (uint64_t)index;
+    }
+    int exponent = (index >> kSubBucketBits) + kSubBucketBits - 1;
+    uint64_t subBucket = (uint64_t)(index & ((1 << kSubBucketBits) - 1));
+    return ((1ull << kSubBucketBits) + subBucket) << (exponent - kSubBucketBits);
+}
+
+const char* benchStageName(BenchStage stage) {
+    switch (stage) {
+        case BenchStage::Capture: return "capture";
+        case BenchStage::Graph: return "graph";
+        case BenchStage::Crop: return "crop";
+        case BenchStage::Scale: return "scale";
+        case BenchStage::Gaussian: return "gaussian";
+        case BenchStage::Subtract: return "subtract";
+        case BenchStage::Hide: return "hide";
+        case BenchStage::HighPassHide: return "highPassHide";
+        case BenchStage::Present: return "present";
+        case BenchStage::Frame: return "frame";
+        default: return "unknown";
+    }
+}
+
+std::vector<BenchResolution> getBenchResolutions() {
+    return {
+        {"1080p", 1920, 1080},
+        {"1440p", 2560, 1440},
+        {"4k", 3840, 2160},
+        {"5k", 5120, 2880},
+    };
+}
+
+using BenchClock = std::chrono::steady_clock;
+using StageHistograms = std::array<LatencyHistogram, (size_t)BenchStage::Count>;
+
+static uint64_t elapsedNanoseconds(BenchClock::time_point start) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - start).count();
+}
+
+// times every stage call of the wrapped executor. an asynchronous backend is drained after each stage so the time
+// is what the stage took on the device and not just how long encoding it took.
+class TimedStageExecutor : public HidingStageExecutor {
+public:
+    TimedStageExecutor(HidingStageExecutor& executor, BenchBackend& backend, StageHistograms& histograms)
+        : m_executor(executor), m_backend(backend), m_histograms(histograms) {
+    }
+
+    // off for the throughput pass
+    void setTimeStages(bool timeStages) {
+        m_timeStages = timeStages;
+    }
+
+    void crop(void* input, const FrameGraphCrop& crop, void* output) override {
+        auto start = BenchClock::now();
+        m_executor.crop(input, crop, output);
+        stageDone(BenchStage::Crop, start);
+    }
+
+    void scale(void* input, void* output) override {
+        auto start = BenchClock::now();
+        m_executor.scale(input, output);
+        stageDone(BenchStage::Scale, start);
+    }
+
+    void gaussian(void* input, void* output, const HideEffect& hideEffect) override {
+        auto start = BenchClock::now();
+        m_executor.gaussian(input, output, hideEffect);
+        stageDone(BenchStage::Gaussian, start);
+    }
+
+    void subtract(void* input1, void* input2, void* output) override {
+        auto start = BenchClock::now();
+        m_executor.subtract(input1, input2, output);
+        stageDone(BenchStage::Subtract, start);
+    }
+
+    void hide(void* envInput, void* highPassInput, void* output, const HideEffect& hideEffect) override {
+        auto start = BenchClock::now();
+        m_executor.hide(envInput, highPassInput, output, hideEffect);
+        stageDone(BenchStage::Hide, start);
+    }
+
+    void highPassHide(void* envInput, void* appInput, void* output, const HideEffect& hideEffect) override {
+        auto start = BenchClock::now();
+        m_executor.highPassHide(envInput, appInput, output, hideEffect);
+        stageDone(BenchStage::HighPassHide, start);
+    }
+
+    void present(void* input, void* target) override {
+        auto start = BenchClock::now();
+        m_executor.present(input, target);
+        stageDone(BenchStage::Present, start);
+    }
+
+    void scaleRects(void* input, void* output, const std::vector<DirtyRect>& rects) override {
+        auto start = BenchClock::now();
+        m_executor.scaleRects(input, output, rects);
+        stageDone(BenchStage::Scale, start);
+    }
+
+    void highPassHideTiles(void* envInput, void* appInput, void* output, const DirtyTileMap& dirtyTiles,
+                           const HideEffect& hideEffect) override {
+        auto start = BenchClock::now();
+        m_executor.highPassHideTiles(envInput, appInput, output, dirtyTiles, hideEffect);
+        stageDone(BenchStage::HighPassHide, start);
+    }
+
+    bool isHideEffectReady(const HideEffectSpecialization& specialization) override {
+        return m_executor.isHideEffectReady(specialization);
+    }
+
+private:
+    void stageDone(BenchStage stage, BenchClock::time_point start) {
+        if (!m_timeStages) {
+            return;
+        }
+        m_backend.finishWork();
+        m_histograms[(size_t)stage].record(elapsedNanoseconds(start));
+    }
+
+    HidingStageExecutor& m_executor;
+    BenchBackend& m_backend;
+    StageHistograms& m_histograms;
+    bool m_timeStages = true;
+};
+
+// counts the physical textures the graph creates, steady frames should not create any
+class CountingFrameGraphBackend : public FrameGraphBackend {
+public:
+    explicit CountingFrameGraphBackend(FrameGraphBackend& backend) : m_backend(backend) {
+    }
+
+    void* createTexture(const FrameGraphTextureDesc& desc) override {
+        m_createdTextures++;
+        return m_backend.createTexture(desc);
+    }
+
+    void destroyTexture(void* texture) override {
+        m_backend.destroyTexture(texture);
+    }
+
+    uint64_t getCreatedTextureCount() const {
+        return m_createdTextures;
+    }
+
+private:
+    FrameGraphBackend& m_backend;
+    uint64_t m_createdTextures = 0;
+};
+
+// captured frames alternate between these, so every upload carries new pixels without generating 5K frames in
+// the timed loop
+static constexpr int kCaptureRingFrames = 2;
+
+// the caret scenario: every ring frame is the first one, the app's second frame has a text caret inverted in it
+static void drawCaretFrames(std::vector<CpuImage> capturedFrames[2], const HidingCompositeDesc& compositeDesc) {
+    for (int source = 0; source < 2; source++) {
+        for (int frame = 1; frame < kCaptureRingFrames; frame++) {
+            auto& first = capturedFrames[source][0];
+            auto& copy = capturedFrames[source][frame];
+            for (int y = 0; y < first.view().height; y++) {
+                std::copy_n(first.view().row(y), first.view().width * 4, copy.view().row(y));
+            }
+        }
+    }
+    // a 2 pixel wide, line high caret a third into the app window, at 1080p sizes
+    auto& appFrame = capturedFrames[1][1];
+    auto scale = std::max(1, appFrame.view().height / 1080);
+    auto caret = DirtyRect{compositeDesc.appCrop.x + compositeDesc.appCropWidth / 3,
+                           compositeDesc.appCrop.y + compositeDesc.appCropHeight / 3, 2 * scale, 20 * scale}
+                         .intersected({0, 0, appFrame.view().width, appFrame.view().height});
+    for (int y = caret.y; y < caret.y + caret.height; y++) {
+        auto pixel = appFrame.view().row(y) + caret.x * 4;
+        for (int x = 0; x < caret.width; x++, pixel += 4) {
+            pixel[0] ^= 0xff;
+            pixel[1] ^= 0xff;
+            pixel[2] ^= 0xff;
+        }
+    }
+}
+
+BenchRunResult runFramePipelineBenchmark(BenchBackend& backend, const BenchRunConfig& config) {
+    BenchRunResult result;
+    result.backend = backend.getName();
+    result.config = config;
+
+    auto width = config.resolution.width;
+    auto height = config.resolution.height;
+    FrameGraphTextureDesc captureDesc{width, height, kFrameGraphFormatBGRA8};
+    FrameGraphTextureDesc outputDesc{width / 2, height / 2, kFrameGraphFormatBGRA8};
+    result.outputWidth = outputDesc.width;
+    result.outputHeight = outputDesc.height;
+    if (width <= 0 || height <= 0 || config.frames <= 0) {
+        return result;
+    }
+    if (config.fusedHighPassHide && !backend.supportsFusedHighPassHide()) {
+        std::cerr << backend.getName() << ": no fused highPassHide, skipping the fused run" << std::endl;
+        return result;
+    }
+    if (!backend.prepare(outputDesc)) {
+        std::cerr << backend.getName() << ": failed to prepare " << config.resolution.name << std::endl;
+        return result;
+    }
+
+    HidingCompositeDesc compositeDesc;
+    compositeDesc.envFrameDesc = captureDesc;
+    compositeDesc.envCrop = {width / 4, height / 4, outputDesc.width, outputDesc.height, 0, 0};
+    compositeDesc.appFrameDesc = captureDesc;
+    compositeDesc.appCropWidth = width * 6 / 10;
+    compositeDesc.appCropHeight = height * 6 / 10;
+    compositeDesc.appCrop = {(width - compositeDesc.appCropWidth) / 2, (height - compositeDesc.appCropHeight) / 2,
+                             compositeDesc.appCropWidth, compositeDesc.appCropHeight, 0, 0};
+    compositeDesc.showAppContent = true;
+    compositeDesc.presentTarget = backend.getPresentTarget();
+    compositeDesc.outputDesc = outputDesc;
+    compositeDesc.fusedHighPassHide = config.fusedHighPassHide;
+
+    // source 0 is the desktop, source 1 the app
+    std::vector<CpuImage> capturedFrames[2];
+    for (int source = 0; source < 2; source++) {
+        SyntheticCaptureConfig syntheticConfig;
+        syntheticConfig.width = width;
+        syntheticConfig.height = height;
+        syntheticConfig.seed = source + 1;
+        SyntheticFrameGenerator generator(syntheticConfig);
+        capturedFrames[source].resize(kCaptureRingFrames);
+        for (int frame = 0; frame < kCaptureRingFrames; frame++) {
+            capturedFrames[source][frame].resize(width, height);
+            generator.generate(frame, capturedFrames[source][frame].view());
+        }
+    }
+    if (config.caretUpdate) {
+        drawCaretFrames(capturedFrames, compositeDesc);
+    }
+
+    // caret scenario: what changed in each capture, and the output tiles it reaches
+    CpuTileChangeDetector changeDetectors[2];
+    DirtyRegion captureDirty[2];
+    DirtyTileMap outputDirtyTiles;
+
+    auto histograms = std::make_unique<StageHistograms>();
+    CountingFrameGraphBackend countingBackend(backend.getFrameGraphBackend());
+    FrameGraph graph(countingBackend);
+    TimedStageExecutor executor(backend.getStageExecutor(), backend, *histograms);
+
+    // a retuned effect is baked (and its pipelines built) in the background, frames keep the defaults until then
+    auto effectDeadline = BenchClock::now() + std::chrono::seconds(5);
+    compositeDesc.hideEffect = selectHideEffect(nullptr, config.hideEffect, executor);
+    while (compositeDesc.hideEffect->getSettings() != config.hideEffect) {
+        if (BenchClock::now() > effectDeadline) {
+            std::cerr << backend.getName() << ": hide effect did not become ready" << std::endl;
+            return result;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        compositeDesc.hideEffect = selectHideEffect(compositeDesc.hideEffect, config.hideEffect, executor);
+    }
+
+    auto runFrame = [&](int frameIndex, bool timeStages) {
+        executor.setTimeStages(timeStages);
+        auto frameStart = BenchClock::now();
+        backend.beginFrame();
+
+        auto captureStart = BenchClock::now();
+        auto ringIndex = frameIndex % kCaptureRingFrames;
+        compositeDesc.envFrame = backend.captureFrame(0, capturedFrames[0][ringIndex].view());
+        compositeDesc.appFrame = backend.captureFrame(1, capturedFrames[1][ringIndex].view());
+        if (config.caretUpdate) {
+            // the portable capture sources hash every frame, so it counts as capture
+            for (int source = 0; source < 2; source++) {
+                changeDetectors[source].detect(capturedFrames[source][ringIndex].view(), captureDirty[source]);
+            }
+        }
+        if (timeStages) {
+            backend.finishWork();
+            (*histograms)[(size_t)BenchStage::Capture].record(elapsedNanoseconds(captureStart));
+        }
+
+        auto graphStart = BenchClock::now();
+        if (config.caretUpdate) {
+            // the first frame comes back as everything and redraws in full
+            markHidingOutputDirtyTiles(compositeDesc, captureDirty[0], captureDirty[1], outputDirtyTiles);
+            compositeDesc.outputDirtyTiles = &outputDirtyTiles;
+        }
+        graph.reset();
+        buildHidingFrameGraph(graph, compositeDesc, executor);
+        bool compiled = graph.compile();
+        if (timeStages) {
+            (*histograms)[(size_t)BenchStage::Graph].record(elapsedNanoseconds(graphStart));
+        }
+        if (compiled) {
+            graph.execute();
+        }
+
+        backend.endFrame();
+        backend.finishWork();
+        return elapsedNanoseconds(frameStart);
+    };
+
+    // warm up: the graph creates its textures, caches fill, clocks ramp
+    for (int frame = 0; frame < config.warmupFrames; frame++) {
+        runFrame(frame, true);
+    }
+    for (auto& histogram : *histograms) {
+        histogram.clear();
+    }
+
+    auto allocationsBefore = getAllocationCount();
+    auto texturesBefore = countingBackend.getCreatedTextureCount();
+    uint64_t totalFrameNanoseconds = 0;
+    for (int frame = 0; frame < config.frames; frame++) {
+        auto frameNanoseconds = runFrame(config.warmupFrames + frame, true);
+        (*histograms)[(size_t)BenchStage::Frame].record(frameNanoseconds);
+        totalFrameNanoseconds += frameNanoseconds;
+    }
+    auto allocationsAfter = getAllocationCount();
+    auto texturesAfter = countingBackend.getCreatedTextureCount();
+
+    // draining after every stage serializes an asynchronous backend, its throughput comes from a run that only
+    // waits at the end of each frame
+    if (backend.isAsynchronous()) {
+        totalFrameNanoseconds = 0;
+        for (int frame = 0; frame < config.frames; frame++) {
+            totalFrameNanoseconds += runFrame(config.warmupFrames + config.frames + frame, false);
+        }
+    }
+
+    result.ok = true;
+    result.framesPerSecond = totalFrameNanoseconds ? (double)config.frames * 1e9 / (double)totalFrameNanoseconds : 0.0;
+    result.allocationsPerFrame = (double)(allocationsAfter.allocations - allocationsBefore.allocations) / config.frames;
+    result.allocatedBytesPerFrame = (double)(allocationsAfter.bytes - allocationsBefore.bytes) / config.frames;
+    result.textureAllocationsPerFrame = (double)(texturesAfter - texturesBefore) / config.frames;
+    result.physicalTextures = graph.getPhysicalTextureCount();
+    result.physicalTextureBytes = graph.getPhysicalTextureBytes();
+    for (size_t stage = 0; stage < (size_t)BenchStage::Count; stage++) {
+        auto& histogram = (*histograms)[stage];
+        if (!histogram.count()) {
+            continue;
+        }
+        BenchStageResult stageResult;
+        stageResult.stage = (BenchStage)stage;
+        stageResult.calls = histogram.count();
+        stageResult.meanMicroseconds = histogram.meanMicroseconds();
+        stageResult.p50Microseconds = histogram.percentileMicroseconds(0.5);
+        stageResult.p99Microseconds = histogram.percentileMicroseconds(0.99);
+        stageResult.p999Microseconds = histogram.percentileMicroseconds(0.999);
+        stageResult.maxMicroseconds = histogram.maxMicroseconds();
+        result.stages.push_back(stageResult);
+    }
+    return result;
+}
+
+static void writeJsonString(std::ostream& out, const std::string& value) {
+    out << '"';
+    for (auto character : value) {
+        if (character == '"' || character == '\\') {
+            out << '\\';
+        }
+        out << character;
+    }
+    out << '"';
+}
+
+void writeBenchResultsJson(std::ostream& out, const std::vector<BenchRunResult>& results) {
+    out << std::fixed << std::setprecision(3);
+    out << "{\n  \"benchmark\": \"framePipeline\",\n  \"latencyUnit\": \"us\",\n  \"results\": [";
+    for (size_t index = 0; index < results.size(); index++) {
+        auto& result = results[index];
+        out << (index ? ",\n" : "\n") << "    {\n";
+        out << "      \"backend\": ";
+        writeJsonString(out, result.backend);
+        out << ",\n      \"resolution\": ";
+        writeJsonString(out, result.config.resolution.name);
+        out << ",\n      \"width\": " << result.config.resolution.width
+            << ",\n      \"height\": " << result.config.resolution.height
+            << ",\n      \"outputWidth\": " << result.outputWidth
+            << ",\n      \"outputHeight\": " << result.outputHeight
+            << ",\n      \"fusedHighPassHide\": " << (result.config.fusedHighPassHide ? "true" : "false")
+            << ",\n      \"update\": \"" << (result.config.caretUpdate ? "caret" : "full") << "\""
+            << ",\n      \"highPassSigma\": " << result.config.hideEffect.highPassSigma
+            << ",\n      \"ok\": " << (result.ok ? "true" : "false")
+            << ",\n      \"frames\": " << result.config.frames
+            << ",\n      \"warmupFrames\": " << result.config.warmupFrames
+            << ",\n      \"framesPerSecond\": " << result.framesPerSecond
+            << ",\n      \"allocationsPerFrame\": " << result.allocationsPerFrame
+            << ",\n      \"allocatedBytesPerFrame\": " << result.allocatedBytesPerFrame
+            << ",\n      \"textureAllocationsPerFrame\": " << result.textureAllocationsPerFrame
+            << ",\n      \"physicalTextures\": " << result.physicalTextures
+            << ",\n      \"physicalTextureBytes\": " << result.physicalTextureBytes
+            << ",\n      \"stages\": {";
+        for (size_t stageIndex = 0; stageIndex < result.stages.size(); stageIndex++) {
+            auto& stage = result.stages[stageIndex];
+            out << (stageIndex ? ",\n" : "\n") << "        ";
+            writeJsonString(out, benchStageName(stage.stage));
+            out << ": {\"calls\": " << stage.calls
+                << ", \"mean\": " << stage.meanMicroseconds
+                << ", \"p50\": " << stage.p50Microseconds
+                << ", \"p99\": " << stage.p99Microseconds
+                << ", \"p999\": " << stage.p999Microseconds
+                << ", \"max\": " << stage.maxMicroseconds << "}";
+        }
+        out << (result.stages.empty() ? "}" : "\n      }") << "\n    }";
+    }
+    out << (results.empty() ? "]" : "\n  ]") << "\n}\n";
+}
@@ -0,0 +1,136 @@
+#ifndef HIDINGIN_BENCHHARNESS_H
+#define HIDINGIN_BENCHHARNESS_H
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "../GPUPipeline/FrameGraph.h"
+#include "../GPUPipeline/HidingFrameGraph.h"
+#include "../GPUPipeline/cpu/CpuImage.h"
+
+// log-linear latency histogram, 32 buckets per power of two (about 3% resolution) so recording never allocates
+class LatencyHistogram {
+public:
+    void record(uint64_t nanoseconds);
+    void clear();
+
+    uint64_t count() const { return m_count; }
+    double meanMicroseconds() const;
+    double maxMicroseconds() const;
+    // percentile in [0, 1], e.g. 0.999
+    double percentileMicroseconds(double percentile) const;
+
+private:
+    static constexpr int kSubBucketBits = 5;
+    static constexpr int kBucketCount = (64 - kSubBucketBits + 1) << kSubBucketBits;
+
+    static int bucketIndex(uint64_t nanoseconds);
+    static uint64_t bucketLowerBound(int index);
+
+    std::array<uint64_t, kBucketCount> m_buckets{};
+    uint64_t m_count = 0;
+    uint64_t m_sum = 0;
+    uint64_t m_max = 0;
+};
+
+// what the harness times, one histogram each. the HidingStageExecutor stages are timed per call (crop runs twice a
+// frame when the app is shown), capture is getting both captured frames into backend textures, graph is
+// reset + build + compile and frame is all of it.
+enum class BenchStage {
+    Capture,
+    Graph,
+    Crop,
+    Scale,
+    Gaussian,
+    Subtract,
+    Hide,
+    HighPassHide,
+    Present,
+    Frame,
+    Count
+};
+
+const char* benchStageName(BenchStage stage);
+
+// one backend the pipeline can run on, the harness drives all of them the same way
+class BenchBackend {
+public:
+    virtual ~BenchBackend() = default;
+
+    virtual const char* getName() const = 0;
+
+    // set up the present target for this output size, false skips the run
+    virtual bool prepare(const FrameGraphTextureDesc& outputDesc) = 0;
+    virtual FrameGraphBackend& getFrameGraphBackend() = 0;
+    virtual HidingStageExecutor& getStageExecutor() = 0;
+    virtual void* getPresentTarget() = 0;
+    virtual bool supportsFusedHighPassHide() const { return true; }
+
+    // the capture stage: frame (source 0 is the desktop, 1 the app) as a texture of this backend, valid until endFrame()
+    virtual void* captureFrame(int sourceIndex, const CpuImageView& frame) = 0;
+
+    virtual void beginFrame() {}
+    virtual void endFrame() {}
+    // block until the work issued so far finished. asynchronous backends need it to time single stages; the
+    // harness then measures throughput in a second pass that only waits once per frame.
+    virtual void finishWork() {}
+    virtual bool isAsynchronous() const { return false; }
+};
+
+struct BenchResolution {
+    std::string name;
+    int width = 0;
+    int height = 0;
+};
+
+// the standard set: 1080p, 1440p, 4K, 5K
+std::vector<BenchResolution> getBenchResolutions();
+
+struct BenchRunConfig {
+    BenchResolution resolution;
+    bool fusedHighPassHide = true;
+    // only a caret blinks in the app and the desktop stands still: the captures go through tile change detection
+    // and the composite only redraws the dirty tiles. otherwise every frame is new and fully redrawn.
+    bool caretUpdate = false;
+    int frames = 120;
+    int warmupFrames = 10;
+    // picked up through selectHideEffect like CompositeCapture does, the run waits until it is in use
+    HideEffectSettings hideEffect;
+};
+
+struct BenchStageResult {
+    BenchStage stage = BenchStage::Frame;
+    uint64_t calls = 0;
+    double meanMicroseconds = 0;
+    double p50Microseconds = 0;
+    double p99Microseconds = 0;
+    double p999Microseconds = 0;
+    double maxMicroseconds = 0;
+};
+
+struct BenchRunResult {
+    std::string backend;
+    BenchRunConfig config;
+    bool ok = false;
+    int outputWidth = 0;
+    int outputHeight = 0;
+    double framesPerSecond = 0;
+    double allocationsPerFrame = 0;
+    double allocatedBytesPerFrame = 0;
+    double textureAllocationsPerFrame = 0;
+    int physicalTextures = 0;
+    uint64_t physicalTextureBytes = 0;
+    std::vector<BenchStageResult> stages; // stages that ran
+};
+
+// the capture -> crop -> scale -> high pass -> hide -> present path on synthetic frames. the scene is a desktop
+// and an app capture at the full resolution, the app window covers the centered 60% of its capture and our window
+// half the desktop, so every stage of the graph runs. with caretUpdate the first frame is a full composite and the
+// rest are incremental.
+BenchRunResult runFramePipelineBenchmark(BenchBackend& backend, const BenchRunConfig& config);
+
+void writeBenchResultsJson(std::ostream& out, const std::vector<BenchRunResult>& results);
+
+#endif //HIDINGIN_BENCHHARNESS_H
@@ -0,0 +1,19 @@
+#include "CpuBenchBackend.h"
+#include <cstring>
+
+bool CpuBenchBackend::prepare(const FrameGraphTextureDesc& outputDesc) {
+    m_presentTarget.resize(outputDesc.width, outputDesc.height);
+    return true;
+}
+
+void* CpuBenchBackend::captureFrame(int sourceIndex, const CpuImageView& frame) {
+    auto& capturedFrame = m_capturedFrames[sourceIndex];
+    if (capturedFrame.width() != frame.width || capturedFrame.height() != frame.height) {
+        capturedFrame.resize(frame.width, frame.height);
+    }
+    auto capturedView = capturedFrame.view();
+    for (int y = 0; y < frame.height; y++) {
+        std::memcpy(capturedView.row(y), frame.row(y), (size_t)frame.width * 4);
+    }
+    return &capturedFrame;
+}
@@ -0,0 +1,41 @@
+#ifndef HIDINGIN_CPUBENCHBACKEND_H
+#define HIDINGIN_CPUBENCHBACKEND_H
+
+#include "BenchHarness.h"
+#include "../GPUPipeline/cpu/CpuFrameGraphBackend.h"
+
+// CpuFrameGraphBackend + CpuHidingStageExecutor, capturing copies the frame into a per source image
+class CpuBenchBackend : public BenchBackend {
+public:
+    explicit CpuBenchBackend(CpuKernelIsa isa) : m_stageExecutor(isa), m_name(std::string("cpu-") + cpuKernelIsaName(isa)) {
+    }
+
+    const char* getName() const override {
+        return m_name.c_str();
+    }
+
+    bool prepare(const FrameGraphTextureDesc& outputDesc) override;
+
+    FrameGraphBackend& getFrameGraphBackend() override {
+        return m_frameGraphBackend;
+    }
+
+    HidingStageExecutor& getStageExecutor() override {
+        return m_stageExecutor;
+    }
+
+    void* getPresentTarget() override {
+        return &m_presentTarget;
+    }
+
+    void* captureFrame(int sourceIndex, const CpuImageView& frame) override;
+
+private:
+    CpuFrameGraphBackend m_frameGraphBackend;
+    CpuHidingStageExecutor m_stageExecutor;
+    CpuImage m_presentTarget;
+    CpuImage m_capturedFrames[2];
+    std::string m_name;
+};
+
+#endif //HIDINGIN_CPUBENCHBACKEND_H
@@ -0,0 +1,211 @@
+#include "BenchHarness.h"
+#include "CpuBenchBackend.h"
+#ifdef __APPLE__
+#include "MetalBenchBackend.h"
+#endif
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+// HidingInBench [--backend cpu|metal|all] [--resolution 1080p,1440p,4k,5k] [--pipeline fused|unfused|both]
+//               [--update full|caret|both] [--cpu-isa best|scalar|all] [--high-pass-sigma S] [--frames N] [--warmup N]
+//               [--output file.json]
+// prints the json to stdout unless --output is given, progress goes to stderr
+
+struct BenchOptions {
+    std::string backend = "all";
+    std::string resolutions = "1080p,1440p,4k,5k";
+    std::string pipeline = "both";
+    std::string update = "full";
+    std::string cpuIsa = "best";
+    float highPassSigma = HideEffectSettings{}.highPassSigma;
+    int frames = 120;
+    int warmupFrames = 10;
+    std::string outputPath;
+};
+
+static void printUsage() {
+    std::cerr << "usage: HidingInBench [--backend cpu|metal|all] [--resolution 1080p,1440p,4k,5k]\n"
+                 "                     [--pipeline fused|unfused|both] [--update full|caret|both]\n"
+                 "                     [--cpu-isa best|scalar|all] [--high-pass-sigma S]\n"
+                 "                     [--frames N] [--warmup N] [--output file.json]" << std::endl;
+}
+
+static bool parseOptions(int argc, char** argv, BenchOptions& options) {
+    for (int index = 1; index < argc; index++) {
+        std::string option = argv[index];
+        if (option == "--help" || option == "-h") {
+            return false;
+        }
+        if (index + 1 >= argc) {
+            std::cerr << "missing value for " << option << std::endl;
+            return false;
+        }
+        std::string value = argv[++index];
+        if (option == "--backend") {
+            options.backend = value;
+        } else if (option == "--resolution") {
+            options.resolutions = value;
+        } else if (option == "--pipeline") {
+            options.pipeline = value;
+        } else if (option == "--update") {
+            options.update = value;
+        } else if (option == "--cpu-isa") {
+            options.cpuIsa = value;
+        } else if (option == "--high-pass-sigma") {
+            options.highPassSigma = (float)std::atof(value.c_str());
+        } else if (option == "--frames") {
+            options.frames = std::atoi(value.c_str());
+        } else if (option == "--warmup") {
+            options.warmupFrames = std::max(0, std::atoi(value.c_str()));
+        } else if (option == "--output") {
+            options.outputPath = value;
+        } else {
+            std::cerr << "unknown option " << option << std::endl;
+            return false;
+        }
+    }
+    return options.frames > 0;
+}
+
+static std::vector<BenchResolution> selectResolutions(const std::string& names) {
+    std::vector<BenchResolution> selected;
+    auto resolutions = getBenchResolutions();
+    std::stringstream nameStream(names);
+    std::string name;
+    while (std::getline(nameStream, name, ',')) {
+        bool found = false;
+        for (auto& resolution : resolutions) {
+            if (resolution.name == name) {
+                selected.push_back(resolution);
+                found = true;
+            }
+        }
+        if (!found) {
+            std::cerr << "unknown resolution " << name << std::endl;
+        }
+    }
+    return selected;
+}
+
+static std::vector<CpuKernelIsa> selectCpuIsas(const std::string& cpuIsa) {
+    std::vector<CpuKernelIsa> isas;
+    if (cpuIsa == "scalar" || cpuIsa == "all") {
+        isas.push_back(CpuKernelIsa::Scalar);
+    }
+    if (cpuIsa == "best" || cpuIsa == "all") {
+        for (auto isa : {CpuKernelIsa::AVX2, CpuKernelIsa::NEON}) {
+            if (isCpuKernelIsaSupported(isa)) {
+                isas.push_back(isa);
+            }
+        }
+        if (cpuIsa == "best" && isas.empty()) {
+            isas.push_back(CpuKernelIsa::Scalar);
+        }
+    }
+    return isas;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+    auto resolutions = selectResolutions(options.resolutions);
+    if (resolutions.empty()) {
+        printUsage();
+        return 2;
+    }
+    std::vector<bool> pipelines;
+    if (options.pipeline == "fused" || options.pipeline == "both") {
+        pipelines.push_back(true);
+    }
+    if (options.pipeline == "unfused" || options.pipeline == "both") {
+        pipelines.push_back(false);
+    }
+    std::vector<bool> updates;
+    if (options.update == "full" || options.update == "both") {
+        updates.push_back(false);
+    }
+    if (options.update == "caret" || options.update == "both") {
+        updates.push_back(true);
+    }
+    if (pipelines.empty() || updates.empty()) {
+        printUsage();
+        return 2;
+    }
+
+    std::vector<std::unique_ptr<BenchBackend>> backends;
+    if (options.backend == "cpu" || options.backend == "all") {
+        for (auto isa : selectCpuIsas(options.cpuIsa)) {
+            backends.push_back(std::make_unique<CpuBenchBackend>(isa));
+        }
+    }
+    if (options.backend == "metal" || options.backend == "all") {
+#if defined(__APPLE__) && defined(HIDINGIN_SHADER_DIR)
+        auto metalBackend = std::make_unique<MetalBenchBackend>(HIDINGIN_SHADER_DIR);
+        if (metalBackend->isAvailable()) {
+            backends.push_back(std::move(metalBackend));
+        } else if (options.backend == "metal") {
+            std::cerr << "metal backend is not available" << std::endl;
+            return 1;
+        }
+#else
+        if (options.backend == "metal") {
+            std::cerr << "this build has no metal backend" << std::endl;
+            return 1;
+        }
+#endif
+    }
+    if (backends.empty()) {
+        printUsage();
+        return 2;
+    }
+
+    std::vector<BenchRunResult> results;
+    bool allOk = true;
+    for (auto& backend : backends) {
+        for (auto& resolution : resolutions) {
+            for (auto fused : pipelines) {
+                if (fused && !backend->supportsFusedHighPassHide()) {
+                    continue;
+                }
+                for (auto caretUpdate : updates) {
+                    BenchRunConfig config;
+                    config.resolution = resolution;
+                    config.fusedHighPassHide = fused;
+                    config.caretUpdate = caretUpdate;
+                    config.frames = options.frames;
+                    config.warmupFrames = options.warmupFrames;
+                    config.hideEffect.highPassSigma = options.highPassSigma;
+                    std::cerr << backend->getName() << " " << resolution.name << (fused ? " fused" : " unfused")
+                              << (caretUpdate ? " caret" : "") << "..." << std::endl;
+                    results.push_back(runFramePipelineBenchmark(*backend, config));
+                    auto& result = results.back();
+                    allOk = allOk && result.ok;
+                    if (result.ok) {
+                        std::cerr << "  " << result.framesPerSecond << " fps, " << result.allocationsPerFrame
+                                  << " allocations per frame" << std::endl;
+                    }
+                }
+            }
+        }
+    }
+
+    if (options.outputPath.empty()) {
+        writeBenchResultsJson(std::cout, results);
+    } else {
+        std::ofstream outputFile(options.outputPath);
+        if (!outputFile) {
+            std::cerr << "failed to write " << options.outputPath << std::endl;
+            return 1;
+        }
+        writeBenchResultsJson(outputFile, results);
+    }
+    return allOk ? 0 : 1;
+}
@@ -0,0 +1,52 @@
+#ifndef HIDINGIN_METALBENCHBACKEND_H
+#define HIDINGIN_METALBENCHBACKEND_H
+
+#include <memory>
+#include <string>
+#include "BenchHarness.h"
+
+class MetalFrameGraphBackend;
+class MetalHidingStageExecutor;
+
+// the composite path CompositeCapture runs on the render queue, minus the qt window: MetalPipeline is set up on
+// the system default device with the shaders from shaderDirectory, present renders into an offscreen target
+class MetalBenchBackend : public BenchBackend {
+public:
+    explicit MetalBenchBackend(const std::string& shaderDirectory);
+    ~MetalBenchBackend() override;
+
+    // false when there is no metal device or the shaders did not build
+    bool isAvailable() const {
+        return m_available;
+    }
+
+    const char* getName() const override {
+        return "metal";
+    }
+
+    bool prepare(const FrameGraphTextureDesc& outputDesc) override;
+    FrameGraphBackend& getFrameGraphBackend() override;
+    HidingStageExecutor& getStageExecutor() override;
+    void* getPresentTarget() override;
+    bool supportsFusedHighPassHide() const override;
+
+    // uploads like CompositeCapture does for cpu frames
+    void* captureFrame(int sourceIndex, const CpuImageView& frame) override;
+
+    void beginFrame() override;
+    void endFrame() override;
+    void finishWork() override;
+    bool isAsynchronous() const override {
+        return true;
+    }
+
+private:
+    bool m_available = false;
+    void* m_mtlDevice = nullptr;
+    void* m_mtlCommandQueue = nullptr;
+    void* m_presentTarget = nullptr;
+    std::unique_ptr<MetalFrameGraphBackend> m_frameGraphBackend;
+    std::unique_ptr<MetalHidingStageExecutor> m_stageExecutor;
+};
+
+#endif //HIDINGIN_METALBENCHBACKEND_H
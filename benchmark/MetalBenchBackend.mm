@@ -0,0 +1,156 @@
+#include "MetalBenchBackend.h"
+#include "../GPUPipeline/macos/MetalPipeline.h"
+#include "../GPUPipeline/macos/MetalFrameGraphBackend.h"
+#include "../com/NotificationCenter.h"
+#include "../DesktopCapture/common/CaptureState.h"
+#import <Metal/Metal.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static bool readShaderFile(const std::string& path, std::string& content) {
+    std::ifstream shaderFile(path);
+    if (!shaderFile) {
+        std::cerr << "failed to open shader file: " << path << std::endl;
+        return false;
+    }
+    std::stringstream shaderStream;
+    shaderStream << shaderFile.rdbuf();
+    content = shaderStream.str();
+    return true;
+}
+
+MetalBenchBackend::MetalBenchBackend(const std::string& shaderDirectory) {
+    auto mtlDevice = MTLCreateSystemDefaultDevice();
+    if (!mtlDevice) {
+        std::cerr << "no metal device" << std::endl;
+        return;
+    }
+    m_mtlDevice = (void*)mtlDevice;
+
+    // same shaders QMetalGraphicsItem loads from the qt resources
+    PipelineConfiguration pipelineConfiguration;
+    pipelineConfiguration.graphicsDevice = m_mtlDevice;
+    ShaderDesc shaderDesc;
+    shaderDesc.functionToGoVert = "vertexFunction";
+    shaderDesc.functionToGoFrag = "fragmentFunction";
+    if (!readShaderFile(shaderDirectory + "/render.metal", shaderDesc.shaderContent)) {
+        return;
+    }
+    shaderDesc.shaderDesc = "basicRenderShader";
+    pipelineConfiguration.renderShaders.push_back(shaderDesc);
+    if (!readShaderFile(shaderDirectory + "/textureBlendHide.metal", shaderDesc.shaderContent)) {
+        return;
+    }
+    shaderDesc.shaderDesc = "hidingShader";
+    pipelineConfiguration.renderShaders.push_back(shaderDesc);
+
+    ShaderDesc computeShaderDesc;
+    if (readShaderFile(shaderDirectory + "/highPassHideCompute.metal", computeShaderDesc.shaderContent)) {
+        computeShaderDesc.shaderDesc = "highPassHide";
+        computeShaderDesc.functionToGoCompute = "highPassHide";
+        pipelineConfiguration.computeShaders.push_back(computeShaderDesc);
+        computeShaderDesc.shaderDesc = "highPassHideTiles";
+        computeShaderDesc.functionToGoCompute = "highPassHideTiles";
+        pipelineConfiguration.computeShaders.push_back(computeShaderDesc);
+    }
+    MetalPipeline::initGlobalMetalPipeline(pipelineConfiguration);
+    // no shader cache: every run compiles, the frames measured do not depend on what an earlier run left
+    MetalPipeline::getGlobalInstance().waitForShaderBuilds();
+
+    auto& renderPipeline = MetalPipeline::getGlobalInstance().getRenderPipeline();
+    m_mtlCommandQueue = renderPipeline.mtlCommandQueue;
+    if (!m_mtlCommandQueue || !renderPipeline.mtlPipelineStates.count("hidingShader")) {
+        std::cerr << "metal pipeline did not come up" << std::endl;
+        return;
+    }
+    m_frameGraphBackend = std::make_unique<MetalFrameGraphBackend>(m_mtlDevice);
+    m_stageExecutor = std::make_unique<MetalHidingStageExecutor>(m_mtlCommandQueue);
+    m_available = true;
+}
+
+MetalBenchBackend::~MetalBenchBackend() {
+    if (m_mtlCommandQueue) {
+        finishWork();
+    }
+    // pooled textures go back before the pool sees its last frame
+    m_frameGraphBackend.reset();
+    if (m_presentTarget) {
+        [(id<MTLTexture>)m_presentTarget release];
+    }
+    MetalPipeline::getGlobalInstance().cleanUp();
+}
+
+bool MetalBenchBackend::prepare(const FrameGraphTextureDesc& outputDesc) {
+    if (!m_available) {
+        return false;
+    }
+    finishWork();
+    if (m_presentTarget) {
+        [(id<MTLTexture>)m_presentTarget release];
+        m_presentTarget = nullptr;
+    }
+    auto textureDescriptor = [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:MTLPixelFormatBGRA8Unorm
+                                                                                 width:outputDesc.width
+                                                                                height:outputDesc.height
+                                                                             mipmapped:NO];
+    textureDescriptor.usage = MTLTextureUsageRenderTarget | MTLTextureUsageShaderRead | MTLTextureUsageShaderWrite;
+    textureDescriptor.storageMode = MTLStorageModePrivate;
+    m_presentTarget = (void*)[(id<MTLDevice>)m_mtlDevice newTextureWithDescriptor:textureDescriptor];
+    if (!m_presentTarget) {
+        return false;
+    }
+    MetalPipeline::getGlobalInstance().setRenderTarget(m_presentTarget);
+
+    // the render pipeline sizes its viewport from the window
+    NotificationCenter::getInstance().renderState().update([&](RenderState& state) {
+        state.width = outputDesc.width;
+        state.height = outputDesc.height;
+        state.scalingFactor = 1.0f;
+    });
+    return true;
+}
+
+FrameGraphBackend& MetalBenchBackend::getFrameGraphBackend() {
+    return *m_frameGraphBackend;
+}
+
+HidingStageExecutor& MetalBenchBackend::getStageExecutor() {
+    return *m_stageExecutor;
+}
+
+void* MetalBenchBackend::getPresentTarget() {
+    return m_presentTarget;
+}
+
+bool MetalBenchBackend::supportsFusedHighPassHide() const {
+    return MetalPipeline::getGlobalInstance().hasComputePipelineState("highPassHide");
+}
+
+void* MetalBenchBackend::captureFrame(int sourceIndex, const CpuImageView& frame) {
+    auto mtlTexture = (id<MTLTexture>)MtlTextureManager::getGlobalInstance().requestFrameTexture(
+            frame.width, frame.height, MTLPixelFormatBGRA8Unorm, m_mtlDevice);
+    if (!mtlTexture) {
+        return nullptr;
+    }
+    [mtlTexture replaceRegion:MTLRegionMake2D(0, 0, frame.width, frame.height)
+                  mipmapLevel:0
+                    withBytes:frame.data
+                  bytesPerRow:frame.bytesPerRow];
+    return (void*)mtlTexture;
+}
+
+void MetalBenchBackend::beginFrame() {
+    MtlTextureManager::getGlobalInstance().beginFrame();
+}
+
+void MetalBenchBackend::endFrame() {
+    MtlTextureManager::getGlobalInstance().endFrame(m_mtlCommandQueue);
+}
+
+void MetalBenchBackend::finishWork() {
+    // the queue runs command buffers in order, once an empty one completed everything before it did
+    auto commandBuffer = [(id<MTLCommandQueue>)m_mtlCommandQueue commandBuffer];
+    [commandBuffer commit];
+    [commandBuffer waitUntilCompleted];
+}
@@ -0,0 +1,163 @@
+#ifndef HIDINGIN_EVENTCHANNEL_H
+#define HIDINGIN_EVENTCHANNEL_H
+
+#include <string>
+#include <functional>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <iostream>
+#include <cstdint>
+#include "../utils/Tracer.h"
+
+// typed counterpart of EventManager for the hot paths (one trigger per captured frame):
+//   - event names are interned once into an EventHandle, triggering never touches a string
+//   - the payload is a plain struct of the channel's type instead of an EventParam map
+//   - listeners of an event are an immutable array that registration replaces (copy, publish, then free the old
+//     one after a grace period), so trigger() is a pointer load plus a loop: no lock, no allocation
+// registration is thread safe against concurrent triggers, but must not happen from inside a listener.
+
+struct EventHandle {
+    uint32_t id = UINT32_MAX;
+
+    bool valid() const {
+        return id != UINT32_MAX;
+    }
+};
+
+// name -> handle, shared by all channels so a name maps to the same handle everywhere
+class EventNameRegistry {
+public:
+    static EventHandle intern(const std::string& eventName) {
+        static std::mutex s_internMutex;
+        static std::unordered_map<std::string, uint32_t> s_handles;
+        std::lock_guard<std::mutex> internLock(s_internMutex);
+        auto findHandle = s_handles.find(eventName);
+        if (findHandle != s_handles.end()) {
+            return EventHandle{findHandle->second};
+        }
+        auto newId = (uint32_t)s_handles.size();
+        s_handles[eventName] = newId;
+        return EventHandle{newId};
+    }
+};
+
+template<typename Payload>
+class EventChannel {
+public:
+    using Listener = std::function<void(const Payload& payload)>;
+    // handles are shared by all channels, so this bounds the names interned in the whole process. a channel only
+    // allocates the blocks of the handles it has listeners for, per display / per source names can come and go.
+    static constexpr uint32_t kEventsPerBlock = 64;
+    static constexpr uint32_t kMaxEventBlocks = 64;
+    static constexpr uint32_t kMaxEvents = kEventsPerBlock * kMaxEventBlocks;
+
+    static EventChannel& getInstance() {
+        static EventChannel channel;
+        return channel;
+    }
+
+    EventHandle handleFor(const std::string& eventName) {
+        auto handle = EventNameRegistry::intern(eventName);
+        if (handle.id >= kMaxEvents) {
+            std::cerr << "event channel: " << kMaxEvents << " event names are interned already, \"" << eventName
+                      << "\" gets no handle, its listeners and triggers are ignored" << std::endl;
+            return {};
+        }
+        return handle;
+    }
+
+    void registerListener(EventHandle handle, Listener listener) {
+        if (!handle.valid()) {
+            return;
+        }
+        std::lock_guard<std::mutex> writeLock(m_writeMutex);
+        auto* oldListeners = slotFor(handle, true)->load(std::memory_order_acquire);
+        auto* newListeners = oldListeners ? new std::vector<Listener>(*oldListeners) : new std::vector<Listener>();
+        newListeners->push_back(std::move(listener));
+        replaceListeners(handle, newListeners);
+    }
+
+    void unregisterListeners(EventHandle handle) {
+        if (!handle.valid()) {
+            return;
+        }
+        std::lock_guard<std::mutex> writeLock(m_writeMutex);
+        if (slotFor(handle, false)) {
+            replaceListeners(handle, nullptr);
+        }
+    }
+
+    void triggerEvent(EventHandle handle, const Payload& payload) {
+        if (!handle.valid()) {
+            return;
+        }
+        TRACE_SCOPE_ARG("triggerEvent", handle.id);
+        uint32_t readerSide = m_epoch.load(std::memory_order_acquire) & 1;
+        m_activeReaders[readerSide].fetch_add(1, std::memory_order_seq_cst);
+        auto* slot = slotFor(handle, false);
+        auto* listeners = slot ? slot->load(std::memory_order_seq_cst) : nullptr;
+        if (listeners) {
+            for (auto& listener : *listeners) {
+                listener(payload);
+            }
+        }
+        m_activeReaders[readerSide].fetch_sub(1, std::memory_order_release);
+    }
+
+    ~EventChannel() {
+        for (auto& block : m_blocks) {
+            auto* slots = block.load(std::memory_order_relaxed);
+            if (!slots) {
+                continue;
+            }
+            for (uint32_t i = 0; i < kEventsPerBlock; i++) {
+                delete slots[i].load(std::memory_order_relaxed);
+            }
+            delete[] slots;
+        }
+    }
+
+private:
+    using ListenerSlot = std::atomic<std::vector<Listener>*>;
+
+    EventChannel() = default;
+
+    // the listener slot of a handle. blocks are allocated by registration (under m_writeMutex) and never move or go
+    // away before the channel, so triggers read them without a lock. null when the block was never needed.
+    ListenerSlot* slotFor(EventHandle handle, bool create) {
+        auto& block = m_blocks[handle.id / kEventsPerBlock];
+        auto* slots = block.load(std::memory_order_acquire);
+        if (!slots && create) {
+            slots = new ListenerSlot[kEventsPerBlock]();
+            block.store(slots, std::memory_order_release);
+        }
+        return slots ? &slots[handle.id % kEventsPerBlock] : nullptr;
+    }
+
+    // publish the new array, then wait until no trigger can still be walking the old one
+    void replaceListeners(EventHandle handle, std::vector<Listener>* newListeners) {
+        auto* oldListeners = slotFor(handle, false)->exchange(newListeners, std::memory_order_seq_cst);
+        if (!oldListeners) {
+            return;
+        }
+        // two flips like userspace rcu: a reader that sampled the epoch just before a flip may still register
+        // on the side we are not waiting for, the second flip drains that side as well
+        for (int flip = 0; flip < 2; flip++) {
+            uint32_t drainSide = m_epoch.fetch_add(1, std::memory_order_seq_cst) & 1;
+            while (m_activeReaders[drainSide].load(std::memory_order_acquire) != 0) {
+                std::this_thread::yield();
+            }
+        }
+        delete oldListeners;
+    }
+
+    std::atomic<ListenerSlot*> m_blocks[kMaxEventBlocks] = {};
+    std::atomic<uint32_t> m_epoch{0};
+    std::atomic<int> m_activeReaders[2] = {};
+    std::mutex m_writeMutex;
+};
+
+#endif //HIDINGIN_EVENTCHANNEL_H
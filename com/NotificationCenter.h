@@ -12,6 +12,9 @@
 #include <thread>
 #include <memory>
 #include <unordered_map>
+#include <optional>
+#include <chrono>
+#include "VersionedState.h"
 
 // Enum for Message Types
 enum MessageType {
@@ -26,29 +29,13 @@ struct SubMsg{
 struct DeviceSubMsg: public SubMsg{
 };
 
-struct ControlSubMsg: public SubMsg{
-    bool couldControlApp;
-    bool showAppContent;
-};
-
-struct WindowSubMsg : public SubMsg{
-    WindowSubMsg(int x, int y, int width, int height, float factor):
-    xPos(x), yPos(y), width(width),height(height), scalingFactor(factor){}
-    int xPos;
-    int yPos;
-    int width;
-    int height;
-    std::tuple<int, int, int, int> visibleRect;
-    std::tuple<int, int> screenSizeInPixels;
-    int capturedAppX;
-    int capturedAppY;
-    int capturedAppWidth;
-    int capturedAppHeight;
-    int capturedWinId;
-    int appPid;
-    float scalingFactor;
-    std::atomic_bool needResizeForRender = false;
-};
+// the Control and Render state used to be persistent messages whose sub message every thread mutated in place,
+// now they are plain structs published through a VersionedState (renderState() / controlState() below). they live
+// with the modules they describe (DesktopCapture/common/CaptureState.h, DesktopCapture/common/DisplayTopology.h),
+// this header only names them.
+struct RenderState;
+struct ControlState;
+struct DisplayTopology;
 
 // Struct for Messages
 struct Message {
@@ -77,11 +64,10 @@ public:
             // Add the message to the regular queue
             messageQueue[msg.msgType].push(msg);
         }
-        cv.notify_one();  // Notify a waiting thread that a new message has arrived
+        cv.notify_all();  // receivers may wait on different types
     }
 
-    // Receive message from the notification center (blocking)
-    // to-do separate different types:
+    // Receive message from the notification center (non blocking)
     std::optional<Message> receiveMessage(MessageType msgType) {
         std::unique_lock<std::mutex> lock(mutex_);
         if(!messageQueue[msgType].empty()){
@@ -93,6 +79,27 @@ public:
         }
     }
 
+    // blocking version, waits up to timeout for a message of that type
+    std::optional<Message> receiveMessage(MessageType msgType, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto& typeQueue = messageQueue[msgType];
+        if (!cv.wait_for(lock, timeout, [&typeQueue] { return !typeQueue.empty(); })) {
+            return std::nullopt;
+        }
+        Message msg = typeQueue.front();
+        typeQueue.pop();
+        return msg;
+    }
+
+    // wait-free snapshots for the per frame readers, poll version() to skip work when nothing changed. defined next
+    // to their structs, the callers include those.
+    VersionedState<RenderState>& renderState();
+
+    VersionedState<ControlState>& controlState();
+
+    // the displays, republished by the platform when one is added, removed, moved or rescaled
+    VersionedState<DisplayTopology>& displayTopology();
+
     // Retrieve a persistent message by type
     bool getPersistentMessage(MessageType msgType, Message& msg) {
         std::lock_guard<std::mutex> lock(mutex_);
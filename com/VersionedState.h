@@ -0,0 +1,114 @@
+#ifndef HIDINGIN_VERSIONEDSTATE_H
+#define HIDINGIN_VERSIONEDSTATE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+// seqlock around a plain struct. readers never block writers and never take a lock: they copy the words and retry
+// if a writer got in between. writers are serialized on the sequence itself (odd = write in progress).
+// the version only moves when something was published, so a consumer can remember it and skip work while it
+// stays the same. the payload lives in atomic words so the racing copy is not a data race.
+template<typename T>
+class VersionedState {
+    static_assert(std::is_trivially_copyable_v<T>, "VersionedState needs a trivially copyable struct");
+
+public:
+    VersionedState() {
+        publishWords(T{});
+    }
+
+    explicit VersionedState(const T& initial) {
+        publishWords(initial);
+    }
+
+    VersionedState(const VersionedState&) = delete;
+    VersionedState& operator=(const VersionedState&) = delete;
+
+    T load() const {
+        uint64_t version;
+        return load(version);
+    }
+
+    // snapshot plus the version it belongs to
+    T load(uint64_t& version) const {
+        uint64_t words[kWordCount];
+        for (;;) {
+            uint64_t seqBefore = m_sequence.load(std::memory_order_acquire);
+            if (seqBefore & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            for (size_t i = 0; i < kWordCount; i++) {
+                words[i] = m_words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m_sequence.load(std::memory_order_relaxed) == seqBefore) {
+                version = seqBefore >> 1;
+                break;
+            }
+        }
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+    // bumps by one for every store / update
+    uint64_t version() const {
+        return m_sequence.load(std::memory_order_acquire) >> 1;
+    }
+
+    void store(const T& value) {
+        uint64_t seq = beginWrite();
+        publishWords(value);
+        m_sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    // read-modify-write as one publish, returns what was published
+    template<typename F>
+    T update(F&& modify) {
+        uint64_t seq = beginWrite();
+        uint64_t words[kWordCount];
+        for (size_t i = 0; i < kWordCount; i++) {
+            words[i] = m_words[i].load(std::memory_order_relaxed);
+        }
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        modify(value);
+        publishWords(value);
+        m_sequence.store(seq + 2, std::memory_order_release);
+        return value;
+    }
+
+private:
+    static constexpr size_t kWordCount = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    uint64_t beginWrite() {
+        uint64_t seq = m_sequence.load(std::memory_order_relaxed);
+        for (;;) {
+            if (!(seq & 1) &&
+                m_sequence.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                break;
+            }
+            std::this_thread::yield();
+            seq = m_sequence.load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        return seq;
+    }
+
+    void publishWords(const T& value) {
+        uint64_t words[kWordCount] = {};
+        std::memcpy(words, &value, sizeof(T));
+        for (size_t i = 0; i < kWordCount; i++) {
+            m_words[i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+
+    std::atomic<uint64_t> m_sequence{0};
+    std::atomic<uint64_t> m_words[kWordCount];
+};
+
+#endif //HIDINGIN_VERSIONEDSTATE_H
@@ -11,10 +11,12 @@
 #include <QProcessEnvironment>
 #include <utility>
 #include "com/NotificationCenter.h"
+#include "DesktopCapture/common/CaptureState.h"
 #include "Handler/AppGeneralEventHandler.h"
 #include "DesktopCapture/CompositeCapture.h"
 #include "Handler/AppWindowListener.h"
 #include "Handler/GlobalEventHandler.h"
+#include "utils/Tracer.h"
 
 // Function to make all windows ignore mouse input
 void ignoreMouseInputForAllWindows() {
@@ -54,31 +56,30 @@ int main(int argc, char *argv[]) {
     // Set the environment variable
     qputenv("QT_QUICK_CONTROLS_IGNORE_CUSTOMIZATION_WARNINGS", "1");
 
-    Message msg;
-    msg.msgType = MessageType::Render;
-    msg.whatHappen = "";
-    msg.subMsg = std::make_shared<WindowSubMsg>(250,250, 1200, 800, getScalingFactor());
-    auto windowSubMsg = (WindowSubMsg*) msg.subMsg.get();
-    windowSubMsg->screenSizeInPixels = getScreenSizeInPixels();
-    NotificationCenter::getInstance().pushMessage(msg, true);
-
-    Message msg2;
-    msg2.msgType = MessageType::Control;
-    msg2.whatHappen = "";
-    msg2.subMsg = std::make_shared<ControlSubMsg>();
-    auto controlSubMsg = (ControlSubMsg*) msg2.subMsg.get();
-    controlSubMsg->couldControlApp = true;
-    controlSubMsg->showAppContent = true;
-    NotificationCenter::getInstance().pushMessage(msg2, true);
+    RenderState initRenderState;
+    initRenderState.xPos = 250;
+    initRenderState.yPos = 250;
+    initRenderState.width = 1200;
+    initRenderState.height = 800;
+    NotificationCenter::getInstance().renderState().store(initRenderState);
+    // the displays, the render state takes the scale and screen size of the one the window is on
+    startDisplayTopologyObserving();
+
+    ControlState initControlState;
+    initControlState.couldControlApp = true;
+    initControlState.showAppContent = true;
+    NotificationCenter::getInstance().controlState().store(initControlState);
+
+    // the window lookups read this list, keep it fresh off the main thread
+    startWindowRegistryPolling(0.5);
 
     GlobalEventHandler globalEventHandler;
     globalEventHandler.startListening();
     globalEventHandler.setCtrlColonPressedCB([](int keyCode) {
-        Message msg;
-        NotificationCenter::getInstance().getPersistentMessage(MessageType::Control, msg);
-        auto controlMsg = (ControlSubMsg *) msg.subMsg.get();
-        controlMsg->couldControlApp = !controlMsg->couldControlApp;
-        if (controlMsg->couldControlApp) {
+        auto controlState = NotificationCenter::getInstance().controlState().update([](ControlState& state) {
+            state.couldControlApp = !state.couldControlApp;
+        });
+        if (controlState.couldControlApp) {
             std::cerr << "start controlling app" << std::endl;
         } else {
             std::cerr << "stop controlling app" << std::endl;
@@ -86,17 +87,23 @@ int main(int argc, char *argv[]) {
     });
 
     globalEventHandler.setCtrlDoubleQuotePressedCB([](int keyCode) {
-        Message msg;
-        NotificationCenter::getInstance().getPersistentMessage(MessageType::Control, msg);
-        auto controlMsg = (ControlSubMsg *) msg.subMsg.get();
-        controlMsg->showAppContent = !controlMsg->showAppContent;
-        if (controlMsg->showAppContent) {
+        auto controlState = NotificationCenter::getInstance().controlState().update([](ControlState& state) {
+            state.showAppContent = !state.showAppContent;
+        });
+        if (controlState.showAppContent) {
             std::cerr << "start show app" << std::endl;
         } else {
             std::cerr << "stop show app" << std::endl;
         }
     });
 
+    // the frame trace is always recorded, cmd + backslash or kill -USR1 writes the last few seconds of it to $TMPDIR
+    Tracer::getInstance().setCurrentThreadName("main");
+    Tracer::getInstance().installDumpSignal(SIGUSR1);
+    globalEventHandler.setCtrlBackslashPressedCB([](int keyCode) {
+        Tracer::getInstance().dumpChromeTrace();
+    });
+
 #ifdef __APPLE__
     //MacOSCaptureSCKit appCapture;
     CompositeCaptureArgs compositeCaptureArgs;
@@ -148,36 +155,38 @@ int main(int argc, char *argv[]) {
     if (window) {
         // Connect to the widthChanged signal
         QObject::connect(window, &QQuickWindow::widthChanged, [](int newWidth) {
-            Message msg;
-            NotificationCenter::getInstance().getPersistentMessage(MessageType::Render, msg);
-            auto windowInfo = (WindowSubMsg*)msg.subMsg.get();
-            windowInfo->width = newWidth;
-            windowInfo->needResizeForRender = true;
+            auto topology = NotificationCenter::getInstance().displayTopology().load();
+            NotificationCenter::getInstance().renderState().update([=](RenderState& state) {
+                state.width = newWidth;
+                followWindowDisplay(state, topology);
+            });
         });
 
         // Connect to the heightChanged signal
         QObject::connect(window, &QQuickWindow::heightChanged, [](int newHeight) {
-            Message msg;
-            NotificationCenter::getInstance().getPersistentMessage(MessageType::Render, msg);
-            auto windowInfo = (WindowSubMsg*)msg.subMsg.get();
-            windowInfo->height = newHeight;
-            windowInfo->needResizeForRender = true;
+            auto topology = NotificationCenter::getInstance().displayTopology().load();
+            NotificationCenter::getInstance().renderState().update([=](RenderState& state) {
+                state.height = newHeight;
+                followWindowDisplay(state, topology);
+            });
         });
 
         // Connect to the xChanged signal (window position x)
         QObject::connect(window, &QQuickWindow::xChanged, [](int newX) {
-            Message msg;
-            NotificationCenter::getInstance().getPersistentMessage(MessageType::Render, msg);
-            auto windowInfo = (WindowSubMsg*)msg.subMsg.get();
-            windowInfo->xPos = newX;
+            auto topology = NotificationCenter::getInstance().displayTopology().load();
+            NotificationCenter::getInstance().renderState().update([=](RenderState& state) {
+                state.xPos = newX;
+                followWindowDisplay(state, topology);
+            });
         });
 
         // Connect to the yChanged signal (window position y)
         QObject::connect(window, &QQuickWindow::yChanged, [](int newY) {
-            Message msg;
-            NotificationCenter::getInstance().getPersistentMessage(MessageType::Render, msg);
-            auto windowInfo = (WindowSubMsg*)msg.subMsg.get();
-            windowInfo->yPos = newY;
+            auto topology = NotificationCenter::getInstance().displayTopology().load();
+            NotificationCenter::getInstance().renderState().update([=](RenderState& state) {
+                state.yPos = newY;
+                followWindowDisplay(state, topology);
+            });
         });
     }
 
@@ -207,13 +216,15 @@ int main(int argc, char *argv[]) {
             auto& appModel = windowModel.getWindowModelByAppName(appName.toStdString());
             auto appWindowId = (int)std::stoi(winId.toStdString());
             auto appRect = resizeAndMoveOverlayWindow(nativeWindow, appWindowId);
-            auto windowInfo = (WindowSubMsg*)msg.subMsg.get();
+            auto appPidToSet = std::stoi(appModel.pid().toStdString());
             // update info:
-            windowInfo->xPos = std::get<0>(appRect);
-            windowInfo->yPos = std::get<1>(appRect);
-            windowInfo->width = std::get<2>(appRect);
-            windowInfo->height = std::get<3>(appRect);
-            windowInfo->appPid = std::stoi(appModel.pid().toStdString());
+            NotificationCenter::getInstance().renderState().update([&](RenderState& state) {
+                state.xPos = std::get<0>(appRect);
+                state.yPos = std::get<1>(appRect);
+                state.width = std::get<2>(appRect);
+                state.height = std::get<3>(appRect);
+                state.appPid = appPidToSet;
+            });
             ignoreMouseInputForAllWindows();
             MetalPipeline::getGlobalInstance().markRenderTargetDirty();
 
@@ -232,37 +243,38 @@ int main(int argc, char *argv[]) {
             captureAppArgs.captureAppName = appName.toStdString();
             compositeCapture.addCaptureByApplicationName(captureAppArgs);
 
+            // the captures filled in the captured window info:
+            auto windowInfo = NotificationCenter::getInstance().renderState().load();
 #ifdef __APPLE__
-            stickToApp(windowInfo->capturedWinId, windowInfo->appPid, nativeWindow);
+            stickToApp(windowInfo.capturedWinId, windowInfo.appPid, nativeWindow);
 #endif
 
-            appWinListener = std::make_shared<AppWindowListener>(windowInfo->appPid, appWindowId);
+            appWinListener = std::make_shared<AppWindowListener>(windowInfo.appPid, appWindowId);
             // Set the callbacks
             appWinListener->setOnWindowMovedCallback([nativeWindow](float x, float y) {
                 //std::cout << "Window moved to: (" << x << ", " << y << ")" << std::endl;
                 QMetaObject::invokeMethod(QGuiApplication::instance(), [nativeWindow, x, y]() {
                     // Execute some UI-related code here
-                    Message msg;
-                    NotificationCenter::getInstance().getPersistentMessage(MessageType::Render, msg);
-                    auto capWinInfo = (WindowSubMsg*)msg.subMsg.get();
-
-                    // Calculate the real cursor position based on scaling
-                    int realX = x * capWinInfo->scalingFactor;
-                    int realY = y * capWinInfo->scalingFactor;
-
-                    capWinInfo->visibleRect = getVisibleRect(realX, realY,
-                                                      capWinInfo->width, capWinInfo->height,
-                                                      std::get<0>(capWinInfo->screenSizeInPixels), std::get<1>(capWinInfo->screenSizeInPixels));
+                    auto capWinInfo = NotificationCenter::getInstance().renderState().update([=](RenderState& state) {
+                        // Calculate the real cursor position based on scaling
+                        int realX = x * state.scalingFactor;
+                        int realY = y * state.scalingFactor;
+                        std::tie(state.visibleRectX, state.visibleRectY, state.visibleRectWidth, state.visibleRectHeight) =
+                                getVisibleRect(realX, realY, state.width, state.height,
+                                               state.screenWidthInPixels, state.screenHeightInPixels);
+                    });
+                    int realX = x * capWinInfo.scalingFactor;
+                    int realY = y * capWinInfo.scalingFactor;
 
                     // Check if the cursor is within the window bounds
                     if (isMouseInWindowWithID(nativeWindow)) {
                         // Call wakeUpAppByPID only if cursor is within the window bounds
-                        wakeUpAppByPID(capWinInfo->appPid);
+                        wakeUpAppByPID(capWinInfo.appPid);
                     }
 
                     // If window position has changed, stick to the app
-                    if (capWinInfo->capturedAppX != realX || capWinInfo->capturedAppY != realY) {
-                        stickToApp(capWinInfo->capturedWinId, capWinInfo->appPid, nativeWindow);
+                    if (capWinInfo.capturedAppX != realX || capWinInfo.capturedAppY != realY) {
+                        stickToApp(capWinInfo.capturedWinId, capWinInfo.appPid, nativeWindow);
                     }
                 }, Qt::QueuedConnection);
             });
@@ -270,24 +282,23 @@ int main(int argc, char *argv[]) {
             appWinListener->setOnWindowResizedCallback([nativeWindow](float width, float height) {
                 //std::cout << "Window resized to: (" << width << ", " << height << ")" << std::endl;
                 QMetaObject::invokeMethod(QGuiApplication::instance(), [nativeWindow, width, height]() {
-                    Message msg;
-                    NotificationCenter::getInstance().getPersistentMessage(MessageType::Render, msg);
-                    auto capWinInfo = (WindowSubMsg*)msg.subMsg.get();
-                    int realWidth = width * capWinInfo->scalingFactor;
-                    int realHeight = height * capWinInfo->scalingFactor;
-
-                    capWinInfo->visibleRect = getVisibleRect(capWinInfo->xPos * capWinInfo->scalingFactor, capWinInfo->yPos * capWinInfo->scalingFactor,
-                                                             capWinInfo->width* capWinInfo->scalingFactor, capWinInfo->height * capWinInfo->scalingFactor,
-                                                             std::get<0>(capWinInfo->screenSizeInPixels), std::get<1>(capWinInfo->screenSizeInPixels));
+                    auto capWinInfo = NotificationCenter::getInstance().renderState().update([](RenderState& state) {
+                        std::tie(state.visibleRectX, state.visibleRectY, state.visibleRectWidth, state.visibleRectHeight) =
+                                getVisibleRect(state.xPos * state.scalingFactor, state.yPos * state.scalingFactor,
+                                               state.width * state.scalingFactor, state.height * state.scalingFactor,
+                                               state.screenWidthInPixels, state.screenHeightInPixels);
+                    });
+                    int realWidth = width * capWinInfo.scalingFactor;
+                    int realHeight = height * capWinInfo.scalingFactor;
 
                     // Check if the cursor is within the window bounds
                     if (isMouseInWindowWithID(nativeWindow)) {
                         // Call wakeUpAppByPID only if cursor is within the window bounds
-                        wakeUpAppByPID(capWinInfo->appPid);
+                        wakeUpAppByPID(capWinInfo.appPid);
                     }
 
-                    if(capWinInfo->capturedAppWidth != realWidth || capWinInfo->capturedAppHeight != realHeight){
-                        stickToApp(capWinInfo->capturedWinId, capWinInfo->appPid, nativeWindow);
+                    if(capWinInfo.capturedAppWidth != realWidth || capWinInfo.capturedAppHeight != realHeight){
+                        stickToApp(capWinInfo.capturedWinId, capWinInfo.appPid, nativeWindow);
                     }
                 }, Qt::QueuedConnection);
 
@@ -5,7 +5,7 @@
 #ifndef HIDINGIN_MACUTILS_H
 #define HIDINGIN_MACUTILS_H
 #include <tuple>
-extern float getScalingFactor();
+#include <chrono>
 std::tuple<int, int, int, int, int> getWindowSizesForPID(pid_t targetPID);
 // Function declaration
 void stickToApp(int targetAppWinId, int targetAppPID, void *overlayWindow);
@@ -17,8 +17,33 @@ bool isAppInForeground(int pid);
 void wakeUpAppByPID(int pid);
 bool isMouseInWindowWithID(void *viewPtr);
 void disableShadow(void* winId);
-std::tuple<int, int>getScreenSizeInPixels();
+struct DisplayTopology;
+// the screens as NSScreen has them, frames in the top left global points of the window list
+DisplayTopology getDisplayTopology();
+// publishes getDisplayTopology() into NotificationCenter::displayTopology and moves the render state over to its
+// display, again whenever a screen is added, removed, moved or rescaled. main thread.
+void startDisplayTopologyObserving();
 std::tuple<int, int, int, int> getVisibleRect(
         int winLeft, int winTop, int winWidth, int winHeight,
         int screenWidth, int screenHeight);
+
+// what the capture rate governor throttles on, polled (IOPS / NSProcessInfo) so call it about once a second
+struct MacPowerStatus {
+    bool onBattery = false;
+    bool lowPowerMode = false;
+    bool thermalPressure = false; // serious or critical thermal state
+    bool displayAsleep = false;   // screens or the whole system asleep
+};
+MacPowerStatus getPowerStatus();
+// since the last keyboard / mouse event of the session, in any app
+double getSecondsSinceLastInput();
+
+// the on screen window list behind the window lookups above (WindowRegistry). one CGWindowListCopyWindowInfo feeds
+// every lookup of a tick: the poller refreshes it off the main thread, a lookup only enumerates itself when the
+// last snapshot is older than maxAge.
+class WindowRegistry;
+bool refreshWindowRegistry();
+WindowRegistry& getWindowRegistry(std::chrono::milliseconds maxAge = std::chrono::milliseconds(1000));
+// runs at the shortest interval asked for so far
+void startWindowRegistryPolling(double intervalSeconds);
 #endif //HIDINGIN_MACUTILS_H
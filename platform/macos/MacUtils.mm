@@ -8,79 +8,62 @@
 #import "MacUtils.h"
 #include <iostream>
 #include "../com/NotificationCenter.h"
+#include "../DesktopCapture/common/CaptureState.h"
+#include "../utils/WindowRegistry.h"
 #include <IOKit/IOMessage.h>
 #include <IOKit/IOCFPlugIn.h>
 #include <IOKit/IOKitLib.h>
 #include <IOKit/pwr_mgt/IOPMLibDefs.h>
 #include <IOKit/pwr_mgt/IOPMLib.h>
+#include <IOKit/ps/IOPowerSources.h>
+#include <IOKit/ps/IOPSKeys.h>
 #include <CoreFoundation/CoreFoundation.h>
+#include <atomic>
 #include <functional>
 #include <iostream>
-float getScalingFactor() {
-    NSScreen *mainScreen = [NSScreen mainScreen];
-    // Get the screen's backing scale factor (retina or non-retina)
-    CGFloat scaleFactor = [mainScreen backingScaleFactor];
-
-    return scaleFactor;
-}
-
+#include <mutex>
 // Function to find and print the size of windows based on a given PID
 std::tuple<int, int, int,int, int> getWindowSizesForPID(pid_t targetPID) {
-    // Get a list of all windows on the screen
-    CFArrayRef windowList = CGWindowListCopyWindowInfo(kCGWindowListOptionOnScreenOnly, kCGNullWindowID);
-
-    // If the list is not null, we proceed
-    if (windowList != NULL) {
-        // Iterate through the list of windows
-        for (int i = 0; i < CFArrayGetCount(windowList); i++) {
-            // Get the dictionary for each window
-            auto windowInfo = static_cast<CFDictionaryRef>(CFArrayGetValueAtIndex(windowList, i));
-
-            // Get the window owner PID
-            auto ownerPIDRef = static_cast<CFNumberRef>(CFDictionaryGetValue(windowInfo, kCGWindowOwnerPID));
-            pid_t ownerPID;
-            CFNumberGetValue(ownerPIDRef, kCFNumberIntType, &ownerPID);
-
-            // Check if this window belongs to the target PID
-            if (ownerPID == targetPID) {
-                // Get the window layer
-                auto layerRef = static_cast<CFNumberRef>(CFDictionaryGetValue(windowInfo, kCGWindowLayer));
-                auto windowIDRef = static_cast<CFNumberRef>(CFDictionaryGetValue(windowInfo, kCGWindowNumber));
-                int layer = 0;
-                CFNumberGetValue(layerRef, kCFNumberIntType, &layer);
-                CGWindowID windowID;
-                CFNumberGetValue(windowIDRef, kCFNumberIntType, &windowID);
-                // Get the window bounds (size and position)
-                auto windowBounds = static_cast<CFDictionaryRef>(CFDictionaryGetValue(windowInfo,
-                                                                                                 kCGWindowBounds));
-                if (windowBounds) {
-                    // Convert the bounds dictionary to a CGRect
-                    CGRect bounds;
-                    CGRectMakeWithDictionaryRepresentation(windowBounds, &bounds);
-                    // Check if it is a small window (possibly a status bar icon)
-                    if (bounds.size.width < 100 && bounds.size.height < 100) {
-                        NSLog(@"Skipping small window (likely a status bar icon) with size: (%f, %f), Layer: %d", bounds.size.width, bounds.size.height, layer);
-                        continue;
-                    }
-
-                    // Output the size and position of the window
-                    NSLog(@"Window for PID %d - Position: (%f, %f), Size: (%f, %f)",
-                          targetPID,
-                          bounds.origin.x, bounds.origin.y,
-                          bounds.size.width, bounds.size.height);
-                    return {bounds.origin.x, bounds.origin.y,bounds.size.width, bounds.size.height, windowID};
-                }
-            }
+    // the app's windows front to back, from the shared window list
+    for (auto& window : getWindowRegistry().getWindowsForPid(targetPID)) {
+        // Check if it is a small window (possibly a status bar icon)
+        if (window.width < 100 && window.height < 100) {
+            NSLog(@"Skipping small window (likely a status bar icon) with size: (%d, %d), Layer: %d", window.width, window.height, window.layer);
+            continue;
         }
 
-        // Release the window list
-        CFRelease(windowList);
-    } else {
-        NSLog(@"No windows found on screen.");
+        // Output the size and position of the window
+        NSLog(@"Window for PID %d - Position: (%d, %d), Size: (%d, %d)",
+              targetPID, window.x, window.y, window.width, window.height);
+        return {window.x, window.y, window.width, window.height, window.windowId};
     }
+    NSLog(@"No windows found on screen for PID %d.", targetPID);
     return {};
 }
 
+// bounds of one window in points: the shared window list has it while it is on screen, otherwise ask for that
+// window alone
+static bool getWindowBounds(int windowID, CGRect& bounds) {
+    if (auto window = getWindowRegistry().findWindow(windowID)) {
+        bounds = CGRectMake(window->x, window->y, window->width, window->height);
+        return true;
+    }
+    CFArrayRef windowList = CGWindowListCopyWindowInfo(kCGWindowListOptionIncludingWindow, windowID);
+    if (windowList == nullptr || CFArrayGetCount(windowList) == 0) {
+        std::cerr << "No window found with the given CGWindowID: " << windowID << std::endl;
+        if (windowList) CFRelease(windowList);
+        return false;
+    }
+    NSDictionary *windowInfo = (NSDictionary *)CFArrayGetValueAtIndex(windowList, 0);
+    NSDictionary *boundsDict = windowInfo[(id)kCGWindowBounds];
+    bool found = boundsDict && CGRectMakeWithDictionaryRepresentation((CFDictionaryRef)boundsDict, &bounds);
+    if (!found) {
+        std::cerr << "Failed to extract window bounds." << std::endl;
+    }
+    CFRelease(windowList);
+    return found;
+}
+
 NSRunningApplication* findAppPidByPid(pid_t pid) {
     NSArray *runningApps = [[NSWorkspace sharedWorkspace] runningApplications];
 
@@ -103,51 +86,35 @@ void stickToApp(int targetAppWinId, int targetAppPID, void *overlayWindow) {
     }
 
     // Step 1: Find the position and size of the window with the given CGWindowID
-    CFArrayRef windowList = CGWindowListCopyWindowInfo(kCGWindowListOptionIncludingWindow, targetAppWinId);
-    if (windowList == nullptr || CFArrayGetCount(windowList) == 0) {
-        std::cerr << "No window found with the given CGWindowID." << std::endl;
-        if (windowList) CFRelease(windowList);
-        return;
-    }
-
-    // Get window info dictionary
-    NSDictionary *windowInfo = (NSDictionary *)CFArrayGetValueAtIndex(windowList, 0);
-    if (!windowInfo) {
-        std::cerr << "Failed to retrieve window information." << std::endl;
-        CFRelease(windowList);
-        return;
-    }
-
-    // Extract window position and size
     CGRect windowRect;
-    NSDictionary *boundsDict = windowInfo[(id)kCGWindowBounds];
-    if (!boundsDict || !CGRectMakeWithDictionaryRepresentation((CFDictionaryRef)boundsDict, &windowRect)) {
-        std::cerr << "Failed to extract window bounds." << std::endl;
-        CFRelease(windowList);
+    if (!getWindowBounds(targetAppWinId, windowRect)) {
         return;
     }
 
-    // Release the window list as we've extracted the needed information
-    CFRelease(windowList);
-
     // Step 2: Update the overlay window's frame to match the target window
     NSRect frame = NSMakeRect(windowRect.origin.x, windowRect.origin.y, windowRect.size.width, windowRect.size.height);
 
-    // Convert to screen coordinates if needed (depending on the screen origin)
-    NSScreen *mainScreen = [NSScreen mainScreen];
-    if (mainScreen) {
-        CGFloat screenHeight = [mainScreen frame].size.height;
+    // Convert to screen coordinates: cocoa flips y around the primary screen, the one with the menu bar (not
+    // mainScreen, that is the one with the key window)
+    NSScreen *primaryScreen = [NSScreen screens].firstObject;
+    if (primaryScreen) {
+        CGFloat screenHeight = [primaryScreen frame].size.height;
         frame.origin.y = screenHeight - windowRect.origin.y - windowRect.size.height;
     }
 
-    // update capture app info:
-    Message msg;
-    NotificationCenter::getInstance().getPersistentMessage(MessageType::Render, msg);
-    auto capWinInfo = (WindowSubMsg*)msg.subMsg.get();
-    capWinInfo->capturedAppX = windowRect.origin.x * capWinInfo->scalingFactor;
-    capWinInfo->capturedAppY = windowRect.origin.y* capWinInfo->scalingFactor;
-    capWinInfo->capturedAppWidth = windowRect.size.width* capWinInfo->scalingFactor;
-    capWinInfo->capturedAppHeight = windowRect.size.height* capWinInfo->scalingFactor;
+    // update capture app info, at the scale of the display the overlay lands on:
+    auto topology = NotificationCenter::getInstance().displayTopology().load();
+    NotificationCenter::getInstance().renderState().update([&](RenderState& capWinInfo) {
+        capWinInfo.xPos = windowRect.origin.x;
+        capWinInfo.yPos = windowRect.origin.y;
+        capWinInfo.width = windowRect.size.width;
+        capWinInfo.height = windowRect.size.height;
+        followWindowDisplay(capWinInfo, topology);
+        capWinInfo.capturedAppX = windowRect.origin.x * capWinInfo.scalingFactor;
+        capWinInfo.capturedAppY = windowRect.origin.y * capWinInfo.scalingFactor;
+        capWinInfo.capturedAppWidth = windowRect.size.width * capWinInfo.scalingFactor;
+        capWinInfo.capturedAppHeight = windowRect.size.height * capWinInfo.scalingFactor;
+    });
 
     [nsWindow setFrame:frame display:YES];
 
@@ -200,29 +167,20 @@ std::vector<int> getWindowIDsForAppByName(const std::string &appName) {
     // Get the process ID of the target application
     pid_t targetPID = [targetApp processIdentifier];
 
-    // Fetch information for all windows
-    CFArrayRef windowList = CGWindowListCopyWindowInfo(kCGWindowListOptionOnScreenOnly, kCGNullWindowID);
-
-    // Iterate over the windows
-    for (NSDictionary *windowInfo in (NSArray *)windowList) {
-        // Get the window's owner process ID
-        pid_t windowPID = [windowInfo[(NSString *)kCGWindowOwnerPID] intValue];
-
-        // Check if the window belongs to the target app
-        if (windowPID == targetPID) {
-            // Get the window ID
-            int windowID = [windowInfo[(NSString *)kCGWindowNumber] intValue];
-            windowIDs.push_back(windowID);
-        }
+    // the app's windows from the shared window list
+    for (auto& window : getWindowRegistry().getWindowsForPid(targetPID)) {
+        windowIDs.push_back(window.windowId);
     }
 
-    // Release the window list
-    CFRelease(windowList);
-
     return windowIDs;
 }
 
 bool getWindowGeometry(int windowID, std::tuple<int, int, int, int>& rectGeometry) {
+    if (auto window = getWindowRegistry().findWindow(windowID)) {
+        rectGeometry = std::make_tuple(window->x, window->y, window->width, window->height);
+        return true;
+    }
+
     // Get the list of windows with the specific window ID
     CFArrayRef windowList = CGWindowListCreateDescriptionFromArray(CFArrayCreate(nullptr, (const void**)&windowID, 1, nullptr));
 
@@ -277,40 +235,18 @@ std::tuple<int, int, int, int> resizeAndMoveOverlayWindow(void* nativeWindowHand
     auto nsWindow = [nsView window];
 
     // Step 1: Find the position and size of the window with the given CGWindowID
-    CFArrayRef windowList = CGWindowListCopyWindowInfo(kCGWindowListOptionIncludingWindow, targetAppWinId);
-    if (windowList == nullptr || CFArrayGetCount(windowList) == 0) {
-        std::cerr << "No window found with the given CGWindowID: " << targetAppWinId << std::endl;
-        if (windowList) CFRelease(windowList);
-        return {};
-    }
-
-    // Get window info dictionary
-    NSDictionary *windowInfo = (NSDictionary *)CFArrayGetValueAtIndex(windowList, 0);
-    if (!windowInfo) {
-        std::cerr << "Failed to retrieve window information." << std::endl;
-        CFRelease(windowList);
-        return {};
-    }
-
-    // Extract window position and size
     CGRect windowRect;
-    NSDictionary *boundsDict = windowInfo[(id)kCGWindowBounds];
-    if (!boundsDict || !CGRectMakeWithDictionaryRepresentation((CFDictionaryRef)boundsDict, &windowRect)) {
-        std::cerr << "Failed to extract window bounds." << std::endl;
-        CFRelease(windowList);
+    if (!getWindowBounds(targetAppWinId, windowRect)) {
         return {};
     }
 
-    // Release the window list as we've extracted the needed information
-    CFRelease(windowList);
-
     // Step 2: Create an NSRect from the target window's CGRect
     NSRect frame = NSMakeRect(windowRect.origin.x, windowRect.origin.y, windowRect.size.width, windowRect.size.height);
 
-    // Step 3: Convert the coordinates to screen coordinates if needed
-    NSScreen *mainScreen = [NSScreen mainScreen];
-    if (mainScreen) {
-        CGFloat screenHeight = [mainScreen frame].size.height;
+    // Step 3: Convert the coordinates to screen coordinates, flipped around the primary screen
+    NSScreen *primaryScreen = [NSScreen screens].firstObject;
+    if (primaryScreen) {
+        CGFloat screenHeight = [primaryScreen frame].size.height;
         // Adjust the y-coordinate to account for macOS's flipped screen origin
         frame.origin.y = screenHeight - windowRect.origin.y - windowRect.size.height;
     }
@@ -334,10 +270,8 @@ bool isAppInForeground(int pid) {
 }
 
 void wakeUpAppByPID(int pid) {
-    Message msg;
-    NotificationCenter::getInstance().getPersistentMessage(MessageType::Control, msg);
-    auto controlMsg = (ControlSubMsg*)msg.subMsg.get();
-    if(!isAppInForeground(pid) && controlMsg->couldControlApp){
+    auto controlState = NotificationCenter::getInstance().controlState().load();
+    if(!isAppInForeground(pid) && controlState.couldControlApp){
         auto nsApp = findAppPidByPid(pid);
         [nsApp activateWithOptions:NSApplicationActivateAllWindows | NSApplicationActivateIgnoringOtherApps];
     }
@@ -387,48 +321,154 @@ getVisibleRect(int winLeft, int winTop, int winWidth, int winHeight, int screenW
     return std::make_tuple(visibleLeft, visibleTop, visibleWidth, visibleHeight);
 }
 
-std::tuple<int, int> getScreenSizeInPixels() {
-    NSScreen *mainScreen = [NSScreen mainScreen];
-    NSRect screenRect = [mainScreen frame];
-    CGFloat scale = [mainScreen backingScaleFactor];
+DisplayTopology getDisplayTopology() {
+    DisplayTopology topology;
+    @autoreleasepool {
+        for (NSScreen *screen in [NSScreen screens]) {
+            DisplayInfo display;
+            display.displayId = [screen.deviceDescription[@"NSScreenNumber"] unsignedIntValue];
+            // CGDisplayBounds is already in the window list's top left global points
+            CGRect bounds = CGDisplayBounds(display.displayId);
+            display.frame = {(int)bounds.origin.x, (int)bounds.origin.y, (int)bounds.size.width, (int)bounds.size.height};
+            display.scale = (float)[screen backingScaleFactor];
+            if (!topology.addDisplay(display)) {
+                NSLog(@"Skipping display %u, only %d displays are tracked", display.displayId, kMaxDisplays);
+            }
+        }
+    }
+    return topology;
+}
 
-    // Calculate the width and height in pixels
-    CGFloat screenWidthInPixels = screenRect.size.width * scale;
-    CGFloat screenHeightInPixels = screenRect.size.height * scale;
+static void publishDisplayTopology() {
+    auto topology = getDisplayTopology();
+    auto& notificationCenter = NotificationCenter::getInstance();
+    if (topology == notificationCenter.displayTopology().load()) {
+        return;
+    }
+    notificationCenter.displayTopology().store(topology);
+    notificationCenter.renderState().update([&](RenderState& state) {
+        followWindowDisplay(state, topology);
+    });
+}
 
-    // Return as an NSArray of NSNumbers
-    return {screenWidthInPixels, screenHeightInPixels};
+void startDisplayTopologyObserving() {
+    publishDisplayTopology();
+    static dispatch_once_t observeOnce;
+    dispatch_once(&observeOnce, ^{
+        [[NSNotificationCenter defaultCenter] addObserverForName:NSApplicationDidChangeScreenParametersNotification
+                                                          object:nil
+                                                           queue:[NSOperationQueue mainQueue]
+                                                      usingBlock:^(NSNotification *notification){
+            publishDisplayTopology();
+        }];
+    });
 }
 
 
-static io_connect_t rootPort;  // Global root port for power notifications
+// screens / system asleep, from the NSWorkspace notifications below
+static std::atomic_bool s_displayAsleep = false;
+
+static void observeDisplaySleep() {
+    static dispatch_once_t observeOnce;
+    dispatch_once(&observeOnce, ^{
+        auto notificationCenter = [[NSWorkspace sharedWorkspace] notificationCenter];
+        void (^markAsleep)(NSNotification*) = ^(NSNotification *notification){
+            s_displayAsleep = true;
+        };
+        void (^markAwake)(NSNotification*) = ^(NSNotification *notification){
+            s_displayAsleep = false;
+        };
+        [notificationCenter addObserverForName:NSWorkspaceScreensDidSleepNotification object:nil queue:nil usingBlock:markAsleep];
+        [notificationCenter addObserverForName:NSWorkspaceWillSleepNotification object:nil queue:nil usingBlock:markAsleep];
+        [notificationCenter addObserverForName:NSWorkspaceScreensDidWakeNotification object:nil queue:nil usingBlock:markAwake];
+        [notificationCenter addObserverForName:NSWorkspaceDidWakeNotification object:nil queue:nil usingBlock:markAwake];
+    });
+}
 
-void displaySleepCallback(void *refCon, io_service_t service, natural_t messageType, void *messageArgument) {
-    // Cast the user data (refCon) to a lambda function pointer
-    auto callback = static_cast<std::function<void(bool)>*>(refCon);
+MacPowerStatus getPowerStatus() {
+    observeDisplaySleep();
+    MacPowerStatus powerStatus;
+    CFTypeRef powerSourcesInfo = IOPSCopyPowerSourcesInfo();
+    if(powerSourcesInfo){
+        CFStringRef providingSource = IOPSGetProvidingPowerSourceType(powerSourcesInfo);
+        powerStatus.onBattery = providingSource && CFStringCompare(providingSource, CFSTR(kIOPMBatteryPowerKey), 0) == kCFCompareEqualTo;
+        CFRelease(powerSourcesInfo);
+    }
+    auto processInfo = [NSProcessInfo processInfo];
+    if (@available(macOS 12.0, *)) {
+        powerStatus.lowPowerMode = processInfo.lowPowerModeEnabled;
+    }
+    powerStatus.thermalPressure = processInfo.thermalState >= NSProcessInfoThermalStateSerious;
+    powerStatus.displayAsleep = s_displayAsleep;
+    return powerStatus;
+}
 
-    switch (messageType) {
-        case kIOMessageSystemWillSleep:
-            std::cout << "System will sleep" << std::endl;
-            (*callback)(true);  // Call the lambda with true, indicating sleep
-            break;
-        case kIOMessageSystemHasPoweredOn:
-            std::cout << "System has powered on (woke up)" << std::endl;
-            (*callback)(false);  // Call the lambda with false, indicating wake
-            break;
-        default:
-            break;
+double getSecondsSinceLastInput() {
+    return CGEventSourceSecondsSinceLastEventType(kCGEventSourceStateCombinedSessionState, kCGAnyInputEventType);
+}
+
+bool refreshWindowRegistry() {
+    std::vector<WindowRecord> snapshot;
+    @autoreleasepool {
+        CFArrayRef windowList = CGWindowListCopyWindowInfo(kCGWindowListOptionOnScreenOnly, kCGNullWindowID);
+        if (!windowList) {
+            return false;
+        }
+        snapshot.reserve(CFArrayGetCount(windowList));
+        for (NSDictionary *windowInfo in (NSArray *)windowList) {
+            WindowRecord record;
+            record.windowId = [windowInfo[(id)kCGWindowNumber] intValue];
+            record.ownerPid = [windowInfo[(id)kCGWindowOwnerPID] intValue];
+            record.layer = [windowInfo[(id)kCGWindowLayer] intValue];
+            CGRect bounds = CGRectZero;
+            NSDictionary *boundsDict = windowInfo[(id)kCGWindowBounds];
+            if (boundsDict) {
+                CGRectMakeWithDictionaryRepresentation((CFDictionaryRef)boundsDict, &bounds);
+            }
+            record.x = (int)bounds.origin.x;
+            record.y = (int)bounds.origin.y;
+            record.width = (int)bounds.size.width;
+            record.height = (int)bounds.size.height;
+            NSString *ownerName = windowInfo[(id)kCGWindowOwnerName];
+            if (ownerName) {
+                record.ownerName = ownerName.UTF8String;
+            }
+            snapshot.push_back(std::move(record));
+        }
+        CFRelease(windowList);
     }
+    WindowRegistry::getInstance().applySnapshot(std::move(snapshot));
+    return true;
 }
 
-//void detectScreenSleep(std::function<void(bool)> callback) {
-//    // Register for system power notifications
-//    rootPort = IORegisterForSystemPower(&callback, &kCFRunLoopDefaultMode, displaySleepCallback, nullptr);
-//    if (rootPort == 0) {
-//        std::cerr << "Failed to register for system power notifications" << std::endl;
-//        return;
-//    }
-//
-//    // Run the main run loop to process power events
-//    CFRunLoopRun();
-//}
+WindowRegistry& getWindowRegistry(std::chrono::milliseconds maxAge) {
+    auto& registry = WindowRegistry::getInstance();
+    auto snapshotTime = registry.getSnapshotTime();
+    if (!snapshotTime || WindowRegistry::Clock::now() - *snapshotTime > maxAge) {
+        refreshWindowRegistry();
+    }
+    return registry;
+}
+
+static std::mutex s_registryPollingMutex;
+static dispatch_source_t s_registryPollingTimer = nullptr;
+static double s_registryPollingInterval = 0.0;
+
+void startWindowRegistryPolling(double intervalSeconds) {
+    std::lock_guard<std::mutex> pollingLock(s_registryPollingMutex);
+    if (s_registryPollingTimer && s_registryPollingInterval <= intervalSeconds) {
+        return;
+    }
+    if (!s_registryPollingTimer) {
+        s_registryPollingTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0,
+                                                        dispatch_get_global_queue(QOS_CLASS_UTILITY, 0));
+        dispatch_source_set_event_handler(s_registryPollingTimer, ^{
+            refreshWindowRegistry();
+        });
+        dispatch_resume(s_registryPollingTimer);
+    }
+    s_registryPollingInterval = intervalSeconds;
+    auto intervalInNanoseconds = (uint64_t)(intervalSeconds * NSEC_PER_SEC);
+    dispatch_source_set_timer(s_registryPollingTimer, dispatch_time(DISPATCH_TIME_NOW, 0), intervalInNanoseconds,
+                              intervalInNanoseconds / 10);
+}
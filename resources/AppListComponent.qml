@@ -104,6 +104,10 @@ Item {
                                     anchors.fill: parent
                                     source: frameContent  // Placeholder image or actual app frame
                                     fillMode: Image.PreserveAspectCrop
+                                    // rendered off the ui thread at the size it is shown at
+                                    asynchronous: true
+                                    sourceSize.width: width
+                                    sourceSize.height: height
                                     opacity: 0.2
                                 }
                             }
@@ -0,0 +1,158 @@
+#include <metal_stdlib>
+using namespace metal;
+
+// fused version of the gaussian (MPS) -> subtract -> hidingShader chain in CompositeCapture.
+// every threadgroup loads its 16x16 tile of the app texture plus an apron of the gaussian's radius into threadgroup
+// memory once, blurs and subtracts there, and only the final pixel is written, so the two intermediate textures are
+// gone. the math is the same as the cpu filter (GPUPipeline/cpu): HighPassKernel taps over 256, rounded to 8 bit
+// after each pass.
+
+// HideEffectSpecialization (GPUPipeline/HideEffect.h): the radius is a function constant so the blur loops unroll,
+// MetalPipeline builds a pipeline state per radius in the background. unspecialised it is the default radius.
+constant int kHighPassRadiusConstant [[function_constant(0)]];
+constant int kHighPassRadius = is_function_constant_defined(kHighPassRadiusConstant) ? kHighPassRadiusConstant : 1;
+
+#define TILE_SIZE 16
+// kMaxHighPassRadius, the threadgroup arrays are sized for the widest blur
+#define MAX_HIGH_PASS_RADIUS 3
+#define APRON_SIZE (TILE_SIZE + 2 * MAX_HIGH_PASS_RADIUS)
+// DirtyTileMap::kTileSize
+#define DIRTY_TILE_SIZE 64
+
+// HideEffectUniforms (GPUPipeline/HideEffect.h): head of the hide effect buffer, the lut follows right after it
+struct HideEffectUniforms {
+    uint highPassWeights[MAX_HIGH_PASS_RADIUS + 1];
+    uint keepEnvBelow;
+    uint padding[11];
+};
+
+// HideColorLut (GPUPipeline/HideColorLut.h): one lattice of HIDE_LUT_SIZE^3 opaque BGRA8 entries of the stand out
+// shift per lightness range, entry (b * N + g) * N + r, then the lattice offset of every max + min. sampled with the
+// same integer tetrahedral interpolation as sampleHideColorLut, so the cpu filter and the shaders write the same bytes.
+#define HIDE_LUT_SIZE 33
+#define HIDE_LUT_STRIDE_G HIDE_LUT_SIZE
+#define HIDE_LUT_STRIDE_B (HIDE_LUT_SIZE * HIDE_LUT_SIZE)
+#define HIDE_LUT_BRANCH_TABLE (4 * HIDE_LUT_SIZE * HIDE_LUT_SIZE * HIDE_LUT_SIZE)
+
+uint divide_by_255(uint value) {
+    return (value + 1 + (value >> 8)) >> 8;
+}
+
+// lattice cell of an 8 bit channel and the position inside it in 1/256
+uint2 hide_lut_cell(uint value) {
+    uint position = value * (HIDE_LUT_SIZE - 1);
+    uint index = min(divide_by_255(position), uint(HIDE_LUT_SIZE - 2));
+    return uint2(index, divide_by_255((position - index * 255) * 256 + 127));
+}
+
+float3 sample_hide_lut(device const uint* hideLut, float3 color) {
+    uint3 value = uint3(rint(saturate(color) * 255.0));
+    uint2 cellR = hide_lut_cell(value.r);
+    uint2 cellG = hide_lut_cell(value.g);
+    uint2 cellB = hide_lut_cell(value.b);
+    uint lattice = hideLut[HIDE_LUT_BRANCH_TABLE + max3(value.r, value.g, value.b) + min3(value.r, value.g, value.b)];
+    uint base = lattice + cellB.x * HIDE_LUT_STRIDE_B + cellG.x * HIDE_LUT_STRIDE_G + cellR.x;
+
+    uint fracMax = max(cellR.y, max(cellG.y, cellB.y));
+    uint fracMin = min(cellR.y, min(cellG.y, cellB.y));
+    uint fracMid = cellR.y + cellG.y + cellB.y - fracMax - fracMin;
+    // a tie gives the corner it picks a zero weight
+    uint strideMax = (cellR.y >= cellG.y && cellR.y >= cellB.y) ? 1 : (cellG.y >= cellB.y ? HIDE_LUT_STRIDE_G : HIDE_LUT_STRIDE_B);
+    uint strideMin = (cellR.y <= cellG.y && cellR.y <= cellB.y) ? 1 : (cellG.y <= cellB.y ? HIDE_LUT_STRIDE_G : HIDE_LUT_STRIDE_B);
+    uint strideAll = 1 + HIDE_LUT_STRIDE_G + HIDE_LUT_STRIDE_B;
+
+    uint4 corners = uint4(hideLut[base], hideLut[base + strideMax], hideLut[base + strideAll - strideMin], hideLut[base + strideAll]);
+    uint4 weights = uint4(256 - fracMax, fracMax - fracMid, fracMid - fracMin, fracMin);
+    uint3 sum = uint3(128);
+    for (int i = 0; i < 4; i++) {
+        sum += weights[i] * ((uint3(corners[i]) >> uint3(16, 8, 0)) & 0xFF);
+    }
+    return float3(sum >> 8) / 255.0;
+}
+
+
+// one 16x16 group of output pixels starting at groupOrigin. the threadgroup arrays have to be declared in the kernel,
+// they come in as pointers to their rows.
+void high_pass_hide_group(texture2d<float, access::read> envTex,
+                          texture2d<float, access::read> appTex,
+                          texture2d<float, access::write> outputTex,
+                          device const HideEffectUniforms* hideEffect,
+                          uint2 groupOrigin,
+                          uint2 lid,
+                          threadgroup uint3 (*appTile)[APRON_SIZE],
+                          threadgroup uint3 (*rowBlurTile)[TILE_SIZE]) {
+    const uint radius = kHighPassRadius;
+    const uint apronSize = TILE_SIZE + 2 * radius;
+    uint2 appSize = uint2(appTex.get_width(), appTex.get_height());
+    int2 tileOrigin = int2(groupOrigin) - int(radius);
+
+    // load the tile and its apron, outside the texture counts as zero (MPSImageEdgeModeZero)
+    for (uint i = lid.y * TILE_SIZE + lid.x; i < apronSize * apronSize; i += TILE_SIZE * TILE_SIZE) {
+        int2 coord = tileOrigin + int2(i % apronSize, i / apronSize);
+        uint3 texel = uint3(0);
+        if (coord.x >= 0 && coord.y >= 0 && uint(coord.x) < appSize.x && uint(coord.y) < appSize.y) {
+            texel = uint3(rint(appTex.read(uint2(coord)).rgb * 255.0));
+        }
+        appTile[i / apronSize][i % apronSize] = texel;
+    }
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+
+    // horizontal pass for the TILE_SIZE + 2 * radius rows the tile needs
+    for (uint i = lid.y * TILE_SIZE + lid.x; i < apronSize * TILE_SIZE; i += TILE_SIZE * TILE_SIZE) {
+        uint row = i / TILE_SIZE;
+        uint col = i % TILE_SIZE + radius;
+        uint3 sum = hideEffect->highPassWeights[0] * appTile[row][col] + 128;
+        for (uint t = 1; t <= radius; t++) {
+            sum += hideEffect->highPassWeights[t] * (appTile[row][col - t] + appTile[row][col + t]);
+        }
+        rowBlurTile[row][col - radius] = sum >> 8;
+    }
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+
+    uint2 gid = groupOrigin + lid;
+    if (gid.x >= outputTex.get_width() || gid.y >= outputTex.get_height()) {
+        return;
+    }
+
+    // vertical pass + subtract, clamped at zero like the unorm texture MPSImageSubtract wrote into
+    uint3 blurred = hideEffect->highPassWeights[0] * rowBlurTile[lid.y + radius][lid.x] + 128;
+    for (uint t = 1; t <= radius; t++) {
+        blurred += hideEffect->highPassWeights[t] * (rowBlurTile[lid.y + radius - t][lid.x] + rowBlurTile[lid.y + radius + t][lid.x]);
+    }
+    blurred >>= 8;
+    uint3 app = appTile[lid.y + radius][lid.x + radius];
+    uint3 highPass = select(uint3(0), app - blurred, app > blurred);
+
+    float4 envColor = envTex.read(gid);
+    if (all(highPass < hideEffect->keepEnvBelow)) {
+        outputTex.write(float4(envColor.rgb, 1.0), gid);
+    } else {
+        outputTex.write(float4(sample_hide_lut((device const uint*)(hideEffect + 1), envColor.rgb), 1.0), gid);
+    }
+}
+
+kernel void highPassHide(texture2d<float, access::read> envTex [[texture(0)]],
+                         texture2d<float, access::read> appTex [[texture(1)]],
+                         texture2d<float, access::write> outputTex [[texture(2)]],
+                         device const HideEffectUniforms* hideEffect [[buffer(0)]],
+                         uint2 lid [[thread_position_in_threadgroup]],
+                         uint2 groupId [[threadgroup_position_in_grid]]) {
+    threadgroup uint3 appTile[APRON_SIZE][APRON_SIZE];
+    threadgroup uint3 rowBlurTile[APRON_SIZE][TILE_SIZE];
+    high_pass_hide_group(envTex, appTex, outputTex, hideEffect, groupId * TILE_SIZE, lid, appTile, rowBlurTile);
+}
+
+// incremental composite: only the dirty tiles (column, row) of DirtyTileMap, every tile is
+// (DIRTY_TILE_SIZE / TILE_SIZE)^2 groups and groupId.z picks the tile
+kernel void highPassHideTiles(texture2d<float, access::read> envTex [[texture(0)]],
+                              texture2d<float, access::read> appTex [[texture(1)]],
+                              texture2d<float, access::write> outputTex [[texture(2)]],
+                              constant ushort2* dirtyTiles [[buffer(0)]],
+                              device const HideEffectUniforms* hideEffect [[buffer(1)]],
+                              uint3 lid [[thread_position_in_threadgroup]],
+                              uint3 groupId [[threadgroup_position_in_grid]]) {
+    threadgroup uint3 appTile[APRON_SIZE][APRON_SIZE];
+    threadgroup uint3 rowBlurTile[APRON_SIZE][TILE_SIZE];
+    uint2 groupOrigin = uint2(dirtyTiles[groupId.z]) * DIRTY_TILE_SIZE + groupId.xy * TILE_SIZE;
+    high_pass_hide_group(envTex, appTex, outputTex, hideEffect, groupOrigin, lid.xy, appTile, rowBlurTile);
+}
@@ -22,141 +22,63 @@ return out;
 }
 
 
-// Utility function to clamp a value between a minimum and a maximum
-float clamp_val(float value, float min_val, float max_val) {
-    return clamp(value, min_val, max_val);
-}
-
-// Convert RGB to HSL
-float3 rgb_to_hsl(float3 rgb) {
-    float R = rgb.r;
-    float G = rgb.g;
-    float B = rgb.b;
-
-    float max_val = max(R, max(G, B));
-    float min_val = min(R, min(G, B));
-    float delta = max_val - min_val;
-
-    float L = (max_val + min_val) / 2.0;
-    float S = 0.0;
-    float H = 0.0;
-
-    if (delta != 0.0) {
-        // Saturation calculation
-        if (L < 0.5) {
-            S = delta / (max_val + min_val);
-        } else {
-            S = delta / (2.0 - max_val - min_val);
-        }
-
-        // Hue calculation
-        if (max_val == R) {
-            H = ((G - B) / delta) + (G < B ? 6.0 : 0.0);
-        } else if (max_val == G) {
-            H = ((B - R) / delta) + 2.0;
-        } else if (max_val == B) {
-            H = ((R - G) / delta) + 4.0;
-        }
-
-        H *= 60.0;  // Convert to degrees
-    }
-
-    return float3(H, S * 100.0, L * 100.0);  // Return H in degrees, S and L in percentages
-}
-
-// Convert HSL back to RGB
-float3 hsl_to_rgb(float3 hsl) {
-    float H = hsl.x;
-    float S = hsl.y / 100.0;
-    float L = hsl.z / 100.0;
-
-    float C = (1.0 - abs(2.0 * L - 1.0)) * S;
-    float H_prime = H / 60.0;
-    float X = C * (1.0 - abs(fmod(H_prime, 2.0) - 1.0));
-
-    float3 rgb;
-
-    if (H_prime >= 0.0 && H_prime < 1.0) {
-        rgb = float3(C, X, 0.0);
-    } else if (H_prime >= 1.0 && H_prime < 2.0) {
-        rgb = float3(X, C, 0.0);
-    } else if (H_prime >= 2.0 && H_prime < 3.0) {
-        rgb = float3(0.0, C, X);
-    } else if (H_prime >= 3.0 && H_prime < 4.0) {
-        rgb = float3(0.0, X, C);
-    } else if (H_prime >= 4.0 && H_prime < 5.0) {
-        rgb = float3(X, 0.0, C);
-    } else if (H_prime >= 5.0 && H_prime < 6.0) {
-        rgb = float3(C, 0.0, X);
-    } else {
-        rgb = float3(0.0, 0.0, 0.0);
-    }
-
-    float m = L - C / 2.0;
-    rgb += float3(m, m, m);  // Add the lightness adjustment
+// HideColorLut (GPUPipeline/HideColorLut.h): one lattice of HIDE_LUT_SIZE^3 opaque BGRA8 entries of the stand out
+// shift per lightness range, entry (b * N + g) * N + r, then the lattice offset of every max + min. sampled with the
+// same integer tetrahedral interpolation as sampleHideColorLut, so the cpu filter and the shaders write the same bytes.
+#define HIDE_LUT_SIZE 33
+#define HIDE_LUT_STRIDE_G HIDE_LUT_SIZE
+#define HIDE_LUT_STRIDE_B (HIDE_LUT_SIZE * HIDE_LUT_SIZE)
+#define HIDE_LUT_BRANCH_TABLE (4 * HIDE_LUT_SIZE * HIDE_LUT_SIZE * HIDE_LUT_SIZE)
+
+// HideEffectUniforms (GPUPipeline/HideEffect.h): head of the hide effect buffer, the lut follows right after it
+#define MAX_HIGH_PASS_RADIUS 3
+struct HideEffectUniforms {
+    uint highPassWeights[MAX_HIGH_PASS_RADIUS + 1];
+    uint keepEnvBelow;
+    uint padding[11];
+};
 
-    return rgb;
+uint divide_by_255(uint value) {
+    return (value + 1 + (value >> 8)) >> 8;
 }
 
-// Adjust HSL values (hue shift, saturation shift, lightness shift)
-float3 adjust_color_hsl(float3 rgb, float hue_shift, float saturation_shift, float lightness_shift) {
-    float3 hsl = rgb_to_hsl(rgb);
-
-    // Adjust H, S, L
-    hsl.x = fmod(hsl.x + hue_shift, 360.0);  // Hue shift and wrap around [0, 360]
-    hsl.y = clamp_val(hsl.y + saturation_shift, 0.0, 100.0);  // Clamp saturation
-    hsl.z = clamp_val(hsl.z + lightness_shift, 0.0, 100.0);  // Clamp lightness
-
-    return hsl_to_rgb(hsl);  // Convert back to RGB
+// lattice cell of an 8 bit channel and the position inside it in 1/256
+uint2 hide_lut_cell(uint value) {
+    uint position = value * (HIDE_LUT_SIZE - 1);
+    uint index = min(divide_by_255(position), uint(HIDE_LUT_SIZE - 2));
+    return uint2(index, divide_by_255((position - index * 255) * 256 + 127));
 }
 
-// Adjust HSL values to stand out in the environment (enhance contrast)
-float3 adjust_hsl_to_stand_out_in_environment(float3 envColor, float3 baseColor) {
-    // Step 1: Convert both envColor and baseColor to HSL
-    float3 envHSL = rgb_to_hsl(envColor);
-    float3 baseHSL = rgb_to_hsl(baseColor);
-
-    // Step 2: Define thresholds for lightness categories
-    const float specularThreshold = 75.0;  // High light (specular)
-    const float diffuseThreshold = 45.0;   // Mid light (diffuse)
-    const float lowLightThreshold = 25.0;  // Low light
-
-    // Step 3: Adjust environment lightness for contrast
-    if (envHSL.z > specularThreshold) {
-        // If environment is specular (high light), reduce lightness to low light
-        envHSL.z = clamp_val(envHSL.z - lowLightThreshold * 0.4, 0.0, 100.0);
-        // Step 4: Slightly adjust the hue
-        const float hueAdjustment = 18.0;  // Adjust hue by 5 degrees (or any small value)
-        envHSL.x = fmod(envHSL.x + hueAdjustment, 360.0);  // Ensure the hue wraps around [0, 360]
-    } else if (envHSL.z < lowLightThreshold) {
-        // If environment is in low light, increase it to the high light range
-        envHSL.z = clamp_val(envHSL.z + specularThreshold * 0.30, 0.0, 100.0);
-        // Step 4: Slightly adjust the hue
-        const float hueAdjustment = 25.0;  // Adjust hue by 5 degrees (or any small value)
-        envHSL.x = fmod(envHSL.x + hueAdjustment, 360.0);  // Ensure the hue wraps around [0, 360]
-    } else {
-        // If environment is mid light, make a subtle adjustment to increase contrast
-        if (envHSL.z > diffuseThreshold) {
-            envHSL.z = clamp_val(lowLightThreshold + (envHSL.z - specularThreshold) * 0.7, 0.0, 100.0);  // Slightly increase lightness
-        } else {
-            envHSL.z = clamp_val(specularThreshold - (lowLightThreshold - envHSL.z) * 0.5, 0.0, 100.0);  // Slightly decrease lightness
-        }
-
-        const float hueAdjustment = 10.0;  // Adjust hue by 5 degrees (or any small value)
-        envHSL.x = fmod(envHSL.x + hueAdjustment, 360.0);  // Ensure the hue wraps around [0, 360]
+float3 sample_hide_lut(device const uint* hideLut, float3 color) {
+    uint3 value = uint3(rint(saturate(color) * 255.0));
+    uint2 cellR = hide_lut_cell(value.r);
+    uint2 cellG = hide_lut_cell(value.g);
+    uint2 cellB = hide_lut_cell(value.b);
+    uint lattice = hideLut[HIDE_LUT_BRANCH_TABLE + max3(value.r, value.g, value.b) + min3(value.r, value.g, value.b)];
+    uint base = lattice + cellB.x * HIDE_LUT_STRIDE_B + cellG.x * HIDE_LUT_STRIDE_G + cellR.x;
+
+    uint fracMax = max(cellR.y, max(cellG.y, cellB.y));
+    uint fracMin = min(cellR.y, min(cellG.y, cellB.y));
+    uint fracMid = cellR.y + cellG.y + cellB.y - fracMax - fracMin;
+    // a tie gives the corner it picks a zero weight
+    uint strideMax = (cellR.y >= cellG.y && cellR.y >= cellB.y) ? 1 : (cellG.y >= cellB.y ? HIDE_LUT_STRIDE_G : HIDE_LUT_STRIDE_B);
+    uint strideMin = (cellR.y <= cellG.y && cellR.y <= cellB.y) ? 1 : (cellG.y <= cellB.y ? HIDE_LUT_STRIDE_G : HIDE_LUT_STRIDE_B);
+    uint strideAll = 1 + HIDE_LUT_STRIDE_G + HIDE_LUT_STRIDE_B;
+
+    uint4 corners = uint4(hideLut[base], hideLut[base + strideMax], hideLut[base + strideAll - strideMin], hideLut[base + strideAll]);
+    uint4 weights = uint4(256 - fracMax, fracMax - fracMid, fracMid - fracMin, fracMin);
+    uint3 sum = uint3(128);
+    for (int i = 0; i < 4; i++) {
+        sum += weights[i] * ((uint3(corners[i]) >> uint3(16, 8, 0)) & 0xFF);
     }
-
-    // Step 5: Mix the result with baseColor (baseColor has minor contribution)
-    float3 adjustedEnvColor = hsl_to_rgb(envHSL);  // Convert adjusted HSL back to RGB
-
-    // Step 6: Return the final mixed color
-    return adjustedEnvColor;
+    return float3(sum >> 8) / 255.0;
 }
 
 // Fragment shader: blends two textures and assigns the blended color to the fragment
 fragment float4 fragmentFunction(VertexOut in [[stage_in]],
 texture2d<float> tex1 [[texture(0)]],
-        texture2d<float> tex2 [[texture(1)]]) {
+        texture2d<float> tex2 [[texture(1)]],
+        device const HideEffectUniforms* hideEffect [[buffer(0)]]) {
 
 // Create a linear sampler to sample the textures
 constexpr sampler textureSampler(mag_filter::linear, min_filter::linear);
@@ -169,13 +91,13 @@ float2 texSize1 = float2(tex1.get_width(), tex1.get_height());
 float2 texSize2 = float2(tex2.get_width(), tex2.get_height());
 float2 scaledTexCoord = in.texCoord * texSize1 / texSize2;
 float4 color2 = tex2.sample(textureSampler, scaledTexCoord);
-color2 *= 1.2;
 
-float3 shiftedColor1 = adjust_hsl_to_stand_out_in_environment(color1.rgb, color2.rgb);
+float3 shiftedColor1 = sample_hide_lut((device const uint*)(hideEffect + 1), color1.rgb);
 
 //shiftedColor1 = float3(1.0);
 
-if(all(color2.rgb < float3(0.001, 0.001, 0.001))){
+// keepEnvBelow is the old color2 * 1.2 < 0.001 test with the effect's gain, on the 8 bit value
+if(all(uint3(rint(saturate(color2.rgb) * 255.0)) < hideEffect->keepEnvBelow)){
     return float4(color1.rgb, 1.0);
 }else{
     return float4(shiftedColor1, 1.0);
@@ -0,0 +1,168 @@
+// CpuBlur against a double precision gaussian over the clamped image
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "TestCheck.h"
+#include "GPUPipeline/cpu/CpuBlur.h"
+#include "GPUPipeline/cpu/CpuKernels.h"
+
+// every channel of image blurred with taps out to 4 sigma, edges clamped
+static std::vector<double> referenceBlur(CpuImage& image, double sigma) {
+    int width = image.width();
+    int height = image.height();
+    int radius = (int)std::ceil(4.0 * sigma);
+    std::vector<double> taps(2 * radius + 1);
+    double sum = 0.0;
+    for (int k = -radius; k <= radius; k++) {
+        taps[k + radius] = std::exp(-(double)(k * k) / (2.0 * sigma * sigma));
+        sum += taps[k + radius];
+    }
+    for (auto& tap : taps) {
+        tap /= sum;
+    }
+    const uint8_t* pixels = image.data();
+    std::vector<double> horizontal((size_t)width * height * 4, 0.0);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            for (int k = -radius; k <= radius; k++) {
+                int sx = std::clamp(x + k, 0, width - 1);
+                for (int c = 0; c < 4; c++) {
+                    horizontal[((size_t)y * width + x) * 4 + c] += taps[k + radius] * pixels[((size_t)y * width + sx) * 4 + c];
+                }
+            }
+        }
+    }
+    std::vector<double> blurred((size_t)width * height * 4, 0.0);
+    for (int y = 0; y < height; y++) {
+        for (int k = -radius; k <= radius; k++) {
+            int sy = std::clamp(y + k, 0, height - 1);
+            for (int i = 0; i < width * 4; i++) {
+                blurred[(size_t)y * width * 4 + i] += taps[k + radius] * horizontal[(size_t)sy * width * 4 + i];
+            }
+        }
+    }
+    return blurred;
+}
+
+static double maxError(CpuImage& image, const std::vector<double>& reference) {
+    double error = 0.0;
+    for (size_t i = 0; i < reference.size(); i++) {
+        error = std::max(error, std::abs(image.data()[i] - reference[i]));
+    }
+    return error;
+}
+
+static CpuImage noiseImage(int width, int height, unsigned seed) {
+    CpuImage image(width, height);
+    std::mt19937 random(seed);
+    for (size_t i = 0; i < (size_t)width * height * 4; i++) {
+        image.data()[i] = (uint8_t)random();
+    }
+    return image;
+}
+
+// 0 / 255 squares of side, the hardest edges there are
+static CpuImage checkerImage(int width, int height, int side) {
+    CpuImage image(width, height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t value = ((x / side + y / side) % 2) ? 255 : 0;
+            for (int c = 0; c < 4; c++) {
+                image.data()[((size_t)y * width + x) * 4 + c] = value;
+            }
+        }
+    }
+    return image;
+}
+
+static void checkKernelShape() {
+    for (float sigma = 0.5f; sigma <= 40.0f; sigma += 0.1f) {
+        auto kernel = CpuGaussianKernel::forSigma(sigma);
+        int total = kernel.weights[0];
+        bool monotone = true;
+        for (int i = 1; i <= kernel.radius; i++) {
+            total += 2 * kernel.weights[i];
+            monotone = monotone && kernel.weights[i] <= kernel.weights[i - 1];
+        }
+        if (total != (1 << kernel.shift) || !monotone) {
+            std::fprintf(stderr, "sigma %.1f: taps add up to %d, monotone %d\n", sigma, total, monotone);
+        }
+        CHECK_EQ(total, 1 << kernel.shift);
+        CHECK(monotone);
+        CHECK(kernel.weights[0] < 32768);
+    }
+}
+
+// sigma, the blur method and the largest errors against the reference that are accepted on noise and on hard
+// edges. three boxes are piecewise quadratic, the edges show it
+struct BlurCase {
+    float sigma;
+    CpuBlurMethod method;
+    double maxNoiseError;
+    double maxEdgeError;
+};
+
+static void checkAgainstReference() {
+    const BlurCase cases[] = {
+            {1.0f, CpuBlurMethod::Gaussian, 2.0, 2.0},
+            {2.5f, CpuBlurMethod::Gaussian, 2.0, 2.0},
+            {3.3f, CpuBlurMethod::Gaussian, 2.0, 2.0},
+            {7.4f, CpuBlurMethod::Gaussian, 2.0, 2.0},
+            {15.5f, CpuBlurMethod::Gaussian, 2.0, 2.0},
+            {40.0f, CpuBlurMethod::Gaussian, 2.0, 2.0},
+            {5.0f, CpuBlurMethod::ThreeBox, 2.5, 7.0},
+            {7.4f, CpuBlurMethod::ThreeBox, 2.5, 7.0},
+            {15.5f, CpuBlurMethod::ThreeBox, 2.5, 7.0},
+            {40.0f, CpuBlurMethod::ThreeBox, 2.5, 7.0},
+    };
+    CpuImage inputs[] = {noiseImage(203, 131, 7), checkerImage(203, 131, 24)};
+    CpuBlur blur;
+    for (auto& input : inputs) {
+        bool edges = &input != &inputs[0];
+        CpuImage output(input.width(), input.height());
+        for (const auto& blurCase : cases) {
+            auto reference = referenceBlur(input, blurCase.sigma);
+            CHECK(blur.blur(input.view(), output.view(), blurCase.sigma, blurCase.method));
+            double error = maxError(output, reference);
+            std::printf("%s, sigma %.1f %s: max error %.2f\n", edges ? "checker" : "noise", blurCase.sigma,
+                        blurCase.method == CpuBlurMethod::Gaussian ? "gaussian" : "three box", error);
+            CHECK(error <= (edges ? blurCase.maxEdgeError : blurCase.maxNoiseError));
+        }
+    }
+}
+
+// the simd versions of blurColumn give the scalar bytes, for narrow and wide kernels
+static void checkKernelsMatch() {
+    const auto& scalar = getCpuKernels(CpuKernelIsa::Scalar);
+    const auto& best = getCpuKernels();
+    if (best.isa == CpuKernelIsa::Scalar) {
+        return;
+    }
+    std::mt19937 random(11);
+    for (float sigma : {1.5f, 3.0f, 4.0f, 15.5f}) {
+        auto kernel = CpuGaussianKernel::forSigma(sigma);
+        int byteCount = 4 * 67;
+        std::vector<std::vector<uint8_t>> rows(2 * kernel.radius + 1, std::vector<uint8_t>(byteCount));
+        std::vector<const uint8_t*> rowPointers;
+        for (auto& row : rows) {
+            for (auto& value : row) {
+                value = (uint8_t)random();
+            }
+            rowPointers.push_back(row.data());
+        }
+        std::vector<uint8_t> expected(byteCount);
+        std::vector<uint8_t> actual(byteCount);
+        scalar.blurColumn(rowPointers.data(), expected.data(), byteCount, kernel);
+        best.blurColumn(rowPointers.data(), actual.data(), byteCount, kernel);
+        CHECK(expected == actual);
+    }
+}
+
+int main() {
+    checkKernelShape();
+    checkAgainstReference();
+    checkKernelsMatch();
+    return testExitCode();
+}
@@ -0,0 +1,180 @@
+// DisplayTopology: display lookups with primaryDisplayFor's fallback to the nearest display for a rect on none,
+// pointsToPixels rounding edge by edge at fractional scales, splitRect cutting a window across a 2x and a 1x display
+// into pixels of each, the render state following the window's display and a composite of such a straddling window
+#include <cstring>
+#include <random>
+#include "TestCheck.h"
+#include "DesktopCapture/common/CaptureState.h"
+#include "DesktopCapture/common/DisplayTopology.h"
+#include "GPUPipeline/cpu/CpuFrameGraphBackend.h"
+#include "GPUPipeline/cpu/CpuImageOps.h"
+
+static bool sameRect(const DirtyRect& a, const DirtyRect& b) {
+    return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+}
+
+// a retina panel at the origin and a 1x display to its right, 20 points higher
+static DisplayTopology makeTopology() {
+    DisplayTopology topology;
+    topology.addDisplay({1, {0, 0, 100, 80}, 2.0f});
+    topology.addDisplay({2, {100, -20, 100, 80}, 1.0f});
+    return topology;
+}
+
+static void checkLookups() {
+    auto topology = makeTopology();
+    CHECK(!topology.addDisplay({2, {0, 0, 10, 10}, 1.0f}));
+    CHECK_EQ(topology.displayCount, 2);
+    CHECK_EQ(topology.findDisplay(1)->getPixelWidth(), 200);
+    CHECK_EQ(topology.findDisplay(2)->getPixelHeight(), 80);
+    CHECK(topology.findDisplay(3) == nullptr);
+    CHECK_EQ(topology.displayAt(5, 5)->displayId, 1u);
+    CHECK_EQ(topology.displayAt(150, -10)->displayId, 2u);
+    CHECK(topology.displayAt(50, 90) == nullptr);
+
+    // the bigger share wins, a tie goes to the first display, a rect on no display to the nearest one
+    CHECK_EQ(topology.primaryDisplayFor({60, 10, 80, 50})->displayId, 1u);
+    CHECK_EQ(topology.primaryDisplayFor({70, 10, 80, 50})->displayId, 2u);
+    CHECK_EQ(topology.primaryDisplayFor({500, 0, 10, 10})->displayId, 2u);
+    CHECK(DisplayTopology().primaryDisplayFor({0, 0, 10, 10}) == nullptr);
+
+    DisplayTopology full;
+    for (uint32_t displayId = 1; displayId <= kMaxDisplays; displayId++) {
+        CHECK(full.addDisplay({displayId, {(int)displayId * 100, 0, 100, 100}, 1.0f}));
+    }
+    CHECK(!full.addDisplay({99, {0, 0, 100, 100}, 1.0f}));
+}
+
+static void checkScaleMath() {
+    // rounded edge by edge: neighbours in points stay neighbours in pixels at a fractional scale
+    CHECK(sameRect(pointsToPixels({1, 1, 1, 1}, 0, 0, 1.5f), {2, 2, 1, 1}));
+    auto left = pointsToPixels({0, 0, 1, 1}, 0, 0, 1.5f);
+    auto right = pointsToPixels({1, 0, 1, 1}, 0, 0, 1.5f);
+    CHECK_EQ(left.x + left.width, right.x);
+    // relative to the origin of the surface
+    CHECK(sameRect(pointsToPixels({110, -10, 20, 10}, 100, -20, 2.0f), {20, 20, 40, 20}));
+
+    // a window across both displays: each piece in its own display's pixels
+    auto parts = makeTopology().splitRect({60, 10, 80, 50});
+    CHECK_EQ(parts.size(), (size_t)2);
+    if (parts.size() == 2) {
+        CHECK_EQ(parts[0].displayId, 1u);
+        CHECK(sameRect(parts[0].points, {60, 10, 40, 50}));
+        CHECK(sameRect(parts[0].pixels, {120, 20, 80, 100}));
+        CHECK_EQ(parts[1].displayId, 2u);
+        CHECK_EQ(parts[1].scale, 1.0f);
+        CHECK(sameRect(parts[1].points, {100, 10, 40, 50}));
+        CHECK(sameRect(parts[1].pixels, {0, 30, 40, 50}));
+    }
+    // off every display: nothing
+    CHECK(makeTopology().splitRect({0, 100, 10, 10}).empty());
+}
+
+static void checkFollowWindowDisplay() {
+    auto topology = makeTopology();
+    RenderState state;
+    state.xPos = 60;
+    state.yPos = 10;
+    state.width = 80;
+    state.height = 50;
+    state.capturedAppX = 100;
+    state.capturedAppWidth = 40;
+    CHECK(followWindowDisplay(state, topology));
+    CHECK_EQ(state.displayId, 1u);
+    CHECK_EQ(state.scalingFactor, 2.0f);
+    CHECK_EQ(state.screenWidthInPixels, 200);
+    CHECK_EQ(state.screenHeightInPixels, 160);
+    // the app rect goes along to the new scale
+    CHECK_EQ(state.capturedAppX, 200);
+    CHECK_EQ(state.capturedAppWidth, 80);
+    CHECK(!followWindowDisplay(state, topology));
+
+    state.xPos = 110;
+    CHECK(followWindowDisplay(state, topology));
+    CHECK_EQ(state.displayId, 2u);
+    CHECK_EQ(state.scalingFactor, 1.0f);
+    CHECK_EQ(state.screenWidthInPixels, 100);
+    CHECK_EQ(state.capturedAppX, 100);
+    CHECK(!followWindowDisplay(state, DisplayTopology()));
+}
+
+static void fillNoise(CpuImage& image, std::mt19937& random) {
+    for (size_t i = 0; i < (size_t)image.width() * image.height() * 4; i++) {
+        image.data()[i] = (uint8_t)random();
+    }
+}
+
+// the window {60, 10, 80, 50} composited at display 1's scale: its left half from display 1's capture, the right
+// half cropped out of display 2's capture and scaled up 2x. the graph has to give what doing it by hand gives.
+static void checkStraddlingComposite() {
+    auto topology = makeTopology();
+    DirtyRect window{60, 10, 80, 50};
+    std::mt19937 random(1);
+    CpuImage desktop1(200, 160), desktop2(100, 80), app1(200, 160), app2(100, 80);
+    for (auto* image : {&desktop1, &desktop2, &app1, &app2}) {
+        fillNoise(*image, random);
+    }
+    auto otherPart = topology.splitRect(window)[1];
+    HidingFramePart envPart;
+    envPart.frame = &desktop2;
+    envPart.frameDesc = {100, 80};
+    envPart.crop = {otherPart.pixels.x, otherPart.pixels.y, otherPart.pixels.width, otherPart.pixels.height, 0, 0};
+    envPart.target = pointsToPixels(otherPart.points, window.x, window.y, 2.0f);
+    CHECK(sameRect(envPart.target, {80, 0, 80, 100}));
+    auto appPart = envPart;
+    appPart.frame = &app2;
+
+    CpuFrameGraphBackend backend;
+    CpuHidingStageExecutor executor;
+    FrameGraph graph(backend);
+    CpuImage target(160, 100);
+    for (bool withApp : {false, true}) {
+        graph.reset();
+        HidingCompositeDesc desc;
+        desc.envFrame = &desktop1;
+        desc.envFrameDesc = {200, 160};
+        desc.envCrop = {120, 20, 160, 100, 0, 0};
+        desc.envParts.push_back(envPart);
+        if (withApp) {
+            desc.appFrame = &app1;
+            desc.appFrameDesc = {200, 160};
+            desc.appCrop = {120, 20, 160, 100, 0, 0};
+            desc.appCropWidth = 160;
+            desc.appCropHeight = 100;
+            desc.appParts.push_back(appPart);
+        }
+        desc.presentTarget = &target;
+        desc.outputDesc = {160, 100};
+        buildHidingFrameGraph(graph, desc, executor);
+        CHECK(graph.compile());
+        graph.execute();
+
+        // by hand: crop the 2x display, crop the 1x one, scale it 2x and put it on the right half
+        auto composeByHand = [](CpuImage& frame1, CpuImage& frame2, CpuImage& output) {
+            CpuImage cropped(40, 50), scaled(80, 100);
+            cropImage(frame1.view(), 120, 20, 160, 100, 0, 0, output.view());
+            cropImage(frame2.view(), 0, 30, 40, 50, 0, 0, cropped.view());
+            scaleImageBilinear(cropped.view(), scaled.view());
+            cropImage(scaled.view(), -80, 0, 80, 100, 80, 0, output.view());
+        };
+        CpuImage env(160, 100), expected(160, 100);
+        composeByHand(desktop1, desktop2, env);
+        if (withApp) {
+            CpuImage app(160, 100);
+            composeByHand(app1, app2, app);
+            CpuHidingFilter hidingFilter;
+            hidingFilter.highPassHideProcess(env.view(), app.view(), expected.view(), *HideEffect::getDefault());
+        } else {
+            expected = env;
+        }
+        CHECK(std::memcmp(expected.data(), target.data(), (size_t)160 * 100 * 4) == 0);
+    }
+}
+
+int main() {
+    checkLookups();
+    checkScaleMath();
+    checkFollowWindowDisplay();
+    checkStraddlingComposite();
+    return testExitCode();
+}
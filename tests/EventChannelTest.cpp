@@ -0,0 +1,98 @@
+// EventChannel: more event names than one listener block holds, triggering while registration grows the table and
+// the handle table running full
+#include <thread>
+#include "TestCheck.h"
+#include "com/EventChannel.h"
+
+struct CountEvent {
+    int value = 0;
+};
+
+struct OtherEvent {
+};
+
+// every event reaches its own listeners only, far past the first block
+static void checkManyEvents() {
+    auto& channel = EventChannel<CountEvent>::getInstance();
+    constexpr int kEvents = 300;
+    std::vector<EventHandle> handles;
+    std::vector<int> sums(kEvents, 0);
+    for (int i = 0; i < kEvents; i++) {
+        handles.push_back(channel.handleFor("display" + std::to_string(i)));
+        CHECK(handles.back().valid());
+        channel.registerListener(handles.back(), [&sums, i](const CountEvent& event) {
+            sums[i] += event.value;
+        });
+    }
+    CHECK_EQ(channel.handleFor("display7").id, handles[7].id);
+    // handles are shared by the channels of every payload
+    CHECK_EQ(EventChannel<OtherEvent>::getInstance().handleFor("display7").id, handles[7].id);
+    for (int i = 0; i < kEvents; i++) {
+        channel.triggerEvent(handles[i], CountEvent{i + 1});
+    }
+    for (int i = 0; i < kEvents; i++) {
+        CHECK_EQ(sums[i], i + 1);
+    }
+    // a handle without listeners in this channel, its block never allocated
+    channel.triggerEvent(channel.handleFor("never listened to, interned late"), CountEvent{1});
+    channel.unregisterListeners(channel.handleFor("never listened to, interned late"));
+    channel.unregisterListeners(handles[0]);
+    channel.triggerEvent(handles[0], CountEvent{5});
+    CHECK_EQ(sums[0], 1);
+}
+
+// hot plug: new per source names get listeners while a capture thread keeps triggering an older one
+static void checkGrowWhileTriggering() {
+    auto& channel = EventChannel<CountEvent>::getInstance();
+    auto frameHandle = channel.handleFor("frames");
+    std::atomic<int> frames{0};
+    channel.registerListener(frameHandle, [&frames](const CountEvent& event) {
+        frames.fetch_add(event.value);
+    });
+    std::atomic<bool> stop{false};
+    int triggered = 0;
+    std::thread capture([&] {
+        while (!stop.load()) {
+            channel.triggerEvent(frameHandle, CountEvent{1});
+            triggered++;
+        }
+    });
+    std::atomic<int> plugged{0};
+    for (int i = 0; i < 1000; i++) {
+        auto handle = channel.handleFor("plugged" + std::to_string(i));
+        channel.registerListener(handle, [&plugged](const CountEvent&) {
+            plugged.fetch_add(1);
+        });
+        channel.triggerEvent(handle, CountEvent{});
+    }
+    stop = true;
+    capture.join();
+    CHECK_EQ(frames.load(), triggered);
+    CHECK_EQ(plugged.load(), 1000);
+}
+
+// past kMaxEvents names there is no handle, listening and triggering on it do nothing
+static void checkFull() {
+    auto& channel = EventChannel<CountEvent>::getInstance();
+    EventHandle handle;
+    int named = 0;
+    do {
+        handle = channel.handleFor("full" + std::to_string(named++));
+    } while (handle.valid() && named <= (int)EventChannel<CountEvent>::kMaxEvents);
+    CHECK(!handle.valid());
+    int calls = 0;
+    channel.registerListener(handle, [&calls](const CountEvent&) {
+        calls++;
+    });
+    channel.triggerEvent(handle, CountEvent{});
+    CHECK_EQ(calls, 0);
+    // the names that got a handle keep working
+    CHECK(channel.handleFor("display3").valid());
+}
+
+int main() {
+    checkManyEvents();
+    checkGrowWhileTriggering();
+    checkFull();
+    return testExitCode();
+}
@@ -0,0 +1,175 @@
+// FrameGraph compile: dependency order, culling, transient aliasing and texture reuse across frames
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "TestCheck.h"
+#include "GPUPipeline/FrameGraph.h"
+
+// hands out numbered fake textures and counts what is alive
+class CountingBackend : public FrameGraphBackend {
+public:
+    void* createTexture(const FrameGraphTextureDesc&) override {
+        createdCount++;
+        liveCount++;
+        return (void*)(intptr_t)createdCount;
+    }
+
+    void destroyTexture(void*) override {
+        liveCount--;
+    }
+
+    int createdCount = 0;
+    int liveCount = 0;
+};
+
+static const FrameGraphTextureDesc kOutputDesc{64, 32};
+static const FrameGraphTextureDesc kSmallDesc{16, 8};
+
+static bool contains(const std::vector<std::string>& names, const std::string& name) {
+    return std::find(names.begin(), names.end(), name) != names.end();
+}
+
+static int positionOf(const std::vector<std::string>& names, const std::string& name) {
+    return (int)(std::find(names.begin(), names.end(), name) - names.begin());
+}
+
+// the readers are declared before their writers, compile still runs every writer first
+static void checkSort() {
+    CountingBackend backend;
+    FrameGraph graph(backend);
+    auto target = graph.importTexture("target", (void*)1, kOutputDesc);
+    auto first = graph.createTexture("first", kOutputDesc);
+    auto second = graph.createTexture("second", kOutputDesc);
+    graph.addPass("present", {second}, {target}, nullptr, true);
+    graph.addPass("makeSecond", {first}, {second}, nullptr);
+    graph.addPass("makeFirst", {}, {first}, nullptr);
+    CHECK(graph.compile());
+    auto order = graph.getExecutionOrder();
+    CHECK_EQ(order.size(), (size_t)3);
+    CHECK(positionOf(order, "makeFirst") < positionOf(order, "makeSecond"));
+    CHECK(positionOf(order, "makeSecond") < positionOf(order, "present"));
+}
+
+// independent passes keep their declaration order, a linear graph runs as declared
+static void checkDeclarationOrder() {
+    CountingBackend backend;
+    FrameGraph graph(backend);
+    auto target = graph.importTexture("target", (void*)1, kOutputDesc);
+    graph.addPass("drawA", {}, {target}, nullptr, true);
+    graph.addPass("drawB", {}, {target}, nullptr, true);
+    graph.addPass("drawC", {}, {target}, nullptr, true);
+    CHECK(graph.compile());
+    CHECK(graph.getExecutionOrder() == std::vector<std::string>({"drawA", "drawB", "drawC"}));
+}
+
+// what no side effect pass reaches is culled along with everything only it needed
+static void checkCull() {
+    CountingBackend backend;
+    FrameGraph graph(backend);
+    auto target = graph.importTexture("target", (void*)1, kOutputDesc);
+    auto used = graph.createTexture("used", kOutputDesc);
+    auto unusedInput = graph.createTexture("unusedInput", kOutputDesc);
+    auto unused = graph.createTexture("unused", kOutputDesc);
+    graph.addPass("makeUsed", {}, {used}, nullptr);
+    graph.addPass("makeUnusedInput", {}, {unusedInput}, nullptr);
+    graph.addPass("makeUnused", {unusedInput}, {unused}, nullptr);
+    graph.addPass("present", {used}, {target}, nullptr, true);
+    CHECK(graph.compile());
+    auto order = graph.getExecutionOrder();
+    CHECK(contains(order, "makeUsed"));
+    CHECK(contains(order, "present"));
+    CHECK(!contains(order, "makeUnused"));
+    CHECK(!contains(order, "makeUnusedInput"));
+    // the culled passes' transients get no texture
+    CHECK_EQ(graph.getPhysicalTextureCount(), 1);
+    CHECK_EQ(backend.liveCount, 1);
+}
+
+// a -> b -> c -> d: a is done when c is written, so a and c share a texture; b overlaps both. the small one never
+// aliases a different desc
+static void checkAlias() {
+    CountingBackend backend;
+    FrameGraph graph(backend);
+    auto target = graph.importTexture("target", (void*)1, kOutputDesc);
+    auto a = graph.createTexture("a", kOutputDesc);
+    auto b = graph.createTexture("b", kOutputDesc);
+    auto c = graph.createTexture("c", kOutputDesc);
+    auto small = graph.createTexture("small", kSmallDesc);
+    std::vector<void*> textures(4, nullptr);
+    graph.addPass("makeA", {}, {a}, [&](FrameGraphPassContext& context) { textures[0] = context.getTexture(a); });
+    graph.addPass("makeB", {a}, {b}, [&](FrameGraphPassContext& context) { textures[1] = context.getTexture(b); });
+    graph.addPass("makeC", {b}, {c}, [&](FrameGraphPassContext& context) { textures[2] = context.getTexture(c); });
+    graph.addPass("makeSmall", {c}, {small}, [&](FrameGraphPassContext& context) { textures[3] = context.getTexture(small); });
+    graph.addPass("present", {small}, {target}, nullptr, true);
+    CHECK(graph.compile());
+    graph.execute();
+    CHECK(textures[0] == textures[2]);
+    CHECK(textures[0] != textures[1]);
+    CHECK(textures[3] != textures[0] && textures[3] != textures[1]);
+    CHECK_EQ(graph.getPhysicalTextureCount(), 3);
+    CHECK_EQ(graph.getTransientTextureBytes(), 3 * kOutputDesc.byteSize() + kSmallDesc.byteSize());
+    CHECK_EQ(graph.getPhysicalTextureBytes(), 2 * kOutputDesc.byteSize() + kSmallDesc.byteSize());
+}
+
+// declares the chain source -> scaled -> target at desc
+static void declareChain(FrameGraph& graph, const FrameGraphTextureDesc& desc) {
+    auto target = graph.importTexture("target", (void*)1, desc);
+    auto source = graph.createTexture("source", desc);
+    auto scaled = graph.createTexture("scaled", desc);
+    graph.addPass("makeSource", {}, {source}, nullptr);
+    graph.addPass("scale", {source}, {scaled}, nullptr);
+    graph.addPass("present", {scaled}, {target}, nullptr, true);
+}
+
+// the same graph next frame allocates nothing, a resize gives the old size back
+static void checkReuseAcrossFrames() {
+    CountingBackend backend;
+    {
+        FrameGraph graph(backend);
+        declareChain(graph, kOutputDesc);
+        CHECK(graph.compile());
+        int created = backend.createdCount;
+        for (int frame = 0; frame < 3; frame++) {
+            graph.reset();
+            declareChain(graph, kOutputDesc);
+            CHECK(graph.compile());
+        }
+        CHECK_EQ(backend.createdCount, created);
+
+        graph.reset();
+        declareChain(graph, kSmallDesc);
+        CHECK(graph.compile());
+        CHECK_EQ(backend.liveCount, 2);
+        CHECK_EQ(graph.getPhysicalTextureBytes(), 2 * kSmallDesc.byteSize());
+    }
+    CHECK_EQ(backend.liveCount, 0);
+}
+
+static void checkInvalidGraphs() {
+    CountingBackend backend;
+    FrameGraph graph(backend);
+    auto target = graph.importTexture("target", (void*)1, kOutputDesc);
+    auto a = graph.createTexture("a", kOutputDesc);
+    auto b = graph.createTexture("b", kOutputDesc);
+    graph.addPass("makeA", {b}, {a}, nullptr);
+    graph.addPass("makeB", {a}, {b}, nullptr);
+    graph.addPass("present", {a}, {target}, nullptr, true);
+    CHECK(!graph.compile());
+
+    // a transient read before anything in the frame wrote it
+    graph.reset();
+    target = graph.importTexture("target", (void*)1, kOutputDesc);
+    a = graph.createTexture("a", kOutputDesc);
+    graph.addPass("present", {a}, {target}, nullptr, true);
+    CHECK(!graph.compile());
+}
+
+int main() {
+    checkSort();
+    checkDeclarationOrder();
+    checkCull();
+    checkAlias();
+    checkReuseAcrossFrames();
+    checkInvalidGraphs();
+    return testExitCode();
+}
@@ -0,0 +1,171 @@
+// FrameRateGovernor: synthetic traces through the rate policy, stepping up, the step down hysteresis, the input
+// boost and the power / thermal caps
+#include "TestCheck.h"
+#include "utils/FrameRateGovernor.h"
+
+using Clock = FrameRateGovernor::Clock;
+using std::chrono::milliseconds;
+
+// a pacing loop ticking every 100ms: what the frames of each tick changed goes in, the rate after the tick comes out
+class GovernorTrace {
+public:
+    explicit GovernorTrace(FrameRateGovernor& governor) : m_governor(governor) {
+    }
+
+    int tick(double changeRatio = 0.0) {
+        m_now += milliseconds(100);
+        m_governor.reportChange(changeRatio);
+        return m_governor.update(m_now);
+    }
+
+    // calm ticks until the time since start reaches ms, the rate of the last one
+    int idleUntil(int ms) {
+        int rate = m_governor.getRate();
+        while (m_now < m_start + milliseconds(ms)) {
+            rate = tick();
+        }
+        return rate;
+    }
+
+    void input() {
+        m_governor.reportInput(m_now);
+    }
+
+    int elapsed() const {
+        return (int)std::chrono::duration_cast<milliseconds>(m_now - m_start).count();
+    }
+
+private:
+    FrameRateGovernor& m_governor;
+    Clock::time_point m_start = Clock::time_point() + std::chrono::hours(1);
+    Clock::time_point m_now = m_start;
+};
+
+// from the start rate down to the lowest one, one step per stepDownDelay of nothing changing
+static void checkStepDown() {
+    FrameRateGovernor governor;
+    GovernorTrace trace(governor);
+    CHECK_EQ(governor.getRate(), 60);
+    CHECK_EQ(governor.getFrameInterval().count(), 1000000000LL / 60);
+    CHECK_EQ(trace.tick(), 60);
+    CHECK_EQ(trace.idleUntil(2000), 60);
+    CHECK_EQ(trace.tick(), 30);
+    CHECK_EQ(trace.idleUntil(4000), 30);
+    CHECK_EQ(trace.tick(), 15);
+    CHECK_EQ(trace.idleUntil(6000), 15);
+    CHECK_EQ(trace.tick(), 2);
+    CHECK_EQ(trace.idleUntil(20000), 2);
+}
+
+// one busy frame is enough to go up, straight to the level its change asks for
+static void checkImmediateStepUp() {
+    FrameRateGovernor governor;
+    GovernorTrace trace(governor);
+    trace.idleUntil(10000);
+    CHECK_EQ(governor.getRate(), 2);
+    // under the first threshold: a blinking caret keeps the lowest rate
+    CHECK_EQ(trace.tick(0.005), 2);
+    CHECK_EQ(trace.tick(0.02), 15);
+    CHECK_EQ(trace.tick(0.06), 30);
+    CHECK_EQ(trace.tick(0.5), 60);
+    // a smaller change does not pull it down
+    CHECK_EQ(trace.tick(0.02), 60);
+}
+
+// the rate only drops after stepDownDelay without a frame asking for it, every busy frame starts the wait over
+static void checkStepDownHysteresis() {
+    FrameRateGovernor governor;
+    GovernorTrace trace(governor);
+    for (int i = 0; i < 10; i++) {
+        CHECK_EQ(trace.tick(0.3), 60);
+    }
+    int busyUntil = trace.elapsed();
+    CHECK_EQ(trace.idleUntil(busyUntil + 1900), 60);
+    CHECK_EQ(trace.tick(0.3), 60);
+    busyUntil = trace.elapsed();
+    CHECK_EQ(trace.idleUntil(busyUntil + 1900), 60);
+    CHECK_EQ(trace.tick(), 30);
+    // a change that asks for the current rate holds it as well
+    for (int i = 0; i < 30; i++) {
+        CHECK_EQ(trace.tick(0.06), 30);
+    }
+    CHECK_EQ(trace.idleUntil(trace.elapsed() + 1900), 30);
+    CHECK_EQ(trace.tick(), 15);
+}
+
+// input runs at inputRate for inputBoostDuration whatever the frames change, then the usual step down
+static void checkInputBoost() {
+    FrameRateGovernor governor;
+    GovernorTrace trace(governor);
+    trace.idleUntil(10000);
+    CHECK_EQ(governor.getRate(), 2);
+    trace.input();
+    int inputAt = trace.elapsed();
+    CHECK_EQ(trace.tick(), 60);
+    CHECK_EQ(trace.idleUntil(inputAt + 1400), 60);
+    // the boost ended at +1500, the last boosted tick at +1400 starts the wait
+    CHECK_EQ(trace.idleUntil(inputAt + 3300), 60);
+    CHECK_EQ(trace.tick(), 30);
+
+    // an input time older than the last one does not shorten the boost
+    trace.input();
+    CHECK_EQ(trace.tick(), 60);
+    governor.reportInput(Clock::time_point() + std::chrono::hours(1));
+    inputAt = trace.elapsed() - 100;
+    CHECK_EQ(trace.idleUntil(inputAt + 1400), 60);
+
+    FrameRateGovernorConfig config;
+    config.inputRate = 30;
+    FrameRateGovernor slowInput(config);
+    GovernorTrace slowTrace(slowInput);
+    slowTrace.idleUntil(10000);
+    slowTrace.input();
+    CHECK_EQ(slowTrace.tick(), 30);
+}
+
+// a cap applies at once, up and down, and the wanted rate comes back as soon as it is lifted
+static void checkPowerAndThermalCaps() {
+    FrameRateGovernor governor;
+    GovernorTrace trace(governor);
+    CHECK_EQ(trace.tick(0.5), 60);
+
+    FrameRatePowerState powerState;
+    powerState.onBattery = true;
+    governor.setPowerState(powerState);
+    CHECK_EQ(trace.tick(0.5), 30);
+    powerState.lowPowerMode = true;
+    governor.setPowerState(powerState);
+    CHECK_EQ(trace.tick(0.5), 15);
+    powerState = {};
+    powerState.thermalPressure = true;
+    governor.setPowerState(powerState);
+    CHECK_EQ(trace.tick(0.5), 30);
+    // input does not get past a cap either
+    trace.input();
+    CHECK_EQ(trace.tick(), 30);
+    powerState = {};
+    powerState.displayAsleep = true;
+    governor.setPowerState(powerState);
+    CHECK_EQ(trace.tick(0.5), 2);
+
+    governor.setPowerState({});
+    CHECK_EQ(trace.tick(0.5), 60);
+
+    // the display's refresh rate: never faster, at the highest step that is not
+    governor.setMaxRate(30);
+    CHECK_EQ(trace.tick(0.5), 30);
+    governor.setMaxRate(24);
+    CHECK_EQ(trace.tick(0.5), 15);
+    governor.setMaxRate(0);
+    CHECK_EQ(trace.tick(0.5), 60);
+    CHECK_EQ(governor.getFrameInterval().count(), 1000000000LL / 60);
+}
+
+int main() {
+    checkStepDown();
+    checkImmediateStepUp();
+    checkStepDownHysteresis();
+    checkInputBoost();
+    checkPowerAndThermalCaps();
+    return testExitCode();
+}
@@ -0,0 +1,97 @@
+// HideColorLut: the baked shift against the exact one over the whole 8 bit cube, for the default params and for
+// moved thresholds
+#include <cmath>
+#include <cstdio>
+#include "TestCheck.h"
+#include "GPUPipeline/HideColorLut.h"
+
+struct LutError {
+    double mean = 0.0;
+    double aboveTwo = 0.0;    // share of colors with a channel off by more than 2
+    double aboveEight = 0.0;
+    int max = 0;
+    int maxAwayFromEnds = 0;  // colors that are neither next to black nor next to white
+};
+
+static int channelOf(float value) {
+    return (int)std::lrintf(std::fmin(std::fmax(value, 0.0f), 1.0f) * 255.0f);
+}
+
+static LutError measure(const HideEffectParams& params) {
+    HideColorLut lut(params);
+    LutError error;
+    uint64_t total = 0, aboveTwo = 0, aboveEight = 0;
+    for (int r = 0; r < 256; r++) {
+        for (int g = 0; g < 256; g++) {
+            for (int b = 0; b < 256; b++) {
+                float outR, outG, outB;
+                adjustHslToStandOut(params, r / 255.0f, g / 255.0f, b / 255.0f, outR, outG, outB);
+                uint32_t sampled = sampleHideColorLut(lut.data(), 0xFF000000u | (r << 16) | (g << 8) | b);
+                int errors[3] = {std::abs((int)((sampled >> 16) & 0xFF) - channelOf(outR)),
+                                 std::abs((int)((sampled >> 8) & 0xFF) - channelOf(outG)),
+                                 std::abs((int)(sampled & 0xFF) - channelOf(outB))};
+                int worst = 0;
+                for (int e : errors) {
+                    total += e;
+                    worst = std::max(worst, e);
+                }
+                aboveTwo += worst > 2;
+                aboveEight += worst > 8;
+                error.max = std::max(error.max, worst);
+                if (std::max(r, std::max(g, b)) >= 24 && std::min(r, std::min(g, b)) <= 231) {
+                    error.maxAwayFromEnds = std::max(error.maxAwayFromEnds, worst);
+                }
+            }
+        }
+    }
+    const double colors = 256.0 * 256.0 * 256.0;
+    error.mean = total / (colors * 3.0);
+    error.aboveTwo = aboveTwo / colors;
+    error.aboveEight = aboveEight / colors;
+    std::printf("mean %.3f, above 2 %.4f%%, above 8 %.4f%%, max %d, max away from the ends %d\n", error.mean,
+                error.aboveTwo * 100.0, error.aboveEight * 100.0, error.max, error.maxAwayFromEnds);
+    return error;
+}
+
+// the jumps at the thresholds are not interpolated across, what is left is where the shift is steep within a range
+static void checkError(const HideEffectParams& params) {
+    LutError error = measure(params);
+    CHECK(error.mean < 0.3);
+    CHECK(error.aboveTwo < 0.005);
+    CHECK(error.aboveEight < 0.0005);
+    CHECK(error.maxAwayFromEnds <= 12);
+}
+
+// the lattice points themselves come out exact
+static void checkLatticePoints() {
+    HideEffectParams params;
+    HideColorLut lut(params);
+    for (int i = 0; i < kHideLutSize; i++) {
+        int value = i * 255 / (kHideLutSize - 1);
+        if (value * (kHideLutSize - 1) != i * 255) {
+            continue;
+        }
+        for (uint32_t pixel : {0x010101u * value, (uint32_t)value << 16, (uint32_t)value << 8 | 0xFF}) {
+            float outR, outG, outB;
+            adjustHslToStandOut(params, ((pixel >> 16) & 0xFF) / 255.0f, ((pixel >> 8) & 0xFF) / 255.0f,
+                                (pixel & 0xFF) / 255.0f, outR, outG, outB);
+            uint32_t expected = 0xFF000000u | (channelOf(outR) << 16) | (channelOf(outG) << 8) | channelOf(outB);
+            CHECK_EQ(sampleHideColorLut(lut.data(), pixel), expected);
+        }
+    }
+}
+
+int main() {
+    checkError(HideEffectParams());
+    HideEffectParams moved;
+    moved.specularThreshold = 68.0f;
+    moved.diffuseThreshold = 52.0f;
+    moved.lowLightThreshold = 18.0f;
+    moved.lowLightLightnessLift = 30.0f;
+    moved.upperDiffuseScale = 0.8f;
+    moved.specularHueShift = 40.0f;
+    moved.diffuseHueShift = -15.0f;
+    checkError(moved);
+    checkLatticePoints();
+    return testExitCode();
+}
@@ -0,0 +1,269 @@
+// HideEffect: settings -> gaussian taps / keepEnvBelow / specialization, the default effect against the hide chain as
+// it was hard coded before it was tunable, and PipelineVariantCache / selectHideEffect handing out the fallback
+// until the wanted variant is built
+#include <cstring>
+#include <random>
+#include <thread>
+#include "TestCheck.h"
+#include "GPUPipeline/HideEffect.h"
+#include "GPUPipeline/HidingFrameGraph.h"
+#include "GPUPipeline/PipelineVariantCache.h"
+#include "GPUPipeline/cpu/CpuHidingFilter.h"
+
+static void checkHighPassKernel() {
+    // the taps MPSImageGaussianBlur(0.5) had, and no blur at all for sigma 0
+    auto defaultKernel = HighPassKernel::forSigma(0.5f);
+    CHECK_EQ(defaultKernel.radius, 1);
+    CHECK_EQ(defaultKernel.weights[0], 202u);
+    CHECK_EQ(defaultKernel.weights[1], 27u);
+    CHECK_EQ(defaultKernel.weights[2], 0u);
+    auto noBlur = HighPassKernel::forSigma(0.0f);
+    CHECK_EQ(noBlur.radius, 0);
+    CHECK_EQ(noBlur.weights[0], 256u);
+
+    // wider with sigma up to kMaxHighPassRadius, always 256 in total and falling off from the center
+    int lastRadius = 0;
+    for (float sigma = 0.1f; sigma < 8.0f; sigma += 0.1f) {
+        auto kernel = HighPassKernel::forSigma(sigma);
+        CHECK(kernel.radius >= lastRadius && kernel.radius <= kMaxHighPassRadius);
+        lastRadius = kernel.radius;
+        uint32_t sum = kernel.weights[0];
+        for (int i = 1; i <= kMaxHighPassRadius; i++) {
+            sum += 2 * kernel.weights[i];
+            CHECK(kernel.weights[i] <= kernel.weights[i - 1]);
+            CHECK((kernel.weights[i] > 0) == (i <= kernel.radius));
+        }
+        CHECK_EQ(sum, 256u);
+    }
+    CHECK_EQ(HighPassKernel::forSigma(0.8f).radius, 2);
+    CHECK_EQ(lastRadius, kMaxHighPassRadius);
+}
+
+static void checkSettingsMapping() {
+    HideEffect defaultEffect{HideEffectSettings{}};
+    // color2 * 1.2 < 0.001 only held for a black pixel
+    CHECK_EQ(defaultEffect.getKeepEnvBelow(), 1u);
+    CHECK_EQ(defaultEffect.getSpecialization().highPassRadius, 1);
+    const auto& uniforms = defaultEffect.getUniforms();
+    CHECK_EQ(uniforms.keepEnvBelow, 1u);
+    CHECK_EQ(uniforms.highPassWeights[0], 202u);
+    CHECK_EQ(uniforms.highPassWeights[1], 27u);
+    CHECK_EQ(uniforms.highPassWeights[2], 0u);
+
+    // a fainter gain lets the darkest high pass values through as black
+    HideEffectSettings settings;
+    settings.highPassGain = 0.2f;
+    CHECK_EQ(HideEffect(settings).getKeepEnvBelow(), 2u);
+    settings.highPassGain = 0.0f;
+    CHECK_EQ(HideEffect(settings).getKeepEnvBelow(), 256u);
+
+    settings = {};
+    settings.highPassSigma = 1.3f;
+    HideEffect wide(settings);
+    CHECK_EQ(wide.getSpecialization().highPassRadius, 3);
+    CHECK_EQ(wide.getHighPassKernel().weights[3], wide.getUniforms().highPassWeights[3]);
+    CHECK(wide.getSpecialization() != defaultEffect.getSpecialization());
+    CHECK(wide.getId() != defaultEffect.getId());
+
+    // the lut is the color shift's, shared between effects with the same one
+    CHECK(wide.getColorLut().getParams() == HideEffectParams{});
+    CHECK(&wide.getColorLut() == &defaultEffect.getColorLut());
+
+    CHECK(settings != HideEffectSettings{});
+    CHECK(settings.hash() != HideEffectSettings{}.hash());
+    settings.highPassSigma = 0.5f;
+    CHECK(settings == HideEffectSettings{});
+    CHECK_EQ(settings.hash(), HideEffectSettings{}.hash());
+}
+
+// ---- the hide chain as the shaders had it hard coded ----
+
+static uint8_t oldGaussianTap(int outer0, int center, int outer1) {
+    return (uint8_t)((27 * (outer0 + outer1) + 202 * center + 128) >> 8);
+}
+
+// MPSImageGaussianBlur(0.5), zero edges, rounded after each direction -> subtract -> hidingShader
+static void oldHideChain(const CpuImageView& env, const CpuImageView& app, const CpuImageView& output, const uint32_t* lut) {
+    int width = app.width;
+    int height = app.height;
+    std::vector<uint8_t> rows((size_t)width * height * 4);
+    auto appAt = [&](int x, int y, int c) {
+        return x >= 0 && x < width ? (int)app.row(y)[x * 4 + c] : 0;
+    };
+    auto rowAt = [&](int x, int y, int c) {
+        return y >= 0 && y < height ? (int)rows[((size_t)y * width + x) * 4 + c] : 0;
+    };
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            for (int c = 0; c < 4; c++) {
+                rows[((size_t)y * width + x) * 4 + c] = oldGaussianTap(appAt(x - 1, y, c), appAt(x, y, c), appAt(x + 1, y, c));
+            }
+        }
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            bool black = true;
+            for (int c = 0; c < 3; c++) {
+                int blurred = oldGaussianTap(rowAt(x, y - 1, c), rowAt(x, y, c), rowAt(x, y + 1, c));
+                black = black && app.row(y)[x * 4 + c] <= blurred;
+            }
+            const uint8_t* envPixel = env.row(y) + x * 4;
+            uint8_t* dstPixel = output.row(y) + x * 4;
+            if (black) {
+                std::memcpy(dstPixel, envPixel, 3);
+                dstPixel[3] = 255;
+            } else {
+                uint32_t pixel;
+                std::memcpy(&pixel, envPixel, 4);
+                pixel = sampleHideColorLut(lut, pixel);
+                std::memcpy(dstPixel, &pixel, 4);
+            }
+        }
+    }
+}
+
+// the default settings write what the hard coded chain wrote, on every kernel set and every path
+static void checkDefaultMatchesOldChain() {
+    const int width = 83;
+    const int height = 47;
+    std::mt19937 random(5);
+    CpuImage env(width, height), app(width, height), expected(width, height);
+    for (int i = 0; i < width * height * 4; i++) {
+        env.data()[i] = (uint8_t)random();
+    }
+    // flat blocks (no high pass, env kept), hard edges between them and a noisy band
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t* pixel = app.view().row(y) + x * 4;
+            for (int c = 0; c < 4; c++) {
+                pixel[c] = y > 20 && y < 30 ? (uint8_t)random() : (uint8_t)(((x / 16 + y / 12) % 3) * 90 + c * 10);
+            }
+        }
+    }
+    auto defaultEffect = HideEffect::getDefault();
+    oldHideChain(env.view(), app.view(), expected.view(), defaultEffect->getColorLut().data());
+
+    std::vector<CpuKernelIsa> isas{CpuKernelIsa::Scalar};
+    if (getCpuKernels().isa != CpuKernelIsa::Scalar) {
+        isas.push_back(getCpuKernels().isa);
+    }
+    size_t byteCount = (size_t)width * height * 4;
+    for (auto isa : isas) {
+        CpuHidingFilter filter(isa);
+        CpuImage output(width, height);
+        CHECK(filter.process(env.view(), app.view(), output.view(), *defaultEffect));
+        CHECK(std::memcmp(output.data(), expected.data(), byteCount) == 0);
+        std::memset(output.data(), 0, byteCount);
+        CHECK(filter.highPassHideProcess(env.view(), app.view(), output.view(), *defaultEffect));
+        CHECK(std::memcmp(output.data(), expected.data(), byteCount) == 0);
+        std::memset(output.data(), 0, byteCount);
+        CHECK(filter.highPassHideRect(env.view(), app.view(), output.view(), 0, 0, width, height, *defaultEffect));
+        CHECK(std::memcmp(output.data(), expected.data(), byteCount) == 0);
+    }
+}
+
+// ---- variants ----
+
+static void checkVariantCache() {
+    PipelineVariantCache cache("testVariants", 2);
+    std::atomic<int> builds{0};
+    auto builder = [&builds](int value) {
+        return [&builds, value]() -> PipelineVariantCache::Variant {
+            builds++;
+            return std::make_shared<int>(value);
+        };
+    };
+    // not there: null, built in the background, there on a later request
+    CHECK(cache.request(1, builder(10)) == nullptr);
+    CHECK(cache.request(1, builder(10)) == nullptr || builds == 1);
+    cache.waitIdle();
+    CHECK(!cache.isBuilding());
+    auto variant = cache.request(1, builder(10));
+    CHECK(variant != nullptr);
+    CHECK(variant && *std::static_pointer_cast<int>(variant) == 10);
+    CHECK_EQ(builds.load(), 1);
+
+    // a failed build is not tried again
+    auto failing = [&builds]() -> PipelineVariantCache::Variant {
+        builds++;
+        return nullptr;
+    };
+    CHECK(cache.request(2, failing) == nullptr);
+    cache.waitIdle();
+    CHECK(cache.request(2, failing) == nullptr);
+    cache.waitIdle();
+    CHECK_EQ(builds.load(), 2);
+
+    // get builds on the calling thread, the least recently used variant goes past maxVariants
+    auto three = cache.get(3, builder(30));
+    CHECK(three && *std::static_pointer_cast<int>(three) == 30);
+    cache.request(1, builder(10));
+    cache.insert(4, std::make_shared<int>(40));
+    CHECK(cache.request(3, builder(31)) == nullptr);
+    CHECK(cache.request(1, builder(11)) != nullptr);
+    cache.waitIdle();
+    three = cache.request(3, builder(31));
+    CHECK(three && *std::static_pointer_cast<int>(three) == 31);
+}
+
+// answers isHideEffectReady as told, the stages are never run
+class ReadyExecutor : public HidingStageExecutor {
+public:
+    void crop(void*, const FrameGraphCrop&, void*) override {}
+    void scale(void*, void*) override {}
+    void gaussian(void*, void*, const HideEffect&) override {}
+    void subtract(void*, void*, void*) override {}
+    void hide(void*, void*, void*, const HideEffect&) override {}
+    void highPassHide(void*, void*, void*, const HideEffect&) override {}
+    void present(void*, void*) override {}
+    void scaleRects(void*, void*, const std::vector<DirtyRect>&) override {}
+    void highPassHideTiles(void*, void*, void*, const DirtyTileMap&, const HideEffect&) override {}
+
+    bool isHideEffectReady(const HideEffectSpecialization& specialization) override {
+        asked.push_back(specialization.highPassRadius);
+        return ready;
+    }
+
+    bool ready = false;
+    std::vector<int> asked;
+};
+
+// the current effect keeps running until the wanted one is baked and the executor has its pipelines
+static void checkSelectHideEffect() {
+    ReadyExecutor executor;
+    HideEffectSettings wanted;
+    wanted.highPassSigma = 1.0f;
+    wanted.highPassGain = 2.0f;
+    auto defaultEffect = HideEffect::getDefault();
+    CHECK(selectHideEffect(nullptr, HideEffectSettings{}, executor) == defaultEffect);
+
+    std::shared_ptr<const HideEffect> current;
+    for (int i = 0; i < 500 && executor.asked.empty(); i++) {
+        current = selectHideEffect(nullptr, wanted, executor);
+        CHECK(current == defaultEffect);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    // baked by now, still not ready to run
+    CHECK(!executor.asked.empty() && executor.asked.back() == 3);
+    CHECK(selectHideEffect(current, wanted, executor) == defaultEffect);
+
+    executor.ready = true;
+    auto selected = selectHideEffect(current, wanted, executor);
+    CHECK(selected != defaultEffect);
+    CHECK(selected && selected->getSettings() == wanted);
+    // once there it is kept without asking again, and the same effect comes back for the same settings
+    executor.asked.clear();
+    CHECK(selectHideEffect(selected, wanted, executor) == selected);
+    CHECK(executor.asked.empty());
+    CHECK(HideEffect::request(wanted) == selected);
+    CHECK(HideEffect::request(HideEffectSettings{}) == defaultEffect);
+}
+
+int main() {
+    checkHighPassKernel();
+    checkSettingsMapping();
+    checkDefaultMatchesOldChain();
+    checkVariantCache();
+    checkSelectHideEffect();
+    return testExitCode();
+}
@@ -0,0 +1,119 @@
+// ShaderCache: keys, manifest round trip across opens and what invalidates an entry
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include "TestCheck.h"
+#include "GPUPipeline/ShaderCache.h"
+
+namespace fs = std::filesystem;
+
+// what the backend does: write a binary to the staging path, then store it
+static bool storeBinary(ShaderCache& cache, const std::string& shaderDesc, const ShaderCacheKey& key,
+                        const std::string& contents) {
+    std::ofstream(cache.stagingPath(key), std::ios::binary) << contents;
+    return cache.store(shaderDesc, key);
+}
+
+static void checkKeys() {
+    // fnv-1a reference values, the files of one run have to be found by the next
+    CHECK_EQ(hashShaderCacheString(""), 14695981039346656037ull);
+    CHECK_EQ(hashShaderCacheString("a"), 0xaf63dc4c8601ec8cull);
+    auto key = ShaderCacheKey::make("source", "pipeline", "device");
+    CHECK(key == ShaderCacheKey::make("source", "pipeline", "device"));
+    for (const auto& other : {ShaderCacheKey::make("source2", "pipeline", "device"),
+                              ShaderCacheKey::make("source", "pipeline2", "device"),
+                              ShaderCacheKey::make("source", "pipeline", "device2")}) {
+        CHECK(key != other);
+        CHECK(key.fileName() != other.fileName());
+    }
+}
+
+static void checkManifest(const fs::path& root) {
+    auto version = "v" + std::to_string(kShaderCacheVersion);
+    auto key = ShaderCacheKey::make("kernel void a() {}", "hideShader", "gpu0");
+    auto otherDeviceKey = ShaderCacheKey::make("kernel void a() {}", "hideShader", "gpu1");
+    {
+        ShaderCache cache(root.string());
+        CHECK(cache.isEnabled());
+        CHECK(cache.lookup("hide", key).empty());
+        CHECK(storeBinary(cache, "hide", key, "binary0"));
+        CHECK(storeBinary(cache, "hide", otherDeviceKey, "binary1"));
+        CHECK(!cache.lookup("hide", key).empty());
+        // a staging file that is empty is not an entry
+        std::ofstream(cache.stagingPath(ShaderCacheKey::make("x", "y", "gpu0")));
+        CHECK(!cache.store("empty", ShaderCacheKey::make("x", "y", "gpu0")));
+    }
+
+    // the next launch finds both devices' entries through the manifest, a leftover of an older version and a
+    // file the manifest does not know are gone
+    fs::create_directories(root / "v0");
+    std::ofstream(root / version / "halfway.metallib.partial") << "junk";
+    {
+        ShaderCache cache(root.string());
+        auto path = cache.lookup("hide", key);
+        CHECK(!path.empty());
+        CHECK(!cache.lookup("hide", otherDeviceKey).empty());
+        CHECK(!fs::exists(root / "v0"));
+        CHECK(!fs::exists(root / version / "halfway.metallib.partial"));
+        // same desc, another key (the device matches but the source changed) misses
+        CHECK(cache.lookup("hide", ShaderCacheKey::make("kernel void b() {}", "hideShader", "gpu0")).empty());
+
+        // a binary truncated behind the cache's back misses
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << "bin";
+        CHECK(cache.lookup("hide", key).empty());
+        CHECK(storeBinary(cache, "hide", key, "binary0"));
+        CHECK(!cache.lookup("hide", key).empty());
+    }
+
+    // an edited shader replaces its entry and the old binary is deleted, the other device's stays
+    auto editedKey = ShaderCacheKey::make("kernel void a() { edited }", "hideShader", "gpu0");
+    {
+        ShaderCache cache(root.string());
+        auto oldPath = cache.lookup("hide", key);
+        CHECK(storeBinary(cache, "hide", editedKey, "binary2"));
+        CHECK(cache.lookup("hide", key).empty());
+        CHECK(!cache.lookup("hide", editedKey).empty());
+        CHECK(!fs::exists(oldPath));
+        CHECK(!cache.lookup("hide", otherDeviceKey).empty());
+
+        // a binary that did not load is dropped
+        auto editedPath = cache.lookup("hide", editedKey);
+        cache.invalidate("hide", editedKey);
+        CHECK(cache.lookup("hide", editedKey).empty());
+        CHECK(!fs::exists(editedPath));
+    }
+    {
+        ShaderCache cache(root.string());
+        CHECK(cache.lookup("hide", editedKey).empty());
+        CHECK(!cache.lookup("hide", otherDeviceKey).empty());
+    }
+
+    // a manifest of another format is ignored, its files then are unknown ones
+    std::ofstream(root / version / "manifest.txt", std::ios::trunc) << "something else\n";
+    {
+        ShaderCache cache(root.string());
+        CHECK(cache.lookup("hide", otherDeviceKey).empty());
+        CHECK(!fs::exists(root / version / otherDeviceKey.fileName()));
+    }
+}
+
+static void checkDisabled() {
+    ShaderCache cache("");
+    auto key = ShaderCacheKey::make("source", "pipeline", "device");
+    CHECK(!cache.isEnabled());
+    CHECK(cache.stagingPath(key).empty());
+    CHECK(!cache.store("desc", key));
+    CHECK(cache.lookup("desc", key).empty());
+}
+
+int main() {
+    auto root = fs::temp_directory_path() / ("hidingin-shader-cache-test-" + std::to_string(std::hash<std::string>{}(
+            fs::current_path().string())));
+    std::error_code error;
+    fs::remove_all(root, error);
+    checkKeys();
+    checkManifest(root);
+    checkDisabled();
+    fs::remove_all(root, error);
+    return testExitCode();
+}
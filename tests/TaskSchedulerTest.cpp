@@ -0,0 +1,276 @@
+// TaskScheduler: submission order, lanes, deadline / coalesce / eviction drops, stop and detached tasks
+#include <mutex>
+#include "TestCheck.h"
+#include "utils/TaskScheduler.h"
+
+// holds the worker in a task until opened, what is enqueued meanwhile queues up behind it
+class WorkerGate {
+public:
+    explicit WorkerGate(TaskScheduler& scheduler) {
+        auto opened = m_open.get_future().share();
+        std::promise<void> started;
+        auto startedFuture = started.get_future();
+        m_future = scheduler.enqueueTask([opened, started = std::move(started)](const std::string&) mutable {
+            started.set_value();
+            opened.wait();
+        });
+        startedFuture.wait();
+    }
+
+    void open() {
+        m_open.set_value();
+        m_future.get();
+    }
+
+private:
+    std::promise<void> m_open;
+    std::future<void> m_future;
+};
+
+// the order tasks ran in
+class RunLog {
+public:
+    auto task(int id) {
+        return [this, id](const std::string&) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_ids.push_back(id);
+        };
+    }
+
+    std::vector<int> ids() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_ids;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<int> m_ids;
+};
+
+static bool wasDropped(std::future<void>& future) {
+    try {
+        future.get();
+    } catch (const TaskDroppedError&) {
+        return true;
+    }
+    return false;
+}
+
+static std::vector<std::string> threadNames{"worker0", "worker1", "worker2", "worker3"};
+
+static void checkFifoOnOneWorker() {
+    TaskScheduler scheduler(1, threadNames, 64);
+    RunLog log;
+    WorkerGate gate(scheduler);
+    std::vector<std::future<void>> futures;
+    std::vector<int> expected;
+    for (int i = 0; i < 40; i++) {
+        futures.push_back(scheduler.enqueueTask(log.task(i)));
+        expected.push_back(i);
+    }
+    gate.open();
+    for (auto& future : futures) {
+        future.get();
+    }
+    CHECK(log.ids() == expected);
+    CHECK_EQ(scheduler.getDroppedTaskCount(), (uint64_t)0);
+}
+
+static void checkControlLaneFirst() {
+    TaskScheduler scheduler(1, threadNames, 64);
+    RunLog log;
+    WorkerGate gate(scheduler);
+    TaskOptions control;
+    control.lane = TaskLane::Control;
+    auto frame1 = scheduler.enqueueTask(log.task(1));
+    auto frame2 = scheduler.enqueueTask(log.task(2));
+    auto control3 = scheduler.enqueueTask(log.task(3), control);
+    auto control4 = scheduler.enqueueTask(log.task(4), control);
+    gate.open();
+    frame2.get();
+    CHECK((log.ids() == std::vector<int>{3, 4, 1, 2}));
+}
+
+static void checkDeadlineAndCoalesceDrops() {
+    TaskScheduler scheduler(1, threadNames, 64);
+    RunLog log;
+    WorkerGate gate(scheduler);
+    TaskOptions late;
+    late.deadline = std::chrono::steady_clock::now() - std::chrono::milliseconds(1);
+    TaskOptions coalesced;
+    coalesced.coalesceKey = TaskScheduler::coalesceKeyFor("frame");
+    auto lateFuture = scheduler.enqueueTask(log.task(1), late);
+    auto first = scheduler.enqueueTask(log.task(2), coalesced);
+    auto second = scheduler.enqueueTask(log.task(3), coalesced);
+    auto plain = scheduler.enqueueTask(log.task(4));
+    auto newest = scheduler.enqueueTask(log.task(5), coalesced);
+    gate.open();
+    CHECK(wasDropped(lateFuture));
+    CHECK(wasDropped(first));
+    CHECK(wasDropped(second));
+    CHECK(!wasDropped(plain));
+    CHECK(!wasDropped(newest));
+    CHECK((log.ids() == std::vector<int>{4, 5}));
+    CHECK_EQ(scheduler.getDroppedTaskCount(), (uint64_t)3);
+}
+
+// maxTasks 3 on one worker is a pool of 4 nodes: the gate and three queued tasks fill it
+static void checkEvictionOnlyOfOptedIn() {
+    TaskOptions evictable;
+    evictable.dropOldestWhenFull = true;
+    {
+        TaskScheduler scheduler(1, threadNames, 3);
+        RunLog log;
+        WorkerGate gate(scheduler);
+        auto plain1 = scheduler.enqueueTask(log.task(1));
+        auto evictable2 = scheduler.enqueueTask(log.task(2), evictable);
+        auto plain3 = scheduler.enqueueTask(log.task(3));
+        // full: evicts 2, not the older plain 1, and gets its node once the worker skipped it
+        std::future<void> evictable4;
+        std::thread producer([&] {
+            evictable4 = scheduler.enqueueTask(log.task(4), evictable);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        gate.open();
+        producer.join();
+        evictable4.get();
+        CHECK(!wasDropped(plain1));
+        CHECK(wasDropped(evictable2));
+        CHECK(!wasDropped(plain3));
+        CHECK((log.ids() == std::vector<int>{1, 3, 4}));
+    }
+    {
+        // nothing opted in: the evicting producer waits like everybody else, nothing is dropped
+        TaskScheduler scheduler(1, threadNames, 3);
+        RunLog log;
+        WorkerGate gate(scheduler);
+        std::vector<std::future<void>> futures;
+        for (int i = 0; i < 3; i++) {
+            futures.push_back(scheduler.enqueueTask(log.task(i)));
+        }
+        std::thread producer([&] {
+            futures.push_back(scheduler.enqueueTask(log.task(3), evictable));
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        CHECK_EQ(scheduler.size(), 3);
+        gate.open();
+        producer.join();
+        for (auto& future : futures) {
+            CHECK(!wasDropped(future));
+        }
+        CHECK((log.ids() == std::vector<int>{0, 1, 2, 3}));
+        CHECK_EQ(scheduler.getDroppedTaskCount(), (uint64_t)0);
+    }
+}
+
+// a coalesced task refused on a full pool must not supersede the queued one with its key
+static void checkRefusedTaskKeepsCoalesced() {
+    TaskScheduler scheduler(1, threadNames, 3);
+    RunLog log;
+    WorkerGate gate(scheduler);
+    TaskOptions coalesced;
+    coalesced.coalesceKey = TaskScheduler::coalesceKeyFor("frame");
+    auto queued = scheduler.enqueueTask(log.task(1), coalesced);
+    auto plain2 = scheduler.enqueueTask(log.task(2));
+    auto plain3 = scheduler.enqueueTask(log.task(3));
+    std::future<void> refused;
+    std::thread producer([&] {
+        refused = scheduler.enqueueTask(log.task(4), coalesced);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    scheduler.stop();
+    producer.join();
+    CHECK(!refused.valid());
+    gate.open();
+    CHECK(!wasDropped(queued));
+    plain3.get();
+    CHECK((log.ids() == std::vector<int>{1, 2, 3}));
+}
+
+static void checkStopDrainsAndRefuses() {
+    TaskScheduler scheduler(2, threadNames, 64);
+    RunLog log;
+    WorkerGate gate(scheduler);
+    std::vector<std::future<void>> futures;
+    for (int i = 0; i < 10; i++) {
+        futures.push_back(scheduler.enqueueTask(log.task(i)));
+    }
+    scheduler.stop();
+    CHECK(!scheduler.enqueueTask(log.task(10)).valid());
+    CHECK(!scheduler.enqueueDetachedTask(log.task(11)));
+    gate.open();
+    for (auto& future : futures) {
+        CHECK(!wasDropped(future));
+    }
+    CHECK_EQ(log.ids().size(), (size_t)10);
+}
+
+static void checkDetachedTasks() {
+    std::atomic<int> ran{0};
+    {
+        TaskScheduler scheduler(4, threadNames, 16);
+        for (int i = 0; i < 200; i++) {
+            // more than the pool holds: the producer waits for nodes instead of failing
+            CHECK(scheduler.enqueueDetachedTask([&ran](const std::string&) {
+                ran.fetch_add(1);
+            }));
+        }
+        // a throwing detached task is logged, the worker goes on
+        CHECK(scheduler.enqueueDetachedTask([](const std::string&) {
+            throw std::runtime_error("detached");
+        }));
+        CHECK(scheduler.enqueueDetachedTask([&ran](const std::string&) {
+            ran.fetch_add(1);
+        }));
+        // the destructor drains what is queued
+    }
+    CHECK_EQ(ran.load(), 201);
+}
+
+// tasks enqueued from a worker go to its deque and are stolen by the others, every one runs once
+static void checkNestedTasks() {
+    std::atomic<int> ran{0};
+    {
+        TaskScheduler scheduler(4, threadNames, 256);
+        std::vector<std::future<void>> futures;
+        for (int i = 0; i < 8; i++) {
+            futures.push_back(scheduler.enqueueTask([&](const std::string&) {
+                for (int j = 0; j < 16; j++) {
+                    scheduler.enqueueDetachedTask([&ran](const std::string&) {
+                        ran.fetch_add(1);
+                    });
+                }
+            }));
+        }
+        for (auto& future : futures) {
+            future.get();
+        }
+    }
+    CHECK_EQ(ran.load(), 8 * 16);
+}
+
+static void checkExecInPlace() {
+    TaskScheduler scheduler(1, threadNames, 8, true);
+    RunLog log;
+    TaskOptions control;
+    control.lane = TaskLane::Control;
+    auto frame1 = scheduler.enqueueTask(log.task(1));
+    auto control2 = scheduler.enqueueTask(log.task(2), control);
+    CHECK(log.ids().empty());
+    scheduler.execAllTasksInPlace();
+    CHECK((log.ids() == std::vector<int>{2, 1}));
+    CHECK(scheduler.empty());
+}
+
+int main() {
+    checkFifoOnOneWorker();
+    checkControlLaneFirst();
+    checkDeadlineAndCoalesceDrops();
+    checkEvictionOnlyOfOptedIn();
+    checkRefusedTaskKeepsCoalesced();
+    checkStopDrainsAndRefuses();
+    checkDetachedTasks();
+    checkNestedTasks();
+    checkExecInPlace();
+    return testExitCode();
+}
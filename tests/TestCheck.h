@@ -0,0 +1,41 @@
+#ifndef HIDINGIN_TESTCHECK_H
+#define HIDINGIN_TESTCHECK_H
+
+#include <iostream>
+
+// the checks of a test executable: a failed CHECK prints where and what and the test keeps going, main returns
+// testExitCode() so ctest sees the failures
+inline int& testFailureCount() {
+    static int failureCount = 0;
+    return failureCount;
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+            testFailureCount()++; \
+        } \
+    } while (0)
+
+// a and b printed when they differ
+#define CHECK_EQ(a, b) \
+    do { \
+        auto checkA = (a); \
+        auto checkB = (b); \
+        if (!(checkA == checkB)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ(" #a ", " #b ") failed: " << checkA << " vs " \
+                      << checkB << std::endl; \
+            testFailureCount()++; \
+        } \
+    } while (0)
+
+inline int testExitCode() {
+    if (testFailureCount()) {
+        std::cerr << testFailureCount() << " check(s) failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+#endif //HIDINGIN_TESTCHECK_H
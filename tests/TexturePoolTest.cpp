@@ -0,0 +1,169 @@
+// TexturePool: generation tagged handles, frame fenced recycling, size classes, budget and idle eviction
+#include <set>
+#include "TestCheck.h"
+#include "GPUPipeline/TexturePool.h"
+
+constexpr int kBGRA8 = 80;
+
+// numbered fake textures, remembers which are alive
+class RecordingAllocator : public TexturePoolAllocator {
+public:
+    void* createTexture(int, int, int) override {
+        auto* texture = (void*)(intptr_t)++createdCount;
+        live.insert(texture);
+        return texture;
+    }
+
+    void destroyTexture(void* texture) override {
+        live.erase(texture);
+    }
+
+    int createdCount = 0;
+    std::set<void*> live;
+};
+
+static void checkHandles() {
+    RecordingAllocator allocator;
+    TexturePool pool(allocator);
+    pool.beginFrame();
+    auto handle = pool.acquire(64, 64, kBGRA8);
+    CHECK(handle.valid());
+    auto* texture = pool.resolve(handle);
+    CHECK(texture != nullptr);
+    pool.release(handle);
+    // released: the old handle stops resolving, releasing it again does nothing
+    CHECK(pool.resolve(handle) == nullptr);
+    pool.release(handle);
+    CHECK_EQ(pool.getStats().inUseBytes, (size_t)0);
+
+    // a new owner of the same texture gets a handle the old one can not pass for
+    pool.signalFrameCompleted(pool.currentFrame());
+    auto reused = pool.acquire(64, 64, kBGRA8);
+    CHECK(pool.resolve(reused) == texture);
+    CHECK_EQ(reused.index, handle.index);
+    CHECK(reused.generation != handle.generation);
+    CHECK(pool.resolve(handle) == nullptr);
+
+    CHECK(!pool.acquire(0, 64, kBGRA8).valid());
+    CHECK(pool.resolve(TexturePoolHandle{}) == nullptr);
+}
+
+// a texture released in a frame is only handed out again once that frame completed
+static void checkFrameFence() {
+    RecordingAllocator allocator;
+    TexturePool pool(allocator);
+    auto frame = pool.beginFrame();
+    auto first = pool.acquire(32, 32, kBGRA8);
+    auto* texture = pool.resolve(first);
+    pool.release(first);
+
+    pool.beginFrame();
+    auto whileInFlight = pool.acquire(32, 32, kBGRA8);
+    CHECK(pool.resolve(whileInFlight) != texture);
+    CHECK_EQ(pool.getStats().misses, (uint64_t)2);
+    pool.release(whileInFlight);
+
+    // completion handlers may come out of order, an older frame does not move the fence back
+    pool.signalFrameCompleted(frame);
+    pool.signalFrameCompleted(frame - 1);
+    auto afterFence = pool.acquire(32, 32, kBGRA8);
+    CHECK(pool.resolve(afterFence) == texture);
+    CHECK_EQ(pool.getStats().hits, (uint64_t)1);
+    CHECK_EQ(allocator.createdCount, 2);
+}
+
+// only the same width, height and format is reused
+static void checkSizeClasses() {
+    RecordingAllocator allocator;
+    TexturePool pool(allocator);
+    pool.beginFrame();
+    pool.release(pool.acquire(64, 32, kBGRA8));
+    pool.signalFrameCompleted(pool.currentFrame());
+    auto otherFormat = pool.acquire(64, 32, 115);
+    auto otherSize = pool.acquire(32, 64, kBGRA8);
+    auto same = pool.acquire(64, 32, kBGRA8);
+    auto stats = pool.getStats();
+    CHECK_EQ(stats.hits, (uint64_t)1);
+    CHECK_EQ(stats.misses, (uint64_t)3);
+    CHECK_EQ(stats.residentTextures, 3);
+    CHECK_EQ(stats.residentBytes, (size_t)64 * 32 * 8 + 2 * (size_t)64 * 32 * 4);
+    CHECK(pool.resolve(otherFormat) && pool.resolve(otherSize) && pool.resolve(same));
+}
+
+// over budget the least recently released idle texture goes first, in use ones never
+static void checkBudgetEviction() {
+    RecordingAllocator allocator;
+    size_t textureBytes = 16 * 16 * 4;
+    TexturePool pool(allocator, 3 * textureBytes);
+    pool.beginFrame();
+    auto inUse = pool.acquire(16, 16, kBGRA8);
+    auto older = pool.acquire(16, 16, kBGRA8);
+    auto newer = pool.acquire(16, 16, kBGRA8);
+    auto* olderTexture = pool.resolve(older);
+    auto* newerTexture = pool.resolve(newer);
+    pool.release(older);
+    pool.release(newer);
+    pool.signalFrameCompleted(pool.currentFrame());
+
+    // a different size needs room: the older idle one is evicted, the newer one stays
+    auto other = pool.acquire(8, 8, kBGRA8);
+    CHECK(other.valid());
+    CHECK(!allocator.live.count(olderTexture));
+    CHECK(allocator.live.count(newerTexture));
+    CHECK(pool.resolve(inUse) != nullptr);
+    CHECK_EQ(pool.getStats().evictions, (uint64_t)1);
+    CHECK(pool.getStats().residentBytes <= 3 * textureBytes);
+
+    // a smaller budget evicts what is idle right away, trim drops the rest of it
+    pool.setBudgetBytes(textureBytes);
+    CHECK(!allocator.live.count(newerTexture));
+    pool.release(other);
+    pool.signalFrameCompleted(pool.currentFrame());
+    pool.trim();
+    CHECK_EQ(pool.getStats().residentTextures, 1);
+    CHECK(pool.resolve(inUse) != nullptr);
+}
+
+// an idle texture nobody wanted for kMaxIdleFrames frames is freed, one that keeps being used is not
+static void checkIdleEviction() {
+    RecordingAllocator allocator;
+    TexturePool pool(allocator);
+    pool.beginFrame();
+    auto oldSize = pool.acquire(128, 128, kBGRA8);
+    auto* oldTexture = pool.resolve(oldSize);
+    pool.release(oldSize);
+    void* steadyTexture = nullptr;
+    for (uint64_t frame = 0; frame < TexturePool::kMaxIdleFrames + 2; frame++) {
+        pool.beginFrame();
+        auto steady = pool.acquire(64, 64, kBGRA8);
+        steadyTexture = steadyTexture ? steadyTexture : pool.resolve(steady);
+        CHECK(pool.resolve(steady) == steadyTexture);
+        pool.release(steady);
+        pool.signalFrameCompleted(pool.currentFrame());
+    }
+    pool.beginFrame();
+    CHECK(!allocator.live.count(oldTexture));
+    CHECK(allocator.live.count(steadyTexture));
+    CHECK_EQ(allocator.createdCount, 2);
+}
+
+static void checkDestruction() {
+    RecordingAllocator allocator;
+    {
+        TexturePool pool(allocator);
+        pool.beginFrame();
+        pool.acquire(16, 16, kBGRA8);
+        pool.release(pool.acquire(32, 32, kBGRA8));
+    }
+    CHECK(allocator.live.empty());
+}
+
+int main() {
+    checkHandles();
+    checkFrameFence();
+    checkSizeClasses();
+    checkBudgetEviction();
+    checkIdleEviction();
+    checkDestruction();
+    return testExitCode();
+}
@@ -0,0 +1,175 @@
+// WindowLogic: the batch rect math, the grid and the occlusion coverage against their scalar definitions on random
+// rects. coordinates are small so edges touch and rects coincide often, sizes go down to zero and below.
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <set>
+#include "TestCheck.h"
+#include "utils/WindowLogic.h"
+
+using Rect = std::tuple<int, int, int, int>;
+
+static Rect randomRect(std::mt19937& random) {
+    std::uniform_int_distribution<int> position(-8, 56);
+    std::uniform_int_distribution<int> size(-2, 24);
+    return Rect(position(random), position(random), size(random), size(random));
+}
+
+static bool isEmpty(const Rect& rect) {
+    return std::get<2>(rect) <= 0 || std::get<3>(rect) <= 0;
+}
+
+static bool overlaps(const Rect& a, const Rect& b) {
+    if (isEmpty(a) || isEmpty(b)) {
+        return false;
+    }
+    return std::get<0>(a) < std::get<0>(b) + std::get<2>(b) && std::get<0>(b) < std::get<0>(a) + std::get<2>(a) &&
+           std::get<1>(a) < std::get<1>(b) + std::get<3>(b) && std::get<1>(b) < std::get<1>(a) + std::get<3>(a);
+}
+
+// every count from 0 to a few simd blocks plus a tail
+static std::vector<WindowRectBatch> randomBatches(std::mt19937& random) {
+    std::vector<WindowRectBatch> batches;
+    for (int count = 0; count < 40; count++) {
+        WindowRectBatch batch;
+        for (int i = 0; i < count; i++) {
+            batch.push(randomRect(random));
+        }
+        batches.push_back(batch);
+    }
+    // edge cases: touching on each side, coinciding, inside with shared edges, empty at the target's corner
+    WindowRectBatch edges;
+    for (const auto& rect : {Rect(0, 0, 10, 10), Rect(10, 0, 5, 10), Rect(-5, 0, 5, 10), Rect(0, 10, 10, 5),
+                             Rect(0, -5, 10, 5), Rect(0, 0, 10, 10), Rect(2, 0, 8, 10), Rect(0, 0, 0, 10),
+                             Rect(10, 10, 0, 0), Rect(0, 0, 10, -3), Rect(0, 0, 11, 10), Rect(-1, -1, 12, 12)}) {
+        edges.push(rect);
+    }
+    batches.push_back(edges);
+    return batches;
+}
+
+static void checkInsideAndIntersect(const std::vector<WindowRectBatch>& batches, std::mt19937& random) {
+    std::vector<Rect> targets{Rect(0, 0, 10, 10), Rect(0, 0, 0, 0), Rect(5, 5, -3, 4)};
+    for (int i = 0; i < 20; i++) {
+        targets.push_back(randomRect(random));
+    }
+    std::vector<uint8_t> inside;
+    WindowRectBatch intersected;
+    for (const auto& batch : batches) {
+        for (const auto& target : targets) {
+            rectsInsideRect(target, batch, inside);
+            CHECK_EQ(inside.size(), batch.size());
+            intersectRects(batch, target, intersected);
+            CHECK_EQ(intersected.size(), batch.size());
+            for (size_t i = 0; i < batch.size(); i++) {
+                CHECK_EQ((bool)inside[i], isRectInside(target, batch.rect(i)));
+
+                int left = std::max(batch.x[i], std::get<0>(target));
+                int top = std::max(batch.y[i], std::get<1>(target));
+                int right = std::min(batch.x[i] + batch.width[i], std::get<0>(target) + std::get<2>(target));
+                int bottom = std::min(batch.y[i] + batch.height[i], std::get<1>(target) + std::get<3>(target));
+                bool meets = right > left && bottom > top;
+                CHECK_EQ(meets, overlaps(batch.rect(i), target));
+                CHECK_EQ(intersected.x[i], left);
+                CHECK_EQ(intersected.y[i], top);
+                CHECK_EQ(intersected.width[i], meets ? right - left : 0);
+                CHECK_EQ(intersected.height[i], meets ? bottom - top : 0);
+            }
+        }
+    }
+}
+
+static void checkUnion(const std::vector<WindowRectBatch>& batches) {
+    for (const auto& batch : batches) {
+        int left = 0, top = 0, right = 0, bottom = 0;
+        bool any = false;
+        for (size_t i = 0; i < batch.size(); i++) {
+            auto rect = batch.rect(i);
+            if (isEmpty(rect)) {
+                continue;
+            }
+            int rectRight = std::get<0>(rect) + std::get<2>(rect);
+            int rectBottom = std::get<1>(rect) + std::get<3>(rect);
+            left = any ? std::min(left, std::get<0>(rect)) : std::get<0>(rect);
+            top = any ? std::min(top, std::get<1>(rect)) : std::get<1>(rect);
+            right = any ? std::max(right, rectRight) : rectRight;
+            bottom = any ? std::max(bottom, rectBottom) : rectBottom;
+            any = true;
+        }
+        CHECK(unionRects(batch) == Rect(left, top, right - left, bottom - top));
+    }
+}
+
+// a query finds every rect sharing area with it, each once. rects only touching it may come along.
+static void checkGrid(const std::vector<WindowRectBatch>& batches, std::mt19937& random) {
+    std::vector<int> candidates;
+    for (const auto& batch : batches) {
+        WindowRectGrid grid;
+        grid.build(batch);
+        std::vector<Rect> queries;
+        for (size_t i = 0; i < batch.size(); i++) {
+            queries.push_back(batch.rect(i));
+        }
+        for (int i = 0; i < 30; i++) {
+            queries.push_back(randomRect(random));
+        }
+        queries.push_back(Rect(-1000, -1000, 5, 5));
+        for (const auto& query : queries) {
+            grid.query(query, candidates);
+            std::set<int> found(candidates.begin(), candidates.end());
+            CHECK_EQ(found.size(), candidates.size());
+            for (size_t i = 0; i < batch.size(); i++) {
+                if (overlaps(batch.rect(i), query)) {
+                    CHECK(found.count((int)i));
+                }
+            }
+            for (int index : candidates) {
+                CHECK(index >= 0 && index < (int)batch.size() && !isEmpty(batch.rect(index)));
+            }
+        }
+    }
+}
+
+// coverage against counting the covered pixels of every region
+static void checkOcclusionCoverage(const std::vector<WindowRectBatch>& batches, std::mt19937& random) {
+    std::vector<float> coverage;
+    for (const auto& windows : batches) {
+        WindowRectBatch regions;
+        for (int i = 0; i < 12; i++) {
+            regions.push(randomRect(random));
+        }
+        regions.push(0, 0, 10, 10);
+        regions.push(-1000, 0, 10, 10);
+        computeOcclusionCoverage(windows, regions, coverage);
+        CHECK_EQ(coverage.size(), regions.size());
+        for (size_t m = 0; m < regions.size(); m++) {
+            auto region = regions.rect(m);
+            if (isEmpty(region)) {
+                CHECK_EQ(coverage[m], 0.0f);
+                continue;
+            }
+            int coveredPixels = 0;
+            for (int y = std::get<1>(region); y < std::get<1>(region) + std::get<3>(region); y++) {
+                for (int x = std::get<0>(region); x < std::get<0>(region) + std::get<2>(region); x++) {
+                    bool covered = false;
+                    for (size_t i = 0; i < windows.size() && !covered; i++) {
+                        covered = overlaps(windows.rect(i), Rect(x, y, 1, 1));
+                    }
+                    coveredPixels += covered;
+                }
+            }
+            double expected = (double)coveredPixels / ((double)std::get<2>(region) * std::get<3>(region));
+            CHECK(std::fabs(coverage[m] - expected) < 1e-6);
+        }
+    }
+}
+
+int main() {
+    std::mt19937 random(3);
+    auto batches = randomBatches(random);
+    checkInsideAndIntersect(batches, random);
+    checkUnion(batches);
+    checkGrid(batches, random);
+    checkOcclusionCoverage(batches, random);
+    return testExitCode();
+}
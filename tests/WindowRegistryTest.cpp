@@ -0,0 +1,78 @@
+// WindowRegistry: snapshot diffs, change only notifications and the lookups into the last snapshot
+#include <vector>
+#include "TestCheck.h"
+#include "utils/WindowRegistry.h"
+
+static WindowRecord makeWindow(int windowId, int pid, int x, int y, int width, int height) {
+    WindowRecord record;
+    record.windowId = windowId;
+    record.ownerPid = pid;
+    record.x = x;
+    record.y = y;
+    record.width = width;
+    record.height = height;
+    record.ownerName = "app" + std::to_string(pid);
+    return record;
+}
+
+int main() {
+    auto& registry = WindowRegistry::getInstance();
+    CHECK(!registry.getSnapshotTime());
+    std::vector<WindowListDiff> heard;
+    int subscriptionId = registry.subscribe([&heard](const WindowListDiff& diff) { heard.push_back(diff); });
+
+    // the first snapshot adds everything
+    auto diff = registry.applySnapshot({makeWindow(1, 100, 0, 0, 800, 600), makeWindow(2, 200, 50, 50, 300, 200),
+                                        makeWindow(3, 100, 10, 10, 400, 300)});
+    CHECK(diff.added == std::vector<int>({1, 2, 3}));
+    CHECK(diff.removed.empty() && diff.moved.empty() && diff.resized.empty());
+    CHECK_EQ(heard.size(), (size_t)1);
+    CHECK(registry.getSnapshotTime().has_value());
+
+    // lookups: by id, by pid front to back, z order from the snapshot position
+    auto window = registry.findWindow(3);
+    CHECK(window.has_value());
+    CHECK_EQ(window->zOrder, 2);
+    CHECK_EQ(window->width, 400);
+    CHECK(!registry.findWindow(42).has_value());
+    auto appWindows = registry.getWindowsForPid(100);
+    CHECK_EQ(appWindows.size(), (size_t)2);
+    CHECK(appWindows.size() == 2 && appWindows[0].windowId == 1 && appWindows[1].windowId == 3);
+    CHECK(registry.getWindowsForPid(999).empty());
+
+    // the same list again changes nothing and nobody hears about it
+    diff = registry.applySnapshot({makeWindow(1, 100, 0, 0, 800, 600), makeWindow(2, 200, 50, 50, 300, 200),
+                                   makeWindow(3, 100, 10, 10, 400, 300)});
+    CHECK(diff.empty());
+    CHECK_EQ(heard.size(), (size_t)1);
+
+    // 1 moved, 2 resized, 3 gone, 4 new, and 2 came to the front
+    diff = registry.applySnapshot({makeWindow(2, 200, 50, 50, 320, 200), makeWindow(1, 100, 5, 0, 800, 600),
+                                   makeWindow(4, 300, 0, 0, 100, 100)});
+    CHECK(diff.moved == std::vector<int>({1}));
+    CHECK(diff.resized == std::vector<int>({2}));
+    CHECK(diff.removed == std::vector<int>({3}));
+    CHECK(diff.added == std::vector<int>({4}));
+    CHECK(diff.touches(1) && diff.touches(3) && !diff.touches(7));
+    CHECK_EQ(heard.size(), (size_t)2);
+    CHECK(!registry.findWindow(3).has_value());
+    CHECK_EQ(registry.findWindow(2)->zOrder, 0);
+    CHECK_EQ(registry.getWindowsForPid(100).size(), (size_t)1);
+    auto windows = registry.getWindows();
+    CHECK(windows.size() == 3 && windows[0].windowId == 2 && windows[2].windowId == 4);
+
+    // a subscriber can drop itself from its callback, nobody hears after unsubscribe
+    int selfRemovingId = 0;
+    int selfRemovingCalls = 0;
+    selfRemovingId = registry.subscribe([&](const WindowListDiff&) {
+        selfRemovingCalls++;
+        registry.unsubscribe(selfRemovingId);
+    });
+    registry.unsubscribe(subscriptionId);
+    registry.applySnapshot({makeWindow(2, 200, 60, 50, 320, 200)});
+    registry.applySnapshot({});
+    CHECK_EQ(selfRemovingCalls, 1);
+    CHECK_EQ(heard.size(), (size_t)2);
+    CHECK(registry.getWindows().empty());
+    return testExitCode();
+}
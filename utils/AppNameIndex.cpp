@@ -0,0 +1,36 @@
+#include "AppNameIndex.h"
+#include <algorithm>
+
+void AppNameIndex::add(int id, const std::vector<std::string>& words) {
+    for (auto& word : words) {
+        auto& ids = m_words[word];
+        // a name repeating a word lists the id once
+        if (ids.empty() || ids.back() != id) {
+            ids.insert(std::upper_bound(ids.begin(), ids.end(), id), id);
+        }
+    }
+}
+
+void AppNameIndex::clear() {
+    m_words.clear();
+}
+
+std::vector<int> AppNameIndex::findPrefix(const std::string& prefix) const {
+    std::vector<int> ids;
+    if (prefix.empty()) {
+        return ids;
+    }
+    for (auto it = m_words.lower_bound(prefix); it != m_words.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+        ids.insert(ids.end(), it->second.begin(), it->second.end());
+    }
+    // one name can match through several words
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+bool AppNameIndex::matchesPrefix(const std::vector<std::string>& words, const std::string& prefix) {
+    return std::any_of(words.begin(), words.end(), [&prefix](const std::string& word) {
+        return word.compare(0, prefix.size(), prefix) == 0;
+    });
+}
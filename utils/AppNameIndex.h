@@ -0,0 +1,25 @@
+#ifndef HIDINGIN_APPNAMEINDEX_H
+#define HIDINGIN_APPNAMEINDEX_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+// per word prefix index over the picker's app names. the words are kept sorted, so the words starting with a
+// prefix are one contiguous range and a query only walks its matches instead of every name.
+class AppNameIndex {
+public:
+    // words are case folded by the caller, queries have to be folded the same way
+    void add(int id, const std::vector<std::string>& words);
+    void clear();
+
+    // ids with a word starting with prefix, ascending, each once. an empty prefix matches nothing.
+    std::vector<int> findPrefix(const std::string& prefix) const;
+
+    static bool matchesPrefix(const std::vector<std::string>& words, const std::string& prefix);
+
+private:
+    std::map<std::string, std::vector<int>> m_words; // word -> ids, ascending
+};
+
+#endif //HIDINGIN_APPNAMEINDEX_H
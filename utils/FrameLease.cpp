@@ -0,0 +1,80 @@
+#include "FrameLease.h"
+#include <mutex>
+#include <vector>
+
+struct FrameLeasePoolState {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<FrameLeaseSlot>> slots;
+    std::vector<FrameLeaseSlot*> freeSlots;
+    size_t maxFrames = 0;
+    size_t leasedCount = 0;
+    // the pool plus one per leased slot, the last one deletes the state and the slots with it
+    std::atomic<uint32_t> refCount{1};
+
+    void release() {
+        if (refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    void giveBack(FrameLeaseSlot* slot) {
+        if (slot->releaseHook) {
+            slot->releaseHook(*slot);
+        }
+        slot->releaseHook = nullptr;
+        slot->releaseContext = nullptr;
+        slot->backing.reset();
+        slot->buffer = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            freeSlots.push_back(slot);
+            leasedCount--;
+        }
+        release();
+    }
+};
+
+void FrameLease::reset() {
+    if (!m_slot) {
+        return;
+    }
+    // acq_rel: whatever the other holders did with the frame happens before the release hook
+    if (m_slot->m_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        m_slot->m_pool->giveBack(m_slot);
+    }
+    m_slot = nullptr;
+}
+
+FrameLeasePool::FrameLeasePool(size_t maxFrames) : m_state(new FrameLeasePoolState) {
+    m_state->maxFrames = maxFrames;
+}
+
+FrameLeasePool::~FrameLeasePool() {
+    m_state->release();
+}
+
+FrameLease FrameLeasePool::acquire() {
+    FrameLeaseSlot* slot = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        if (!m_state->freeSlots.empty()) {
+            slot = m_state->freeSlots.back();
+            m_state->freeSlots.pop_back();
+        } else if (m_state->slots.size() < m_state->maxFrames) {
+            m_state->slots.push_back(std::make_unique<FrameLeaseSlot>());
+            slot = m_state->slots.back().get();
+            slot->m_pool = m_state;
+        } else {
+            return {};
+        }
+        m_state->leasedCount++;
+    }
+    m_state->refCount.fetch_add(1, std::memory_order_relaxed);
+    slot->m_refCount.store(1, std::memory_order_relaxed);
+    return FrameLease(slot);
+}
+
+size_t FrameLeasePool::getLeasedCount() const {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    return m_state->leasedCount;
+}
@@ -0,0 +1,153 @@
+#ifndef HIDINGIN_FRAMELEASE_H
+#define HIDINGIN_FRAMELEASE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include "../GPUPipeline/cpu/CpuImage.h"
+
+enum class CaptureFrameStorage{
+    MetalTexture, // buffer is an id<MTLTexture>
+    CpuImage      // buffer is the first BGRA8 pixel, from the portable capture sources
+};
+
+enum class FramePixelFormat{
+    BGRA8
+};
+
+struct FrameLeasePoolState;
+
+// one captured frame as it travels from the capture source to the gpu. the slot belongs to a FrameLeasePool, the
+// producer fills it and hands out FrameLeases; when the last one is dropped the release hook gives back what backs
+// the pixels (the sample buffer) and the slot goes back to its pool.
+struct FrameLeaseSlot {
+    void* buffer = nullptr;
+    CaptureFrameStorage storage = CaptureFrameStorage::CpuImage;
+    FramePixelFormat format = FramePixelFormat::BGRA8;
+    int width = 0;
+    int height = 0;
+    int bytesPerRow = 0;
+    uint64_t timestampNs = 0; // capture time on the source's clock
+
+    // runs on the thread dropping the last lease, releaseContext is the producer's (e.g. a CVPixelBufferRef)
+    void (*releaseHook)(FrameLeaseSlot& slot) = nullptr;
+    void* releaseContext = nullptr;
+    // cpu frames: what keeps the pixels alive when the slot does not own them, e.g. the mapped dump file
+    std::shared_ptr<void> backing;
+    // cpu frames: pixels the slot owns, kept across uses so a steady source does not allocate per frame
+    CpuImage image;
+
+    CpuImageView cpuView() const {
+        CpuImageView view;
+        view.data = (uint8_t*)buffer;
+        view.width = width;
+        view.height = height;
+        view.bytesPerRow = bytesPerRow;
+        return view;
+    }
+
+    void setCpuView(const CpuImageView& view) {
+        buffer = view.data;
+        storage = CaptureFrameStorage::CpuImage;
+        format = FramePixelFormat::BGRA8;
+        width = view.width;
+        height = view.height;
+        bytesPerRow = view.bytesPerRow;
+    }
+
+private:
+    friend class FrameLease;
+    friend class FrameLeasePool;
+    friend struct FrameLeasePoolState;
+    std::atomic<uint32_t> m_refCount{0};
+    FrameLeasePoolState* m_pool = nullptr;
+};
+
+// counted reference to a FrameLeaseSlot. copies bump an intrusive count (no control block, no allocation), moves
+// do not touch it at all, so the handoff capture -> ring -> composite -> gpu completion moves where it can.
+class FrameLease {
+public:
+    FrameLease() = default;
+
+    FrameLease(const FrameLease& other) : m_slot(other.m_slot) {
+        if (m_slot) {
+            m_slot->m_refCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    FrameLease(FrameLease&& other) noexcept : m_slot(std::exchange(other.m_slot, nullptr)) {
+    }
+
+    FrameLease& operator=(const FrameLease& other) {
+        FrameLease copy(other);
+        std::swap(m_slot, copy.m_slot);
+        return *this;
+    }
+
+    FrameLease& operator=(FrameLease&& other) noexcept {
+        if (this != &other) {
+            reset();
+            m_slot = std::exchange(other.m_slot, nullptr);
+        }
+        return *this;
+    }
+
+    ~FrameLease() {
+        reset();
+    }
+
+    void reset();
+
+    explicit operator bool() const {
+        return m_slot != nullptr;
+    }
+
+    const FrameLeaseSlot* operator->() const {
+        return m_slot;
+    }
+
+    const FrameLeaseSlot& operator*() const {
+        return *m_slot;
+    }
+
+    // the producer fills the slot through this before handing out copies, nobody writes it afterwards
+    FrameLeaseSlot& slot() {
+        return *m_slot;
+    }
+
+    uint32_t useCount() const {
+        return m_slot ? m_slot->m_refCount.load(std::memory_order_relaxed) : 0;
+    }
+
+private:
+    friend class FrameLeasePool;
+    explicit FrameLease(FrameLeaseSlot* slot) : m_slot(slot) {
+    }
+
+    FrameLeaseSlot* m_slot = nullptr;
+};
+
+// the slots of one capture source. a slot is only reused once every lease on it is gone, so at most maxFrames are
+// in flight; a source whose frames are all still held downstream skips a frame instead of allocating. the pool
+// may go away before its last leases, the slots then stay valid until those are dropped.
+class FrameLeasePool {
+public:
+    explicit FrameLeasePool(size_t maxFrames = kDefaultMaxFrames);
+    ~FrameLeasePool();
+    FrameLeasePool(const FrameLeasePool&) = delete;
+    FrameLeasePool& operator=(const FrameLeasePool&) = delete;
+
+    static constexpr size_t kDefaultMaxFrames = 8;
+
+    // a free slot with its release hook cleared, an empty lease when all maxFrames are held downstream
+    FrameLease acquire();
+
+    size_t getLeasedCount() const;
+
+private:
+    FrameLeasePoolState* m_state = nullptr;
+};
+
+#endif //HIDINGIN_FRAMELEASE_H
@@ -0,0 +1,92 @@
+#include "FrameRateGovernor.h"
+#include <utility>
+
+FrameRateGovernor::FrameRateGovernor(FrameRateGovernorConfig config) : m_config(std::move(config)) {
+    if (m_config.rates.empty()) {
+        m_config.rates = {60};
+    }
+    m_config.stepUpChangeRatios.resize(m_config.rates.size() - 1, 1.0);
+    // start responsive, the first frames are all new anyway
+    m_level = (int)m_config.rates.size() - 1;
+}
+
+void FrameRateGovernor::reportChange(double changeRatio) {
+    m_changeLevel = std::max(m_changeLevel, levelForChange(changeRatio));
+}
+
+void FrameRateGovernor::reportInput(Clock::time_point inputTime) {
+    if (!m_hasInput || inputTime > m_lastInput) {
+        m_lastInput = inputTime;
+    }
+    m_hasInput = true;
+}
+
+void FrameRateGovernor::setPowerState(const FrameRatePowerState& powerState) {
+    m_powerState = powerState;
+}
+
+void FrameRateGovernor::setMaxRate(int maxRate) {
+    m_maxRate = std::max(maxRate, 0);
+}
+
+int FrameRateGovernor::update(Clock::time_point now) {
+    if (!m_started) {
+        m_started = true;
+        m_calmSince = now;
+    }
+    int wantedLevel = m_changeLevel;
+    m_changeLevel = 0;
+    if (m_hasInput && now - m_lastInput < m_config.inputBoostDuration) {
+        wantedLevel = std::max(wantedLevel, levelForRate(m_config.inputRate));
+    }
+    // a cap is never waited for
+    int capLevel = levelForRate(getCapRate());
+    wantedLevel = std::min(wantedLevel, capLevel);
+    if (m_level > capLevel) {
+        m_level = capLevel;
+        m_calmSince = now;
+    }
+
+    if (wantedLevel >= m_level) {
+        m_level = wantedLevel;
+        m_calmSince = now;
+    } else if (now - m_calmSince >= m_config.stepDownDelay) {
+        m_level--;
+        m_calmSince = now;
+    }
+    return getRate();
+}
+
+int FrameRateGovernor::levelForChange(double changeRatio) const {
+    int level = 0;
+    while (level < (int)m_config.stepUpChangeRatios.size() && changeRatio >= m_config.stepUpChangeRatios[level]) {
+        level++;
+    }
+    return level;
+}
+
+// highest level that does not run faster than rate, the lowest one when they all do
+int FrameRateGovernor::levelForRate(int rate) const {
+    int level = 0;
+    while (level + 1 < (int)m_config.rates.size() && m_config.rates[level + 1] <= rate) {
+        level++;
+    }
+    return level;
+}
+
+int FrameRateGovernor::getCapRate() const {
+    int capRate = m_maxRate > 0 ? m_maxRate : m_config.rates.back();
+    if (m_powerState.displayAsleep) {
+        return m_config.rates.front();
+    }
+    if (m_powerState.lowPowerMode) {
+        capRate = std::min(capRate, m_config.lowPowerRate);
+    }
+    if (m_powerState.onBattery) {
+        capRate = std::min(capRate, m_config.batteryRate);
+    }
+    if (m_powerState.thermalPressure) {
+        capRate = std::min(capRate, m_config.thermalPressureRate);
+    }
+    return std::max(capRate, 1);
+}
@@ -0,0 +1,76 @@
+#ifndef HIDINGIN_FRAMERATEGOVERNOR_H
+#define HIDINGIN_FRAMERATEGOVERNOR_H
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+struct FrameRateGovernorConfig {
+    // the rates the governor steps between, ascending
+    std::vector<int> rates{2, 15, 30, 60};
+    // change ratio (changed pixels / frame pixels) a frame needs for rates[i + 1]. a caret blink stays under the
+    // first one, typing gets there through the input boost instead.
+    std::vector<double> stepUpChangeRatios{0.01, 0.05, 0.2};
+    // how long the wanted rate has to stay below the current one before it drops by one step
+    std::chrono::milliseconds stepDownDelay{2000};
+    // after keyboard / mouse input (or our window moving) run at least at inputRate for this long
+    std::chrono::milliseconds inputBoostDuration{1500};
+    int inputRate = 60;
+    // caps while saving power
+    int batteryRate = 30;
+    int lowPowerRate = 15;
+    int thermalPressureRate = 30;
+};
+
+struct FrameRatePowerState {
+    bool onBattery = false;
+    bool lowPowerMode = false;
+    bool thermalPressure = false;
+    bool displayAsleep = false; // nothing is seen, the lowest rate
+};
+
+// picks the capture / composite rate from how much the frames change, input activity and the power state.
+// going up is immediate, going down is one step at a time after stepDownDelay without a reason to stay, so a
+// blinking caret or one busy frame does not make the rate bounce. time comes in from the caller, which makes the
+// policy replayable from a recorded trace.
+class FrameRateGovernor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit FrameRateGovernor(FrameRateGovernorConfig config = {});
+
+    // one composited frame, changeRatio 0 (nothing changed) .. 1 (everything)
+    void reportChange(double changeRatio);
+    void reportInput(Clock::time_point inputTime);
+    void setPowerState(const FrameRatePowerState& powerState);
+    // the display's refresh rate, 0 for no limit
+    void setMaxRate(int maxRate);
+
+    // takes in what was reported since the last call, returns the rate to run at from now
+    int update(Clock::time_point now);
+
+    int getRate() const {
+        return std::min(m_config.rates[m_level], getCapRate());
+    }
+
+    std::chrono::nanoseconds getFrameInterval() const {
+        return std::chrono::nanoseconds(1000000000LL / getRate());
+    }
+
+private:
+    int levelForChange(double changeRatio) const;
+    int levelForRate(int rate) const;
+    int getCapRate() const;
+
+    FrameRateGovernorConfig m_config;
+    FrameRatePowerState m_powerState;
+    int m_maxRate = 0;
+    int m_level = 0;
+    int m_changeLevel = 0;   // highest level the frames since the last update asked for
+    bool m_started = false;
+    bool m_hasInput = false;
+    Clock::time_point m_lastInput;
+    Clock::time_point m_calmSince;
+};
+
+#endif //HIDINGIN_FRAMERATEGOVERNOR_H
@@ -0,0 +1,610 @@
+#ifndef HIDINGIN_TASKSCHEDULER_H
+#define HIDINGIN_TASKSCHEDULER_H
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <string>
+#include <future>
+#include <memory>
+#include <optional>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+#include "Tracer.h"
+
+// drop in replacement for TaskQueue without the global mutex:
+//   - tasks live in a fixed pool of nodes sized at construction, a node index is what moves through the queues
+//   - producers outside the pool push into a bounded MPMC injection queue (Vyukov), FIFO
+//   - tasks enqueued from a worker go to that worker's Chase-Lev deque, idle workers steal from the others
+//   - the callable is stored inline (SmallTask), only captures bigger than kInlineSize go to the heap
+//   - idle workers park on an atomic epoch, producers only notify when somebody is parked
+// maxTasks bounds the queued tasks like before, enqueue blocks when the pool is exhausted.
+// with one worker (the render queue) everything enqueued from outside keeps its submission order.
+//
+// lanes / deadlines / coalescing (TaskOptions):
+//   - Control lane tasks are picked before any Frame lane task
+//   - a task whose deadline passed when a worker picks it up is dropped, not run
+//   - tasks sharing a coalesceKey: only the newest queued one runs, older ones are dropped (latest frame wins)
+//   - dropOldestWhenFull: the task may be evicted while queued. a producer asking for it evicts the oldest queued
+//     task that asked for it too when the pool is full, and blocks like everybody else when there is none.
+// only tasks that opted in to one of these are ever dropped. a dropped task's future throws TaskDroppedError, it
+// is counted in getDroppedTaskCount().
+
+// what the future of a task that was dropped instead of run throws
+class TaskDroppedError : public std::runtime_error {
+public:
+    TaskDroppedError() : std::runtime_error("task dropped before it ran") {}
+};
+
+enum class TaskLane {
+    Control = 0,
+    Frame = 1
+};
+
+struct TaskOptions {
+    TaskLane lane = TaskLane::Frame;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    uint64_t coalesceKey = 0; // 0: no coalescing
+    bool dropOldestWhenFull = false;
+};
+
+// move-only void(const std::string&) callable with inline storage
+class SmallTask {
+public:
+    static constexpr size_t kInlineSize = 96;
+
+    SmallTask() = default;
+    SmallTask(const SmallTask&) = delete;
+    SmallTask& operator=(const SmallTask&) = delete;
+
+    ~SmallTask() {
+        reset();
+    }
+
+    template<typename F>
+    void emplace(F&& func) {
+        using Fn = std::decay_t<F>;
+        reset();
+        if constexpr (sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(std::max_align_t)) {
+            new (m_storage) Fn(std::forward<F>(func));
+            m_invoke = [](void* storage, const std::string& threadName) {
+                (*static_cast<Fn*>(storage))(threadName);
+            };
+            m_destroy = [](void* storage) {
+                static_cast<Fn*>(storage)->~Fn();
+            };
+        } else {
+            *reinterpret_cast<Fn**>(m_storage) = new Fn(std::forward<F>(func));
+            m_invoke = [](void* storage, const std::string& threadName) {
+                (**static_cast<Fn**>(storage))(threadName);
+            };
+            m_destroy = [](void* storage) {
+                delete *static_cast<Fn**>(storage);
+            };
+        }
+    }
+
+    void operator()(const std::string& threadName) {
+        m_invoke(m_storage, threadName);
+    }
+
+    void reset() {
+        if (m_destroy) {
+            m_destroy(m_storage);
+            m_destroy = nullptr;
+            m_invoke = nullptr;
+        }
+    }
+
+private:
+    alignas(std::max_align_t) unsigned char m_storage[kInlineSize];
+    void (*m_invoke)(void*, const std::string&) = nullptr;
+    void (*m_destroy)(void*) = nullptr;
+};
+
+// Vyukov's bounded MPMC queue of node indices, capacity is a power of two
+class MpmcIndexQueue {
+public:
+    explicit MpmcIndexQueue(size_t capacity) : m_mask(capacity - 1), m_cells(new Cell[capacity]) {
+        for (size_t i = 0; i < capacity; i++) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool push(uint32_t value) {
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(uint32_t& value) {
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        uint32_t value;
+    };
+    size_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+    alignas(64) std::atomic<size_t> m_enqueuePos{0};
+    alignas(64) std::atomic<size_t> m_dequeuePos{0};
+};
+
+// Chase-Lev deque (the C11 version from Le et al.) of node indices. the owner pushes and pops at the bottom,
+// thieves take from the top. it never grows: it is as big as the node pool, so it can not overflow.
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(size_t capacity) : m_mask(capacity - 1), m_slots(new std::atomic<uint32_t>[capacity]) {
+    }
+
+    void push(uint32_t value) {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        m_slots[bottom & m_mask].store(value, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    bool pop(uint32_t& value) {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = m_top.load(std::memory_order_relaxed);
+        if (top > bottom) {
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+        value = m_slots[bottom & m_mask].load(std::memory_order_relaxed);
+        if (top == bottom) {
+            // last one, race the thieves for it
+            bool won = m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    bool steal(uint32_t& value) {
+        int64_t top = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = m_bottom.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            return false;
+        }
+        value = m_slots[top & m_mask].load(std::memory_order_relaxed);
+        return m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+private:
+    size_t m_mask;
+    std::unique_ptr<std::atomic<uint32_t>[]> m_slots;
+    alignas(64) std::atomic<int64_t> m_top{0};
+    alignas(64) std::atomic<int64_t> m_bottom{0};
+};
+
+class TaskScheduler {
+public:
+    TaskScheduler(unsigned int numThreads, std::vector<std::string>& threadNames, unsigned int maxTasks, bool execInPlace = false)
+            : isExecInPlace(execInPlace),
+              nodeCount(roundUpPowerOfTwo(maxTasks + (execInPlace ? 0 : numThreads))),
+              nodes(new TaskNode[nodeCount]),
+              freeNodes(nodeCount),
+              injectionQueues{MpmcIndexQueue(nodeCount), MpmcIndexQueue(nodeCount)} {
+        for (uint32_t i = 0; i < nodeCount; i++) {
+            freeNodes.push(i);
+        }
+        execInPlaceThreadName = threadNames[0];
+        if (!execInPlace) {
+            for (unsigned int i = 0; i < numThreads; ++i) {
+                workerDeques.emplace_back(std::make_unique<WorkStealingDeque>(nodeCount));
+            }
+            for (unsigned int i = 0; i < numThreads; ++i) {
+                workers.emplace_back(&TaskScheduler::worker, this, i, threadNames[i]);
+            }
+        }
+    }
+
+    ~TaskScheduler() {
+        stop();
+        for (auto& thread : workers) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+
+    bool empty() {
+        return pendingCount.load(std::memory_order_acquire) == 0;
+    }
+
+    int size() {
+        return pendingCount.load(std::memory_order_acquire);
+    }
+
+    // Enqueue tasks that take the thread name as a parameter and return a future to wait for completion.
+    // returns an invalid future once the scheduler is stopped.
+    template<typename F>
+    std::future<void> enqueueTask(F&& task, const TaskOptions& options = {}) {
+        std::promise<void> promise;
+        auto future = promise.get_future();
+        if (!enqueueNode(std::forward<F>(task), &promise, options)) {
+            return {};
+        }
+        return future;
+    }
+
+    // fire and forget: no promise / future is created, an exception thrown by the task is only logged
+    template<typename F>
+    bool enqueueDetachedTask(F&& task, const TaskOptions& options = {}) {
+        return enqueueNode(std::forward<F>(task), nullptr, options);
+    }
+
+    // for exec in place mode:
+    void execAllTasksInPlace() {
+        uint32_t nodeIndex;
+        while (injectionQueues[(int)TaskLane::Control].pop(nodeIndex) ||
+               injectionQueues[(int)TaskLane::Frame].pop(nodeIndex)) {
+            pendingCount.fetch_sub(1, std::memory_order_acq_rel);
+            runNode(nodeIndex, execInPlaceThreadName);
+        }
+    }
+
+    uint64_t getDroppedTaskCount() {
+        return droppedCount.load(std::memory_order_relaxed);
+    }
+
+    // 0 in exec in place mode
+    unsigned int getThreadCount() const {
+        return (unsigned int)workers.size();
+    }
+
+    static uint64_t coalesceKeyFor(const std::string& name) {
+        uint64_t key = std::hash<std::string>{}(name);
+        return key ? key : 1;
+    }
+
+    bool getIsExecInPlace() {
+        return isExecInPlace;
+    }
+
+    void stop() {
+        stopFlag.store(true, std::memory_order_seq_cst);
+        workEpoch.fetch_add(1, std::memory_order_seq_cst);
+        workEpoch.notify_all();
+        freeEpoch.fetch_add(1, std::memory_order_seq_cst);
+        freeEpoch.notify_all();
+    }
+
+private:
+    // a node's state, packed with its enqueue sequence and whether it may be evicted so an evicting producer can
+    // not cancel a node that got recycled for another task in the meantime
+    enum NodeState : uint64_t {
+        NodeFree = 0,
+        NodeQueued = 1,
+        NodeRunning = 2,
+        NodeCancelled = 3
+    };
+    static constexpr uint64_t kNodeStateMask = 3;
+    static constexpr uint64_t kNodeEvictableBit = 4;
+    static constexpr int kNodeSequenceShift = 3;
+
+    struct TaskNode {
+        std::atomic<uint64_t> ticket{NodeFree};
+        SmallTask task;
+        std::optional<std::promise<void>> promise;
+        std::chrono::steady_clock::time_point deadline;
+        int coalesceSlot = -1;
+        uint64_t generation = 0;
+        uint64_t enqueueTraceTime = 0; // Tracer time, 0 when tracing was off
+    };
+
+    // coalesce keys are claimed for the lifetime of the scheduler (there are only a few capture events), the
+    // generation of a slot is bumped by every enqueue with that key, a queued task that is not the newest is stale.
+    struct CoalesceSlot {
+        std::atomic<uint64_t> key{0};
+        std::atomic<uint64_t> generation{0};
+    };
+    static constexpr int kCoalesceSlotCount = 32;
+
+    struct WorkerContext {
+        TaskScheduler* scheduler;
+        unsigned int index;
+    };
+
+    static inline thread_local WorkerContext currentWorker{nullptr, 0};
+    static constexpr int kSpinCount = 64;
+
+    bool isExecInPlace = false;
+    std::atomic<bool> stopFlag{false};
+    uint32_t nodeCount;
+    std::unique_ptr<TaskNode[]> nodes;
+    MpmcIndexQueue freeNodes;
+    MpmcIndexQueue injectionQueues[2]; // indexed by TaskLane
+    CoalesceSlot coalesceSlots[kCoalesceSlotCount];
+    std::vector<std::unique_ptr<WorkStealingDeque>> workerDeques;
+    std::vector<std::thread> workers;
+    std::string execInPlaceThreadName;
+
+    std::atomic<int> pendingCount{0};
+    std::atomic<uint64_t> droppedCount{0};
+    std::atomic<uint64_t> enqueueSequence{0};
+    alignas(64) std::atomic<uint32_t> workEpoch{0};
+    std::atomic<int> parkedWorkers{0};
+    alignas(64) std::atomic<uint32_t> freeEpoch{0};
+    std::atomic<int> waitingProducers{0};
+
+    static uint32_t roundUpPowerOfTwo(uint32_t value) {
+        uint32_t result = 2;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    template<typename F>
+    bool enqueueNode(F&& task, std::promise<void>* promise, const TaskOptions& options) {
+        uint32_t nodeIndex;
+        if (!acquireNode(nodeIndex, options.dropOldestWhenFull)) {
+            return false;
+        }
+        // the queued tasks of the key are only superseded once this one is sure to be queued, a refused task must
+        // not take the one it would have replaced down with it
+        int coalesceSlot = options.coalesceKey ? findCoalesceSlot(options.coalesceKey) : -1;
+        uint64_t generation = 0;
+        if (coalesceSlot >= 0) {
+            generation = coalesceSlots[coalesceSlot].generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+        }
+        TaskNode& node = nodes[nodeIndex];
+        node.task.emplace(std::forward<F>(task));
+        if (promise) {
+            node.promise.emplace(std::move(*promise));
+        }
+        node.deadline = options.deadline;
+        node.enqueueTraceTime = Tracer::getInstance().isEnabled() ? Tracer::getInstance().now() : 0;
+        node.coalesceSlot = coalesceSlot;
+        node.generation = generation;
+        uint64_t sequence = enqueueSequence.fetch_add(1, std::memory_order_relaxed);
+        node.ticket.store((sequence << kNodeSequenceShift) | (options.dropOldestWhenFull ? kNodeEvictableBit : 0) |
+                          NodeQueued, std::memory_order_release);
+
+        pendingCount.fetch_add(1, std::memory_order_acq_rel);
+        if (currentWorker.scheduler == this && options.lane == TaskLane::Frame) {
+            workerDeques[currentWorker.index]->push(nodeIndex);
+        } else {
+            injectionQueues[(int)options.lane].push(nodeIndex); // can not fail, it holds every node
+        }
+
+        workEpoch.fetch_add(1, std::memory_order_seq_cst);
+        if (parkedWorkers.load(std::memory_order_seq_cst) > 0) {
+            workEpoch.notify_one();
+        }
+        return true;
+    }
+
+    int findCoalesceSlot(uint64_t key) {
+        for (int i = 0; i < kCoalesceSlotCount; i++) {
+            CoalesceSlot& slot = coalesceSlots[(key + i) % kCoalesceSlotCount];
+            uint64_t slotKey = slot.key.load(std::memory_order_acquire);
+            if (slotKey == 0 && slot.key.compare_exchange_strong(slotKey, key, std::memory_order_acq_rel)) {
+                return (int)((key + i) % kCoalesceSlotCount);
+            }
+            if (slotKey == key) {
+                return (int)((key + i) % kCoalesceSlotCount);
+            }
+        }
+        return -1; // table full, the task just does not coalesce
+    }
+
+    // blocks while every node is queued or running, that is the maxTasks back pressure.
+    // with mayEvict the oldest queued evictable task is cancelled first, the worker skips it and frees its node.
+    bool acquireNode(uint32_t& nodeIndex, bool mayEvict) {
+        bool evicted = false;
+        for (int spin = 0; ; spin++) {
+            if (stopFlag.load(std::memory_order_acquire)) {
+                return false;
+            }
+            if (freeNodes.pop(nodeIndex)) {
+                return true;
+            }
+            if (mayEvict && !evicted) {
+                evicted = cancelOldestEvictable();
+            }
+            if (spin < kSpinCount) {
+                std::this_thread::yield();
+                continue;
+            }
+            waitingProducers.fetch_add(1, std::memory_order_seq_cst);
+            uint32_t epoch = freeEpoch.load(std::memory_order_seq_cst);
+            if (freeNodes.pop(nodeIndex)) {
+                waitingProducers.fetch_sub(1, std::memory_order_seq_cst);
+                return true;
+            }
+            if (!stopFlag.load(std::memory_order_acquire)) {
+                freeEpoch.wait(epoch, std::memory_order_seq_cst);
+            }
+            waitingProducers.fetch_sub(1, std::memory_order_seq_cst);
+        }
+    }
+
+    // one cancel per acquire is enough, the node it frees is the one we wait for
+    bool cancelOldestEvictable() {
+        for (;;) {
+            int oldest = -1;
+            uint64_t oldestTicket = 0;
+            for (uint32_t i = 0; i < nodeCount; i++) {
+                uint64_t ticket = nodes[i].ticket.load(std::memory_order_acquire);
+                if ((ticket & kNodeStateMask) == NodeQueued && (ticket & kNodeEvictableBit) &&
+                    (oldest < 0 || ticket < oldestTicket)) {
+                    oldest = (int)i;
+                    oldestTicket = ticket;
+                }
+            }
+            if (oldest < 0) {
+                return false;
+            }
+            uint64_t cancelled = (oldestTicket & ~kNodeStateMask) | NodeCancelled;
+            if (nodes[oldest].ticket.compare_exchange_strong(oldestTicket, cancelled, std::memory_order_acq_rel)) {
+                return true;
+            }
+            // picked up or recycled meanwhile, look again
+        }
+    }
+
+    // Queued -> Running unless a producer cancelled it first
+    bool claimNode(TaskNode& node) {
+        uint64_t ticket = node.ticket.load(std::memory_order_acquire);
+        while ((ticket & kNodeStateMask) == NodeQueued) {
+            if (node.ticket.compare_exchange_weak(ticket, (ticket & ~kNodeStateMask) | NodeRunning,
+                                                  std::memory_order_acq_rel)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void releaseNode(uint32_t nodeIndex) {
+        nodes[nodeIndex].ticket.store(NodeFree, std::memory_order_release);
+        freeNodes.push(nodeIndex);
+        freeEpoch.fetch_add(1, std::memory_order_seq_cst);
+        if (waitingProducers.load(std::memory_order_seq_cst) > 0) {
+            freeEpoch.notify_one();
+        }
+    }
+
+    bool isStale(const TaskNode& node) {
+        if (node.coalesceSlot >= 0 &&
+            coalesceSlots[node.coalesceSlot].generation.load(std::memory_order_acquire) != node.generation) {
+            return true;
+        }
+        return node.deadline != std::chrono::steady_clock::time_point::max() &&
+               std::chrono::steady_clock::now() > node.deadline;
+    }
+
+    // fails the future with TaskDroppedError without running the task, the node is left empty for the caller
+    void dropNode(uint32_t nodeIndex) {
+        TaskNode& node = nodes[nodeIndex];
+        droppedCount.fetch_add(1, std::memory_order_relaxed);
+        if (node.promise) {
+            node.promise->set_exception(std::make_exception_ptr(TaskDroppedError()));
+        }
+        node.task.reset();
+        node.promise.reset();
+    }
+
+    void runNode(uint32_t nodeIndex, const std::string& threadName) {
+        TaskNode& node = nodes[nodeIndex];
+        if (node.enqueueTraceTime && Tracer::getInstance().isEnabled()) {
+            Tracer::getInstance().recordSpan("taskQueueWait", node.enqueueTraceTime, Tracer::getInstance().now());
+        }
+        if (!claimNode(node) || isStale(node)) {
+            TRACE_INSTANT("taskDropped");
+            dropNode(nodeIndex);
+            releaseNode(nodeIndex);
+            return;
+        }
+        TRACE_SCOPE("runTask");
+        try {
+            node.task(threadName);
+            if (node.promise) {
+                node.promise->set_value();
+            }
+        } catch (...) {
+            if (node.promise) {
+                node.promise->set_exception(std::current_exception());
+            } else {
+                std::cerr << "detached task on " << threadName << " threw" << std::endl;
+            }
+        }
+        node.task.reset();
+        node.promise.reset();
+        releaseNode(nodeIndex);
+    }
+
+    bool findWork(unsigned int index, uint32_t& nodeIndex) {
+        if (injectionQueues[(int)TaskLane::Control].pop(nodeIndex) ||
+            workerDeques[index]->pop(nodeIndex) ||
+            injectionQueues[(int)TaskLane::Frame].pop(nodeIndex)) {
+            return true;
+        }
+        for (size_t i = 1; i < workerDeques.size(); i++) {
+            if (workerDeques[(index + i) % workerDeques.size()]->steal(nodeIndex)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Worker function for threads
+    void worker(unsigned int index, std::string threadName) {
+        currentWorker.scheduler = this;
+        currentWorker.index = index;
+        Tracer::getInstance().setCurrentThreadName(threadName);
+        int idleSpins = 0;
+        while (true) {
+            uint32_t nodeIndex;
+            if (findWork(index, nodeIndex)) {
+                pendingCount.fetch_sub(1, std::memory_order_acq_rel);
+                runNode(nodeIndex, threadName);
+                idleSpins = 0;
+                continue;
+            }
+
+            if (stopFlag.load(std::memory_order_acquire) && pendingCount.load(std::memory_order_acquire) == 0) {
+                return;  // Exit the loop if stop flag is set and no tasks are left
+            }
+
+            if (idleSpins++ < kSpinCount) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // park until a producer bumps the epoch, re-check after announcing so a push in between is not missed
+            parkedWorkers.fetch_add(1, std::memory_order_seq_cst);
+            uint32_t epoch = workEpoch.load(std::memory_order_seq_cst);
+            if (pendingCount.load(std::memory_order_seq_cst) == 0 && !stopFlag.load(std::memory_order_seq_cst)) {
+                workEpoch.wait(epoch, std::memory_order_seq_cst);
+            }
+            parkedWorkers.fetch_sub(1, std::memory_order_seq_cst);
+            idleSpins = 0;
+        }
+    }
+};
+
+#endif //HIDINGIN_TASKSCHEDULER_H
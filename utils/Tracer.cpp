@@ -0,0 +1,177 @@
+#include "Tracer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+void TraceRing::snapshot(std::vector<Snapshot>& events) const {
+    auto end = m_writeIndex.load(std::memory_order_acquire);
+    auto begin = end > kRingCapacity ? end - kRingCapacity : 0;
+    auto first = events.size();
+    for (auto index = begin; index < end; index++) {
+        auto& event = m_events[index & (kRingCapacity - 1)];
+        events.push_back({event.name.load(std::memory_order_relaxed), event.start.load(std::memory_order_relaxed),
+                          event.duration.load(std::memory_order_relaxed), event.arg.load(std::memory_order_relaxed)});
+    }
+    // the owner kept writing: drop what it may have overwritten under us, it is at most writing index "after" now
+    std::atomic_thread_fence(std::memory_order_acquire);
+    auto after = m_writeIndex.load(std::memory_order_relaxed);
+    auto stableBegin = after + 1 > kRingCapacity ? after + 1 - kRingCapacity : 0;
+    if (stableBegin > begin) {
+        auto overwritten = std::min<uint64_t>(stableBegin - begin, end - begin);
+        events.erase(events.begin() + (ptrdiff_t)first, events.begin() + (ptrdiff_t)(first + overwritten));
+    }
+}
+
+Tracer::Tracer() : m_startTime(std::chrono::steady_clock::now()) {
+}
+
+Tracer::~Tracer() {
+    m_stopDumpSignalThread = true;
+    if (m_dumpSignalThread.joinable()) {
+        m_dumpSignalThread.join();
+    }
+}
+
+TraceRing& Tracer::currentRing() {
+    // one ring per thread and tracer (there is only the one tracer), registered on the thread's first event
+    static thread_local std::shared_ptr<TraceRing> threadRing;
+    if (!threadRing) {
+        std::lock_guard<std::mutex> ringsLock(m_ringsMutex);
+        auto threadId = m_nextThreadId++;
+        threadRing = std::make_shared<TraceRing>(threadId, "thread " + std::to_string(threadId));
+        m_rings.push_back(threadRing);
+    }
+    return *threadRing;
+}
+
+void Tracer::recordSpan(const char* name, uint64_t start, uint64_t end, uint64_t arg) {
+    currentRing().record(name, start, end > start ? end - start : 0, arg);
+}
+
+void Tracer::recordInstant(const char* name, uint64_t arg) {
+    currentRing().record(name, now(), kTraceInstant, arg);
+}
+
+void Tracer::setCurrentThreadName(const std::string& threadName) {
+    auto& ring = currentRing();
+    std::lock_guard<std::mutex> ringsLock(m_ringsMutex);
+    ring.threadName() = threadName;
+}
+
+static void writeJsonString(std::ostream& out, const char* value) {
+    out << '"';
+    for (auto character = value; character && *character; character++) {
+        if (*character == '"' || *character == '\\') {
+            out << '\\';
+        }
+        out << *character;
+    }
+    out << '"';
+}
+
+bool Tracer::dumpChromeTrace(const std::string& path) {
+    std::vector<std::pair<uint32_t, std::string>> threads;
+    std::vector<std::shared_ptr<TraceRing>> rings;
+    {
+        std::lock_guard<std::mutex> ringsLock(m_ringsMutex);
+        rings = m_rings;
+        for (auto& ring : rings) {
+            threads.emplace_back(ring->getThreadId(), ring->threadName());
+        }
+    }
+
+    std::ofstream traceFile(path);
+    if (!traceFile) {
+        std::cerr << "failed to write trace: " << path << std::endl;
+        return false;
+    }
+    auto pid = (int)getpid();
+    traceFile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool firstEvent = true;
+    for (auto& thread : threads) {
+        traceFile << (firstEvent ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+                  << ",\"tid\":" << thread.first << ",\"args\":{\"name\":";
+        writeJsonString(traceFile, thread.second.c_str());
+        traceFile << "}}";
+        firstEvent = false;
+    }
+
+    std::vector<TraceRing::Snapshot> events;
+    char timeBuffer[64];
+    for (auto& ring : rings) {
+        events.clear();
+        ring->snapshot(events);
+        for (auto& event : events) {
+            if (!event.name) {
+                continue;
+            }
+            traceFile << (firstEvent ? "" : ",\n") << "{\"name\":";
+            writeJsonString(traceFile, event.name);
+            // microseconds with ns precision
+            std::snprintf(timeBuffer, sizeof(timeBuffer), "%.3f", (double)event.start / 1000.0);
+            traceFile << ",\"cat\":\"hidingin\",\"pid\":" << pid << ",\"tid\":" << ring->getThreadId() << ",\"ts\":" << timeBuffer;
+            if (event.duration == kTraceInstant) {
+                traceFile << ",\"ph\":\"i\",\"s\":\"t\"";
+            } else {
+                std::snprintf(timeBuffer, sizeof(timeBuffer), "%.3f", (double)event.duration / 1000.0);
+                traceFile << ",\"ph\":\"X\",\"dur\":" << timeBuffer;
+            }
+            if (event.arg) {
+                traceFile << ",\"args\":{\"arg\":" << event.arg << "}";
+            }
+            traceFile << "}";
+            firstEvent = false;
+        }
+    }
+    traceFile << "\n]}\n";
+    return (bool)traceFile;
+}
+
+std::string Tracer::dumpChromeTrace() {
+    auto tempDirectory = std::getenv("TMPDIR");
+    std::string path = tempDirectory && *tempDirectory ? tempDirectory : "/tmp";
+    if (path.back() != '/') {
+        path += '/';
+    }
+    path += "hidingin-trace-" + std::to_string((long long)std::time(nullptr)) + ".json";
+    if (!dumpChromeTrace(path)) {
+        return "";
+    }
+    std::cerr << "trace written to " << path << std::endl;
+    return path;
+}
+
+static volatile std::sig_atomic_t g_traceDumpRequested = 0;
+
+static void onTraceDumpSignal(int) {
+    g_traceDumpRequested = 1;
+}
+
+void Tracer::installDumpSignal(int signalNumber) {
+    struct sigaction signalAction{};
+    signalAction.sa_handler = onTraceDumpSignal;
+    sigemptyset(&signalAction.sa_mask);
+    signalAction.sa_flags = SA_RESTART;
+    if (sigaction(signalNumber, &signalAction, nullptr) != 0) {
+        std::cerr << "failed to install the trace dump signal" << std::endl;
+        return;
+    }
+    if (!m_dumpSignalThread.joinable()) {
+        m_dumpSignalThread = std::thread(&Tracer::dumpSignalThreadFunc, this);
+    }
+}
+
+void Tracer::dumpSignalThreadFunc() {
+    // files can not be written from a signal handler, poll the flag instead
+    while (!m_stopDumpSignalThread) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        if (g_traceDumpRequested) {
+            g_traceDumpRequested = 0;
+            dumpChromeTrace();
+        }
+    }
+}
@@ -0,0 +1,169 @@
+#ifndef HIDINGIN_TRACER_H
+#define HIDINGIN_TRACER_H
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// always on frame path tracer:
+//   - every thread records into its own ring of the last kRingCapacity events, recording is a few relaxed stores
+//     (no lock, no allocation), old events are overwritten
+//   - dumpChromeTrace() snapshots all rings into chrome trace event json (chrome://tracing, ui.perfetto.dev)
+//   - names must be string literals (or otherwise live forever), only the pointer is stored
+// TRACE_SCOPE("name") records a span from there to the end of the scope.
+
+struct TraceEvent {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<uint64_t> start{0};    // ns since the tracer started
+    std::atomic<uint64_t> duration{0}; // kTraceInstant for instant events
+    std::atomic<uint64_t> arg{0};
+};
+
+constexpr uint64_t kTraceInstant = ~0ull;
+
+class TraceRing {
+public:
+    static constexpr size_t kRingCapacity = 8192; // power of two, 256KB per thread
+
+    TraceRing(uint32_t threadId, std::string threadName)
+        : m_events(new TraceEvent[kRingCapacity]), m_threadId(threadId), m_threadName(std::move(threadName)) {
+    }
+
+    // owner thread only
+    void record(const char* name, uint64_t start, uint64_t duration, uint64_t arg) {
+        auto index = m_writeIndex.load(std::memory_order_relaxed);
+        // a reader that sees any of the stores below also sees the previous publish, so it knows this slot is
+        // being overwritten (seqlock style)
+        std::atomic_thread_fence(std::memory_order_release);
+        auto& event = m_events[index & (kRingCapacity - 1)];
+        event.name.store(name, std::memory_order_relaxed);
+        event.start.store(start, std::memory_order_relaxed);
+        event.duration.store(duration, std::memory_order_relaxed);
+        event.arg.store(arg, std::memory_order_relaxed);
+        m_writeIndex.store(index + 1, std::memory_order_release);
+    }
+
+    struct Snapshot {
+        const char* name;
+        uint64_t start;
+        uint64_t duration;
+        uint64_t arg;
+    };
+
+    // any thread, the events that were not overwritten while copying, oldest first
+    void snapshot(std::vector<Snapshot>& events) const;
+
+    uint32_t getThreadId() const {
+        return m_threadId;
+    }
+
+    // guarded by the tracer's rings mutex
+    std::string& threadName() {
+        return m_threadName;
+    }
+
+private:
+    std::unique_ptr<TraceEvent[]> m_events;
+    std::atomic<uint64_t> m_writeIndex{0};
+    uint32_t m_threadId;
+    std::string m_threadName;
+};
+
+class Tracer {
+public:
+    static Tracer& getInstance() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    // on by default, off makes TRACE_SCOPE a load and a branch
+    bool isEnabled() const {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    void setEnabled(bool enabled) {
+        m_enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    // steady clock, ns since the tracer started
+    uint64_t now() const {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - m_startTime).count();
+    }
+
+    uint64_t toTraceTime(std::chrono::steady_clock::time_point timePoint) const {
+        return timePoint <= m_startTime ? 0 : (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                timePoint - m_startTime).count();
+    }
+
+    // a span on the calling thread, e.g. a queue wait measured from an enqueue timestamp
+    void recordSpan(const char* name, uint64_t start, uint64_t end, uint64_t arg = 0);
+    void recordInstant(const char* name, uint64_t arg = 0);
+
+    // shows up as the thread's name in the trace
+    void setCurrentThreadName(const std::string& threadName);
+
+    bool dumpChromeTrace(const std::string& path);
+    // dumps to $TMPDIR/hidingin-trace-<time>.json, returns the path or "" when writing failed
+    std::string dumpChromeTrace();
+
+    // kill -USR1 <pid> dumps a trace (from a helper thread, the signal handler only sets a flag)
+    void installDumpSignal(int signalNumber = SIGUSR1);
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+private:
+    Tracer();
+    ~Tracer();
+
+    TraceRing& currentRing();
+    void dumpSignalThreadFunc();
+
+    std::atomic_bool m_enabled{true};
+    std::chrono::steady_clock::time_point m_startTime;
+    std::mutex m_ringsMutex;
+    std::vector<std::shared_ptr<TraceRing>> m_rings; // kept after their thread exited
+    uint32_t m_nextThreadId = 1;
+    std::thread m_dumpSignalThread;
+    std::atomic_bool m_stopDumpSignalThread{false};
+};
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, uint64_t arg = 0)
+        : m_name(Tracer::getInstance().isEnabled() ? name : nullptr), m_arg(arg) {
+        if (m_name) {
+            m_start = Tracer::getInstance().now();
+        }
+    }
+
+    ~TraceScope() {
+        if (m_name) {
+            Tracer::getInstance().recordSpan(m_name, m_start, Tracer::getInstance().now(), m_arg);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* m_name;
+    uint64_t m_arg;
+    uint64_t m_start = 0;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_SCOPE_ARG(name, arg) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, (uint64_t)(arg))
+#define TRACE_INSTANT(name) \
+    do { if (Tracer::getInstance().isEnabled()) Tracer::getInstance().recordInstant(name); } while (0)
+
+#endif //HIDINGIN_TRACER_H
@@ -0,0 +1,62 @@
+#ifndef HIDINGIN_TRIPLEBUFFER_H
+#define HIDINGIN_TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+// single producer / single consumer "latest value" mailbox. the producer owns one slot, the consumer owns one slot
+// and the third one sits in the middle; publishing and consuming are one atomic exchange each, so neither side
+// ever waits for the other. a value the consumer did not pick up in time is simply overwritten by the next one.
+template<typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() = default;
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // producer side: fill the back slot, then publish it
+    T& backSlot() {
+        return m_slots[m_back];
+    }
+
+    void publish() {
+        auto previousMiddle = m_middle.exchange(m_back | kFreshBit, std::memory_order_acq_rel);
+        m_back = previousMiddle & kIndexMask;
+    }
+
+    void publish(T value) {
+        m_slots[m_back] = std::move(value);
+        publish();
+    }
+
+    // consumer side: swap in the newest published value if there is one, false when nothing new arrived.
+    // the front slot stays valid (and unchanged) until the next consume()
+    bool consume() {
+        if (!(m_middle.load(std::memory_order_relaxed) & kFreshBit)) {
+            return false;
+        }
+        auto previousMiddle = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = previousMiddle & kIndexMask;
+        return true;
+    }
+
+    T& frontSlot() {
+        return m_slots[m_front];
+    }
+
+    bool hasFresh() const {
+        return m_middle.load(std::memory_order_acquire) & kFreshBit;
+    }
+
+private:
+    static constexpr uint8_t kIndexMask = 0x3;
+    static constexpr uint8_t kFreshBit = 0x4;
+
+    T m_slots[3] = {};
+    alignas(64) uint8_t m_back = 0;              // producer only
+    alignas(64) std::atomic<uint8_t> m_middle{1};
+    alignas(64) uint8_t m_front = 2;             // consumer only
+};
+
+#endif //HIDINGIN_TRIPLEBUFFER_H
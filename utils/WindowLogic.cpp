@@ -1,6 +1,15 @@
 #include "WindowLogic.h"
 #include <iostream>
 #include <algorithm> // For std::max and std::min
+#include <cmath>
+
+#if defined(__SSE2__) || defined(__x86_64__) || defined(_M_X64)
+#define HIDINGIN_HAS_SSE2_RECTS 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define HIDINGIN_HAS_NEON_RECTS 1
+#include <arm_neon.h>
+#endif
 
 // Implementation of WindowSize constructor
 WindowSize::WindowSize(int width, int height) {
@@ -67,4 +76,387 @@ bool isRectInside(const std::tuple<int, int, int, int>& target, const std::tuple
            (cx + cw <= tx + tw) &&                // Right edge
            (cy >= ty) &&                          // Top edge
            (cy + ch <= ty + th);                  // Bottom edge
-}
\ No newline at end of file
+}
+
+void WindowRectBatch::clear() {
+    x.clear();
+    y.clear();
+    width.clear();
+    height.clear();
+}
+
+void WindowRectBatch::reserve(size_t count) {
+    x.reserve(count);
+    y.reserve(count);
+    width.reserve(count);
+    height.reserve(count);
+}
+
+void WindowRectBatch::push(int rectX, int rectY, int rectWidth, int rectHeight) {
+    x.push_back(rectX);
+    y.push_back(rectY);
+    width.push_back(rectWidth);
+    height.push_back(rectHeight);
+}
+
+void WindowRectBatch::push(const std::tuple<int, int, int, int>& rect) {
+    push(std::get<0>(rect), std::get<1>(rect), std::get<2>(rect), std::get<3>(rect));
+}
+
+std::tuple<int, int, int, int> WindowRectBatch::rect(size_t index) const {
+    return std::make_tuple(x[index], y[index], width[index], height[index]);
+}
+
+#ifdef HIDINGIN_HAS_SSE2_RECTS
+// sse2 has no 32 bit min / max, select through the compare mask
+static inline __m128i maxEpi32(__m128i a, __m128i b) {
+    __m128i greater = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(greater, a), _mm_andnot_si128(greater, b));
+}
+
+static inline __m128i minEpi32(__m128i a, __m128i b) {
+    __m128i greater = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(greater, b), _mm_andnot_si128(greater, a));
+}
+
+static inline __m128i loadRects(const std::vector<int>& values, size_t index) {
+    return _mm_loadu_si128((const __m128i*)(values.data() + index));
+}
+#endif
+
+void rectsInsideRect(const std::tuple<int, int, int, int>& target, const WindowRectBatch& rects, std::vector<uint8_t>& inside) {
+    int left, top, width, height;
+    std::tie(left, top, width, height) = target;
+    int right = left + width;
+    int bottom = top + height;
+    size_t count = rects.size();
+    inside.resize(count);
+    size_t i = 0;
+#if defined(HIDINGIN_HAS_SSE2_RECTS)
+    __m128i targetLeft = _mm_set1_epi32(left);
+    __m128i targetTop = _mm_set1_epi32(top);
+    __m128i targetRight = _mm_set1_epi32(right);
+    __m128i targetBottom = _mm_set1_epi32(bottom);
+    for (; i + 4 <= count; i += 4) {
+        __m128i x = loadRects(rects.x, i);
+        __m128i y = loadRects(rects.y, i);
+        __m128i rectRight = _mm_add_epi32(x, loadRects(rects.width, i));
+        __m128i rectBottom = _mm_add_epi32(y, loadRects(rects.height, i));
+        // any edge outside the target
+        __m128i outside = _mm_or_si128(_mm_or_si128(_mm_cmplt_epi32(x, targetLeft), _mm_cmpgt_epi32(rectRight, targetRight)),
+                                       _mm_or_si128(_mm_cmplt_epi32(y, targetTop), _mm_cmpgt_epi32(rectBottom, targetBottom)));
+        int outsideBits = _mm_movemask_ps(_mm_castsi128_ps(outside));
+        for (int lane = 0; lane < 4; lane++) {
+            inside[i + lane] = (outsideBits >> lane) & 1 ? 0 : 1;
+        }
+    }
+#elif defined(HIDINGIN_HAS_NEON_RECTS)
+    int32x4_t targetLeft = vdupq_n_s32(left);
+    int32x4_t targetTop = vdupq_n_s32(top);
+    int32x4_t targetRight = vdupq_n_s32(right);
+    int32x4_t targetBottom = vdupq_n_s32(bottom);
+    for (; i + 4 <= count; i += 4) {
+        int32x4_t x = vld1q_s32(rects.x.data() + i);
+        int32x4_t y = vld1q_s32(rects.y.data() + i);
+        int32x4_t rectRight = vaddq_s32(x, vld1q_s32(rects.width.data() + i));
+        int32x4_t rectBottom = vaddq_s32(y, vld1q_s32(rects.height.data() + i));
+        uint32x4_t isInside = vandq_u32(vandq_u32(vcgeq_s32(x, targetLeft), vcleq_s32(rectRight, targetRight)),
+                                        vandq_u32(vcgeq_s32(y, targetTop), vcleq_s32(rectBottom, targetBottom)));
+        // lanes are all ones or zero, keep one byte of each
+        uint16x4_t narrow = vmovn_u32(isInside);
+        uint8x8_t bytes = vmovn_u16(vcombine_u16(narrow, narrow));
+        uint8_t laneBytes[8];
+        vst1_u8(laneBytes, vand_u8(bytes, vdup_n_u8(1)));
+        for (int lane = 0; lane < 4; lane++) {
+            inside[i + lane] = laneBytes[lane];
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        inside[i] = rects.x[i] >= left && rects.x[i] + rects.width[i] <= right &&
+                    rects.y[i] >= top && rects.y[i] + rects.height[i] <= bottom ? 1 : 0;
+    }
+}
+
+void intersectRects(const WindowRectBatch& rects, const std::tuple<int, int, int, int>& clip, WindowRectBatch& out) {
+    int clipLeft, clipTop, clipWidth, clipHeight;
+    std::tie(clipLeft, clipTop, clipWidth, clipHeight) = clip;
+    int clipRight = clipLeft + clipWidth;
+    int clipBottom = clipTop + clipHeight;
+    size_t count = rects.size();
+    out.x.resize(count);
+    out.y.resize(count);
+    out.width.resize(count);
+    out.height.resize(count);
+    size_t i = 0;
+#if defined(HIDINGIN_HAS_SSE2_RECTS)
+    __m128i left4 = _mm_set1_epi32(clipLeft);
+    __m128i top4 = _mm_set1_epi32(clipTop);
+    __m128i right4 = _mm_set1_epi32(clipRight);
+    __m128i bottom4 = _mm_set1_epi32(clipBottom);
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        __m128i x = loadRects(rects.x, i);
+        __m128i y = loadRects(rects.y, i);
+        __m128i left = maxEpi32(x, left4);
+        __m128i top = maxEpi32(y, top4);
+        __m128i width = _mm_sub_epi32(minEpi32(_mm_add_epi32(x, loadRects(rects.width, i)), right4), left);
+        __m128i height = _mm_sub_epi32(minEpi32(_mm_add_epi32(y, loadRects(rects.height, i)), bottom4), top);
+        __m128i meets = _mm_and_si128(_mm_cmpgt_epi32(width, zero), _mm_cmpgt_epi32(height, zero));
+        _mm_storeu_si128((__m128i*)(out.x.data() + i), left);
+        _mm_storeu_si128((__m128i*)(out.y.data() + i), top);
+        _mm_storeu_si128((__m128i*)(out.width.data() + i), _mm_and_si128(width, meets));
+        _mm_storeu_si128((__m128i*)(out.height.data() + i), _mm_and_si128(height, meets));
+    }
+#elif defined(HIDINGIN_HAS_NEON_RECTS)
+    int32x4_t left4 = vdupq_n_s32(clipLeft);
+    int32x4_t top4 = vdupq_n_s32(clipTop);
+    int32x4_t right4 = vdupq_n_s32(clipRight);
+    int32x4_t bottom4 = vdupq_n_s32(clipBottom);
+    int32x4_t zero = vdupq_n_s32(0);
+    for (; i + 4 <= count; i += 4) {
+        int32x4_t x = vld1q_s32(rects.x.data() + i);
+        int32x4_t y = vld1q_s32(rects.y.data() + i);
+        int32x4_t left = vmaxq_s32(x, left4);
+        int32x4_t top = vmaxq_s32(y, top4);
+        int32x4_t width = vsubq_s32(vminq_s32(vaddq_s32(x, vld1q_s32(rects.width.data() + i)), right4), left);
+        int32x4_t height = vsubq_s32(vminq_s32(vaddq_s32(y, vld1q_s32(rects.height.data() + i)), bottom4), top);
+        int32x4_t meets = vreinterpretq_s32_u32(vandq_u32(vcgtq_s32(width, zero), vcgtq_s32(height, zero)));
+        vst1q_s32(out.x.data() + i, left);
+        vst1q_s32(out.y.data() + i, top);
+        vst1q_s32(out.width.data() + i, vandq_s32(width, meets));
+        vst1q_s32(out.height.data() + i, vandq_s32(height, meets));
+    }
+#endif
+    for (; i < count; i++) {
+        int left = std::max(rects.x[i], clipLeft);
+        int top = std::max(rects.y[i], clipTop);
+        int width = std::min(rects.x[i] + rects.width[i], clipRight) - left;
+        int height = std::min(rects.y[i] + rects.height[i], clipBottom) - top;
+        bool meets = width > 0 && height > 0;
+        out.x[i] = left;
+        out.y[i] = top;
+        out.width[i] = meets ? width : 0;
+        out.height[i] = meets ? height : 0;
+    }
+}
+
+std::tuple<int, int, int, int> unionRects(const WindowRectBatch& rects) {
+    int left = 0, top = 0, right = 0, bottom = 0;
+    bool any = false;
+    for (size_t i = 0; i < rects.size(); i++) {
+        if (rects.width[i] <= 0 || rects.height[i] <= 0) {
+            continue;
+        }
+        if (!any) {
+            left = rects.x[i];
+            top = rects.y[i];
+            right = rects.x[i] + rects.width[i];
+            bottom = rects.y[i] + rects.height[i];
+            any = true;
+            continue;
+        }
+        left = std::min(left, rects.x[i]);
+        top = std::min(top, rects.y[i]);
+        right = std::max(right, rects.x[i] + rects.width[i]);
+        bottom = std::max(bottom, rects.y[i] + rects.height[i]);
+    }
+    return std::make_tuple(left, top, right - left, bottom - top);
+}
+
+void WindowRectGrid::build(const WindowRectBatch& rects) {
+    int width, height;
+    std::tie(m_originX, m_originY, width, height) = unionRects(rects);
+    size_t nonEmpty = 0;
+    for (size_t i = 0; i < rects.size(); i++) {
+        nonEmpty += rects.width[i] > 0 && rects.height[i] > 0;
+    }
+    // about sqrt(n) x sqrt(n) cells
+    int cellsPerSide = std::max(1, (int)std::ceil(std::sqrt((double)nonEmpty)));
+    m_cellSize = std::max(1, (std::max(width, height) + cellsPerSide - 1) / cellsPerSide);
+    m_columns = width > 0 ? (width + m_cellSize - 1) / m_cellSize : 0;
+    m_rows = height > 0 ? (height + m_cellSize - 1) / m_cellSize : 0;
+
+    // counting sort of the rects into their cells
+    m_cellStart.assign((size_t)m_columns * m_rows + 1, 0);
+    m_queryStamp.assign(rects.size(), 0);
+    m_queryCount = 0;
+    auto forEachCell = [&](size_t i, auto&& cellFunc) {
+        int left, top, right, bottom;
+        if (!cellRange(rects.rect(i), left, top, right, bottom)) {
+            return;
+        }
+        for (int row = top; row <= bottom; row++) {
+            for (int column = left; column <= right; column++) {
+                cellFunc(row * m_columns + column);
+            }
+        }
+    };
+    for (size_t i = 0; i < rects.size(); i++) {
+        forEachCell(i, [&](int cell) { m_cellStart[cell + 1]++; });
+    }
+    for (size_t cell = 1; cell < m_cellStart.size(); cell++) {
+        m_cellStart[cell] += m_cellStart[cell - 1];
+    }
+    m_cellRects.resize(m_cellStart.back());
+    std::vector<int> cellFill(m_cellStart.begin(), m_cellStart.end() - 1);
+    for (size_t i = 0; i < rects.size(); i++) {
+        forEachCell(i, [&](int cell) { m_cellRects[cellFill[cell]++] = (int)i; });
+    }
+}
+
+bool WindowRectGrid::cellRange(const std::tuple<int, int, int, int>& rect, int& left, int& top, int& right, int& bottom) const {
+    int x, y, width, height;
+    std::tie(x, y, width, height) = rect;
+    if (width <= 0 || height <= 0 || m_columns == 0 || m_rows == 0) {
+        return false;
+    }
+    // cells of the first and the last pixel, clamped to the grid
+    int firstColumn = (int)std::floor((double)(x - m_originX) / m_cellSize);
+    int firstRow = (int)std::floor((double)(y - m_originY) / m_cellSize);
+    int lastColumn = (int)std::floor((double)(x + width - 1 - m_originX) / m_cellSize);
+    int lastRow = (int)std::floor((double)(y + height - 1 - m_originY) / m_cellSize);
+    if (lastColumn < 0 || lastRow < 0 || firstColumn >= m_columns || firstRow >= m_rows) {
+        return false;
+    }
+    left = std::max(firstColumn, 0);
+    top = std::max(firstRow, 0);
+    right = std::min(lastColumn, m_columns - 1);
+    bottom = std::min(lastRow, m_rows - 1);
+    return true;
+}
+
+void WindowRectGrid::query(const std::tuple<int, int, int, int>& rect, std::vector<int>& candidates) const {
+    candidates.clear();
+    int left, top, right, bottom;
+    if (!cellRange(rect, left, top, right, bottom)) {
+        return;
+    }
+    if (++m_queryCount == 0) {
+        // the stamp wrapped, forget every old one
+        std::fill(m_queryStamp.begin(), m_queryStamp.end(), 0);
+        m_queryCount = 1;
+    }
+    for (int row = top; row <= bottom; row++) {
+        for (int column = left; column <= right; column++) {
+            int cell = row * m_columns + column;
+            for (int slot = m_cellStart[cell]; slot < m_cellStart[cell + 1]; slot++) {
+                int index = m_cellRects[slot];
+                if (m_queryStamp[index] != m_queryCount) {
+                    m_queryStamp[index] = m_queryCount;
+                    candidates.push_back(index);
+                }
+            }
+        }
+    }
+}
+
+namespace {
+// covered length of the compressed y intervals, count[node] > 0 covers the node's whole span
+struct CoverTree {
+    const std::vector<int>* ys = nullptr;
+    std::vector<int> count;
+    std::vector<int64_t> covered;
+
+    void reset(const std::vector<int>& yCoordinates) {
+        ys = &yCoordinates;
+        size_t nodes = std::max<size_t>(1, yCoordinates.size()) * 4;
+        count.assign(nodes, 0);
+        covered.assign(nodes, 0);
+    }
+
+    // adds delta to the intervals [from, to) of ys
+    void add(int node, int nodeFrom, int nodeTo, int from, int to, int delta) {
+        if (to <= nodeFrom || nodeTo <= from) {
+            return;
+        }
+        if (from <= nodeFrom && nodeTo <= to) {
+            count[node] += delta;
+        } else {
+            int middle = (nodeFrom + nodeTo) / 2;
+            add(node * 2, nodeFrom, middle, from, to, delta);
+            add(node * 2 + 1, middle, nodeTo, from, to, delta);
+        }
+        if (count[node] > 0) {
+            covered[node] = (*ys)[nodeTo] - (*ys)[nodeFrom];
+        } else if (nodeTo - nodeFrom == 1) {
+            covered[node] = 0;
+        } else {
+            covered[node] = covered[node * 2] + covered[node * 2 + 1];
+        }
+    }
+};
+
+struct SweepEdge {
+    int x;
+    int yFrom;
+    int yTo;
+    int delta;
+};
+}
+
+// area of the union of the non empty rects, sweep over x with the covered y length in a segment tree
+static int64_t unionArea(const WindowRectBatch& rects, std::vector<int>& ys, std::vector<SweepEdge>& edges, CoverTree& tree) {
+    ys.clear();
+    edges.clear();
+    for (size_t i = 0; i < rects.size(); i++) {
+        if (rects.width[i] <= 0 || rects.height[i] <= 0) {
+            continue;
+        }
+        ys.push_back(rects.y[i]);
+        ys.push_back(rects.y[i] + rects.height[i]);
+    }
+    if (ys.empty()) {
+        return 0;
+    }
+    std::sort(ys.begin(), ys.end());
+    ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+    for (size_t i = 0; i < rects.size(); i++) {
+        if (rects.width[i] <= 0 || rects.height[i] <= 0) {
+            continue;
+        }
+        int yFrom = (int)(std::lower_bound(ys.begin(), ys.end(), rects.y[i]) - ys.begin());
+        int yTo = (int)(std::lower_bound(ys.begin(), ys.end(), rects.y[i] + rects.height[i]) - ys.begin());
+        edges.push_back({rects.x[i], yFrom, yTo, 1});
+        edges.push_back({rects.x[i] + rects.width[i], yFrom, yTo, -1});
+    }
+    std::sort(edges.begin(), edges.end(), [](const SweepEdge& a, const SweepEdge& b) { return a.x < b.x; });
+
+    tree.reset(ys);
+    int intervals = (int)ys.size() - 1;
+    int64_t area = 0;
+    for (size_t i = 0; i < edges.size(); i++) {
+        if (i > 0) {
+            area += tree.covered[1] * (int64_t)(edges[i].x - edges[i - 1].x);
+        }
+        tree.add(1, 0, intervals, edges[i].yFrom, edges[i].yTo, edges[i].delta);
+    }
+    return area;
+}
+
+void computeOcclusionCoverage(const WindowRectBatch& windows, const WindowRectBatch& regions, std::vector<float>& coverage) {
+    coverage.assign(regions.size(), 0.0f);
+    WindowRectGrid grid;
+    grid.build(windows);
+
+    std::vector<int> candidates;
+    WindowRectBatch nearWindows;
+    WindowRectBatch clippedWindows;
+    std::vector<int> ys;
+    std::vector<SweepEdge> edges;
+    CoverTree tree;
+    for (size_t m = 0; m < regions.size(); m++) {
+        auto region = regions.rect(m);
+        int64_t regionArea = (int64_t)regions.width[m] * regions.height[m];
+        if (regions.width[m] <= 0 || regions.height[m] <= 0) {
+            continue;
+        }
+        grid.query(region, candidates);
+        nearWindows.clear();
+        for (int index : candidates) {
+            nearWindows.push(windows.rect(index));
+        }
+        intersectRects(nearWindows, region, clippedWindows);
+        coverage[m] = (float)((double)unionArea(clippedWindows, ys, edges, tree) / (double)regionArea);
+    }
+}
@@ -6,6 +6,9 @@
 #define HIDINGIN_WINDOWLOGIC_H
 
 #include <tuple>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
 
 // Define a structure to represent a 2D size (width and height)
 struct WindowSize {
@@ -40,4 +43,60 @@ WindowRect calculateRectForWindowAtPosition(const WindowSize& desktopSize, const
 // Function to check if one rectangle is inside another
 bool isRectInside(const std::tuple<int, int, int, int>& target, const std::tuple<int, int, int, int>& cmp);
 
+// many rects at once as structure of arrays, the batch functions below go over them 4 at a time (sse2 / neon).
+// rect i is (x[i], y[i], width[i], height[i]), a rect with width or height <= 0 is empty.
+struct WindowRectBatch {
+    std::vector<int> x;
+    std::vector<int> y;
+    std::vector<int> width;
+    std::vector<int> height;
+
+    size_t size() const {
+        return x.size();
+    }
+
+    void clear();
+    void reserve(size_t count);
+    void push(int rectX, int rectY, int rectWidth, int rectHeight);
+    void push(const std::tuple<int, int, int, int>& rect);
+    std::tuple<int, int, int, int> rect(size_t index) const;
+};
+
+// inside[i] = isRectInside(target, rects[i])
+void rectsInsideRect(const std::tuple<int, int, int, int>& target, const WindowRectBatch& rects, std::vector<uint8_t>& inside);
+
+// out[i] = rects[i] intersected with clip, 0 sized where they do not meet. with the screen rect as clip this is
+// the visible part of every window.
+void intersectRects(const WindowRectBatch& rects, const std::tuple<int, int, int, int>& clip, WindowRectBatch& out);
+
+// bounding box of the non empty rects, 0 sized when there is none
+std::tuple<int, int, int, int> unionRects(const WindowRectBatch& rects);
+
+// uniform grid over the rects' bounding box, every cell lists the rects touching it. about one rect per cell, so
+// a query only looks at the rects near it instead of all of them.
+class WindowRectGrid {
+public:
+    void build(const WindowRectBatch& rects);
+    // indices of the rects that may touch rect (a superset), each once
+    void query(const std::tuple<int, int, int, int>& rect, std::vector<int>& candidates) const;
+
+private:
+    bool cellRange(const std::tuple<int, int, int, int>& rect, int& left, int& top, int& right, int& bottom) const;
+
+    int m_originX = 0;
+    int m_originY = 0;
+    int m_cellSize = 1;
+    int m_columns = 0;
+    int m_rows = 0;
+    std::vector<int> m_cellStart;   // rects of cell c are m_cellRects[m_cellStart[c] .. m_cellStart[c + 1])
+    std::vector<int> m_cellRects;
+    mutable std::vector<uint32_t> m_queryStamp; // per rect, dedupes rects spanning several cells
+    mutable uint32_t m_queryCount = 0;
+};
+
+// coverage[m] = part of regions[m] (0..1) the union of windows covers, overlapping windows count once. windows
+// are looked up through a grid and every region's union is a sweep over its candidates, O((N + M) log N) for
+// windows spread over the screen instead of N * M.
+void computeOcclusionCoverage(const WindowRectBatch& windows, const WindowRectBatch& regions, std::vector<float>& coverage);
+
 #endif //HIDINGIN_WINDOWLOGIC_H
\ No newline at end of file
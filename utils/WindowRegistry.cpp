@@ -0,0 +1,112 @@
+#include "WindowRegistry.h"
+#include <algorithm>
+#include <utility>
+
+bool WindowListDiff::touches(int windowId) const {
+    for (auto* ids : {&added, &removed, &moved, &resized}) {
+        if (std::find(ids->begin(), ids->end(), windowId) != ids->end()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+WindowListDiff WindowRegistry::applySnapshot(std::vector<WindowRecord> snapshot, Clock::time_point now) {
+    WindowListDiff diff;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::unordered_map<int, WindowRecord> windows;
+        windows.reserve(snapshot.size());
+        m_windowOrder.clear();
+        m_windowsByPid.clear();
+        for (size_t i = 0; i < snapshot.size(); i++) {
+            auto& record = snapshot[i];
+            record.zOrder = (int)i;
+            auto previous = m_windows.find(record.windowId);
+            if (previous == m_windows.end()) {
+                diff.added.push_back(record.windowId);
+            } else {
+                if (previous->second.x != record.x || previous->second.y != record.y) {
+                    diff.moved.push_back(record.windowId);
+                }
+                if (previous->second.width != record.width || previous->second.height != record.height) {
+                    diff.resized.push_back(record.windowId);
+                }
+                m_windows.erase(previous);
+            }
+            m_windowOrder.push_back(record.windowId);
+            m_windowsByPid[record.ownerPid].push_back(record.windowId);
+            windows.emplace(record.windowId, std::move(record));
+        }
+        // whatever is left of the old list is gone
+        for (auto& [windowId, record] : m_windows) {
+            diff.removed.push_back(windowId);
+        }
+        std::sort(diff.removed.begin(), diff.removed.end());
+        m_windows = std::move(windows);
+        m_snapshotTime = now;
+    }
+    if (diff.empty()) {
+        return diff;
+    }
+
+    // a copy, a subscriber may (un)subscribe from its callback
+    std::lock_guard<std::recursive_mutex> lock(m_subscribersMutex);
+    auto subscribers = m_subscribers;
+    for (auto& [subscriptionId, subscriber] : subscribers) {
+        subscriber(diff);
+    }
+    return diff;
+}
+
+int WindowRegistry::subscribe(Subscriber subscriber) {
+    std::lock_guard<std::recursive_mutex> lock(m_subscribersMutex);
+    int subscriptionId = m_nextSubscriptionId++;
+    m_subscribers.emplace_back(subscriptionId, std::move(subscriber));
+    return subscriptionId;
+}
+
+void WindowRegistry::unsubscribe(int subscriptionId) {
+    std::lock_guard<std::recursive_mutex> lock(m_subscribersMutex);
+    m_subscribers.erase(std::remove_if(m_subscribers.begin(), m_subscribers.end(),
+                                       [subscriptionId](const auto& entry) { return entry.first == subscriptionId; }),
+                        m_subscribers.end());
+}
+
+std::optional<WindowRecord> WindowRegistry::findWindow(int windowId) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_windows.find(windowId);
+    if (found == m_windows.end()) {
+        return std::nullopt;
+    }
+    return found->second;
+}
+
+std::vector<WindowRecord> WindowRegistry::getWindowsForPid(int pid) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<WindowRecord> records;
+    auto found = m_windowsByPid.find(pid);
+    if (found == m_windowsByPid.end()) {
+        return records;
+    }
+    records.reserve(found->second.size());
+    for (int windowId : found->second) {
+        records.push_back(m_windows.at(windowId));
+    }
+    return records;
+}
+
+std::vector<WindowRecord> WindowRegistry::getWindows() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<WindowRecord> records;
+    records.reserve(m_windowOrder.size());
+    for (int windowId : m_windowOrder) {
+        records.push_back(m_windows.at(windowId));
+    }
+    return records;
+}
+
+std::optional<WindowRegistry::Clock::time_point> WindowRegistry::getSnapshotTime() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_snapshotTime;
+}
@@ -0,0 +1,84 @@
+#ifndef HIDINGIN_WINDOWREGISTRY_H
+#define HIDINGIN_WINDOWREGISTRY_H
+
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// one on screen window of a snapshot, bounds in points like CGWindowListCopyWindowInfo reports them
+struct WindowRecord {
+    int windowId = 0;
+    int ownerPid = 0;
+    int layer = 0;
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    std::string ownerName;
+    int zOrder = 0; // position in the snapshot, 0 is the frontmost window
+};
+
+// what changed between two snapshots, window ids
+struct WindowListDiff {
+    std::vector<int> added;
+    std::vector<int> removed;
+    std::vector<int> moved;
+    std::vector<int> resized;
+
+    bool empty() const {
+        return added.empty() && removed.empty() && moved.empty() && resized.empty();
+    }
+
+    bool touches(int windowId) const;
+};
+
+// the on screen window list, shared by every lookup. the platform poller feeds one full enumeration per tick,
+// subscribers only hear about ticks that changed something and lookups are hash lookups into the last snapshot
+// instead of another enumeration each.
+class WindowRegistry {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Subscriber = std::function<void(const WindowListDiff&)>;
+
+    static WindowRegistry& getInstance() {
+        static WindowRegistry registry;
+        return registry;
+    }
+
+    // replaces the window list with snapshot (front to back) and tells the subscribers what changed, on the
+    // calling thread
+    WindowListDiff applySnapshot(std::vector<WindowRecord> snapshot, Clock::time_point now = Clock::now());
+
+    int subscribe(Subscriber subscriber);
+    // once it returns the subscriber is not running and will not run again
+    void unsubscribe(int subscriptionId);
+
+    std::optional<WindowRecord> findWindow(int windowId) const;
+    // front to back
+    std::vector<WindowRecord> getWindowsForPid(int pid) const;
+    std::vector<WindowRecord> getWindows() const;
+
+    // time of the last snapshot, nullopt before the first one
+    std::optional<Clock::time_point> getSnapshotTime() const;
+
+private:
+    WindowRegistry() = default;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<int, WindowRecord> m_windows;
+    std::unordered_map<int, std::vector<int>> m_windowsByPid; // front to back
+    std::vector<int> m_windowOrder;                           // front to back
+    std::optional<Clock::time_point> m_snapshotTime;
+
+    // held while notifying, recursive so a subscriber can (un)subscribe from its callback
+    std::recursive_mutex m_subscribersMutex;
+    std::vector<std::pair<int, Subscriber>> m_subscribers;
+    int m_nextSubscriptionId = 1;
+};
+
+#endif //HIDINGIN_WINDOWREGISTRY_H